@@ -41,6 +41,7 @@ authd_cmd_handler authd_cmd_handlers[256] = {
 };
 
 authd_stat_handler authd_stat_handlers[256] = {
+	['C'] = dns_cache_stats,
 	['D'] = enumerate_nameservers,
 };
 
@@ -202,6 +203,7 @@ main(int argc, char *argv[])
 	authd_option_handlers = rb_dictionary_create("authd options handlers", rb_strcasecmp);
 
 	init_resolver();
+	init_dns();
 	init_providers();
 	rb_init_prng(NULL, RB_PRNG_DEFAULT);
 
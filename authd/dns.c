@@ -28,9 +28,181 @@ static void handle_lookup_hostname_reply(void *data, struct DNSReply *reply);
 
 uint64_t query_count = 0;
 
+/*
+ * Answers are kept for their TTL (capped at AR_TTL), failures for
+ * DNS_CACHE_NEG_TTL, and a lookup for a name already being resolved waits
+ * on that query rather than sending another one.
+ */
+static rb_dictionary *dns_cache;
+static rb_dlink_list dns_cache_lru;	/* answered entries, most recently used first */
+static rb_dlink_list ready_queries;	/* cache hits to deliver after this loop pass */
+static struct dns_cache_stats cache_stats;
+
+static void
+free_cache_entry(struct dns_cache_entry *entry)
+{
+	rb_dictionary_delete(dns_cache, entry->key);
+	rb_dlinkDelete(&entry->node, &dns_cache_lru);
+	rb_free(entry->answer);
+	rb_free(entry->key);
+	rb_free(entry);
+}
+
+/* Hand an answer to whoever asked, unless they have since cancelled */
+static void
+deliver_answer(struct dns_query *query, const char *answer)
+{
+	if(query->callback)
+	{
+		if(query->type == QUERY_A || query->type == QUERY_AAAA)
+			query->callback(answer ? answer : "*", answer != NULL, query->type, query->data);
+		else
+			query->callback(answer, answer != NULL, query->type, query->data);
+	}
+
+	rb_free(query);
+}
+
+/*
+ * Cache hits are not answered from inside lookup_ip()/lookup_hostname(),
+ * as callers expect to get their query back before the callback runs.
+ */
+static void
+deliver_ready_queries(void)
+{
+	rb_dlink_list ready = { NULL, NULL, 0 };
+	rb_dlink_node *ptr, *nptr;
+
+	rb_dlinkMoveList(&ready_queries, &ready);
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, ready.head)
+	{
+		struct dns_query *query = ptr->data;
+		char *answer = query->answer;
+
+		rb_dlinkDelete(ptr, &ready);
+		deliver_answer(query, answer);
+		rb_free(answer);
+	}
+}
+
+static void
+expire_dns_cache(void *unused)
+{
+	rb_dlink_node *ptr, *nptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, dns_cache_lru.head)
+	{
+		struct dns_cache_entry *entry = ptr->data;
+
+		if(entry->expires <= rb_current_time())
+		{
+			free_cache_entry(entry);
+			cache_stats.expired++;
+		}
+	}
+}
+
+/* Answer from the cache, wait on an outstanding lookup, or start a new one */
+static void
+submit_query(struct dns_query *query, const char *name,
+		void (*reply_cb)(void *, struct DNSReply *), int g_type)
+{
+	char key[RESOLVER_HOSTLEN + 2];
+	struct dns_cache_entry *entry;
+
+	snprintf(key, sizeof(key), "%c%s", query->type, name);
+	entry = rb_dictionary_retrieve(dns_cache, key);
+
+	if(entry != NULL && entry->pending)
+	{
+		rb_dlinkAdd(query, &query->node, &entry->waiters);
+		query->cached = true;
+		cache_stats.coalesced++;
+		return;
+	}
+
+	if(entry != NULL && entry->expires > rb_current_time())
+	{
+		if(entry->answer != NULL)
+			cache_stats.hits++;
+		else
+			cache_stats.neg_hits++;
+
+		rb_dlinkDelete(&entry->node, &dns_cache_lru);
+		rb_dlinkAdd(entry, &entry->node, &dns_cache_lru);
+
+		query->answer = entry->answer ? rb_strdup(entry->answer) : NULL;
+		query->cached = true;
+		rb_dlinkAddTail(query, &query->node, &ready_queries);
+		return;
+	}
+
+	cache_stats.misses++;
+
+	if(entry != NULL)
+	{
+		/* stale, look it up again */
+		rb_dlinkDelete(&entry->node, &dns_cache_lru);
+		rb_free(entry->answer);
+		entry->answer = NULL;
+	}
+	else
+	{
+		if(rb_dictionary_size(dns_cache) >= DNS_CACHE_MAX && dns_cache_lru.tail != NULL)
+		{
+			free_cache_entry(dns_cache_lru.tail->data);
+			cache_stats.evicted++;
+		}
+
+		entry = rb_malloc(sizeof(struct dns_cache_entry));
+		entry->key = rb_strdup(key);
+		entry->type = query->type;
+		entry->addr = query->addr;
+		rb_dictionary_add(dns_cache, entry->key, entry);
+	}
+
+	entry->pending = true;
+	rb_dlinkAdd(query, &query->node, &entry->waiters);
+
+	entry->query.ptr = entry;
+	entry->query.callback = reply_cb;
+
+	if(g_type == T_PTR)
+		gethost_byaddr(&entry->addr, &entry->query);
+	else
+		gethost_byname_type(name, &entry->query, g_type);
+}
+
+/* Record what the resolver said and answer everyone waiting on it */
+static void
+cache_answer(struct dns_cache_entry *entry, const char *answer, time_t ttl)
+{
+	rb_dlink_list waiters = { NULL, NULL, 0 };
+	rb_dlink_node *ptr, *nptr;
+
+	if(ttl > AR_TTL)
+		ttl = AR_TTL;
+
+	entry->answer = answer ? rb_strdup(answer) : NULL;
+	entry->expires = rb_current_time() + ttl;
+	entry->pending = false;
+	rb_dlinkAdd(entry, &entry->node, &dns_cache_lru);
+
+	/* callbacks may look up this name again, or evict this entry */
+	rb_dlinkMoveList(&entry->waiters, &waiters);
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, waiters.head)
+	{
+		rb_dlinkDelete(ptr, &waiters);
+		deliver_answer(ptr->data, answer);
+	}
+}
+
 /* A bit different from ircd... you just get a dns_query object.
  *
- * It gets freed whenever the res code gets back to us.
+ * It gets freed once its callback has been called, which never happens
+ * before this returns.
  */
 struct dns_query *
 lookup_ip(const char *host, int aftype, DNSCB callback, void *data)
@@ -58,10 +230,7 @@ lookup_ip(const char *host, int aftype, DNSCB callback, void *data)
 	query->callback = callback;
 	query->data = data;
 
-	query->query.ptr = query;
-	query->query.callback = handle_lookup_ip_reply;
-
-	gethost_byname_type(host, &query->query, g_type);
+	submit_query(query, host, handle_lookup_ip_reply, g_type);
 
 	return query;
 }
@@ -71,6 +240,7 @@ struct dns_query *
 lookup_hostname(const char *ip, DNSCB callback, void *data)
 {
 	struct dns_query *query = rb_malloc(sizeof(struct dns_query));
+	char addr[HOSTIPLEN];
 	int aftype;
 
 	if(!rb_inet_pton_sock(ip, &query->addr))
@@ -95,10 +265,9 @@ lookup_hostname(const char *ip, DNSCB callback, void *data)
 	query->callback = callback;
 	query->data = data;
 
-	query->query.ptr = query;
-	query->query.callback = handle_lookup_hostname_reply;
-
-	gethost_byaddr(&query->addr, &query->query);
+	/* the same address can be written more than one way */
+	rb_inet_ntop_sock((struct sockaddr *)&query->addr, addr, sizeof(addr));
+	submit_query(query, addr, handle_lookup_hostname_reply, T_PTR);
 
 	return query;
 }
@@ -114,20 +283,20 @@ cancel_query(struct dns_query *query)
 static void
 handle_lookup_ip_reply(void *data, struct DNSReply *reply)
 {
-	struct dns_query *query = data;
+	struct dns_cache_entry *entry = data;
 	char ip[HOSTIPLEN] = "*";
 
-	if(query == NULL)
+	if(entry == NULL)
 	{
 		/* Shouldn't happen */
-		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: query == NULL!");
+		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: entry == NULL!");
 		exit(EX_DNS_ERROR);
 	}
 
 	if(reply == NULL)
 		goto end;
 
-	switch(query->type)
+	switch(entry->type)
 	{
 	case QUERY_A:
 		if(GET_SS_FAMILY(&reply->addr) == AF_INET)
@@ -146,47 +315,47 @@ handle_lookup_ip_reply(void *data, struct DNSReply *reply)
 		break;
 	default:
 		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: unknown query type %d",
-				query->type);
+				entry->type);
 		exit(EX_DNS_ERROR);
 	}
 
 end:
-	if(query->callback)
-		query->callback(ip, ip[0] != '*', query->type, query->data);
-
-	rb_free(query);
+	if(ip[0] != '*')
+		cache_answer(entry, ip, reply->ttl);
+	else
+		cache_answer(entry, NULL, DNS_CACHE_NEG_TTL);
 }
 
 /* Callback from gethost_byaddr */
 static void
 handle_lookup_hostname_reply(void *data, struct DNSReply *reply)
 {
-	struct dns_query *query = data;
+	struct dns_cache_entry *entry = data;
 	char *hostname = NULL;
 
-	if(query == NULL)
+	if(entry == NULL)
 	{
 		/* Shouldn't happen */
-		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: query == NULL!");
+		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: entry == NULL!");
 		exit(EX_DNS_ERROR);
 	}
 
 	if(reply == NULL)
 		goto end;
 
-	if(query->type == QUERY_PTR_A)
+	if(entry->type == QUERY_PTR_A)
 	{
 		struct sockaddr_in *ip, *ip_fwd;
-		ip = (struct sockaddr_in *) &query->addr;
+		ip = (struct sockaddr_in *) &entry->addr;
 		ip_fwd = (struct sockaddr_in *) &reply->addr;
 
 		if(ip->sin_addr.s_addr == ip_fwd->sin_addr.s_addr)
 			hostname = reply->h_name;
 	}
-	else if(query->type == QUERY_PTR_AAAA)
+	else if(entry->type == QUERY_PTR_AAAA)
 	{
 		struct sockaddr_in6 *ip, *ip_fwd;
-		ip = (struct sockaddr_in6 *) &query->addr;
+		ip = (struct sockaddr_in6 *) &entry->addr;
 		ip_fwd = (struct sockaddr_in6 *) &reply->addr;
 
 		if(memcmp(&ip->sin6_addr, &ip_fwd->sin6_addr, sizeof(struct in6_addr)) == 0)
@@ -196,14 +365,14 @@ handle_lookup_hostname_reply(void *data, struct DNSReply *reply)
 	{
 		/* Shouldn't happen */
 		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: unknown query type %d",
-				query->type);
+				entry->type);
 		exit(EX_DNS_ERROR);
 	}
 end:
-	if(query->callback)
-		query->callback(hostname, hostname != NULL, query->type, query->data);
-
-	rb_free(query);
+	if(hostname != NULL)
+		cache_answer(entry, hostname, reply->ttl);
+	else
+		cache_answer(entry, NULL, DNS_CACHE_NEG_TTL);
 }
 
 static void
@@ -295,9 +464,31 @@ enumerate_nameservers(uint32_t rid, const char letter)
 	stats_result(rid, letter, "%s", buf);
 }
 
+void
+dns_cache_stats(uint32_t rid, const char letter)
+{
+	stats_result(rid, letter, "%u %lu %lu %lu %lu %lu %lu",
+		rb_dictionary_size(dns_cache), cache_stats.hits, cache_stats.neg_hits,
+		cache_stats.misses, cache_stats.coalesced, cache_stats.evicted,
+		cache_stats.expired);
+}
+
 void
 reload_nameservers(const char letter)
 {
-	/* Not a whole lot to it */
+	rb_dlink_node *ptr, *nptr;
+
 	restart_resolver();
+
+	/* new servers may well give different answers; lookups in flight carry on */
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, dns_cache_lru.head)
+		free_cache_entry(ptr->data);
+}
+
+void
+init_dns(void)
+{
+	dns_cache = rb_dictionary_create("dns cache", rb_strcasecmp);
+	rb_set_loop_hook(deliver_ready_queries);
+	rb_event_add("expire_dns_cache", expire_dns_cache, NULL, 60);
 }
@@ -23,6 +23,9 @@
 
 #define DNS_REQ_IDLEN 10
 
+#define DNS_CACHE_MAX 8192	/* answers kept before the oldest are evicted */
+#define DNS_CACHE_NEG_TTL 30	/* seconds a failed lookup is remembered */
+
 #include "stdinc.h"
 #include "res.h"
 #include "reslib.h"
@@ -41,21 +44,50 @@ typedef void (*DNSCB)(const char *res, bool status, query_type type, void *data)
 
 struct dns_query
 {
-	struct DNSQuery query;
+	rb_dlink_node node;	/* on a cache entry's waiters, or ready_queries */
 	query_type type;
 	struct rb_sockaddr_storage addr;
 	uint64_t id;
+	char *answer;		/* cached answer awaiting delivery */
+	bool cached;		/* answered without a query of its own */
 
 	DNSCB callback;
 	void *data;
 };
 
+/* One name or address, answered or still being looked up */
+struct dns_cache_entry
+{
+	rb_dlink_node node;	/* on dns_cache_lru once answered */
+	char *key;		/* query type followed by the name or address */
+	struct DNSQuery query;
+	query_type type;
+	struct rb_sockaddr_storage addr;
+
+	char *answer;		/* NULL if the lookup failed */
+	time_t expires;
+	bool pending;
+	rb_dlink_list waiters;
+};
+
+struct dns_cache_stats
+{
+	unsigned long hits;
+	unsigned long neg_hits;
+	unsigned long misses;
+	unsigned long coalesced;
+	unsigned long evicted;
+	unsigned long expired;
+};
+
 extern struct dns_query *lookup_hostname(const char *ip, DNSCB callback, void *data);
 extern struct dns_query *lookup_ip(const char *host, int aftype, DNSCB callback, void *data);
 extern void cancel_query(struct dns_query *query);
 
+extern void init_dns(void);
 extern void handle_resolve_dns(int parc, char *parv[]);
 extern void enumerate_nameservers(uint32_t rid, const char letter);
+extern void dns_cache_stats(uint32_t rid, const char letter);
 extern void reload_nameservers(const char letter);
 
 #endif
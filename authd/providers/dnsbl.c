@@ -67,6 +67,8 @@ struct dnsbl
 	bool delete;			/* If true delete when no clients */
 	int refcount;			/* When 0 and delete is set, remove this dnsbl */
 	unsigned int hits;
+	unsigned int answers;		/* Lookups answered */
+	unsigned int cached;		/* ...of which from authd's DNS cache */
 
 	time_t lastwarning;		/* Last warning about garbage replies sent */
 };
@@ -244,6 +246,10 @@ dnsbl_dns_callback(const char *result, bool status, query_type type, void *data)
 	bl = bllookup->bl;
 	auth = bllookup->auth;
 
+	bl->answers++;
+	if(bllookup->query->cached)
+		bl->cached++;
+
 	if((bluser = get_provider_data(auth, SELF_PID)) == NULL)
 		return;
 
@@ -565,7 +571,6 @@ add_conf_dnsbl_timeout(const char *key, int parc, const char **parv)
 	dnsbl_timeout = timeout;
 }
 
-#if 0
 static void
 dnsbl_stats(uint32_t rid, char letter)
 {
@@ -578,12 +583,12 @@ dnsbl_stats(uint32_t rid, char letter)
 		if(bl->delete)
 			continue;
 
-		stats_result(rid, letter, "%s %hhu %u", bl->host, bl->iptype, bl->hits);
+		stats_result(rid, letter, "%s %hhu %u %u %u", bl->host, bl->iptype,
+				bl->hits, bl->answers, bl->cached);
 	}
 
 	stats_done(rid, letter);
 }
-#endif
 
 struct auth_opts_handler dnsbl_options[] =
 {
@@ -604,5 +609,5 @@ struct auth_provider dnsbl_provider =
 	.timeout = dnsbls_timeout,
 	.completed = dnsbls_initiate,
 	.opt_handlers = dnsbl_options,
-	/* .stats_handler = { 'B', dnsbl_stats }, */
+	.stats_handler = { 'B', dnsbl_stats },
 };
@@ -44,7 +44,6 @@
 static PF res_readreply;
 
 #define MAXPACKET      1024	/* rfc sez 512 but we expand names so ... */
-#define AR_TTL         600	/* TTL in seconds for dns cache entries */
 
 /* RFC 1104/1105 wasn't very helpful about what these fields
  * should be named, so for now, we'll just name them this way.
@@ -64,6 +63,7 @@ struct reslist
 	rb_dlink_node node;
 	int id;
 	time_t ttl;
+	time_t ptr_ttl;		/* TTL of the PTR record this forward lookup checks */
 	char type;
 	char queryname[IRCD_RES_HOSTLEN + 1]; /* name currently being queried */
 	char retries;		/* retry counter */
@@ -82,9 +82,10 @@ static int ns_failure_count[IRCD_MAXNS]; /* timeouts and invalid/failed replies
 
 static void rem_request(struct reslist *request);
 static struct reslist *make_request(struct DNSQuery *query);
-static void gethost_byname_type_fqdn(const char *name, struct DNSQuery *query,
+static struct reslist *gethost_byname_type_fqdn(const char *name, struct DNSQuery *query,
 		int type);
-static void do_query_name(struct DNSQuery *query, const char *name, struct reslist *request, int);
+static struct reslist *do_query_name(struct DNSQuery *query, const char *name,
+		struct reslist *request, int);
 static void do_query_number(struct DNSQuery *query, const struct rb_sockaddr_storage *,
 			    struct reslist *request);
 static void query_name(struct reslist *request);
@@ -283,6 +284,7 @@ static struct reslist *make_request(struct DNSQuery *query)
 	struct reslist *request = rb_malloc(sizeof(struct reslist));
 
 	request->sentat = rb_current_time();
+	request->ptr_ttl = AR_TTL;
 	request->retries = 3;
 	request->timeout = 4;	/* start at 4 and exponential inc. */
 	request->query = query;
@@ -419,11 +421,11 @@ void gethost_byname_type(const char *name, struct DNSQuery *query, int type)
 /*
  * gethost_byname_type_fqdn - get host address from fqdn
  */
-static void gethost_byname_type_fqdn(const char *name, struct DNSQuery *query,
+static struct reslist *gethost_byname_type_fqdn(const char *name, struct DNSQuery *query,
 		int type)
 {
 	assert(name != 0);
-	do_query_name(query, name, NULL, type);
+	return do_query_name(query, name, NULL, type);
 }
 
 /*
@@ -437,8 +439,8 @@ void gethost_byaddr(const struct rb_sockaddr_storage *addr, struct DNSQuery *que
 /*
  * do_query_name - nameserver lookup name
  */
-static void do_query_name(struct DNSQuery *query, const char *name, struct reslist *request,
-			  int type)
+static struct reslist *do_query_name(struct DNSQuery *query, const char *name,
+		struct reslist *request, int type)
 {
 	if (request == NULL)
 	{
@@ -449,6 +451,7 @@ static void do_query_name(struct DNSQuery *query, const char *name, struct resli
 	rb_strlcpy(request->queryname, name, sizeof(request->queryname));
 	request->type = type;
 	query_name(request);
+	return request;
 }
 
 /* Build an rDNS style query - if suffix is NULL, use the appropriate .arpa zone */
@@ -835,10 +838,13 @@ static int res_read_single_reply(rb_fde_t *F, void *data)
 			 * Lookup the 'authoritative' name that we were given for the
 			 * ip#.
 			 */
+			struct reslist *forward;
+
 			if (GET_SS_FAMILY(&request->addr) == AF_INET6)
-				gethost_byname_type_fqdn(request->name, request->query, T_AAAA);
+				forward = gethost_byname_type_fqdn(request->name, request->query, T_AAAA);
 			else
-				gethost_byname_type_fqdn(request->name, request->query, T_A);
+				forward = gethost_byname_type_fqdn(request->name, request->query, T_A);
+			forward->ptr_ttl = request->ttl;
 			rem_request(request);
 		}
 		else
@@ -880,6 +886,7 @@ make_dnsreply(struct reslist *request)
 	cp = (struct DNSReply *)rb_malloc(sizeof(struct DNSReply));
 
 	cp->h_name = request->name;
+	cp->ttl = request->ttl < request->ptr_ttl ? request->ttl : request->ptr_ttl;
 	memcpy(&cp->addr, &request->addr, sizeof(cp->addr));
 	return (cp);
 }
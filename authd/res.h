@@ -12,10 +12,12 @@
  */
 #define IRCD_MAXNS 10
 #define RESOLVER_HOSTLEN 255
+#define AR_TTL         600	/* longest TTL in seconds for dns cache entries */
 
 struct DNSReply
 {
   char *h_name;
+  time_t ttl;	/* the shortest of the records used */
   struct rb_sockaddr_storage addr;
 };
 
@@ -37,7 +37,7 @@ h_can_join(void *data_)
 	RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
 	{
 		invex = ptr->data;
-		if (matches_mask(&ms, invex->banstr) ||
+		if (matches_mask_prog(&ms, invex->prog, invex->banstr) ||
 				match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
 		{
 			data->approved = 0;
@@ -35,6 +35,8 @@ struct DNSBLEntryStats
 	char *host;
 	uint8_t iptype;
 	unsigned int hits;
+	unsigned int answers;	/* as of the last refresh_dnsbl_stats() */
+	unsigned int cached;
 };
 
 struct OPMScanner
@@ -79,6 +81,7 @@ void authd_abort_client(struct Client *);
 void add_dnsbl_entry(const char *host, const char *reason, uint8_t iptype, rb_dlink_list *filters);
 void del_dnsbl_entry(const char *host);
 void del_dnsbl_entry_all(void);
+void refresh_dnsbl_stats(void);
 
 bool set_authd_timeout(const char *key, int timeout);
 void ident_check_enable(bool enabled);
@@ -0,0 +1,45 @@
+/*
+ *  Solanum: a slightly advanced ircd
+ *  banmatch.h: compiled channel ban/quiet/exception/invex lists
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_banmatch_h
+#define INCLUDED_banmatch_h
+
+struct Channel;
+struct Client;
+struct Ban;
+struct matchset;
+
+/*
+ * A channel's +b/+q/+e/+I lists are compiled on first use into a
+ * matcher which is thrown away whenever chptr->bants changes.  Masks
+ * with a literal host (or a literal "*.domain" host), or failing that
+ * a literal nick, are hashed; CIDR masks also go into a patricia tree;
+ * anything else, including extbans, is checked in one pass in list order.
+ *
+ * list_type is one of CHFL_BAN, CHFL_QUIET, CHFL_EXCEPTION, CHFL_INVEX.
+ * If first is set the earliest matching entry in list order is returned
+ * (so its forward can be used), otherwise any matching entry.
+ */
+struct Ban *banmatch_find(struct Channel *chptr, long list_type,
+			  struct Client *who, const struct matchset *ms, bool first);
+bool banmatch_has_extbans(struct Channel *chptr, long list_type);
+void banmatch_free(struct Channel *chptr);
+size_t banmatch_memory(struct Channel *chptr);
+
+#endif
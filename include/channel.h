@@ -31,6 +31,12 @@
 #define MAXMODEPARAMS   4
 #define MAXMODEPARAMSSERV 10
 
+/* Channels with at least this many members keep a hashed membership
+ * index; smaller ones are simply walked.  The index is dropped again
+ * once the channel shrinks below half of this.
+ */
+#define MEMBER_INDEX_MIN 32
+
 #include <setup.h>
 #include "hook.h"
 
@@ -61,6 +67,11 @@ struct Channel
 	rb_dlink_list members;	/* channel members */
 	rb_dlink_list locmembers;	/* local channel members */
 
+	/* open addressed client -> membership index, only kept while
+	 * the channel has at least MEMBER_INDEX_MIN members */
+	struct membership **member_index;
+	unsigned int member_index_size;
+
 	rb_dlink_list invites;
 	rb_dlink_list banlist;
 	rb_dlink_list exceptlist;
@@ -74,14 +85,18 @@ struct Channel
 	unsigned int join_count;  /* joins within delta */
 	unsigned int join_delta;  /* last ts of join */
 
-	time_t bants;
+	time_t bants;	/* bumped whenever a ban/quiet/except/invex list changes */
 	time_t channelts;
 	char *chname;
 
-	struct Client *last_checked_client;
-	time_t last_checked_ts;
-	unsigned int last_checked_type;
+	struct banmatch *banmatch;	/* compiled ban lists, see banmatch.c */
+
+	/* last is_banned()/is_quieted() verdict for a non-member */
+	uint64_t last_checked_id;
+	time_t last_checked_bants;
+	long last_checked_type;
 	int last_checked_result;
+	const char *last_checked_forward;
 };
 
 struct membership
@@ -101,6 +116,7 @@ struct membership
 struct Ban
 {
 	char *banstr;
+	struct match_prog *prog;	/* compiled banstr */
 	char *who;
 	time_t when;
 	char *forward;
@@ -261,6 +277,7 @@ extern int can_join(struct Client *source_p, struct Channel *chptr,
 		    const char *key, const char **forward);
 
 extern struct membership *find_channel_membership(struct Channel *, struct Client *);
+extern size_t channel_member_index_memory(struct Channel *);
 extern const char *find_channel_status(struct membership *msptr, int combine);
 extern void add_user_to_channel(struct Channel *, struct Client *, int flags);
 extern void remove_user_from_channel(struct membership *);
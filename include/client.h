@@ -63,6 +63,7 @@ struct PreClient;
 struct ListClient;
 struct scache_entry;
 struct ws_ctl;
+struct ServerBurst;
 
 typedef int SSL_OPEN_CB(struct Client *, int status);
 
@@ -107,6 +108,7 @@ struct Client
 	time_t tsinfo;		/* TS on the nick, SVINFO on server */
 	unsigned int umodes;	/* opers, normal users subset */
 	uint64_t flags;		/* client flags */
+	uint64_t introduced;	/* order of introduction, see burst_client_introduced() */
 
 	unsigned int snomask;	/* server notice mask */
 
@@ -172,6 +174,7 @@ struct LocalUser
 				   MIN_JOIN_LEAVE_TIME seconds */
 	int oper_warn_count_down;	/* warn opers of this possible
 					   spambot every time this gets to 0 */
+	uint64_t bancache_id;	/* identifies the client's masks for cached ban checks */
 	time_t last_caller_id_time;
 
 	time_t lasttime;	/* last time we parsed something */
@@ -180,6 +183,7 @@ struct LocalUser
 	/* Send and receive linebuf queues .. */
 	buf_head_t buf_sendq;
 	buf_head_t buf_recvq;
+	rb_dlink_node flush_node;	/* on deferred_flush_list */
 
 	/*
 	 * we want to use unsigned int here so the sizes have a better chance of
@@ -264,6 +268,8 @@ struct LocalUser
 
 	struct _ssl_ctl *ssl_ctl;		/* which ssl daemon we're associate with */
 	struct _ssl_ctl *z_ctl;			/* second ctl for ssl+zlib */
+	struct ZipStats *zipstats;		/* set once the link is compressed */
+	struct ServerBurst *burst;		/* burst still being sent to this server */
 	struct ws_ctl *ws_ctl;			/* ctl for wsockd */
 	SSL_OPEN_CB *ssl_callback;		/* ssl connection is now open */
 	uint32_t localflags;
@@ -279,6 +285,22 @@ struct LocalUser
 	time_t sasl_next_retry;
 };
 
+/* ssld's figures for a compressed server link, data being what the
+ * ircd reads and writes and wire what goes over the network */
+struct ZipStats
+{
+	uint32_t id;		/* ssld connection id */
+	unsigned long long in;
+	unsigned long long in_wire;
+	unsigned long long out;
+	unsigned long long out_wire;
+	double in_ratio;
+	double out_ratio;
+	double in_rate;		/* data bytes/sec over the last sample */
+	double out_rate;
+	time_t last;		/* when the last sample came in */
+};
+
 #define AUTHC_F_DEFERRED 0x01
 #define AUTHC_F_COMPLETE 0x02
 
@@ -429,6 +451,8 @@ struct ListClient
 #define LFLAGS_SECURE		0x00000010	/* for marking SSL clients as secure before registration */
 /* LFLAGS_FAKE: client may not have the usually expected machinery plugged in; don't assert on it. For tests only. */
 #define LFLAGS_FAKE		0x00000020
+#define LFLAGS_SSL_HANDSHAKE	0x00000040	/* counted in our ssld's handshakes */
+#define LFLAGS_DEFERRED		0x00000080	/* sendq is flushed at the end of the loop */
 
 /* umodes, settable flags */
 /* lots of this moved to snomask -- jilles */
@@ -508,6 +532,14 @@ struct ListClient
 #define SetSecure(x)		((x)->localClient->localflags |= LFLAGS_SECURE)
 #define ClearSecure(x)		((x)->localClient->localflags &= ~LFLAGS_SECURE)
 
+#define IsSSLHandshake(x)	((x)->localClient->localflags & LFLAGS_SSL_HANDSHAKE)
+#define SetSSLHandshake(x)	((x)->localClient->localflags |= LFLAGS_SSL_HANDSHAKE)
+#define ClearSSLHandshake(x)	((x)->localClient->localflags &= ~LFLAGS_SSL_HANDSHAKE)
+
+#define IsDeferred(x)		((x)->localClient->localflags & LFLAGS_DEFERRED)
+#define SetDeferred(x)		((x)->localClient->localflags |= LFLAGS_DEFERRED)
+#define ClearDeferred(x)	((x)->localClient->localflags &= ~LFLAGS_DEFERRED)
+
 /* oper flags */
 #define MyOper(x)               (MyConnect(x) && IsOper(x))
 
@@ -577,6 +609,8 @@ extern void check_klines(void);
 extern void check_one_kline(struct ConfItem *kline);
 extern void check_dlines(void);
 extern void check_xlines(void);
+extern void ban_check_run(void);
+extern void dump_ban_check(void (*func)(char *, void *), void *ptr);
 extern void resv_nick_fnc(const char *mask, const char *reason, int temp_time);
 
 extern const char *get_client_name(struct Client *client, int show_ip);
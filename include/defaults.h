@@ -70,12 +70,17 @@ extern const char *ircd_paths[IRCD_PATH_COUNT];
 #define TS_WARN_DELTA_DEFAULT		30		/* default for ts_warn_delta */
 /* ServerInfo default values */
 #define NETWORK_NAME_DEFAULT		"DefaultNet"	/* default for network_name */
+#define SSLD_COUNT_AUTO_MAX		8		/* most ssld started for ssld_count = 0 */
+#define WSOCK_DEFLATE_BITS_MIN		9		/* zlib cannot produce raw deflate with 8 */
+#define WSOCK_DEFLATE_BITS_MAX		15
 /* General defaults */
 #define CLIENT_FLOOD_DEFAULT		20		/* default for client_flood */
 #define CLIENT_FLOOD_MAX		2000
 #define CLIENT_FLOOD_MIN		10
 #define LINKS_DELAY_DEFAULT		300
 #define MAX_TARGETS_DEFAULT		4		/* default for max_targets */
+#define DEFERRED_FLUSH_SENDQ		16384		/* sendq written at once with deferred_flush */
+#define DEFERRED_FLUSH_DELAY_DEFAULT	20		/* default for deferred_flush_delay, msec */
 #define IDENT_TIMEOUT_DEFAULT		5
 #define DNSBL_TIMEOUT_DEFAULT		10
 #define OPM_TIMEOUT_DEFAULT		10
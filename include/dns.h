@@ -31,6 +31,21 @@
 
 extern rb_dlink_list nameservers;
 
+/* authd's DNS cache counters, as of the last refresh_dns_cache_stats() */
+struct dns_cache_stats
+{
+	unsigned long entries;
+	unsigned long hits;
+	unsigned long neg_hits;
+	unsigned long misses;
+	unsigned long coalesced;
+	unsigned long evicted;
+	unsigned long expired;
+	time_t updated;
+};
+
+extern struct dns_cache_stats dns_cache_stats;
+
 typedef void (*DNSCB)(const char *res, int status, int aftype, void *data);
 typedef void (*DNSLISTCB)(int resc, const char *resv[], int status, void *data);
 
@@ -44,5 +59,6 @@ void dns_stats_results_callback(const char *callid, const char *status, int resc
 
 void init_dns(void);
 void reload_nameservers(void);
+void refresh_dns_cache_stats(void);
 
 #endif
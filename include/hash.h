@@ -71,6 +71,7 @@ extern uint32_t fnv_hash_len(const unsigned char *s, int bits, int len);
 extern uint32_t fnv_hash_upper_len(const unsigned char *s, int bits, int len);
 
 extern void init_hash(void);
+extern void hash_stats_walk(void (*cb)(const char *line, void *privdata), void *privdata);
 
 extern void add_to_client_hash(const char *name, struct Client *client);
 extern void del_from_client_hash(const char *name, struct Client *client);
@@ -23,6 +23,13 @@ enum hook_priority
 
 typedef void (*hookfn) (void *data);
 
+struct hook_fn_stats
+{
+	unsigned long count;
+	unsigned long long total_ns;	/* only while command_timing is on */
+	unsigned long long max_ns;
+};
+
 extern int h_iosend_id;
 extern int h_iorecv_id;
 extern int h_iorecvctrl_id;
@@ -54,6 +61,9 @@ void add_hook(const char *name, hookfn fn);
 void add_hook_prio(const char *name, hookfn fn, enum hook_priority priority);
 void remove_hook(const char *name, hookfn fn);
 void call_hook(int id, void *arg);
+void hook_stats_walk(void (*cb)(const char *name, hookfn fn, const struct hook_fn_stats *stats,
+		void *privdata), void *privdata);
+void hook_stats_reset(void);
 
 typedef struct
 {
@@ -102,12 +102,17 @@ struct AddressRec
 
 	/* Only checked if !(type & 1)... */
 	const char *username;
+	/* Compiled hostname (HM_HOST only) and username masks */
+	struct match_prog *host_prog;
+	struct match_prog *user_prog;
 	/* Only checked if type == CONF_CLIENT */
 	const char *auth_user;
 	struct ConfItem *aconf;
 
 	/* The next record in this hash bucket. */
 	struct AddressRec *next;
+	/* The next record with the same prefix (HM_IPV4/HM_IPV6 only). */
+	struct AddressRec *tnext;
 };
 
 
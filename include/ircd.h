@@ -104,5 +104,6 @@ extern bool ircd_zlib_ok;
 extern int maxconnections;
 
 void ircd_shutdown(const char *reason) __attribute__((noreturn));
+void update_loop_stats(void);
 
 #endif
@@ -0,0 +1,54 @@
+/*
+ *  Solanum: a slightly advanced ircd
+ *  maskindex.h: index of match_esc() masks (X-lines, nick RESVs)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_maskindex_h
+#define INCLUDED_maskindex_h
+
+struct ConfItem;
+struct mask_index;
+
+/*
+ * Masks without wildcards are hashed on the whole mask.  Masks with
+ * wildcards are bucketed on a three character piece of one of their
+ * literal runs, so only strings containing that piece need to check
+ * them; masks without such a run are checked on every lookup.
+ *
+ * Every mask is also hashed on the whole mask for mask_index_find_mask().
+ * Lookups return the most recently added match, which is the first one
+ * in a list kept with rb_dlinkAdd(), and the caller's node is handed
+ * back by mask_index_delete().
+ */
+struct mask_index_stats
+{
+	unsigned int entries;
+	unsigned int unindexed;
+	size_t memory;
+	unsigned long lookups;
+	unsigned long checked;		/* masks run against a string */
+	unsigned long skipped;		/* masks a lookup never looked at */
+};
+
+struct mask_index *mask_index_create(void);
+void mask_index_add(struct mask_index *idx, struct ConfItem *aconf, rb_dlink_node *node);
+rb_dlink_node *mask_index_delete(struct mask_index *idx, struct ConfItem *aconf);
+struct ConfItem *mask_index_find(struct mask_index *idx, const char *name);
+struct ConfItem *mask_index_find_mask(struct mask_index *idx, const char *mask);
+void mask_index_stats(struct mask_index *idx, struct mask_index_stats *stats);
+
+#endif
@@ -43,6 +43,22 @@ extern int match_esc(const char *mask, const char *name);
 extern int match_cidr(const char *mask, const char *name);
 extern int match_ips(const char *mask, const char *name);
 
+/*
+ * match_compile - compile a match() mask once for repeated use
+ * match_compile_esc - compile a match_esc() mask once for repeated use
+ * match_prog - check a string against a compiled mask, returns 1 on match
+ * match_prog_free - free a compiled mask
+ *
+ * A compiled mask has the casemapping folded in and rejects strings
+ * that are too short or don't start/end with the mask's literal prefix
+ * and suffix before looking at anything else.
+ */
+struct match_prog;
+extern struct match_prog *match_compile(const char *mask);
+extern struct match_prog *match_compile_esc(const char *mask);
+extern int match_prog(const struct match_prog *prog, const char *name);
+extern void match_prog_free(struct match_prog *prog);
+
 /*
  * comp_with_mask - compares to IP address
  */
@@ -69,6 +85,7 @@ struct Client;
 void matchset_for_client(struct Client *who, struct matchset *m);
 bool client_matches_mask(struct Client *who, const char *mask);
 bool matches_mask(const struct matchset *m, const char *mask);
+bool matches_mask_prog(const struct matchset *m, const struct match_prog *prog, const char *mask);
 
 /*
  * irccmp - case insensitive comparison of s1 and s2
@@ -70,6 +70,23 @@ struct Message
 	 * UNREGISTERED, CLIENT, RCLIENT, SERVER, ENCAP, OPER
 	 */
 	struct MessageEntry handlers[LAST_HANDLER_TYPE];
+
+	struct MessageTiming *timing;	/* set once the command is timed */
+};
+
+/* handler run times: under 1us, then doubling up to the last bucket */
+#define MESSAGE_TIMING_BUCKETS	20
+
+struct MessageTiming
+{
+	const char *cmd;
+	struct
+	{
+		unsigned long count;
+		unsigned long long total_ns;
+		unsigned long long max_ns;
+		unsigned long buckets[MESSAGE_TIMING_BUCKETS];
+	} handlers[LAST_HANDLER_TYPE];
 };
 
 /* generic handlers */
@@ -37,9 +37,14 @@ extern void handle_encap(struct MsgBuf *, struct Client *, struct Client *,
 extern void clear_hash_parse(void);
 extern void mod_add_cmd(struct Message *msg);
 extern void mod_del_cmd(struct Message *msg);
+extern struct Message *find_command(const char *cmd);
 extern char *reconstruct_parv(int parc, const char *parv[]);
 
+extern const char *handler_type_name(int);
+extern void reset_command_timing(void);
+
 extern rb_dictionary *alias_dict;
 extern rb_dictionary *cmd_dict;
+extern rb_dictionary *cmd_timing_dict;
 
 #endif /* INCLUDED_parse_h_h */
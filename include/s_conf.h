@@ -73,6 +73,7 @@ struct ConfItem
 	char *className;	/* Name of class */
 	struct Class *c_class;	/* Class of connection */
 	rb_patricia_node_t *pnode;	/* Our patricia node */
+	struct match_prog *host_prog;	/* compiled host, see conf_host_prog() */
 	int umodes, umodes_mask;	/* Override umodes specified by mask */
 };
 
@@ -240,6 +241,11 @@ struct config_file_entry
 	int use_propagated_bans;
 	int max_ratelimit_tokens;
 	int away_interval;
+	int deferred_flush;
+	int deferred_flush_delay;
+	int command_timing;
+	int slow_loop_pass;
+	int loop_stats_interval;
 	int tls_ciphers_oper_only;
 	int oper_secure_only;
 
@@ -322,6 +328,9 @@ struct server_info
 	char *ssl_cipher_list;
 	int ssld_count;
 	int wsockd_count;
+	int wsock_deflate;
+	int wsock_deflate_window_bits;
+	int wsock_deflate_no_context_takeover;
 };
 
 struct admin_info
@@ -366,6 +375,7 @@ extern void init_s_conf(void);
 
 extern struct ConfItem *make_conf(void);
 extern void free_conf(struct ConfItem *);
+extern const struct match_prog *conf_host_prog(struct ConfItem *);
 
 extern struct ConfItem *find_prop_ban(unsigned int status, const char *user, const char *host);
 extern void add_prop_ban(struct ConfItem *);
@@ -44,12 +44,15 @@
 
 struct Client;
 struct ConfItem;
+struct mask_index;
 
 extern rb_dlink_list cluster_conf_list;
 extern rb_dlink_list oper_conf_list;
 extern rb_dlink_list server_conf_list;
 extern rb_dlink_list xline_conf_list;
 extern rb_dlink_list resv_conf_list;
+extern struct mask_index *xline_index;
+extern struct mask_index *nick_resv_index;
 extern rb_dlink_list nd_list;
 extern rb_dlink_list tgchange_list;
 
@@ -233,6 +236,12 @@ extern void set_server_conf_autoconn(struct Client *source_p, const char *name,
 extern void disable_server_conf_autoconn(const char *name);
 
 
+/* keep xline_conf_list/resv_conf_list and their indexes in step */
+extern void add_xline_conf(struct ConfItem *);
+extern void del_xline_conf(struct ConfItem *);
+extern void add_nick_resv_conf(struct ConfItem *);
+extern void del_nick_resv_conf(struct ConfItem *);
+
 extern struct ConfItem *find_xline(const char *, int);
 extern struct ConfItem *find_xline_mask(const char *);
 extern struct ConfItem *find_nick_resv(const char *name);
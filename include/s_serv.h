@@ -92,9 +92,10 @@ extern unsigned int CAP_EUID;			/* supports EUID (ext UID + nonencap CHGHOST) */
 extern unsigned int CAP_EOPMOD;			/* supports EOPMOD (ext +z + ext topic) */
 extern unsigned int CAP_BAN;			/* supports propagated bans */
 extern unsigned int CAP_MLOCK;			/* supports MLOCK messages */
+extern unsigned int CAP_ZIP;			/* compresses the link via ssld */
 
 /* XXX: added for backwards compatibility. --nenolod */
-#define CAP_MASK	(capability_index_mask(serv_capindex) & ~(CAP_TS6 | CAP_CAP))
+#define CAP_MASK	(capability_index_mask(serv_capindex) & ~(CAP_TS6 | CAP_CAP | CAP_ZIP))
 
 /*
  * Capability macros.
@@ -137,4 +138,11 @@ extern int server_estab(struct Client *client_p);
 
 extern int serv_connect(struct server_conf *, struct Client *);
 
+extern void burst_resume(struct Client *);
+extern void burst_cancel(struct Client *);
+extern void burst_before_send(struct Client *, buf_head_t *);
+extern void burst_client_introduced(struct Client *);
+extern void burst_unlink_client(struct Client *);
+extern void burst_unlink_channel(struct Channel *);
+
 #endif /* INCLUDED_s_serv_h */
@@ -66,6 +66,9 @@ struct ServerStatistics
 	unsigned int is_sbad;	/* failed sasl authentications */
 	unsigned int is_tgch;	/* messages blocked due to target change */
 	unsigned int is_rl;     /* commands blocked due to ratelimit */
+	unsigned long long int is_dflush;	/* deferred sendq writes */
+	unsigned long long int is_dfsaved;	/* writes saved by deferring */
+	unsigned long long int is_dfearly;	/* deferred writes done early */
 };
 
 extern struct ServerStatistics ServerStats;
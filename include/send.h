@@ -40,6 +40,8 @@ extern struct Client *remote_rehash_oper_p;
 extern void send_pop_queue(struct Client *);
 
 extern void send_queued(struct Client *to);
+extern void send_deferred_flush(void);
+extern void send_cancel_deferred(struct Client *to);
 
 extern void sendto_one(struct Client *target_p, const char *, ...) AFP(2, 3);
 extern void sendto_one_notice(struct Client *target_p,const char *, ...) AFP(2, 3);
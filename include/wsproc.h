@@ -32,13 +32,24 @@ enum wsockd_status {
 	WSOCKD_DEAD,
 };
 
+/* permessage-deflate totals, as last reported by a wsockd */
+struct wsockd_stats {
+	uint64_t deflate_conns;		/* connections using compression now */
+	uint64_t deflate_in;		/* bytes compressed */
+	uint64_t deflate_out;		/* ...and what they compressed to */
+	uint64_t inflate_in;		/* compressed bytes received */
+	uint64_t inflate_out;		/* ...and what they inflated to */
+	uint64_t cpu_usec;		/* CPU time spent in zlib */
+};
+
 void init_wsockd(void);
 void restart_wsockd(void);
 int start_wsockd(int count);
 ws_ctl_t *start_wsockd_accept(rb_fde_t *wsF, rb_fde_t *plainF, uint32_t id);
 void wsockd_decrement_clicount(ws_ctl_t *ctl);
 int get_wsockd_count(void);
-void wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status), void *data);
+void wsockd_update_config(void);
+void wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status, const struct wsockd_stats *stats), void *data);
 
 #endif
 
@@ -252,6 +252,7 @@ cmd_stats_results(int parc, char **parv)
 	/* Select by type */
 	switch(*parv[2])
 	{
+	case 'C':
 	case 'D':
 		/* parv[0] conveys status */
 		if(parc < 4)
@@ -262,6 +263,19 @@ cmd_stats_results(int parc, char **parv)
 		}
 		dns_stats_results_callback(parv[1], parv[0], parc - 3, (const char **)&parv[3]);
 		break;
+	case 'B':
+		/* host iptype hits answers cached; we count hits ourselves */
+		if(*parv[0] == 'Y' && parc >= 8 && dnsbl_stats != NULL)
+		{
+			struct DNSBLEntryStats *stats = rb_dictionary_retrieve(dnsbl_stats, parv[3]);
+
+			if(stats != NULL)
+			{
+				stats->answers = strtoul(parv[6], NULL, 10);
+				stats->cached = strtoul(parv[7], NULL, 10);
+			}
+		}
+		break;
 	default:
 		break;
 	}
@@ -613,6 +627,7 @@ add_dnsbl_entry(const char *host, const char *reason, uint8_t iptype, rb_dlink_l
 	stats->host = rb_strdup(host);
 	stats->iptype = iptype;
 	stats->hits = 0;
+	stats->answers = stats->cached = 0;
 	rb_dictionary_add(dnsbl_stats, stats->host, stats);
 
 	rb_helper_write(authd_helper, "O rbl %s %hhu %s :%s", host, iptype, filterbuf, reason);
@@ -653,6 +668,16 @@ del_dnsbl_entry_all(void)
 	rb_helper_write(authd_helper, "O rbl_del_all");
 }
 
+/* Ask authd how many DNSBL lookups it answered from its cache */
+void
+refresh_dnsbl_stats(void)
+{
+	if(authd_helper == NULL || dnsbl_stats == NULL)
+		return;
+
+	rb_helper_write(authd_helper, "S 0 B");
+}
+
 /* Adjust an authd timeout value */
 bool
 set_authd_timeout(const char *key, int timeout)
@@ -350,7 +350,7 @@ bandb_handle_finish(void)
 
 		case CONF_XLINE:
 			if(bandb_check_xline(aconf))
-				rb_dlinkAddAlloc(aconf, &xline_conf_list);
+				add_xline_conf(aconf);
 			else
 				free_conf(aconf);
 
@@ -366,7 +366,7 @@ bandb_handle_finish(void)
 
 		case CONF_RESV_NICK:
 			if(bandb_check_resv_nick(aconf))
-				rb_dlinkAddAlloc(aconf, &resv_conf_list);
+				add_nick_resv_conf(aconf);
 			else
 				free_conf(aconf);
 
@@ -0,0 +1,538 @@
+/*
+ *  Solanum: a slightly advanced ircd
+ *  banmatch.c: compiled channel ban/quiet/exception/invex lists
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "banmatch.h"
+#include "channel.h"
+#include "client.h"
+#include "match.h"
+#include "s_assert.h"
+
+/*
+ * Every entry found through the hash tables or the patricia trees is
+ * only a candidate and is confirmed with matches_mask(), so the indexes
+ * just have to never miss a mask that could match:
+ *
+ *  - a mask with exactly one '@' and a host part without wildcards can
+ *    only match a string with that exact host, as nicks and usernames
+ *    never contain '@'.  Likewise "*.domain" can only match hosts
+ *    ending in ".domain", which we find by looking up each '.' suffix.
+ *  - a mask with exactly one '!' preceded by a literal nick can only
+ *    match that nick.
+ *  - match_cidr() only matches if the address is within the mask.
+ */
+
+#define BANMATCH_LISTS		4
+#define BANMATCH_MIN_TABLE	16
+
+struct banmatch_entry
+{
+	struct banmatch_entry *next;		/* hash chain */
+	struct banmatch_entry *cidr_next;	/* patricia node chain */
+	struct Ban *ban;
+	unsigned int pos;			/* position in the channel list */
+};
+
+struct banmatch_list
+{
+	struct banmatch_entry *entries;
+	unsigned int count;
+
+	/* both tables are the same size, mask is size - 1 */
+	struct banmatch_entry **hosts;
+	struct banmatch_entry **nicks;
+	unsigned int mask;
+
+	rb_patricia_tree_t *cidr4;
+	rb_patricia_tree_t *cidr6;
+
+	/* everything else, in list order */
+	struct banmatch_entry **rest;
+	unsigned int restcount;
+
+	bool extbans;
+};
+
+struct banmatch
+{
+	time_t bants;
+	size_t memory;
+	struct banmatch_list lists[BANMATCH_LISTS];
+};
+
+static int
+banmatch_index(long list_type)
+{
+	switch(list_type)
+	{
+	case CHFL_BAN:
+		return 0;
+	case CHFL_QUIET:
+		return 1;
+	case CHFL_EXCEPTION:
+		return 2;
+	case CHFL_INVEX:
+		return 3;
+	}
+
+	s_assert(0);
+	return 0;
+}
+
+static rb_dlink_list *
+banmatch_source(struct Channel *chptr, int index)
+{
+	switch(index)
+	{
+	case 0:
+		return &chptr->banlist;
+	case 1:
+		return &chptr->quietlist;
+	case 2:
+		return &chptr->exceptlist;
+	default:
+		return &chptr->invexlist;
+	}
+}
+
+static uint32_t
+banmatch_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while(len--)
+	{
+		h ^= irctolower(*s++);
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static bool
+has_wild(const char *s, size_t len)
+{
+	while(len--)
+	{
+		if(*s == '*' || *s == '?')
+			return true;
+		s++;
+	}
+
+	return false;
+}
+
+static void
+banmatch_hash_add(struct banmatch_entry **table, unsigned int mask,
+		  struct banmatch_entry *e, const char *key, size_t len)
+{
+	uint32_t h = banmatch_hash(key, len) & mask;
+
+	e->next = table[h];
+	table[h] = e;
+}
+
+/* banmatch_add_cidr()
+ *
+ * input	- list, entry, host part of its mask
+ * output	- true if the entry was added to a patricia tree
+ * side effects - parses the host part the same way match_cidr() does
+ */
+static bool
+banmatch_add_cidr(struct banmatch_list *bl, struct banmatch_entry *e, const char *host)
+{
+	struct rb_sockaddr_storage addr;
+	rb_patricia_tree_t **tree;
+	rb_patricia_node_t *pnode;
+	char buf[BUFSIZE];
+	char *len;
+	void *ipptr;
+	int bits, aftype;
+
+	rb_strlcpy(buf, host, sizeof(buf));
+
+	len = strrchr(buf, '/');
+	if(len == NULL)
+		return false;
+	*len++ = '\0';
+
+	bits = atoi(len);
+	if(bits <= 0)
+		return false;
+
+	memset(&addr, 0, sizeof(addr));
+
+	if(strchr(buf, ':') != NULL)
+	{
+		if(bits > 128)
+			return false;
+		aftype = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)&addr)->sin6_addr;
+		tree = &bl->cidr6;
+	}
+	else
+	{
+		if(bits > 32)
+			return false;
+		aftype = AF_INET;
+		ipptr = &((struct sockaddr_in *)&addr)->sin_addr;
+		tree = &bl->cidr4;
+	}
+
+	if(rb_inet_pton(aftype, buf, ipptr) <= 0)
+		return false;
+	SET_SS_FAMILY(&addr, aftype);
+
+	if(*tree == NULL)
+		*tree = rb_new_patricia(PATRICIA_BITS);
+
+	pnode = make_and_lookup_ip(*tree, (struct sockaddr *)&addr, bits);
+	if(pnode == NULL)
+		return false;
+
+	e->cidr_next = pnode->data;
+	pnode->data = e;
+	return true;
+}
+
+static void
+banmatch_classify(struct banmatch_list *bl, struct banmatch_entry *e)
+{
+	const char *banstr = e->ban->banstr;
+	const char *at, *bang, *host;
+
+	if(*banstr == '$')
+	{
+		bl->extbans = true;
+		bl->rest[bl->restcount++] = e;
+		return;
+	}
+
+	at = strchr(banstr, '@');
+	if(at != NULL && strchr(at + 1, '@') == NULL)
+	{
+		host = at + 1;
+
+		if(host[0] == '*' && host[1] == '.' && !has_wild(host + 1, strlen(host + 1)))
+		{
+			banmatch_hash_add(bl->hosts, bl->mask, e, host + 1, strlen(host + 1));
+			return;
+		}
+
+		if(*host != '\0' && !has_wild(host, strlen(host)))
+		{
+			banmatch_hash_add(bl->hosts, bl->mask, e, host, strlen(host));
+
+			/* a CIDR mask can also match by address; if the
+			 * patricia insert fails fall back to scanning it */
+			if(strchr(host, '/') != NULL && !banmatch_add_cidr(bl, e, host))
+				bl->rest[bl->restcount++] = e;
+			return;
+		}
+	}
+
+	bang = strchr(banstr, '!');
+	if(bang != NULL && bang != banstr && strchr(bang + 1, '!') == NULL &&
+	   !has_wild(banstr, bang - banstr))
+	{
+		banmatch_hash_add(bl->nicks, bl->mask, e, banstr, bang - banstr);
+		return;
+	}
+
+	bl->rest[bl->restcount++] = e;
+}
+
+static void
+banmatch_compile_list(struct banmatch *bm, struct banmatch_list *bl, rb_dlink_list *list)
+{
+	struct banmatch_entry *e;
+	rb_dlink_node *ptr;
+	unsigned int size = BANMATCH_MIN_TABLE;
+
+	bl->count = rb_dlink_list_length(list);
+	if(bl->count == 0)
+		return;
+
+	while(size < bl->count)
+		size <<= 1;
+
+	bl->entries = rb_malloc(bl->count * sizeof(struct banmatch_entry));
+	bl->rest = rb_malloc(bl->count * sizeof(struct banmatch_entry *));
+	bl->hosts = rb_malloc(size * sizeof(struct banmatch_entry *));
+	bl->nicks = rb_malloc(size * sizeof(struct banmatch_entry *));
+	bl->mask = size - 1;
+
+	bm->memory += bl->count * (sizeof(struct banmatch_entry) + sizeof(struct banmatch_entry *)) +
+		size * 2 * sizeof(struct banmatch_entry *);
+
+	e = bl->entries;
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		e->ban = ptr->data;
+		e->pos = e - bl->entries;
+		banmatch_classify(bl, e);
+		e++;
+	}
+}
+
+static void
+banmatch_free_list(struct banmatch_list *bl)
+{
+	rb_free(bl->entries);
+	rb_free(bl->rest);
+	rb_free(bl->hosts);
+	rb_free(bl->nicks);
+
+	if(bl->cidr4 != NULL)
+		rb_destroy_patricia(bl->cidr4, NULL);
+	if(bl->cidr6 != NULL)
+		rb_destroy_patricia(bl->cidr6, NULL);
+}
+
+void
+banmatch_free(struct Channel *chptr)
+{
+	int i;
+
+	if(chptr->banmatch == NULL)
+		return;
+
+	for(i = 0; i < BANMATCH_LISTS; i++)
+		banmatch_free_list(&chptr->banmatch->lists[i]);
+
+	rb_free(chptr->banmatch);
+	chptr->banmatch = NULL;
+}
+
+/* banmatch_get()
+ *
+ * input	- channel
+ * output	- compiled lists for the channel
+ * side effects - lists are (re)compiled if they changed since last use
+ */
+static struct banmatch *
+banmatch_get(struct Channel *chptr)
+{
+	struct banmatch *bm = chptr->banmatch;
+	int i;
+
+	if(bm != NULL && bm->bants == chptr->bants)
+		return bm;
+
+	banmatch_free(chptr);
+
+	bm = rb_malloc(sizeof(struct banmatch));
+	bm->bants = chptr->bants;
+	bm->memory = sizeof(struct banmatch);
+
+	for(i = 0; i < BANMATCH_LISTS; i++)
+		banmatch_compile_list(bm, &bm->lists[i], banmatch_source(chptr, i));
+
+	chptr->banmatch = bm;
+	return bm;
+}
+
+/* candidates are only worth confirming if they would beat the best match so far */
+static inline bool
+banmatch_try(struct banmatch_entry *e, struct banmatch_entry *best, const struct matchset *ms)
+{
+	return (best == NULL || e->pos < best->pos) && matches_mask_prog(ms, e->ban->prog, e->ban->banstr);
+}
+
+static struct banmatch_entry *
+banmatch_find_chain(struct banmatch_entry *e, struct banmatch_entry *best,
+		    const struct matchset *ms, bool first)
+{
+	for(; e != NULL; e = e->next)
+	{
+		if(banmatch_try(e, best, ms))
+		{
+			best = e;
+			if(!first)
+				break;
+		}
+	}
+
+	return best;
+}
+
+static struct banmatch_entry *
+banmatch_find_cidr(struct banmatch_list *bl, const char *ip, struct banmatch_entry *best,
+		   const struct matchset *ms, bool first)
+{
+	struct rb_sockaddr_storage addr;
+	rb_patricia_tree_t *tree;
+	rb_patricia_node_t *pnode;
+	struct banmatch_entry *e;
+	void *ipptr;
+	int aftype;
+
+	memset(&addr, 0, sizeof(addr));
+
+	if(strchr(ip, ':') != NULL)
+	{
+		tree = bl->cidr6;
+		aftype = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)&addr)->sin6_addr;
+	}
+	else
+	{
+		tree = bl->cidr4;
+		aftype = AF_INET;
+		ipptr = &((struct sockaddr_in *)&addr)->sin_addr;
+	}
+
+	if(tree == NULL || rb_inet_pton(aftype, ip, ipptr) <= 0)
+		return best;
+	SET_SS_FAMILY(&addr, aftype);
+
+	/* every prefix containing the address is on the path to the best one */
+	for(pnode = rb_match_ip(tree, (struct sockaddr *)&addr); pnode != NULL; pnode = pnode->parent)
+	{
+		if(pnode->prefix == NULL)
+			continue;
+
+		for(e = pnode->data; e != NULL; e = e->cidr_next)
+		{
+			if(banmatch_try(e, best, ms))
+			{
+				best = e;
+				if(!first)
+					return best;
+			}
+		}
+	}
+
+	return best;
+}
+
+static struct banmatch_entry *
+banmatch_find_string(struct banmatch_list *bl, const char *s, struct banmatch_entry *best,
+		     const struct matchset *ms, bool first)
+{
+	const char *bang, *host, *p;
+
+	bang = strchr(s, '!');
+	host = strrchr(s, '@');
+	if(bang == NULL || host == NULL)
+		return best;
+	host++;
+
+	best = banmatch_find_chain(bl->nicks[banmatch_hash(s, bang - s) & bl->mask], best, ms, first);
+	if(best != NULL && !first)
+		return best;
+
+	best = banmatch_find_chain(bl->hosts[banmatch_hash(host, strlen(host)) & bl->mask], best, ms, first);
+	if(best != NULL && !first)
+		return best;
+
+	for(p = strchr(host, '.'); p != NULL; p = strchr(p + 1, '.'))
+	{
+		best = banmatch_find_chain(bl->hosts[banmatch_hash(p, strlen(p)) & bl->mask], best, ms, first);
+		if(best != NULL && !first)
+			return best;
+	}
+
+	return best;
+}
+
+struct Ban *
+banmatch_find(struct Channel *chptr, long list_type, struct Client *who,
+	      const struct matchset *ms, bool first)
+{
+	struct banmatch_list *bl = &banmatch_get(chptr)->lists[banmatch_index(list_type)];
+	struct banmatch_entry *best = NULL, *e;
+	long extban_type = list_type == CHFL_QUIET ? CHFL_BAN : list_type;
+	unsigned int i;
+
+	if(bl->count == 0)
+		return NULL;
+
+	for(i = 0; i < ARRAY_SIZE(ms->host) && ms->host[i][0] != '\0'; i++)
+	{
+		best = banmatch_find_string(bl, ms->host[i], best, ms, first);
+		if(best != NULL && !first)
+			return best->ban;
+	}
+
+	for(i = 0; i < ARRAY_SIZE(ms->ip) && ms->ip[i][0] != '\0'; i++)
+	{
+		best = banmatch_find_string(bl, ms->ip[i], best, ms, first);
+		if(best != NULL && !first)
+			return best->ban;
+
+		best = banmatch_find_cidr(bl, strrchr(ms->ip[i], '@') + 1, best, ms, first);
+		if(best != NULL && !first)
+			return best->ban;
+	}
+
+	for(i = 0; i < bl->restcount; i++)
+	{
+		e = bl->rest[i];
+		if(best != NULL && e->pos >= best->pos)
+			break;
+
+		if(matches_mask_prog(ms, e->ban->prog, e->ban->banstr) ||
+		   match_extban(e->ban->banstr, who, chptr, extban_type))
+		{
+			best = e;
+			break;
+		}
+	}
+
+	return best != NULL ? best->ban : NULL;
+}
+
+/* banmatch_has_extbans()
+ *
+ * input	- channel, list type
+ * output	- true if the list contains extbans, whose result may depend
+ *                on more than the client's masks
+ * side effects -
+ */
+bool
+banmatch_has_extbans(struct Channel *chptr, long list_type)
+{
+	return banmatch_get(chptr)->lists[banmatch_index(list_type)].extbans;
+}
+
+size_t
+banmatch_memory(struct Channel *chptr)
+{
+	struct banmatch *bm = chptr->banmatch;
+	struct banmatch_list *bl;
+	size_t memory;
+	int i;
+
+	if(bm == NULL)
+		return 0;
+
+	memory = bm->memory;
+	for(i = 0; i < BANMATCH_LISTS; i++)
+	{
+		bl = &bm->lists[i];
+		if(bl->cidr4 != NULL)
+			memory += bl->cidr4->num_active_node * (sizeof(rb_patricia_node_t) + sizeof(rb_prefix_t));
+		if(bl->cidr6 != NULL)
+			memory += bl->cidr6->num_active_node * (sizeof(rb_patricia_node_t) + sizeof(rb_prefix_t));
+	}
+
+	return memory;
+}
@@ -23,6 +23,7 @@
  */
 
 #include "stdinc.h"
+#include "banmatch.h"
 #include "channel.h"
 #include "chmode.h"
 #include "client.h"
@@ -89,6 +90,8 @@ free_channel(struct Channel *chptr)
 {
 	rb_free(chptr->chname);
 	rb_free(chptr->mode_lock);
+	rb_free(chptr->member_index);
+	banmatch_free(chptr);
 	rb_bh_free(channel_heap, chptr);
 }
 
@@ -98,6 +101,7 @@ allocate_ban(const char *banstr, const char *who, const char *forward)
 	struct Ban *bptr;
 	bptr = rb_bh_alloc(ban_heap);
 	bptr->banstr = rb_strdup(banstr);
+	bptr->prog = match_compile(banstr);
 	bptr->who = rb_strdup(who);
 	bptr->forward = forward ? rb_strdup(forward) : NULL;
 
@@ -108,6 +112,7 @@ void
 free_ban(struct Ban *bptr)
 {
 	rb_free(bptr->banstr);
+	match_prog_free(bptr->prog);
 	rb_free(bptr->who);
 	rb_free(bptr->forward);
 	rb_bh_free(ban_heap, bptr);
@@ -141,6 +146,158 @@ send_channel_join(struct Channel *chptr, struct Client *client_p)
 							    client_p->host, client_p->user->away);
 }
 
+/*
+ * The membership index is an open addressed table of membership
+ * pointers keyed on the client, using linear probing with backward
+ * shift deletion so no tombstones are needed.  It is sized to stay at
+ * most half full and is only kept for channels large enough that
+ * walking the member list would hurt.
+ */
+static inline unsigned int
+member_index_slot(struct Channel *chptr, struct Client *client_p)
+{
+	uintptr_t h = (uintptr_t) client_p;
+
+	h ^= h >> 17;
+	h *= 0x9e3779b1UL;
+	h ^= h >> 15;
+	return (unsigned int) h & (chptr->member_index_size - 1);
+}
+
+static void
+member_index_insert(struct Channel *chptr, struct membership *msptr)
+{
+	unsigned int mask = chptr->member_index_size - 1;
+	unsigned int i = member_index_slot(chptr, msptr->client_p);
+
+	while(chptr->member_index[i] != NULL)
+		i = (i + 1) & mask;
+
+	chptr->member_index[i] = msptr;
+}
+
+static void
+member_index_delete(struct Channel *chptr, struct membership *msptr)
+{
+	unsigned int mask = chptr->member_index_size - 1;
+	unsigned int i = member_index_slot(chptr, msptr->client_p);
+	unsigned int j, k;
+
+	while(chptr->member_index[i] != msptr)
+	{
+		s_assert(chptr->member_index[i] != NULL);
+		if(chptr->member_index[i] == NULL)
+			return;
+		i = (i + 1) & mask;
+	}
+
+	/* shift back any entries whose probe sequence crossed this slot */
+	for(j = (i + 1) & mask; chptr->member_index[j] != NULL; j = (j + 1) & mask)
+	{
+		k = member_index_slot(chptr, chptr->member_index[j]->client_p);
+
+		if(((j - k) & mask) >= ((j - i) & mask))
+		{
+			chptr->member_index[i] = chptr->member_index[j];
+			i = j;
+		}
+	}
+
+	chptr->member_index[i] = NULL;
+}
+
+/* member_index_rebuild()
+ *
+ * input	- channel, number of members the index must hold
+ * output	-
+ * side effects - membership index is (re)allocated to fit and refilled
+ *                from the member list
+ */
+static void
+member_index_rebuild(struct Channel *chptr, unsigned long count)
+{
+	struct membership *msptr;
+	rb_dlink_node *ptr;
+	unsigned int size = MEMBER_INDEX_MIN * 2;
+
+	while(size < count * 2)
+		size <<= 1;
+
+	rb_free(chptr->member_index);
+	chptr->member_index = rb_malloc(size * sizeof(struct membership *));
+	chptr->member_index_size = size;
+
+	RB_DLINK_FOREACH(ptr, chptr->members.head)
+	{
+		msptr = ptr->data;
+		member_index_insert(chptr, msptr);
+	}
+}
+
+/* member_index_add()
+ *
+ * input	- membership which has just been added to chptr->members
+ * output	-
+ * side effects - membership is added to the index, creating or growing
+ *                it as needed
+ */
+static void
+member_index_add(struct Channel *chptr, struct membership *msptr)
+{
+	unsigned long count = rb_dlink_list_length(&chptr->members);
+
+	if(chptr->member_index == NULL)
+	{
+		if(count >= MEMBER_INDEX_MIN)
+			member_index_rebuild(chptr, count);
+		return;
+	}
+
+	if(count * 2 > chptr->member_index_size)
+	{
+		member_index_rebuild(chptr, count);
+		return;
+	}
+
+	member_index_insert(chptr, msptr);
+}
+
+/* member_index_remove()
+ *
+ * input	- membership which has just been removed from chptr->members
+ * output	-
+ * side effects - membership is removed from the index, dropping the
+ *                index entirely once the channel is small again
+ */
+static void
+member_index_remove(struct Channel *chptr, struct membership *msptr)
+{
+	if(chptr->member_index == NULL)
+		return;
+
+	if(rb_dlink_list_length(&chptr->members) < MEMBER_INDEX_MIN / 2)
+	{
+		rb_free(chptr->member_index);
+		chptr->member_index = NULL;
+		chptr->member_index_size = 0;
+		return;
+	}
+
+	member_index_delete(chptr, msptr);
+}
+
+/* channel_member_index_memory()
+ *
+ * input	- channel
+ * output	- bytes used by the channels membership index
+ * side effects -
+ */
+size_t
+channel_member_index_memory(struct Channel *chptr)
+{
+	return chptr->member_index_size * sizeof(struct membership *);
+}
+
 /* find_channel_membership()
  *
  * input	- channel to find them in, client to find
@@ -152,14 +309,26 @@ find_channel_membership(struct Channel *chptr, struct Client *client_p)
 {
 	struct membership *msptr;
 	rb_dlink_node *ptr;
+	unsigned int i, mask;
 
 	if(!IsClient(client_p))
 		return NULL;
 
-	/* Pick the most efficient list to use to be nice to things like
-	 * CHANSERV which could be in a large number of channels
+	/* Big channels carry an index; otherwise one of the two lists is
+	 * short, so pick that to be nice to things like CHANSERV which
+	 * could be in a large number of channels
 	 */
-	if(rb_dlink_list_length(&chptr->members) < rb_dlink_list_length(&client_p->user->channel))
+	if(chptr->member_index != NULL)
+	{
+		mask = chptr->member_index_size - 1;
+
+		for(i = member_index_slot(chptr, client_p); chptr->member_index[i] != NULL; i = (i + 1) & mask)
+		{
+			if(chptr->member_index[i]->client_p == client_p)
+				return chptr->member_index[i];
+		}
+	}
+	else if(rb_dlink_list_length(&chptr->members) < rb_dlink_list_length(&client_p->user->channel))
 	{
 		RB_DLINK_FOREACH(ptr, chptr->members.head)
 		{
@@ -245,6 +414,7 @@ add_user_to_channel(struct Channel *chptr, struct Client *client_p, int flags)
 		rb_dlinkAddBefore(p, msptr, &msptr->usernode, &client_p->user->channel);
 
 	rb_dlinkAdd(msptr, &msptr->channode, &chptr->members);
+	member_index_add(chptr, msptr);
 
 	if(MyClient(client_p))
 		rb_dlinkAdd(msptr, &msptr->locchannode, &chptr->locmembers);
@@ -270,6 +440,7 @@ remove_user_from_channel(struct membership *msptr)
 
 	rb_dlinkDelete(&msptr->usernode, &client_p->user->channel);
 	rb_dlinkDelete(&msptr->channode, &chptr->members);
+	member_index_remove(chptr, msptr);
 
 	if(client_p->servptr == &me)
 		rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
@@ -305,6 +476,7 @@ remove_user_from_channels(struct Client *client_p)
 		chptr = msptr->chptr;
 
 		rb_dlinkDelete(&msptr->channode, &chptr->members);
+		member_index_remove(chptr, msptr);
 
 		if(client_p->servptr == &me)
 			rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
@@ -335,6 +507,9 @@ invalidate_bancache_user(struct Client *client_p)
 	if(client_p == NULL)
 		return;
 
+	if(MyClient(client_p))
+		client_p->localClient->bancache_id = 0;
+
 	RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
 	{
 		msptr = ptr->data;
@@ -343,6 +518,25 @@ invalidate_bancache_user(struct Client *client_p)
 	}
 }
 
+/* bancache_id()
+ *
+ * input	- local client
+ * output	- id for the client's current set of masks
+ * side effects - a fresh id is assigned after invalidate_bancache_user(),
+ *                so verdicts cached under an old id (or for a previous
+ *                client at the same address) are never reused
+ */
+static uint64_t
+bancache_id(struct Client *client_p)
+{
+	static uint64_t bancache_serial;
+
+	if(client_p->localClient->bancache_id == 0)
+		client_p->localClient->bancache_id = ++bancache_serial;
+
+	return client_p->localClient->bancache_id;
+}
+
 /* check_channel_name()
  *
  * input	- channel name
@@ -413,6 +607,7 @@ destroy_channel(struct Channel *chptr)
 	/* Free the topic */
 	free_topic(chptr);
 
+	burst_unlink_channel(chptr);
 	rb_dlinkDelete(&chptr->node, &global_channel_list);
 	del_from_channel_hash(chptr->chname, chptr);
 	free_channel(chptr);
@@ -547,84 +742,86 @@ del_invite(struct Channel *chptr, struct Client *who)
 
 /* is_banned_list()
  *
- * input	- channel to check bans for, ban list (banlist or quietlist),
+ * input	- channel to check bans for, list type (CHFL_BAN or CHFL_QUIET),
  *                user to check bans against, optional prebuilt buffers,
  *                optional forward channel pointer
  * output	- 1 if banned, else 0
  * side effects -
  */
 static int
-is_banned_list(struct Channel *chptr, rb_dlink_list *list,
+is_banned_list(struct Channel *chptr, long list_type,
 	       struct Client *who, struct membership *msptr,
 	       const struct matchset *ms, const char **forward)
 {
 	struct matchset ms_;
-	rb_dlink_node *ptr;
-	struct Ban *actualBan = NULL;
-	struct Ban *actualExcept = NULL;
+	struct Ban *actualBan;
+	bool use_except = ConfigChannel.use_except;
+	bool cacheable;
+	long cache_type;
+	int result;
 
 	if (!MyClient(who))
 		return 0;
 
-	if (ms == NULL)
+	/* members cache their verdict in the membership; for everyone
+	 * else keep the last verdict, unless extbans make it depend on
+	 * more than the client's masks
+	 */
+	cacheable = msptr == NULL && !banmatch_has_extbans(chptr, list_type) &&
+		!(use_except && banmatch_has_extbans(chptr, CHFL_EXCEPTION));
+	cache_type = list_type | (use_except ? CHFL_EXCEPTION : 0);
+
+	if (cacheable && chptr->last_checked_id == bancache_id(who) &&
+			chptr->last_checked_bants == chptr->bants &&
+			chptr->last_checked_type == cache_type)
 	{
-		matchset_for_client(who, &ms_);
-		ms = &ms_;
+		if (chptr->last_checked_forward != NULL && forward != NULL)
+			*forward = chptr->last_checked_forward;
+		return chptr->last_checked_result;
 	}
 
-	RB_DLINK_FOREACH(ptr, list->head)
+	if (ms == NULL)
 	{
-		actualBan = ptr->data;
-		if (matches_mask(ms, actualBan->banstr))
-			break;
-		if (match_extban(actualBan->banstr, who, chptr, CHFL_BAN))
-			break;
-		actualBan = NULL;
+		matchset_for_client(who, &ms_);
+		ms = &ms_;
 	}
 
-	if ((actualBan != NULL) && ConfigChannel.use_except)
-	{
-		RB_DLINK_FOREACH(ptr, chptr->exceptlist.head)
-		{
-			actualExcept = ptr->data;
+	/* only the first ban in list order decides the forward */
+	actualBan = banmatch_find(chptr, list_type, who, ms, msptr == NULL);
 
-			/* theyre exempted.. */
-			if (matches_mask(ms, actualExcept->banstr) ||
-					match_extban(actualExcept->banstr, who, chptr, CHFL_EXCEPTION))
-			{
-				/* cache the fact theyre not banned */
-				if(msptr != NULL)
-				{
-					msptr->bants = chptr->bants;
-					msptr->flags &= ~CHFL_BANNED;
-				}
-
-				return CHFL_EXCEPTION;
-			}
-		}
-	}
+	if (actualBan == NULL)
+		result = 0;
+	else if (use_except && banmatch_find(chptr, CHFL_EXCEPTION, who, ms, false) != NULL)
+		result = CHFL_EXCEPTION;	/* theyre exempted.. */
+	else
+		result = CHFL_BAN;
 
 	/* cache the banned/not banned status */
-	if(msptr != NULL)
+	if (msptr != NULL)
 	{
 		msptr->bants = chptr->bants;
 
-		if(actualBan != NULL)
-		{
+		if (result == CHFL_BAN)
 			msptr->flags |= CHFL_BANNED;
-			return CHFL_BAN;
-		}
 		else
-		{
 			msptr->flags &= ~CHFL_BANNED;
-			return 0;
-		}
+
+		return result;
 	}
 
-	if (actualBan && actualBan->forward && forward)
+	if (result == CHFL_BAN && actualBan->forward && forward)
 		*forward = actualBan->forward;
 
-	return ((actualBan ? CHFL_BAN : 0));
+	if (cacheable)
+	{
+		chptr->last_checked_id = bancache_id(who);
+		chptr->last_checked_bants = chptr->bants;
+		chptr->last_checked_type = cache_type;
+		chptr->last_checked_result = result;
+		chptr->last_checked_forward = result == CHFL_BAN ? actualBan->forward : NULL;
+	}
+
+	return result;
 }
 
 /* is_banned()
@@ -638,22 +835,7 @@ int
 is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr,
 	  const struct matchset *ms, const char **forward)
 {
-#if 0
-	if (chptr->last_checked_client != NULL &&
-		who == chptr->last_checked_client &&
-		chptr->last_checked_type == CHFL_BAN &&
-		chptr->last_checked_ts > chptr->bants)
-		return chptr->last_checked_result;
-
-	chptr->last_checked_client = who;
-	chptr->last_checked_type = CHFL_BAN;
-	chptr->last_checked_result = is_banned_list(chptr, &chptr->banlist, who, msptr, s, s2, forward);
-	chptr->last_checked_ts = rb_current_time();
-
-	return chptr->last_checked_result;
-#else
-	return is_banned_list(chptr, &chptr->banlist, who, msptr, ms, forward);
-#endif
+	return is_banned_list(chptr, CHFL_BAN, who, msptr, ms, forward);
 }
 
 /* is_quieted()
@@ -667,22 +849,7 @@ int
 is_quieted(struct Channel *chptr, struct Client *who, struct membership *msptr,
 	   const struct matchset *ms)
 {
-#if 0
-	if (chptr->last_checked_client != NULL &&
-		who == chptr->last_checked_client &&
-		chptr->last_checked_type == CHFL_QUIET &&
-		chptr->last_checked_ts > chptr->bants)
-		return chptr->last_checked_result;
-
-	chptr->last_checked_client = who;
-	chptr->last_checked_type = CHFL_QUIET;
-	chptr->last_checked_result = is_banned_list(chptr, &chptr->quietlist, who, msptr, s, s2, NULL);
-	chptr->last_checked_ts = rb_current_time();
-
-	return chptr->last_checked_result;
-#else
-	return is_banned_list(chptr, &chptr->quietlist, who, msptr, ms, NULL);
-#endif
+	return is_banned_list(chptr, CHFL_QUIET, who, msptr, ms, NULL);
 }
 
 /* can_join()
@@ -696,8 +863,6 @@ int
 can_join(struct Client *source_p, struct Channel *chptr, const char *key, const char **forward)
 {
 	rb_dlink_node *invite = NULL;
-	rb_dlink_node *ptr;
-	struct Ban *invex = NULL;
 	struct matchset ms;
 	int i = 0;
 	hook_data_channel moduledata;
@@ -737,14 +902,7 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 		{
 			if(!ConfigChannel.use_invex)
 				moduledata.approved = ERR_INVITEONLYCHAN;
-			RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
-			{
-				invex = ptr->data;
-				if (matches_mask(&ms, invex->banstr) ||
-						match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
-					break;
-			}
-			if(ptr == NULL)
+			if(banmatch_find(chptr, CHFL_INVEX, source_p, &ms, false) == NULL)
 				moduledata.approved = ERR_INVITEONLYCHAN;
 		}
 	}
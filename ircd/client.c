@@ -69,6 +69,8 @@ static int exit_local_server(struct Client *, struct Client *, struct Client *,c
 static int qs_server(struct Client *, struct Client *, struct Client *, const char *comment);
 
 static EVH check_pings;
+static EVH ban_check;
+static void ban_check_exit_client(struct Client *);
 
 static rb_bh *client_heap = NULL;
 static rb_bh *lclient_heap = NULL;
@@ -119,6 +121,7 @@ init_client(void)
 	rb_event_addish("free_exited_clients", &free_exited_clients, NULL, 4);
 	rb_event_addish("exit_aborted_clients", exit_aborted_clients, NULL, 1);
 	rb_event_add("flood_recalc", flood_recalc, NULL, 1);
+	rb_event_add("ban_check", ban_check, NULL, 1);
 
 	nd_dict = rb_dictionary_create("nickdelay", irccmp);
 }
@@ -285,6 +288,7 @@ free_local_client(struct Client *client_p)
 	}
 
 	client_release_connids(client_p);
+	send_cancel_deferred(client_p);
 	if(client_p->localClient->F != NULL)
 	{
 		rb_close(client_p->localClient->F);
@@ -303,10 +307,18 @@ free_local_client(struct Client *client_p)
 	rb_free(client_p->localClient->mangledhost);
 
 	if (IsSSL(client_p))
+	{
+		ssld_handshake_done(client_p);
 		ssld_decrement_clicount(client_p->localClient->ssl_ctl);
+	}
 
 	rb_free(client_p->localClient->cipher_string);
 
+	if (client_p->localClient->z_ctl != NULL)
+		ssld_decrement_clicount(client_p->localClient->z_ctl);
+	rb_free(client_p->localClient->zipstats);
+	burst_cancel(client_p);
+
 	if (client_p->localClient->ws_ctl != NULL)
 		wsockd_decrement_clicount(client_p->localClient->ws_ctl);
 
@@ -504,18 +516,78 @@ notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int ban)
 }
 
 /*
- * check_banned_lines
+ * Ban enforcement on local clients
+ *
+ * New or changed bans are queued by check_banned_lines(), check_klines(),
+ * check_dlines(), check_xlines() and check_one_kline(), and ban_check_run()
+ * then walks lclient_list once for everything that was queued, stopping
+ * after BAN_CHECK_SLICE_USEC and picking up where it left off at the end
+ * of the next event loop pass.  The ban_check event keeps it going when
+ * the server is otherwise idle.  Work queued while a check is running
+ * waits for the next one; clients registering meanwhile have already been
+ * checked against the new bans and go on the head of lclient_list, behind
+ * the cursor.
+ */
+#define BAN_CHECK_SLICE_USEC	5000	/* per event loop pass */
+#define BAN_CHECK_CLOCK_EVERY	64	/* clients between looks at the clock */
+
+#define BAN_CHECK_DLINES	0x1
+#define BAN_CHECK_KLINES	0x2
+#define BAN_CHECK_XLINES	0x4
+
+struct ban_check_kline
+{
+	rb_dlink_node node;
+	struct ConfItem *aconf;		/* holds a reference */
+	int masktype;
+	int bits;
+	struct rb_sockaddr_storage addr;
+	struct match_prog *user_prog;
+	struct match_prog *host_prog;
+};
+
+struct ban_check_work
+{
+	unsigned int flags;
+	rb_dlink_list klines;	/* only used without BAN_CHECK_KLINES */
+};
+
+static struct ban_check_work ban_check_queued;
+static struct ban_check_work ban_check_current;
+static bool ban_check_running;
+static rb_dlink_node *ban_check_cursor;
+static unsigned int ban_check_total;
+static unsigned int ban_check_checked;
+static unsigned int ban_check_banned;
+static unsigned int ban_check_slices;
+static time_t ban_check_started;
+
+static void
+free_ban_check_klines(rb_dlink_list *list)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head)
+	{
+		struct ban_check_kline *bk = ptr->data;
+
+		rb_dlinkDelete(ptr, list);
+		match_prog_free(bk->user_prog);
+		match_prog_free(bk->host_prog);
+		deref_conf(bk->aconf);
+		rb_free(bk);
+	}
+}
+
+/* check_banned_lines
  * inputs	- NONE
  * output	- NONE
- * side effects - Check all connections for a pending k/dline against the
- * 		  client, exit the client if found.
+ * side effects - all local clients will be checked for every k/d/xline
  */
 void
 check_banned_lines(void)
 {
-	check_dlines();
-	check_klines();
-	check_xlines();
+	ban_check_queued.flags |= BAN_CHECK_DLINES | BAN_CHECK_KLINES | BAN_CHECK_XLINES;
 }
 
 /* check_klines
@@ -527,43 +599,10 @@ check_banned_lines(void)
 void
 check_klines(void)
 {
-	struct Client *client_p;
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
-	{
-		client_p = ptr->data;
-
-		if(IsMe(client_p) || !IsPerson(client_p))
-			continue;
-
-		if((aconf = find_kline(client_p)) != NULL)
-		{
-			if(IsExemptKline(client_p))
-			{
-				sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-						     "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
-						     get_client_name(client_p, HIDE_IP),
-						     aconf->user, aconf->host);
-				continue;
-			}
-
-			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-					     "Disconnecting K-Lined user %s (%s@%s)",
-					     get_client_name(client_p, HIDE_IP), aconf->user, aconf->host);
-
-			notify_banned_client(client_p, aconf, K_LINED);
-			continue;
-		}
-	}
+	ban_check_queued.flags |= BAN_CHECK_KLINES;
 }
 
-
 /* check_one_kline()
- *
- * This process needs to be kept in sync with find_kline() aka find_conf_by_address().
  *
  * inputs       - pointer to kline to check
  * outputs      -
@@ -572,166 +611,304 @@ check_klines(void)
 void
 check_one_kline(struct ConfItem *kline)
 {
-	struct Client *client_p;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
-	int masktype;
-	int bits;
-	struct rb_sockaddr_storage sockaddr;
+	struct ban_check_kline *bk;
+
+	if(ban_check_queued.flags & BAN_CHECK_KLINES)
+		return;
+
+	bk = rb_malloc(sizeof(struct ban_check_kline));
+	bk->aconf = kline;
+	kline->clients++;
+	bk->masktype = parse_netmask(kline->host, (struct sockaddr_storage *)&bk->addr, &bk->bits);
+	bk->user_prog = match_compile(kline->user);
+	bk->host_prog = match_compile(kline->host);
+	rb_dlinkAddTail(bk, &bk->node, &ban_check_queued.klines);
+}
+
+/* check_dlines()
+ *
+ * inputs       -
+ * outputs      -
+ * side effects - all clients will be checked for dlines
+ */
+void
+check_dlines(void)
+{
+	ban_check_queued.flags |= BAN_CHECK_DLINES;
+}
+
+/* check_xlines
+ *
+ * inputs       -
+ * outputs      -
+ * side effects - all clients will be checked for xlines
+ */
+void
+check_xlines(void)
+{
+	ban_check_queued.flags |= BAN_CHECK_XLINES;
+}
+
+/* This needs to be kept in sync with find_kline() aka find_conf_by_address(). */
+static bool
+kline_matches_client(struct ban_check_kline *bk, struct Client *client_p)
+{
 	struct sockaddr_in ip4;
 
-	masktype = parse_netmask(kline->host, (struct sockaddr_storage *)&sockaddr, &bits);
+	if(!match_prog(bk->user_prog, client_p->username))
+		return false;
+
+	switch (bk->masktype) {
+	case HM_IPV4:
+	case HM_IPV6:
+		if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
+				IsConfKlineSpoof(client_p->localClient->att_conf))
+			return false;
+		if (client_p->localClient->ip.ss_family == AF_INET6 && bk->addr.ss_family == AF_INET &&
+				rb_ipv4_from_ipv6((struct sockaddr_in6 *)&client_p->localClient->ip, &ip4)
+					&& comp_with_mask_sock((struct sockaddr *)&ip4, (struct sockaddr *)&bk->addr, bk->bits))
+			return true;
+		if (client_p->localClient->ip.ss_family == bk->addr.ss_family &&
+				comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip,
+					(struct sockaddr *)&bk->addr, bk->bits))
+			return true;
+		return false;
+	case HM_HOST:
+		if (match_prog(bk->host_prog, client_p->orighost))
+			return true;
+		if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
+				IsConfKlineSpoof(client_p->localClient->att_conf))
+			return false;
+		return match_prog(bk->host_prog, client_p->sockhost);
+	}
+
+	return false;
+}
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+static bool
+kline_client(struct Client *client_p, struct ConfItem *aconf)
+{
+	if(IsExemptKline(client_p))
 	{
-		int matched = 0;
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				     "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
+				     get_client_name(client_p, HIDE_IP),
+				     aconf->user, aconf->host);
+		return false;
+	}
 
-		client_p = ptr->data;
+	sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+			     "Disconnecting K-Lined user %s (%s@%s)",
+			     get_client_name(client_p, HIDE_IP), aconf->user, aconf->host);
 
-		if(IsMe(client_p) || !IsPerson(client_p))
-			continue;
+	notify_banned_client(client_p, aconf, K_LINED);
+	return true;
+}
 
-		if(!match(kline->user, client_p->username))
-			continue;
+/* checks one client against everything in the current pass,
+ * returns true if it was disconnected */
+static bool
+ban_check_client(struct Client *client_p)
+{
+	struct ConfItem *aconf;
+	rb_dlink_node *ptr;
 
-		/* match one kline */
-		switch (masktype) {
-		case HM_IPV4:
-		case HM_IPV6:
-			if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
-					IsConfKlineSpoof(client_p->localClient->att_conf))
-				break;
-			if (client_p->localClient->ip.ss_family == AF_INET6 && sockaddr.ss_family == AF_INET &&
-					rb_ipv4_from_ipv6((struct sockaddr_in6 *)&client_p->localClient->ip, &ip4)
-						&& comp_with_mask_sock((struct sockaddr *)&ip4, (struct sockaddr *)&sockaddr, bits))
-				matched = 1;
-			else if (client_p->localClient->ip.ss_family == sockaddr.ss_family &&
-					comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip,
-						(struct sockaddr *)&sockaddr, bits))
-				matched = 1;
-			break;
-		case HM_HOST:
-			if (match(kline->host, client_p->orighost))
-				matched = 1;
-			if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
-					IsConfKlineSpoof(client_p->localClient->att_conf))
-				break;
-			if (match(kline->host, client_p->sockhost))
-				matched = 1;
-			break;
-		}
+	if(IsMe(client_p) || !IsPerson(client_p))
+		return false;
 
-		if (!matched)
-			continue;
+	if(ban_check_current.flags & BAN_CHECK_DLINES &&
+			(aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL &&
+			!(aconf->status & CONF_EXEMPTDLINE))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				     "Disconnecting D-Lined user %s (%s)",
+				     get_client_name(client_p, HIDE_IP), aconf->host);
 
+		notify_banned_client(client_p, aconf, D_LINED);
+		return true;
+	}
+
+	if(ban_check_current.flags & BAN_CHECK_KLINES)
+	{
+		if((aconf = find_kline(client_p)) != NULL && kline_client(client_p, aconf))
+			return true;
+	}
+	else
+	{
+		RB_DLINK_FOREACH(ptr, ban_check_current.klines.head)
+		{
+			struct ban_check_kline *bk = ptr->data;
+
+			/* removed since it was queued */
+			if(IsIllegal(bk->aconf))
+				continue;
+
+			if(kline_matches_client(bk, client_p) && kline_client(client_p, bk->aconf))
+				return true;
+		}
+	}
+
+	if(ban_check_current.flags & BAN_CHECK_XLINES &&
+			(aconf = find_xline(client_p->info, 1)) != NULL)
+	{
 		if(IsExemptKline(client_p))
 		{
 			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-						 "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
-						 get_client_name(client_p, HIDE_IP),
-						 kline->user, kline->host);
-			continue;
+					     "XLINE over-ruled for %s, client is kline_exempt [%s]",
+					     get_client_name(client_p, HIDE_IP),
+					     aconf->host);
+			return false;
 		}
 
 		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-					 "Disconnecting K-Lined user %s (%s@%s)",
-					 get_client_name(client_p, HIDE_IP), kline->user, kline->host);
+					"Disconnecting X-Lined user %s (%s)",
+					get_client_name(client_p, HIDE_IP), aconf->host);
 
-		notify_banned_client(client_p, kline, K_LINED);
+		(void) exit_client(client_p, client_p, &me, "Bad user info");
+		return true;
 	}
-}
 
+	return false;
+}
 
-/* check_dlines()
- *
- * inputs       -
- * outputs      -
- * side effects - all clients will be checked for dlines
- */
-void
-check_dlines(void)
+static void
+start_ban_check(void)
 {
 	struct Client *client_p;
 	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
+	rb_dlink_node *ptr, *next_ptr;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
-	{
-		client_p = ptr->data;
+	ban_check_current.flags = ban_check_queued.flags;
+	ban_check_queued.flags = 0;
+	rb_dlinkMoveList(&ban_check_queued.klines, &ban_check_current.klines);
 
-		if(IsMe(client_p))
-			continue;
+	if(ban_check_current.flags & BAN_CHECK_KLINES)
+		free_ban_check_klines(&ban_check_current.klines);
 
-		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
+	/* dlines need to be checked against unknowns too, there are few
+	 * enough of those to do it straight away */
+	if(ban_check_current.flags & BAN_CHECK_DLINES)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
 		{
-			if(aconf->status & CONF_EXEMPTDLINE)
-				continue;
+			client_p = ptr->data;
 
-			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-					     "Disconnecting D-Lined user %s (%s)",
-					     get_client_name(client_p, HIDE_IP), aconf->host);
+			if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
+			{
+				if(aconf->status & CONF_EXEMPTDLINE)
+					continue;
 
-			notify_banned_client(client_p, aconf, D_LINED);
-			continue;
+				notify_banned_client(client_p, aconf, D_LINED);
+			}
 		}
 	}
 
-	/* dlines need to be checked against unknowns too */
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
-	{
-		client_p = ptr->data;
-
-		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
-		{
-			if(aconf->status & CONF_EXEMPTDLINE)
-				continue;
+	ban_check_running = true;
+	ban_check_cursor = lclient_list.head;
+	ban_check_total = rb_dlink_list_length(&lclient_list);
+	ban_check_checked = 0;
+	ban_check_banned = 0;
+	ban_check_slices = 0;
+	ban_check_started = rb_current_time();
+}
 
-			notify_banned_client(client_p, aconf, D_LINED);
-		}
-	}
+static void
+finish_ban_check(void)
+{
+	free_ban_check_klines(&ban_check_current.klines);
+	ban_check_current.flags = 0;
+	ban_check_running = false;
+
+	if(ban_check_slices > 1)
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "Finished checking %u local clients against new bans in %ld seconds, %u disconnected",
+				     ban_check_checked,
+				     (long)(rb_current_time() - ban_check_started),
+				     ban_check_banned);
 }
 
-/* check_xlines
+/* ban_check_run()
  *
- * inputs       -
- * outputs      -
- * side effects - all clients will be checked for xlines
+ * inputs	- none
+ * outputs	- none
+ * side effects - checks a slice of local clients against new bans, if any
  */
 void
-check_xlines(void)
+ban_check_run(void)
 {
-	struct Client *client_p;
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
+	struct timeval start, now;
+	unsigned int count = 0;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+	if(!ban_check_running)
 	{
-		client_p = ptr->data;
+		if(!ban_check_queued.flags && !rb_dlink_list_length(&ban_check_queued.klines))
+			return;
 
-		if(IsMe(client_p) || !IsPerson(client_p))
-			continue;
+		start_ban_check();
+	}
 
-		if((aconf = find_xline(client_p->info, 1)) != NULL)
-		{
-			if(IsExemptKline(client_p))
-			{
-				sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-						     "XLINE over-ruled for %s, client is kline_exempt [%s]",
-						     get_client_name(client_p, HIDE_IP),
-						     aconf->host);
-				continue;
-			}
+	rb_gettimeofday(&start, NULL);
 
-			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-						"Disconnecting X-Lined user %s (%s)",
-						get_client_name(client_p, HIDE_IP), aconf->host);
+	while(ban_check_cursor != NULL)
+	{
+		struct Client *client_p = ban_check_cursor->data;
 
-			(void) exit_client(client_p, client_p, &me, "Bad user info");
-			continue;
+		ban_check_cursor = ban_check_cursor->next;
+		ban_check_checked++;
+
+		if(ban_check_client(client_p))
+			ban_check_banned++;
+
+		if(++count % BAN_CHECK_CLOCK_EVERY == 0)
+		{
+			rb_gettimeofday(&now, NULL);
+			if((now.tv_sec - start.tv_sec) * 1000000 + (now.tv_usec - start.tv_usec) >= BAN_CHECK_SLICE_USEC)
+				break;
 		}
 	}
+
+	if(ban_check_slices++ == 0 && ban_check_cursor != NULL)
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "Checking %u local clients against new bans in the background",
+				     ban_check_total);
+
+	if(ban_check_cursor == NULL)
+		finish_ban_check();
+}
+
+static void
+ban_check(void *unused)
+{
+	ban_check_run();
+}
+
+/* an exiting client must not be left as the next one to check */
+static void
+ban_check_exit_client(struct Client *client_p)
+{
+	if(ban_check_cursor == &client_p->localClient->tnode)
+		ban_check_cursor = ban_check_cursor->next;
+}
+
+void
+dump_ban_check(void (*func)(char *, void *), void *ptr)
+{
+	char buf[512];
+
+	if(ban_check_running)
+		snprintf(buf, sizeof buf, "Ban check: %u of %u local clients checked, %u disconnected, %ld seconds",
+			 ban_check_checked, ban_check_total, ban_check_banned,
+			 (long)(rb_current_time() - ban_check_started));
+	else
+		rb_strlcpy(buf, "Ban check: idle", sizeof buf);
+	func(buf, ptr);
+
+	snprintf(buf, sizeof buf, "Ban check: queued%s%s%s, %lu K-lines",
+		 ban_check_queued.flags & BAN_CHECK_DLINES ? " D-lines" : "",
+		 ban_check_queued.flags & BAN_CHECK_KLINES ? " K-lines" : "",
+		 ban_check_queued.flags & BAN_CHECK_XLINES ? " X-lines" : "",
+		 rb_dlink_list_length(&ban_check_queued.klines));
+	func(buf, ptr);
 }
 
 /* resv_nick_fnc
@@ -748,10 +925,13 @@ resv_nick_fnc(const char *mask, const char *reason, int temp_time)
 	rb_dlink_node *next_ptr;
 	char *nick;
 	char note[NICKLEN+10];
+	struct match_prog *prog;
 
 	if (!ConfigFileEntry.resv_fnc)
 		return;
 
+	prog = match_compile_esc(mask);
+
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
 	{
 		client_p = ptr->data;
@@ -763,7 +943,7 @@ resv_nick_fnc(const char *mask, const char *reason, int temp_time)
 		if(IsDigit(client_p->name[0]))
 			continue;
 
-		if(match_esc(mask, client_p->name))
+		if(match_prog(prog, client_p->name))
 		{
 			nick = client_p->id;
 
@@ -820,6 +1000,8 @@ resv_nick_fnc(const char *mask, const char *reason, int temp_time)
 			rb_note(client_p->localClient->F, note);
 		}
 	}
+
+	match_prog_free(prog);
 }
 
 /*
@@ -901,6 +1083,7 @@ remove_client_from_list(struct Client *client_p)
 	if(client_p->node.prev == NULL && client_p->node.next == NULL)
 		return;
 
+	burst_unlink_client(client_p);
 	rb_dlinkDelete(&client_p->node, &global_client_list);
 
 	update_client_exit_stats(client_p);
@@ -1607,6 +1790,7 @@ exit_local_client(struct Client *client_p, struct Client *source_p, struct Clien
 	clear_monitor(source_p);
 
 	s_assert(IsPerson(source_p));
+	ban_check_exit_client(source_p);
 	rb_dlinkDelete(&source_p->localClient->tnode, &lclient_list);
 	rb_dlinkDelete(&source_p->lnode, &me.serv->users);
 
@@ -2085,6 +2269,7 @@ close_connection(struct Client *client_p)
 		ServerStats.is_ni++;
 
 	client_release_connids(client_p);
+	send_cancel_deferred(client_p);
 
 	if(client_p->localClient->F != NULL)
 	{
@@ -44,7 +44,7 @@
 #define DNS_REVERSE_IPV6	((char)'S')
 
 static void submit_dns(uint32_t uid, char type, const char *addr);
-static void submit_dns_stat(uint32_t uid);
+static void submit_dns_stat(uint32_t uid, char letter);
 
 struct dnsreq
 {
@@ -63,6 +63,7 @@ static rb_dictionary *query_dict;
 static rb_dictionary *stat_dict;
 
 rb_dlink_list nameservers;
+struct dns_cache_stats dns_cache_stats;
 
 static uint32_t query_id = 0;
 static uint32_t stat_id = 0;
@@ -180,7 +181,7 @@ lookup_ip(const char *addr, int aftype, DNSCB callback, void *data)
 }
 
 static uint32_t
-get_nameservers(DNSLISTCB callback, void *data)
+get_dns_stats(char letter, DNSLISTCB callback, void *data)
 {
 	struct dnsstatreq *req = rb_malloc(sizeof(struct dnsstatreq));
 	uint32_t qid = assign_id(&stat_id);
@@ -192,10 +193,16 @@ get_nameservers(DNSLISTCB callback, void *data)
 	req->callback = callback;
 	req->data = data;
 
-	submit_dns_stat(qid);
+	submit_dns_stat(qid, letter);
 	return (qid);
 }
 
+static uint32_t
+get_nameservers(DNSLISTCB callback, void *data)
+{
+	return get_dns_stats('D', callback, data);
+}
+
 
 void
 dns_results_callback(const char *callid, const char *status, const char *type, const char *results)
@@ -302,6 +309,29 @@ stats_results_callback(int resc, const char *resv[], int status, void *data)
 	}
 }
 
+static void
+cache_stats_callback(int resc, const char *resv[], int status, void *data)
+{
+	unsigned long *fields[] = {
+		&dns_cache_stats.entries, &dns_cache_stats.hits, &dns_cache_stats.neg_hits,
+		&dns_cache_stats.misses, &dns_cache_stats.coalesced, &dns_cache_stats.evicted,
+		&dns_cache_stats.expired,
+	};
+
+	if(status != 0 || resc < (int)ARRAY_SIZE(fields))
+		return;
+
+	for(size_t i = 0; i < ARRAY_SIZE(fields); i++)
+		*fields[i] = strtoul(resv[i], NULL, 10);
+	dns_cache_stats.updated = rb_current_time();
+}
+
+/* The answer arrives after the caller is done; STATS A shows the last one */
+void
+refresh_dns_cache_stats(void)
+{
+	(void)get_dns_stats('C', cache_stats_callback, NULL);
+}
 
 void
 init_dns(void)
@@ -309,6 +339,7 @@ init_dns(void)
 	query_dict = rb_dictionary_create("dns queries", rb_uint32cmp);
 	stat_dict = rb_dictionary_create("dns stat queries", rb_uint32cmp);
 	(void)get_nameservers(stats_results_callback, NULL);
+	refresh_dns_cache_stats();
 }
 
 void
@@ -332,12 +363,12 @@ submit_dns(uint32_t nid, char type, const char *addr)
 }
 
 static void
-submit_dns_stat(uint32_t nid)
+submit_dns_stat(uint32_t nid, char letter)
 {
 	if(authd_helper == NULL)
 	{
 		handle_dns_stat_failure(nid);
 		return;
 	}
-	rb_helper_write(authd_helper, "S %x D", nid);
+	rb_helper_write(authd_helper, "S %x %c", nid, letter);
 }
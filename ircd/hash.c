@@ -40,12 +40,59 @@
 #include "rb_radixtree.h"
 
 rb_dictionary *client_connid_tree = NULL;
-rb_radixtree *client_id_tree = NULL;
-rb_radixtree *client_name_tree = NULL;
 
 rb_radixtree *channel_tree = NULL;
 rb_radixtree *resv_tree = NULL;
-rb_radixtree *hostname_tree = NULL;
+
+/*
+ * Clients, channels and hostnames are looked up far more often than
+ * anything else, so they are kept in open addressing tables rather
+ * than radix trees: a lookup hashes the name as it is and compares it
+ * against the stored key, which was upper cased when it was added,
+ * without copying or canonicalising anything.  channel_tree is still
+ * kept for the ordered walk /list needs.
+ *
+ * Tables double when three quarters full.  Rather than rehash every
+ * entry at once, the old table is kept and a few of its slots are moved
+ * across on each add or delete; lookups check both until it is empty.
+ * Entries deleted from the old table meanwhile leave a marker behind,
+ * those in the current one are removed by shifting back the entries
+ * after them.
+ */
+#define HASH_SIZE_MIN	256
+#define HASH_MOVE	16	/* old slots moved per add or delete */
+
+struct hash_slot
+{
+	uint32_t hashv;
+	char *key;		/* NULL if the slot is free */
+	void *data;
+};
+
+struct hash_table
+{
+	const char *name;
+	bool fold;		/* keys are case insensitive */
+	struct hash_slot *slots;
+	uint32_t mask;
+	uint32_t count;
+	struct hash_slot *old;	/* being moved into slots, or NULL */
+	uint32_t old_mask;
+	uint32_t old_next;	/* first old slot not moved yet */
+	uint32_t old_count;
+};
+
+static char hash_deleted[] = "";
+#define HASH_DELETED	hash_deleted
+
+static struct hash_table client_id_hash = { "client id", false };
+static struct hash_table client_name_hash = { "client name", true };
+static struct hash_table channel_hash = { "channel", true };
+static struct hash_table hostname_hash = { "hostname", true };
+
+static struct hash_table *hash_tables[] = {
+	&client_id_hash, &client_name_hash, &channel_hash, &hostname_hash,
+};
 
 /*
  * look in whowas.c for the missing ...[WW_MAX]; entry
@@ -58,14 +105,18 @@ rb_radixtree *hostname_tree = NULL;
 void
 init_hash(void)
 {
+	size_t i;
+
 	client_connid_tree = rb_dictionary_create("client connid", rb_uint32cmp);
-	client_id_tree = rb_radixtree_create("client id", NULL);
-	client_name_tree = rb_radixtree_create("client name", irccasecanon);
 
 	channel_tree = rb_radixtree_create("channel", irccasecanon);
 	resv_tree = rb_radixtree_create("resv", irccasecanon);
 
-	hostname_tree = rb_radixtree_create("hostname", irccasecanon);
+	for(i = 0; i < ARRAY_SIZE(hash_tables); i++)
+	{
+		hash_tables[i]->slots = rb_malloc(HASH_SIZE_MIN * sizeof(struct hash_slot));
+		hash_tables[i]->mask = HASH_SIZE_MIN - 1;
+	}
 }
 
 uint32_t
@@ -128,6 +179,218 @@ fnv_hash_upper_len(const unsigned char *s, int bits, int len)
 	return h;
 }
 
+static inline uint32_t
+hash_key(const struct hash_table *table, const char *name)
+{
+	uint32_t h;
+
+	if(table->fold)
+		h = fnv_hash_upper((const unsigned char *)name, 32);
+	else
+		h = fnv_hash((const unsigned char *)name, 32);
+
+	/* the low bits pick the slot, so mix the high ones into them */
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	return h;
+}
+
+static inline bool
+hash_match(const struct hash_table *table, const char *key, const char *name)
+{
+	if(!table->fold)
+		return strcmp(key, name) == 0;
+
+	for(; *key != '\0'; key++, name++)
+	{
+		if(*key != (char)irctoupper(*name))
+			return false;
+	}
+	return *name == '\0';
+}
+
+static struct hash_slot *
+hash_lookup_slots(struct hash_slot *slots, uint32_t mask, uint32_t hashv, const struct hash_table *table, const char *name)
+{
+	uint32_t i;
+
+	for(i = hashv & mask; slots[i].key != NULL; i = (i + 1) & mask)
+	{
+		if(slots[i].hashv == hashv && slots[i].key != HASH_DELETED &&
+		   hash_match(table, slots[i].key, name))
+			return &slots[i];
+	}
+	return NULL;
+}
+
+static struct hash_slot *
+hash_lookup(struct hash_table *table, const char *name, uint32_t hashv)
+{
+	struct hash_slot *slot;
+
+	slot = hash_lookup_slots(table->slots, table->mask, hashv, table, name);
+	if(slot == NULL && table->old != NULL)
+		slot = hash_lookup_slots(table->old, table->old_mask, hashv, table, name);
+	return slot;
+}
+
+static void
+hash_insert_slot(struct hash_table *table, uint32_t hashv, char *key, void *data)
+{
+	uint32_t i;
+
+	for(i = hashv & table->mask; table->slots[i].key != NULL; i = (i + 1) & table->mask)
+		;
+
+	table->slots[i].hashv = hashv;
+	table->slots[i].key = key;
+	table->slots[i].data = data;
+	table->count++;
+}
+
+/* move up to n slots of the old table across */
+static void
+hash_move(struct hash_table *table, uint32_t n)
+{
+	struct hash_slot *slot;
+
+	while(table->old != NULL && n-- > 0)
+	{
+		slot = &table->old[table->old_next];
+		if(slot->key != NULL && slot->key != HASH_DELETED)
+		{
+			hash_insert_slot(table, slot->hashv, slot->key, slot->data);
+			table->old_count--;
+		}
+
+		if(table->old_next++ == table->old_mask)
+		{
+			rb_free(table->old);
+			table->old = NULL;
+		}
+	}
+}
+
+static void
+hash_grow(struct hash_table *table)
+{
+	/* can only happen if a table is nothing but adds */
+	hash_move(table, UINT32_MAX);
+
+	table->old = table->slots;
+	table->old_mask = table->mask;
+	table->old_next = 0;
+	table->old_count = table->count;
+
+	table->mask = table->mask * 2 + 1;
+	table->slots = rb_malloc((table->mask + 1) * sizeof(struct hash_slot));
+	table->count = 0;
+}
+
+static void *
+hash_find(struct hash_table *table, const char *name)
+{
+	struct hash_slot *slot;
+
+	slot = hash_lookup(table, name, hash_key(table, name));
+	return slot != NULL ? slot->data : NULL;
+}
+
+static void
+hash_add(struct hash_table *table, const char *name, void *data)
+{
+	uint32_t hashv = hash_key(table, name);
+	char *key;
+
+	hash_move(table, HASH_MOVE);
+
+	/* as with rb_radixtree_add(), the first entry for a name stays */
+	if(hash_lookup(table, name, hashv) != NULL)
+		return;
+
+	if((table->count + table->old_count + 1) * 4 > (table->mask + 1) * 3)
+		hash_grow(table);
+
+	key = rb_strdup(name);
+	if(table->fold)
+		irccasecanon(key);
+	hash_insert_slot(table, hashv, key, data);
+}
+
+static void
+hash_delete(struct hash_table *table, const char *name)
+{
+	struct hash_slot *slot;
+	uint32_t i, j, home;
+
+	hash_move(table, HASH_MOVE);
+
+	slot = hash_lookup(table, name, hash_key(table, name));
+	if(slot == NULL)
+		return;
+
+	rb_free(slot->key);
+
+	if(table->old != NULL && slot >= table->old && slot <= &table->old[table->old_mask])
+	{
+		slot->key = HASH_DELETED;
+		table->old_count--;
+		return;
+	}
+
+	/* shift back whatever probed past this slot */
+	i = slot - table->slots;
+	for(j = (i + 1) & table->mask; table->slots[j].key != NULL; j = (j + 1) & table->mask)
+	{
+		home = table->slots[j].hashv & table->mask;
+		if(((j - home) & table->mask) >= ((j - i) & table->mask))
+		{
+			table->slots[i] = table->slots[j];
+			i = j;
+		}
+	}
+	table->slots[i].key = NULL;
+	table->count--;
+}
+
+/* hash_stats_walk()
+ *
+ * reports the probe lengths of the lookup tables, as
+ * rb_radixtree_stats_walk() does for the trees
+ */
+void
+hash_stats_walk(void (*cb)(const char *line, void *privdata), void *privdata)
+{
+	char str[256];
+	struct hash_table *table;
+	uint32_t i, probe, sum, max, count;
+	size_t n;
+
+	for(n = 0; n < ARRAY_SIZE(hash_tables); n++)
+	{
+		table = hash_tables[n];
+		sum = max = 0;
+
+		for(i = 0; i <= table->mask; i++)
+		{
+			if(table->slots[i].key == NULL)
+				continue;
+
+			probe = ((i - table->slots[i].hashv) & table->mask) + 1;
+			sum += probe;
+			if(probe > max)
+				max = probe;
+		}
+
+		count = table->count + table->old_count;
+		snprintf(str, sizeof str, "%-30s %-15s %-10u %-10u %-10u %-10u",
+				table->name, table->old != NULL ? "HASH (GROWING)" : "HASH",
+				count, sum, table->count ? sum / table->count : 0, max);
+		cb(str, privdata);
+	}
+}
+
 /* add_to_id_hash()
  *
  * adds an entry to the id hash table
@@ -138,7 +401,7 @@ add_to_id_hash(const char *name, struct Client *client_p)
 	if(EmptyString(name) || (client_p == NULL))
 		return;
 
-	rb_radixtree_add(client_id_tree, name, client_p);
+	hash_add(&client_id_hash, name, client_p);
 }
 
 /* add_to_client_hash()
@@ -153,7 +416,7 @@ add_to_client_hash(const char *name, struct Client *client_p)
 	if(EmptyString(name) || (client_p == NULL))
 		return;
 
-	rb_radixtree_add(client_name_tree, name, client_p);
+	hash_add(&client_name_hash, name, client_p);
 }
 
 /* add_to_hostname_hash()
@@ -170,7 +433,7 @@ add_to_hostname_hash(const char *hostname, struct Client *client_p)
 	if(EmptyString(hostname) || (client_p == NULL))
 		return;
 
-	list = rb_radixtree_retrieve(hostname_tree, hostname);
+	list = hash_find(&hostname_hash, hostname);
 	if (list != NULL)
 	{
 		rb_dlinkAddAlloc(client_p, list);
@@ -178,7 +441,7 @@ add_to_hostname_hash(const char *hostname, struct Client *client_p)
 	}
 
 	list = rb_malloc(sizeof(*list));
-	rb_radixtree_add(hostname_tree, hostname, list);
+	hash_add(&hostname_hash, hostname, list);
 	rb_dlinkAddAlloc(client_p, list);
 }
 
@@ -209,7 +472,7 @@ del_from_id_hash(const char *id, struct Client *client_p)
 	if(EmptyString(id) || client_p == NULL)
 		return;
 
-	rb_radixtree_delete(client_id_tree, id);
+	hash_delete(&client_id_hash, id);
 }
 
 /* del_from_client_hash()
@@ -225,7 +488,7 @@ del_from_client_hash(const char *name, struct Client *client_p)
 	if(EmptyString(name) || client_p == NULL)
 		return;
 
-	rb_radixtree_delete(client_name_tree, name);
+	hash_delete(&client_name_hash, name);
 }
 
 /* del_from_channel_hash()
@@ -241,6 +504,7 @@ del_from_channel_hash(const char *name, struct Channel *chptr)
 	if(EmptyString(name) || chptr == NULL)
 		return;
 
+	hash_delete(&channel_hash, name);
 	rb_radixtree_delete(channel_tree, name);
 }
 
@@ -256,7 +520,7 @@ del_from_hostname_hash(const char *hostname, struct Client *client_p)
 	if(hostname == NULL || client_p == NULL)
 		return;
 
-	list = rb_radixtree_retrieve(hostname_tree, hostname);
+	list = hash_find(&hostname_hash, hostname);
 	if (list == NULL)
 		return;
 
@@ -264,7 +528,7 @@ del_from_hostname_hash(const char *hostname, struct Client *client_p)
 
 	if (rb_dlink_list_length(list) == 0)
 	{
-		rb_radixtree_delete(hostname_tree, hostname);
+		hash_delete(&hostname_hash, hostname);
 		rb_free(list);
 	}
 }
@@ -294,7 +558,7 @@ find_id(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(client_id_tree, name);
+	return hash_find(&client_id_hash, name);
 }
 
 /* find_client()
@@ -312,7 +576,7 @@ find_client(const char *name)
 	if(IsDigit(*name))
 		return (find_id(name));
 
-	return rb_radixtree_retrieve(client_name_tree, name);
+	return hash_find(&client_name_hash, name);
 }
 
 /* find_named_client()
@@ -326,7 +590,7 @@ find_named_client(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(client_name_tree, name);
+	return hash_find(&client_name_hash, name);
 }
 
 /* find_server()
@@ -348,7 +612,7 @@ find_server(struct Client *source_p, const char *name)
       		return(target_p);
 	}
 
-	target_p = rb_radixtree_retrieve(client_name_tree, name);
+	target_p = hash_find(&client_name_hash, name);
 	if (target_p != NULL)
 	{
 		if(IsServer(target_p) || IsMe(target_p))
@@ -372,7 +636,7 @@ find_hostname(const char *hostname)
 	if(EmptyString(hostname))
 		return NULL;
 
-	hlist = rb_radixtree_retrieve(hostname_tree, hostname);
+	hlist = hash_find(&hostname_hash, hostname);
 	if (hlist == NULL)
 		return NULL;
 
@@ -390,7 +654,7 @@ find_channel(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(channel_tree, name);
+	return hash_find(&channel_hash, name);
 }
 
 /*
@@ -430,7 +694,7 @@ get_or_create_channel(struct Client *client_p, const char *chname, bool *isnew)
 		s = t;
 	}
 
-	chptr = rb_radixtree_retrieve(channel_tree, s);
+	chptr = hash_find(&channel_hash, s);
 	if (chptr != NULL)
 	{
 		if (isnew != NULL)
@@ -445,6 +709,7 @@ get_or_create_channel(struct Client *client_p, const char *chname, bool *isnew)
 	chptr->channelts = rb_current_time();	/* doesn't hurt to set it here */
 
 	rb_dlinkAdd(chptr, &chptr->node, &global_channel_list);
+	hash_add(&channel_hash, chptr->chname, chptr);
 	rb_radixtree_add(channel_tree, chptr->chname, chptr);
 
 	return chptr;
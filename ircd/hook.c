@@ -37,6 +37,7 @@
 #include "stdinc.h"
 #include "hook.h"
 #include "match.h"
+#include "s_conf.h"
 
 hook *hooks;
 
@@ -47,6 +48,7 @@ struct hook_entry
 	rb_dlink_node node;
 	hookfn fn;
 	enum hook_priority priority;
+	struct hook_fn_stats stats;
 };
 
 int num_hooks = 0;
@@ -195,7 +197,7 @@ void
 add_hook_prio(const char *name, hookfn fn, enum hook_priority priority)
 {
 	rb_dlink_node *ptr;
-	struct hook_entry *entry = rb_malloc(sizeof *entry);
+	struct hook_entry *entry = rb_malloc(sizeof *entry);	/* zeroes stats */
 	int i;
 
 	i = register_hook(name);
@@ -252,7 +254,71 @@ call_hook(int id, void *arg)
 	RB_DLINK_FOREACH(ptr, hooks[id].hooks.head)
 	{
 		struct hook_entry *entry = ptr->data;
+		struct timespec start, end;
+		unsigned long long ns;
+
+		entry->stats.count++;
+
+		if(!ConfigFileEntry.command_timing)
+		{
+			entry->fn(arg);
+			continue;
+		}
+
+		/* entries are never freed, so this is safe even if fn
+		 * removes itself
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &start);
 		entry->fn(arg);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+		entry->stats.total_ns += ns;
+		if(ns > entry->stats.max_ns)
+			entry->stats.max_ns = ns;
+	}
+}
+
+/* hook_stats_walk()
+ *   Calls cb for every function on every event, with its call counts
+ *   and times.
+ */
+void
+hook_stats_walk(void (*cb)(const char *name, hookfn fn, const struct hook_fn_stats *stats,
+		void *privdata), void *privdata)
+{
+	rb_dlink_node *ptr;
+	int i;
+
+	for(i = 0; i < max_hooks; i++)
+	{
+		if(!hooks[i].name)
+			continue;
+
+		RB_DLINK_FOREACH(ptr, hooks[i].hooks.head)
+		{
+			struct hook_entry *entry = ptr->data;
+			cb(hooks[i].name, entry->fn, &entry->stats, privdata);
+		}
+	}
+}
+
+/* hook_stats_reset()
+ *   Clears the call counts and times of every hook function.
+ */
+void
+hook_stats_reset(void)
+{
+	rb_dlink_node *ptr;
+	int i;
+
+	for(i = 0; i < max_hooks; i++)
+	{
+		RB_DLINK_FOREACH(ptr, hooks[i].hooks.head)
+		{
+			struct hook_entry *entry = ptr->data;
+			memset(&entry->stats, 0, sizeof(entry->stats));
+		}
 	}
 }
 
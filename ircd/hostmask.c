@@ -129,12 +129,121 @@ int parse_netmask_strict(const char *mask, struct rb_sockaddr_storage *addr, int
 /* Hashtable stuff...now external as its used in m_stats.c */
 struct AddressRec *atable[ATABLE_SIZE];
 
+/*
+ * IP masks are also kept in a patricia tree per type and address family,
+ * each node holding the records for its prefix, so a lookup only looks at
+ * the masks containing the address: they are all on the path from the
+ * longest matching prefix up to the root.  /0 masks can't go in the
+ * tree and are kept on a list of their own.
+ */
+#define ATREE_TYPES	6
+
+struct atree
+{
+	rb_patricia_tree_t *tree;
+	struct AddressRec *any;
+};
+
+static struct atree atree[ATREE_TYPES][2];
+
+static struct atree *
+get_atree(int type, int masktype)
+{
+	int i;
+
+	switch(type & ~0x1)
+	{
+	case CONF_CLIENT:
+		i = 0;
+		break;
+	case CONF_KILL:
+		i = 1;
+		break;
+	case CONF_DLINE:
+		i = 2;
+		break;
+	case CONF_EXEMPTDLINE:
+		i = 3;
+		break;
+	case CONF_SECURE:
+		i = 4;
+		break;
+	default:
+		i = 5;
+		break;
+	}
+
+	return &atree[i][masktype == HM_IPV6];
+}
+
 void
 init_host_hash(void)
 {
 	memset(&atable, 0, sizeof(atable));
 }
 
+static void
+atree_add(struct AddressRec *arec)
+{
+	struct atree *at = get_atree(arec->type, arec->masktype);
+	rb_patricia_node_t *pnode = NULL;
+
+	if(arec->Mask.ipa.bits > 0)
+	{
+		if(at->tree == NULL)
+			at->tree = rb_new_patricia(PATRICIA_BITS);
+
+		pnode = make_and_lookup_ip(at->tree, (struct sockaddr *)&arec->Mask.ipa.addr,
+				arec->Mask.ipa.bits);
+	}
+
+	if(pnode != NULL)
+	{
+		arec->tnext = pnode->data;
+		pnode->data = arec;
+	}
+	else
+	{
+		arec->tnext = at->any;
+		at->any = arec;
+	}
+}
+
+static bool
+unlink_tnext(struct AddressRec **head, struct AddressRec *arec)
+{
+	for(; *head != NULL; head = &(*head)->tnext)
+	{
+		if(*head == arec)
+		{
+			*head = arec->tnext;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void
+atree_delete(struct AddressRec *arec)
+{
+	struct atree *at = get_atree(arec->type, arec->masktype);
+	rb_patricia_node_t *pnode = NULL;
+
+	if(at->tree != NULL && arec->Mask.ipa.bits > 0)
+		pnode = rb_match_ip_exact(at->tree, (struct sockaddr *)&arec->Mask.ipa.addr,
+				arec->Mask.ipa.bits);
+
+	if(pnode != NULL && unlink_tnext((struct AddressRec **)&pnode->data, arec))
+	{
+		if(pnode->data == NULL)
+			rb_patricia_remove(at->tree, pnode);
+		return;
+	}
+
+	unlink_tnext(&at->any, arec);
+}
+
 /* unsigned long hash_ipv4(struct rb_sockaddr_storage*)
  * Input: An IP address.
  * Output: A hash value of the IP address.
@@ -220,6 +329,47 @@ get_mask_hash(const char *text)
 	return hash_text(text);
 }
 
+static void
+find_ip_conf_chain(struct AddressRec *arec, struct sockaddr *addr, int type,
+		const char *username, const char *auth_user,
+		unsigned long *hprecv, struct ConfItem **hprec)
+{
+	for (; arec; arec = arec->tnext)
+		if(arec->type == (type & ~0x1) &&
+		   arec->precedence > *hprecv &&
+		   comp_with_mask_sock(addr, (struct sockaddr *)&arec->Mask.ipa.addr,
+				       arec->Mask.ipa.bits) &&
+			(type & 0x1 || match_prog(arec->user_prog, username)) &&
+			(type != CONF_CLIENT || !arec->auth_user ||
+			(auth_user && match(arec->auth_user, auth_user))))
+		{
+			*hprecv = arec->precedence;
+			*hprec = arec->aconf;
+		}
+}
+
+static void
+find_ip_conf(struct atree *at, struct sockaddr *addr, int type,
+		const char *username, const char *auth_user,
+		unsigned long *hprecv, struct ConfItem **hprec)
+{
+	rb_patricia_node_t *pnode;
+
+	if(at->tree != NULL)
+	{
+		for(pnode = rb_match_ip(at->tree, addr); pnode != NULL; pnode = pnode->parent)
+		{
+			if(pnode->prefix == NULL)
+				continue;
+
+			find_ip_conf_chain(pnode->data, addr, type, username, auth_user,
+					hprecv, hprec);
+		}
+	}
+
+	find_ip_conf_chain(at->any, addr, type, username, auth_user, hprecv, hprec);
+}
+
 /* struct ConfItem* find_conf_by_address(const char*, struct rb_sockaddr_storage*,
  *         int type, int fam, const char *username)
  *
@@ -242,7 +392,6 @@ find_conf_by_address(const char *name, const char *sockhost,
 	struct AddressRec *arec;
 	struct sockaddr_in ip4;
 	struct sockaddr *pip4 = NULL;
-	int b;
 
 	if(username == NULL)
 		username = "";
@@ -257,43 +406,13 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if (type == CONF_KILL && rb_ipv4_from_ipv6((struct sockaddr_in6 *)addr, &ip4))
 				pip4 = (struct sockaddr *)&ip4;
 
-			for (b = 128; b >= 0; b -= 16)
-			{
-				for (arec = atable[hash_ipv6(addr, b)]; arec; arec = arec->next)
-					if(arec->type == (type & ~0x1) &&
-					   arec->masktype == HM_IPV6 &&
-					   comp_with_mask_sock(addr, (struct sockaddr *)&arec->Mask.ipa.addr,
-						arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec-> username, username)) &&
-						(type != CONF_CLIENT || !arec->auth_user ||
-						(auth_user && match(arec->auth_user, auth_user))) &&
-						arec->precedence > hprecv)
-					{
-						hprecv = arec->precedence;
-						hprec = arec->aconf;
-					}
-			}
+			find_ip_conf(get_atree(type, HM_IPV6), addr, type, username, auth_user,
+					&hprecv, &hprec);
 		}
 
 		if (pip4 != NULL)
-		{
-			for (b = 32; b >= 0; b -= 8)
-			{
-				for (arec = atable[hash_ipv4(pip4, b)]; arec; arec = arec->next)
-					if(arec->type == (type & ~0x1) &&
-					   arec->masktype == HM_IPV4 &&
-					   comp_with_mask_sock(pip4, (struct sockaddr *)&arec->Mask.ipa.addr,
-							       arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec->username, username)) &&
-						(type != CONF_CLIENT || !arec->auth_user ||
-						(auth_user && match(arec->auth_user, auth_user))) &&
-						arec->precedence > hprecv)
-					{
-						hprecv = arec->precedence;
-						hprec = arec->aconf;
-					}
-			}
-		}
+			find_ip_conf(get_atree(type, HM_IPV4), pip4, type, username, auth_user,
+					&hprecv, &hprec);
 	}
 
 	if(orighost != NULL)
@@ -307,10 +426,10 @@ find_conf_by_address(const char *name, const char *sockhost,
 				if((arec->type == (type & ~0x1)) &&
 				   (arec->masktype == HM_HOST) &&
 				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, orighost) &&
+				   match_prog(arec->host_prog, orighost) &&
 				   (type != CONF_CLIENT || !arec->auth_user ||
 				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
+				   (type & 0x1 || match_prog(arec->user_prog, username)))
 				{
 					hprecv = arec->precedence;
 					hprec = arec->aconf;
@@ -326,11 +445,11 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if(arec->type == (type & ~0x1) &&
 			   arec->masktype == HM_HOST &&
 			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, orighost) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
+			   (match_prog(arec->host_prog, orighost) ||
+			    (sockhost && match_prog(arec->host_prog, sockhost))) &&
 			    (type != CONF_CLIENT || !arec->auth_user ||
 			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
+			   (type & 0x1 || match_prog(arec->user_prog, username)))
 			{
 				hprecv = arec->precedence;
 				hprec = arec->aconf;
@@ -349,10 +468,10 @@ find_conf_by_address(const char *name, const char *sockhost,
 				if((arec->type == (type & ~0x1)) &&
 				   (arec->masktype == HM_HOST) &&
 				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, name) &&
+				   match_prog(arec->host_prog, name) &&
 				   (type != CONF_CLIENT || !arec->auth_user ||
 				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
+				   (type & 0x1 || match_prog(arec->user_prog, username)))
 				{
 					hprecv = arec->precedence;
 					hprec = arec->aconf;
@@ -368,11 +487,11 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if(arec->type == (type & ~0x1) &&
 			   arec->masktype == HM_HOST &&
 			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, name) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
+			   (match_prog(arec->host_prog, name) ||
+			    (sockhost && match_prog(arec->host_prog, sockhost))) &&
 			    (type != CONF_CLIENT || !arec->auth_user ||
 			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
+			   (type & 0x1 || match_prog(arec->user_prog, username)))
 			{
 				hprecv = arec->precedence;
 				hprec = arec->aconf;
@@ -576,14 +695,27 @@ add_conf_by_address(const char *address, int type, const char *username, const c
 	else
 	{
 		arec->Mask.hostname = address;
+		arec->host_prog = match_compile(address);
 		arec->next = atable[(hv = get_mask_hash(address))];
 		atable[hv] = arec;
 	}
 	arec->username = username;
+	arec->user_prog = match_compile(username != NULL ? username : "");
 	arec->auth_user = auth_user;
 	arec->aconf = aconf;
 	arec->precedence = prec_value--;
 	arec->type = type;
+
+	if(arec->masktype != HM_HOST)
+		atree_add(arec);
+}
+
+static void
+free_address_rec(struct AddressRec *arec)
+{
+	match_prog_free(arec->host_prog);
+	match_prog_free(arec->user_prog);
+	rb_free(arec);
 }
 
 /* void delete_one_address(const char*, struct ConfItem*)
@@ -622,10 +754,12 @@ delete_one_address_conf(const char *address, struct ConfItem *aconf)
 				arecl->next = arec->next;
 			else
 				atable[hv] = arec->next;
+			if(arec->masktype != HM_HOST)
+				atree_delete(arec);
 			aconf->status |= CONF_ILLEGAL;
 			if(!aconf->clients)
 				free_conf(aconf);
-			rb_free(arec);
+			free_address_rec(arec);
 			return;
 		}
 		arecl = arec;
@@ -668,10 +802,12 @@ clear_out_address_conf(enum aconf_category clear_type)
 			}
 			else
 			{
+				if(arec->masktype != HM_HOST)
+					atree_delete(arec);
 				arec->aconf->status |= CONF_ILLEGAL;
 				if(!arec->aconf->clients)
 					free_conf(arec->aconf);
-				rb_free(arec);
+				free_address_rec(arec);
 			}
 		}
 		*store_next = NULL;
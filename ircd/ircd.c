@@ -180,6 +180,9 @@ ircd_shutdown(const char *reason)
 			me.name, reason);
 	}
 
+	/* the loop hook won't get another chance to write these */
+	send_deferred_flush();
+
 	ilog(L_MAIN, "Server Terminating. %s", reason);
 	close_logfiles();
 
@@ -517,6 +520,133 @@ seed_random(void *unused)
 	srand(seed);
 }
 
+/*
+ * cleanup_blockheaps
+ *
+ * Hands blocks that have been completely freed (e.g. after a connect
+ * storm or netsplit) back to the operating system.
+ */
+static void
+cleanup_blockheaps(void *unused)
+{
+	rb_bh_cleanup_all();
+}
+
+static struct ev_entry *loop_stats_ev;
+static struct rb_loop_stats loop_stats_last;
+
+/*
+ * log_loop_stats
+ *
+ * Logs how busy the event loop has been since it last ran, for
+ * general::loop_stats_interval.
+ */
+static void
+log_loop_stats(void *unused)
+{
+	struct rb_loop_stats st, *last = &loop_stats_last;
+	unsigned long long passes, busy, io, timers, hook, total;
+	unsigned long seen = 0, p99_count;
+	int p99;
+
+	rb_get_loop_stats(&st);
+	passes = st.passes - last->passes;
+	io = st.io_ns - last->io_ns;
+	timers = st.timer_ns - last->timer_ns;
+	hook = st.hook_ns - last->hook_ns;
+	busy = io + timers + hook;
+	total = busy + st.wait_ns - last->wait_ns;
+
+	if(passes == 0 || total == 0)
+		return;
+
+	/* upper bound of the bucket holding the 99th percentile pass */
+	p99_count = passes - passes / 100;
+	for(p99 = 0; p99 < RB_LOOP_BUCKETS - 1; p99++)
+	{
+		seen += st.buckets[p99] - last->buckets[p99];
+		if(seen >= p99_count)
+			break;
+	}
+
+	ilog(L_MAIN, "Event loop: %llu passes, busy %llu%% (fds %llu%%, timers %llu%%, flush %llu%%), "
+	     "%llu us per pass, 99%% %s %u us, %llu.%02llu fds ready per pass, %lu slow",
+	     passes, busy * 100 / total, io * 100 / total, timers * 100 / total, hook * 100 / total,
+	     busy / passes / 1000, p99 == RB_LOOP_BUCKETS - 1 ? "over" : "under",
+	     16U << (p99 == RB_LOOP_BUCKETS - 1 ? p99 - 1 : p99),
+	     (st.ready - last->ready) / passes, (st.ready - last->ready) * 100 / passes % 100,
+	     st.slow - last->slow);
+
+	*last = st;
+}
+
+/*
+ * end_loop_pass
+ *
+ * Runs at the end of each pass through the event loop: moves any ban
+ * check along, then writes out the deferred sendqs, its notices among them.
+ */
+static void
+end_loop_pass(void)
+{
+	ban_check_run();
+	send_deferred_flush();
+}
+
+/*
+ * slow_loop_pass
+ *
+ * Logs a pass through the event loop longer than general::slow_loop_pass,
+ * and what it spent the time on, at most once a second.
+ */
+static void
+slow_loop_pass(const struct rb_loop_pass *pass)
+{
+	static time_t last_logged;
+	static unsigned long suppressed;
+	char more[48] = "";
+
+	if(last_logged == rb_current_time())
+	{
+		suppressed++;
+		return;
+	}
+	last_logged = rb_current_time();
+
+	if(suppressed > 0)
+		snprintf(more, sizeof(more), "; %lu more not logged", suppressed);
+
+	ilog(L_MAIN, "Slow event loop pass: %llu ms (fds %llu ms, timers %llu ms, flush %llu ms, "
+	     "%lu fds ready), longest was %s at %llu ms%s",
+	     pass->pass_ns / 1000000, pass->io_ns / 1000000, pass->timer_ns / 1000000,
+	     pass->hook_ns / 1000000, pass->ready,
+	     pass->culprit != NULL ? pass->culprit : "nothing in particular",
+	     pass->culprit_ns / 1000000, more);
+	suppressed = 0;
+}
+
+/*
+ * update_loop_stats
+ *
+ * Applies general::slow_loop_pass and general::loop_stats_interval
+ * after the config is read.
+ */
+void
+update_loop_stats(void)
+{
+	rb_set_loop_slow(ConfigFileEntry.slow_loop_pass, slow_loop_pass);
+
+	rb_event_delete(loop_stats_ev);
+	loop_stats_ev = NULL;
+
+	if(ConfigFileEntry.loop_stats_interval > 0)
+	{
+		rb_get_loop_stats(&loop_stats_last);
+		loop_stats_ev = rb_event_add("log_loop_stats", log_loop_stats, NULL,
+					     ConfigFileEntry.loop_stats_interval);
+	}
+}
+
 /*
  * main
  *
@@ -751,6 +881,7 @@ solanum_main(int argc, char * const argv[])
 	rb_event_addonce("try_connections_startup", try_connections, NULL, 2);
 	rb_event_add("check_rehash", check_rehash, NULL, 3);
 	rb_event_addish("reseed_srand", seed_random, NULL, 300); /* reseed every 10 minutes */
+	rb_event_addish("cleanup_blockheaps", cleanup_blockheaps, NULL, 300);
 
 	if(splitmode)
 		check_splitmode_ev = rb_event_add("check_splitmode", check_splitmode, NULL, 5);
@@ -759,6 +890,7 @@ solanum_main(int argc, char * const argv[])
 		inotice("now running in foreground mode from %s as pid %ld ...",
 		        ConfigFileEntry.dpath, (long)getpid());
 
+	rb_set_loop_hook(end_loop_pass);
 	rb_lib_loop(0);
 
 	return 0;
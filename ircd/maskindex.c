@@ -0,0 +1,350 @@
+/*
+ *  Solanum: a slightly advanced ircd
+ *  maskindex.c: index of match_esc() masks (X-lines, nick RESVs)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "maskindex.h"
+#include "match.h"
+#include "s_conf.h"
+#include "s_assert.h"
+
+/*
+ * Outside of a '\\' escape, match_esc() only lets '*', '?', '@' and '#'
+ * stand for something other than themselves, and every other mask
+ * character has to be matched by the same character (ignoring case).  So
+ * a run of such characters in a mask has to appear in any string the
+ * mask matches, and so does every MASKINDEX_GRAM long piece of it.
+ *
+ * Entries found through the hashes are only candidates and are
+ * confirmed with match_prog(), except for masks without any special
+ * characters, which only match themselves.
+ */
+
+#define MASKINDEX_GRAM		3
+#define MASKINDEX_MIN_TABLE	256
+
+struct mask_index_entry
+{
+	struct ConfItem *aconf;
+	rb_dlink_node *node;		/* caller's list node */
+	unsigned long serial;		/* higher is newer */
+	unsigned long seen;		/* last lookup that checked us */
+	uint32_t maskhash;
+	uint32_t gramhash;
+	char gram[MASKINDEX_GRAM];	/* folded, if indexed */
+	bool literal;
+	bool indexed;
+	rb_dlink_node masknode;
+	rb_dlink_node gramnode;		/* in grams[] or unindexed */
+};
+
+struct mask_index
+{
+	/* both tables are the same size, mask is size - 1 */
+	rb_dlink_list *masks;
+	rb_dlink_list *grams;
+	unsigned int mask;
+
+	rb_dlink_list unindexed;
+	unsigned int count;
+
+	unsigned long serial;
+	unsigned long generation;
+
+	unsigned long lookups;
+	unsigned long checked;
+	unsigned long skipped;
+};
+
+static uint32_t
+fold_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while(len--)
+	{
+		h ^= irctolower(*s++);
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static bool
+is_literal(const char *mask)
+{
+	return strpbrk(mask, "*?@#\\") == NULL;
+}
+
+struct mask_index *
+mask_index_create(void)
+{
+	struct mask_index *idx = rb_malloc(sizeof(struct mask_index));
+
+	idx->masks = rb_malloc(sizeof(rb_dlink_list) * MASKINDEX_MIN_TABLE);
+	idx->grams = rb_malloc(sizeof(rb_dlink_list) * MASKINDEX_MIN_TABLE);
+	idx->mask = MASKINDEX_MIN_TABLE - 1;
+
+	return idx;
+}
+
+static void
+grow_tables(struct mask_index *idx)
+{
+	unsigned int size = (idx->mask + 1) * 2;
+	rb_dlink_list *masks = rb_malloc(sizeof(rb_dlink_list) * size);
+	rb_dlink_list *grams = rb_malloc(sizeof(rb_dlink_list) * size);
+	rb_dlink_node *ptr, *next_ptr;
+	unsigned int i;
+
+	for(i = 0; i <= idx->mask; i++)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, idx->masks[i].head)
+		{
+			struct mask_index_entry *entry = ptr->data;
+
+			rb_dlinkMoveNode(ptr, &idx->masks[i], &masks[entry->maskhash & (size - 1)]);
+		}
+
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, idx->grams[i].head)
+		{
+			struct mask_index_entry *entry = ptr->data;
+
+			rb_dlinkMoveNode(ptr, &idx->grams[i], &grams[entry->gramhash & (size - 1)]);
+		}
+	}
+
+	rb_free(idx->masks);
+	rb_free(idx->grams);
+	idx->masks = masks;
+	idx->grams = grams;
+	idx->mask = size - 1;
+}
+
+/* pick the piece of the mask's literal runs with the fewest entries
+ * already filed under its bucket */
+static bool
+choose_gram(struct mask_index *idx, struct mask_index_entry *entry, const char *mask)
+{
+	const char *run = NULL;
+	unsigned long best_len = ULONG_MAX;
+	const char *p;
+
+	for(p = mask;; p++)
+	{
+		if(*p != '\0' && *p != '\\' && !strchr("*?@#", *p))
+		{
+			if(run == NULL)
+				run = p;
+
+			if(p - run + 1 >= MASKINDEX_GRAM)
+			{
+				const char *start = p - MASKINDEX_GRAM + 1;
+				uint32_t h = fold_hash(start, MASKINDEX_GRAM);
+				unsigned long len = rb_dlink_list_length(&idx->grams[h & idx->mask]);
+
+				if(len < best_len)
+				{
+					int i;
+
+					best_len = len;
+					entry->gramhash = h;
+					for(i = 0; i < MASKINDEX_GRAM; i++)
+						entry->gram[i] = irctolower(start[i]);
+				}
+			}
+			continue;
+		}
+
+		run = NULL;
+
+		if(*p == '\0')
+			break;
+
+		/* the escaped character never starts or extends a run */
+		if(*p == '\\' && *++p == '\0')
+			break;
+	}
+
+	return best_len != ULONG_MAX;
+}
+
+void
+mask_index_add(struct mask_index *idx, struct ConfItem *aconf, rb_dlink_node *node)
+{
+	struct mask_index_entry *entry;
+
+	if(idx->count > idx->mask)
+		grow_tables(idx);
+
+	entry = rb_malloc(sizeof(struct mask_index_entry));
+	entry->aconf = aconf;
+	entry->node = node;
+	entry->serial = ++idx->serial;
+	entry->maskhash = fold_hash(aconf->host, strlen(aconf->host));
+	entry->literal = is_literal(aconf->host);
+
+	rb_dlinkAdd(entry, &entry->masknode, &idx->masks[entry->maskhash & idx->mask]);
+
+	if(!entry->literal)
+	{
+		entry->indexed = choose_gram(idx, entry, aconf->host);
+
+		if(entry->indexed)
+			rb_dlinkAdd(entry, &entry->gramnode, &idx->grams[entry->gramhash & idx->mask]);
+		else
+			rb_dlinkAdd(entry, &entry->gramnode, &idx->unindexed);
+	}
+
+	idx->count++;
+}
+
+rb_dlink_node *
+mask_index_delete(struct mask_index *idx, struct ConfItem *aconf)
+{
+	uint32_t h = fold_hash(aconf->host, strlen(aconf->host));
+	rb_dlink_list *bucket = &idx->masks[h & idx->mask];
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, bucket->head)
+	{
+		struct mask_index_entry *entry = ptr->data;
+		rb_dlink_node *node;
+
+		if(entry->aconf != aconf)
+			continue;
+
+		rb_dlinkDelete(&entry->masknode, bucket);
+
+		if(entry->indexed)
+			rb_dlinkDelete(&entry->gramnode, &idx->grams[entry->gramhash & idx->mask]);
+		else if(!entry->literal)
+			rb_dlinkDelete(&entry->gramnode, &idx->unindexed);
+
+		node = entry->node;
+		rb_free(entry);
+		idx->count--;
+		return node;
+	}
+
+	s_assert(0);
+	return NULL;
+}
+
+static void
+check_entry(struct mask_index *idx, struct mask_index_entry *entry,
+		const char *name, struct mask_index_entry **best)
+{
+	if(entry->seen == idx->generation)
+		return;
+
+	entry->seen = idx->generation;
+
+	/* an older match could not be returned anyway */
+	if(*best != NULL && entry->serial < (*best)->serial)
+		return;
+
+	idx->checked++;
+
+	if(match_prog(conf_host_prog(entry->aconf), name))
+		*best = entry;
+}
+
+struct ConfItem *
+mask_index_find(struct mask_index *idx, const char *name)
+{
+	struct mask_index_entry *best = NULL;
+	unsigned long checked = idx->checked;
+	size_t len = strlen(name);
+	rb_dlink_node *ptr;
+	size_t i;
+
+	idx->lookups++;
+	idx->generation++;
+
+	RB_DLINK_FOREACH(ptr, idx->masks[fold_hash(name, len) & idx->mask].head)
+	{
+		struct mask_index_entry *entry = ptr->data;
+
+		if(!entry->literal || (best != NULL && entry->serial < best->serial))
+			continue;
+
+		idx->checked++;
+
+		if(!irccmp(entry->aconf->host, name))
+			best = entry;
+	}
+
+	for(i = 0; i + MASKINDEX_GRAM <= len; i++)
+	{
+		char gram[MASKINDEX_GRAM];
+		int j;
+
+		for(j = 0; j < MASKINDEX_GRAM; j++)
+			gram[j] = irctolower(name[i + j]);
+
+		RB_DLINK_FOREACH(ptr, idx->grams[fold_hash(name + i, MASKINDEX_GRAM) & idx->mask].head)
+		{
+			struct mask_index_entry *entry = ptr->data;
+
+			if(!memcmp(entry->gram, gram, MASKINDEX_GRAM))
+				check_entry(idx, entry, name, &best);
+		}
+	}
+
+	RB_DLINK_FOREACH(ptr, idx->unindexed.head)
+		check_entry(idx, ptr->data, name, &best);
+
+	idx->skipped += idx->count - (idx->checked - checked);
+
+	return best != NULL ? best->aconf : NULL;
+}
+
+struct ConfItem *
+mask_index_find_mask(struct mask_index *idx, const char *mask)
+{
+	struct mask_index_entry *best = NULL;
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, idx->masks[fold_hash(mask, strlen(mask)) & idx->mask].head)
+	{
+		struct mask_index_entry *entry = ptr->data;
+
+		if(best != NULL && entry->serial < best->serial)
+			continue;
+
+		if(!irccmp(entry->aconf->host, mask))
+			best = entry;
+	}
+
+	return best != NULL ? best->aconf : NULL;
+}
+
+void
+mask_index_stats(struct mask_index *idx, struct mask_index_stats *stats)
+{
+	stats->entries = idx->count;
+	stats->unindexed = rb_dlink_list_length(&idx->unindexed);
+	stats->memory = sizeof(struct mask_index) +
+		2 * (idx->mask + 1) * sizeof(rb_dlink_list) +
+		idx->count * sizeof(struct mask_index_entry);
+	stats->lookups = idx->lookups;
+	stats->checked = idx->checked;
+	stats->skipped = idx->skipped;
+}
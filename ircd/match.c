@@ -343,6 +343,301 @@ match_esc(const char *mask, const char *name)
 	return 0;
 }
 
+/*
+ * Compiled masks.
+ *
+ * A mask is split on '*' into segments of fixed length atoms.  The
+ * first segment must match at the start of the string and the last at
+ * the end; the ones in between are matched leftmost-first, which is
+ * enough as '*' is the only thing that can match a variable number of
+ * characters.
+ */
+enum match_atom_type
+{
+	MATCH_LITERAL,	/* c, already folded with irctolower() */
+	MATCH_ANY,	/* '?' */
+	MATCH_LETTER,	/* '@' in match_esc() */
+	MATCH_DIGIT	/* '#' in match_esc() */
+};
+
+struct match_atom
+{
+	unsigned char type;
+	unsigned char c;
+	unsigned char alt;	/* other char folding to c, for scanning */
+};
+
+struct match_segment
+{
+	unsigned int start;
+	unsigned int len;
+};
+
+struct match_prog
+{
+	unsigned int minlen;	/* total number of atoms */
+	unsigned int nsegs;
+	bool star;		/* false if the mask has no '*' at all */
+	char *interp;		/* mask to hand to match_esc() instead */
+	struct match_segment *segs;
+	struct match_atom *atoms;
+};
+
+/* the char other than c that folds to c, c if there is none, or 0 if
+ * the casemapping is too odd to scan for */
+static unsigned char
+match_fold_alt(unsigned char c)
+{
+	unsigned char alt = c;
+	bool self = false;
+
+	for (int i = 1; i < 256; i++)
+	{
+		if (irctolower(i) != c)
+			continue;
+		if (i == c)
+			self = true;
+		else if (alt != c)
+			return 0;
+		else
+			alt = i;
+	}
+	return self ? alt : 0;
+}
+
+/* match_esc() restarts a failed '*' without its quoting state and lets
+ * an escaped '*' at the end of the mask act as a real one, so masks with
+ * a '\\' straight after a '*' or after the last '*' are left to it */
+static bool
+match_esc_irregular(const char *mask)
+{
+	const char *last = NULL;
+
+	for (const char *p = mask; *p != '\0'; p++)
+	{
+		if (*p == '\\')
+		{
+			if (p > mask && p[-1] == '*')
+				return true;
+			if (*++p == '\0')
+				break;
+		}
+		else if (*p == '*')
+			last = p;
+	}
+
+	return strchr(last != NULL ? last : mask, '\\') != NULL;
+}
+
+static struct match_prog *
+match_compile_common(const char *mask, bool esc)
+{
+	struct match_prog *prog;
+	struct match_atom *atom;
+	struct match_segment *seg;
+	size_t len = strlen(mask);
+	unsigned int maxsegs = 1;
+	const char *p;
+
+	if (esc && match_esc_irregular(mask))
+	{
+		prog = rb_malloc(sizeof(struct match_prog) + len + 1);
+		prog->interp = memcpy(prog + 1, mask, len + 1);
+		return prog;
+	}
+
+	for (p = mask; *p != '\0'; p++)
+		if (*p == '*')
+			maxsegs++;
+
+	prog = rb_malloc(sizeof(struct match_prog) + maxsegs * sizeof(struct match_segment) +
+			len * sizeof(struct match_atom));
+	prog->segs = (struct match_segment *)(prog + 1);
+	prog->atoms = (struct match_atom *)(prog->segs + maxsegs);
+
+	atom = prog->atoms;
+	seg = prog->segs;
+	seg->start = 0;
+
+	for (p = mask; *p != '\0'; p++)
+	{
+		if (*p == '*')
+		{
+			seg->len = (atom - prog->atoms) - seg->start;
+			prog->star = true;
+
+			/* runs of '*' don't need empty segments between them */
+			if (seg->len > 0 || seg == prog->segs)
+				seg++;
+			seg->start = atom - prog->atoms;
+			continue;
+		}
+
+		atom->type = MATCH_LITERAL;
+
+		if (esc && *p == '\\')
+		{
+			/* a trailing backslash is ignored, as in match_esc() */
+			if (*++p == '\0')
+				break;
+			atom->c = *p == 's' ? ' ' : irctolower(*p);
+		}
+		else if (*p == '?')
+			atom->type = MATCH_ANY;
+		else if (esc && *p == '@')
+			atom->type = MATCH_LETTER;
+		else if (esc && *p == '#')
+			atom->type = MATCH_DIGIT;
+		else
+			atom->c = irctolower(*p);
+
+		atom++;
+	}
+
+	seg->len = (atom - prog->atoms) - seg->start;
+	prog->nsegs = seg - prog->segs + 1;
+	prog->minlen = atom - prog->atoms;
+
+	/* middle segments are searched for, so remember how to find their first char */
+	for (unsigned int i = 1; i + 1 < prog->nsegs; i++)
+	{
+		atom = &prog->atoms[prog->segs[i].start];
+		if (atom->type == MATCH_LITERAL)
+			atom->alt = match_fold_alt(atom->c);
+	}
+
+	return prog;
+}
+
+struct match_prog *
+match_compile(const char *mask)
+{
+	s_assert(mask != NULL);
+	return match_compile_common(mask, false);
+}
+
+struct match_prog *
+match_compile_esc(const char *mask)
+{
+	s_assert(mask != NULL);
+	return match_compile_common(mask, true);
+}
+
+void
+match_prog_free(struct match_prog *prog)
+{
+	rb_free(prog);
+}
+
+static inline bool
+match_atom(const struct match_atom *atom, unsigned char c)
+{
+	switch (atom->type)
+	{
+	case MATCH_LITERAL:
+		return irctolower(c) == atom->c;
+	case MATCH_LETTER:
+		return IsLetter(c);
+	case MATCH_DIGIT:
+		return IsDigit(c);
+	default:
+		return true;
+	}
+}
+
+static inline bool
+match_segment(const struct match_prog *prog, const struct match_segment *seg, const char *s)
+{
+	const struct match_atom *atom = &prog->atoms[seg->start];
+
+	for (unsigned int i = 0; i < seg->len; i++)
+		if (!match_atom(&atom[i], s[i]))
+			return false;
+	return true;
+}
+
+/* find the leftmost place in [s, last] the segment matches */
+static const char *
+match_find_segment(const struct match_prog *prog, const struct match_segment *seg,
+		const char *s, const char *last)
+{
+	const struct match_atom *first = &prog->atoms[seg->start];
+
+	for (; s <= last; s++)
+	{
+		if (first->type == MATCH_LITERAL)
+		{
+			if (first->alt == first->c)
+			{
+				/* nothing else folds to it; let memchr() skip ahead */
+				s = memchr(s, first->c, last - s + 1);
+				if (s == NULL)
+					return NULL;
+			}
+			else if (first->alt != 0)
+			{
+				while (s <= last && *s != first->c && *s != first->alt)
+					s++;
+				if (s > last)
+					return NULL;
+			}
+		}
+
+		if (match_segment(prog, seg, s))
+			return s;
+	}
+
+	return NULL;
+}
+
+/** Check a string against a compiled mask.
+ *
+ * @param[in] prog Mask compiled by match_compile() or match_compile_esc().
+ * @param[in] name String to check against \a prog.
+ * @return 1 if \a prog matches \a name, 0 otherwise.
+ */
+int
+match_prog(const struct match_prog *prog, const char *name)
+{
+	const struct match_segment *prefix, *suffix;
+	const char *p, *end;
+	size_t len;
+
+	s_assert(prog != NULL);
+	s_assert(name != NULL);
+
+	if (prog->interp != NULL)
+		return match_esc(prog->interp, name);
+
+	len = strlen(name);
+	if (len < prog->minlen)
+		return 0;
+
+	prefix = &prog->segs[0];
+	if (!prog->star)
+		return len == prefix->len && match_segment(prog, prefix, name);
+
+	suffix = &prog->segs[prog->nsegs - 1];
+	if (!match_segment(prog, prefix, name) ||
+			!match_segment(prog, suffix, name + len - suffix->len))
+		return 0;
+
+	p = name + prefix->len;
+	end = name + len - suffix->len;
+
+	for (unsigned int i = 1; i + 1 < prog->nsegs; i++)
+	{
+		const struct match_segment *seg = &prog->segs[i];
+
+		p = match_find_segment(prog, seg, p, end - seg->len);
+		if (p == NULL)
+			return 0;
+		p += seg->len;
+	}
+
+	return 1;
+}
+
 int comp_with_mask(void *addr, void *dest, unsigned int mask)
 {
 	if (memcmp(addr, dest, mask / 8) == 0)
@@ -678,6 +973,8 @@ bool client_matches_mask(struct Client *who, const char *mask)
 
 bool matches_mask(const struct matchset *m, const char *mask)
 {
+	bool cidr = strchr(mask, '/') != NULL;
+
 	for (int i = 0; i < ARRAY_SIZE(m->host); i++)
 	{
 		if (m->host[i][0] == '\0')
@@ -691,7 +988,31 @@ bool matches_mask(const struct matchset *m, const char *mask)
 			break;
 		if (match(mask, m->ip[i]))
 			return true;
-		if (match_cidr(mask, m->ip[i]))
+		if (cidr && match_cidr(mask, m->ip[i]))
+			return true;
+	}
+	return false;
+}
+
+/* as matches_mask(), with mask already compiled as prog */
+bool matches_mask_prog(const struct matchset *m, const struct match_prog *prog, const char *mask)
+{
+	bool cidr = strchr(mask, '/') != NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(m->host); i++)
+	{
+		if (m->host[i][0] == '\0')
+			break;
+		if (match_prog(prog, m->host[i]))
+			return true;
+	}
+	for (int i = 0; i < ARRAY_SIZE(m->ip); i++)
+	{
+		if (m->ip[i][0] == '\0')
+			break;
+		if (match_prog(prog, m->ip[i]))
+			return true;
+		if (cidr && match_cidr(mask, m->ip[i]))
 			return true;
 	}
 	return false;
@@ -56,6 +56,11 @@ msgbuf_unescape_value(char *value)
 	if (value == NULL)
 		return;
 
+	/* most values have nothing escaped */
+	in = out = strchr(value, '\\');
+	if (in == NULL)
+		return;
+
 	while (*in != '\0') {
 		if (*in == '\\') {
 			const char unescape = tag_unescape_table[(unsigned char)*++in];
@@ -105,16 +110,20 @@ msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 			*ch++ = '\0';
 
 			while (1) {
-				char *next = strchr(t, ';');
-				char *eq = strchr(t, '=');
+				/* one pass over each tag, up to its '=' or ';' */
+				char *next = t + strcspn(t, "=;");
+				char *eq = NULL;
+
+				if (*next == '=') {
+					eq = next;
+					next = strchr(eq + 1, ';');
+				} else if (*next == '\0') {
+					next = NULL;
+				}
 
-				if (next != NULL) {
+				if (next != NULL)
 					*next = '\0';
 
-					if (eq > next)
-						eq = NULL;
-				}
-
 				if (eq != NULL)
 					*eq++ = '\0';
 
@@ -135,9 +144,12 @@ msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 	}
 
 	/* truncate message if it's too long */
-	if (strlen(ch) > DATALEN) {
+	size_t len = strlen(ch);
+	if (len > DATALEN) {
 		ch[DATALEN] = '\0';
+		len = DATALEN;
 	}
+	char *endp = ch + len;
 
 	if (*ch == ':') {
 		ch++;
@@ -154,7 +166,7 @@ msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 	if (*ch == '\0')
 		return 2;
 
-	msgbuf->endp = &ch[strlen(ch)];
+	msgbuf->endp = endp;
 	msgbuf->n_para = rb_string_to_array(ch, (char **)msgbuf->para, MAXPARA);
 	if (msgbuf->n_para == 0)
 		return 3;
@@ -234,7 +246,7 @@ msgbuf_unparse_tags(char *buf, size_t buflen, const struct MsgBuf *msgbuf, unsig
 
 		if (output + len > end)
 			break;
-		strcat(output, msgbuf->tags[i].key);
+		memcpy(output, msgbuf->tags[i].key, len);
 		output += len;
 
 		if (msgbuf->tags[i].value != NULL) {
@@ -356,7 +356,7 @@ static struct mode_table auth_table[] = {
 
 static struct mode_table connect_table[] = {
 	{ "autoconn",	SERVER_AUTOCONN		},
-	{ "compressed",	0			},
+	{ "compressed",	SERVER_COMPRESSED	},
 	{ "encrypted",	SERVER_ENCRYPTED	},
 	{ "topicburst",	SERVER_TB		},
 	{ "sctp",	SERVER_SCTP		},
@@ -2574,6 +2574,10 @@ static struct ConfEntry conf_serverinfo_table[] =
 	{ "ssl_cipher_list",	CF_QSTRING, NULL, 0, &ServerInfo.ssl_cipher_list },
 	{ "ssld_count",		CF_INT,	    NULL, 0, &ServerInfo.ssld_count },
 
+	{ "wsock_deflate",	CF_YESNO,   NULL, 0, &ServerInfo.wsock_deflate },
+	{ "wsock_deflate_window_bits", CF_INT, NULL, 0, &ServerInfo.wsock_deflate_window_bits },
+	{ "wsock_deflate_no_context_takeover", CF_YESNO, NULL, 0, &ServerInfo.wsock_deflate_no_context_takeover },
+
 	{ "default_max_clients",CF_INT,     NULL, 0, &ServerInfo.default_max_clients },
 
 	{ "nicklen",		CF_INT,     conf_set_serverinfo_nicklen, 0, NULL },
@@ -2752,6 +2756,11 @@ static struct ConfEntry conf_general_table[] =
 	{ "client_flood_message_time",	CF_INT,   NULL, 0, &ConfigFileEntry.client_flood_message_time	},
 	{ "max_ratelimit_tokens",	CF_INT,   NULL, 0, &ConfigFileEntry.max_ratelimit_tokens	},
 	{ "away_interval",		CF_INT,   NULL, 0, &ConfigFileEntry.away_interval		},
+	{ "deferred_flush",		CF_YESNO, NULL, 0, &ConfigFileEntry.deferred_flush		},
+	{ "deferred_flush_delay",	CF_INT,   NULL, 0, &ConfigFileEntry.deferred_flush_delay	},
+	{ "command_timing",		CF_YESNO, NULL, 0, &ConfigFileEntry.command_timing		},
+	{ "slow_loop_pass",		CF_INT,   NULL, 0, &ConfigFileEntry.slow_loop_pass		},
+	{ "loop_stats_interval",	CF_TIME,  NULL, 0, &ConfigFileEntry.loop_stats_interval	},
 	{ "hide_opers_in_whois",	CF_YESNO, NULL, 0, &ConfigFileEntry.hide_opers_in_whois		},
 	{ "hide_opers",		CF_YESNO, NULL, 0, &ConfigFileEntry.hide_opers		},
 	{ "certfp_method",	CF_STRING, conf_set_general_certfp_method, 0, NULL },
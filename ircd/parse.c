@@ -44,12 +44,46 @@
 rb_dictionary *cmd_dict = NULL;
 rb_dictionary *alias_dict = NULL;
 
+/*
+ * With general::command_timing (or SET CMDTIMING) on, handlers are timed
+ * into a histogram per command and handler type.  The timings belong
+ * to this dictionary rather than to the module's struct Message, so
+ * they outlive a module being unloaded, possibly by the very handler
+ * being timed, and carry on where they left off when it is reloaded.
+ */
+rb_dictionary *cmd_timing_dict = NULL;
+
+static const char *handler_type_names[LAST_HANDLER_TYPE] = {
+	"unregistered", "client", "remote", "server", "encap", "oper",
+};
+
+/*
+ * cmd_dict stays the list of commands, but lookups go through an open
+ * addressing table rebuilt from it whenever a command is added or
+ * removed.  The key is the first eight bytes of the command, upper
+ * cased and packed into a word, so most commands are found with one
+ * compare; the rest of a longer command is compared as a string.
+ */
+#define CMD_KEYLEN	8
+
+struct cmd_slot
+{
+	uint64_t key;
+	const char *rest;	/* mptr->cmd past the key */
+	struct Message *mptr;
+};
+
+static struct cmd_slot *cmd_table;
+static unsigned int cmd_table_mask;
+
 static void cancel_clients(struct Client *, struct Client *);
 static void remove_unknown(struct Client *, const char *, char *);
 
 static void do_numeric(int, struct Client *, struct Client *, int, const char **);
 
 static int handle_command(struct Message *, struct MsgBuf *, struct Client *, struct Client *);
+static void call_handler(struct Message *, int, MessageHandler, struct MsgBuf *,
+		struct Client *, struct Client *, int, const char **);
 
 static char buffer[1024];
 
@@ -132,7 +166,7 @@ parse(struct Client *client_p, char *pbuffer, char *bufend)
 	}
 	else
 	{
-		mptr = rb_dictionary_retrieve(cmd_dict, msgbuf.cmd);
+		mptr = find_command(msgbuf.cmd);
 
 		/* no command or its encap only, error */
 		if(!mptr || !mptr->cmd)
@@ -237,7 +271,7 @@ handle_command(struct Message *mptr, struct MsgBuf *msgbuf_p, struct Client *cli
 		return (-1);
 	}
 
-	(*handler) (msgbuf_p, client_p, from, msgbuf_p->n_para, msgbuf_p->para);
+	call_handler(mptr, from->handler, handler, msgbuf_p, client_p, from, msgbuf_p->n_para, msgbuf_p->para);
 	return (1);
 }
 
@@ -249,7 +283,7 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 	struct MessageEntry ehandler;
 	MessageHandler handler = 0;
 
-	mptr = rb_dictionary_retrieve(cmd_dict, command);
+	mptr = find_command(command);
 
 	if(mptr == NULL || mptr->cmd == NULL)
 		return;
@@ -261,7 +295,186 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 	   (ehandler.min_para && EmptyString(parv[ehandler.min_para - 1])))
 		return;
 
+	call_handler(mptr, ENCAP_HANDLER, handler, msgbuf_p, client_p, source_p, parc, parv);
+}
+
+const char *
+handler_type_name(int type)
+{
+	if(type < 0 || type >= LAST_HANDLER_TYPE)
+		return "unknown";
+	return handler_type_names[type];
+}
+
+static struct MessageTiming *
+get_command_timing(const char *cmd)
+{
+	struct MessageTiming *timing;
+
+	timing = rb_dictionary_retrieve(cmd_timing_dict, cmd);
+	if(timing == NULL)
+	{
+		timing = rb_malloc(sizeof(struct MessageTiming));
+		timing->cmd = rb_strdup(cmd);
+		rb_dictionary_add(cmd_timing_dict, timing->cmd, timing);
+	}
+	return timing;
+}
+
+static void
+record_command_timing(struct MessageTiming *timing, int type, const struct timespec *start)
+{
+	struct timespec end;
+	unsigned long long ns, us;
+	int bucket = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - start->tv_sec) * 1000000000ULL + end.tv_nsec - start->tv_nsec;
+
+	for(us = ns / 1000; us > 0 && bucket < MESSAGE_TIMING_BUCKETS - 1; us >>= 1)
+		bucket++;
+
+	timing->handlers[type].count++;
+	timing->handlers[type].total_ns += ns;
+	if(ns > timing->handlers[type].max_ns)
+		timing->handlers[type].max_ns = ns;
+	timing->handlers[type].buckets[bucket]++;
+}
+
+/*
+ * call_handler
+ *
+ * inputs	- command, handler type and handler, then its arguments
+ * output	- NONE
+ * side effects	- runs the handler, timing it if command timing is on
+ */
+static void
+call_handler(struct Message *mptr, int type, MessageHandler handler, struct MsgBuf *msgbuf_p,
+		struct Client *client_p, struct Client *source_p, int parc, const char **parv)
+{
+	struct MessageTiming *timing;
+	struct timespec start;
+
+	if(!ConfigFileEntry.command_timing)
+	{
+		(*handler) (msgbuf_p, client_p, source_p, parc, parv);
+		return;
+	}
+
+	if(mptr->timing == NULL)
+		mptr->timing = get_command_timing(mptr->cmd);
+
+	/* mptr may be gone once the handler returns */
+	timing = mptr->timing;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	(*handler) (msgbuf_p, client_p, source_p, parc, parv);
+	record_command_timing(timing, type, &start);
+}
+
+/* reset_command_timing()
+ *
+ * clears the handler timings of every command
+ */
+void
+reset_command_timing(void)
+{
+	rb_dictionary_iter iter;
+	struct MessageTiming *timing;
+
+	RB_DICTIONARY_FOREACH(timing, &iter, cmd_timing_dict)
+	{
+		memset(timing->handlers, 0, sizeof(timing->handlers));
+	}
+}
+
+static inline uint64_t
+cmd_key(const char *cmd, const char **rest)
+{
+	uint64_t key = 0;
+	unsigned int i;
+
+	for(i = 0; i < CMD_KEYLEN && cmd[i] != '\0'; i++)
+	{
+		unsigned char c = cmd[i];
+
+		if(c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		key |= (uint64_t)c << (i * 8);
+	}
+
+	*rest = cmd + i;
+	return key;
+}
+
+static inline unsigned int
+cmd_hash(uint64_t key)
+{
+	return (key * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+}
+
+/*
+ * find_command()
+ *
+ * inputs	- command name, any case
+ * output	- its struct Message, or NULL
+ */
+struct Message *
+find_command(const char *cmd)
+{
+	struct cmd_slot *slot;
+	const char *rest;
+	uint64_t key;
+	unsigned int i;
+
+	if(cmd_table == NULL)
+		return NULL;
+
+	key = cmd_key(cmd, &rest);
+	for(i = cmd_hash(key) & cmd_table_mask; ; i = (i + 1) & cmd_table_mask)
+	{
+		slot = &cmd_table[i];
+		if(slot->mptr == NULL)
+			return NULL;
+
+		if(slot->key != key)
+			continue;
+
+		if(*rest == '\0' ? *slot->rest == '\0' : !rb_strcasecmp(rest, slot->rest))
+			return slot->mptr;
+	}
+}
+
+/* rebuild the lookup table from cmd_dict, at most half full */
+static void
+rebuild_cmd_table(void)
+{
+	rb_dictionary_iter iter;
+	struct Message *msg;
+	struct cmd_slot *slot;
+	unsigned int size = 16, i;
+	uint64_t key;
+	const char *rest;
+
+	while(size < rb_dictionary_size(cmd_dict) * 2)
+		size *= 2;
+
+	rb_free(cmd_table);
+	cmd_table = rb_malloc(size * sizeof(struct cmd_slot));
+	cmd_table_mask = size - 1;
+
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+	{
+		key = cmd_key(msg->cmd, &rest);
+		for(i = cmd_hash(key) & cmd_table_mask; cmd_table[i].mptr != NULL;
+				i = (i + 1) & cmd_table_mask)
+			;
+
+		slot = &cmd_table[i];
+		slot->key = key;
+		slot->rest = rest;
+		slot->mptr = msg;
+	}
 }
 
 /*
@@ -276,6 +489,8 @@ void
 clear_hash_parse()
 {
 	cmd_dict = rb_dictionary_create("command", rb_strcasecmp);
+	cmd_timing_dict = rb_dictionary_create("command timing", rb_strcasecmp);
+	rebuild_cmd_table();
 }
 
 /* mod_add_cmd
@@ -294,7 +509,7 @@ mod_add_cmd(struct Message *msg)
 	if(msg == NULL)
 		return;
 
-	if (rb_dictionary_find(cmd_dict, msg->cmd) != NULL) {
+	if (find_command(msg->cmd) != NULL) {
 		ilog(L_MAIN, "Add command: %s already exists", msg->cmd);
 		s_assert(0);
 		return;
@@ -303,8 +518,10 @@ mod_add_cmd(struct Message *msg)
 	msg->count = 0;
 	msg->rcount = 0;
 	msg->bytes = 0;
+	msg->timing = rb_dictionary_retrieve(cmd_timing_dict, msg->cmd);
 
 	rb_dictionary_add(cmd_dict, msg->cmd, msg);
+	rebuild_cmd_table();
 }
 
 /* mod_del_cmd
@@ -323,7 +540,10 @@ mod_del_cmd(struct Message *msg)
 	if (rb_dictionary_delete(cmd_dict, msg->cmd) == NULL) {
 		ilog(L_MAIN, "Delete command: %s not found", msg->cmd);
 		s_assert(0);
+		return;
 	}
+
+	rebuild_cmd_table();
 }
 
 /* cancel_clients()
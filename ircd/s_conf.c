@@ -155,6 +155,7 @@ free_conf(struct ConfItem *aconf)
 	rb_free(aconf->user);
 	rb_free(aconf->host);
 	rb_free(aconf->desc);
+	match_prog_free(aconf->host_prog);
 
 	if(IsConfBan(aconf))
 		operhash_delete(aconf->info.oper);
@@ -164,6 +165,21 @@ free_conf(struct ConfItem *aconf)
 	rb_bh_free(confitem_heap, aconf);
 }
 
+/* conf_host_prog()
+ *
+ * inputs	- conf item whose host is a match_esc() mask (X-line, nick RESV)
+ * outputs	- the compiled host
+ * side effects - host is compiled on first use
+ */
+const struct match_prog *
+conf_host_prog(struct ConfItem *aconf)
+{
+	if(aconf->host_prog == NULL)
+		aconf->host_prog = match_compile_esc(aconf->host);
+
+	return aconf->host_prog;
+}
+
 /*
  * check_client
  *
@@ -781,6 +797,11 @@ set_default_conf(void)
 	ConfigFileEntry.use_propagated_bans = true;
 	ConfigFileEntry.max_ratelimit_tokens = 30;
 	ConfigFileEntry.away_interval = 30;
+	ConfigFileEntry.deferred_flush = false;
+	ConfigFileEntry.deferred_flush_delay = DEFERRED_FLUSH_DELAY_DEFAULT;
+	ConfigFileEntry.command_timing = false;
+	ConfigFileEntry.slow_loop_pass = 0;
+	ConfigFileEntry.loop_stats_interval = 0;
 	ConfigFileEntry.tls_ciphers_oper_only = false;
 	ConfigFileEntry.oper_secure_only = false;
 
@@ -841,6 +862,10 @@ set_default_conf(void)
 
 	ServerInfo.default_max_clients = MAXCONNECTIONS;
 
+	ServerInfo.wsock_deflate = true;
+	ServerInfo.wsock_deflate_window_bits = WSOCK_DEFLATE_BITS_MAX;
+	ServerInfo.wsock_deflate_no_context_takeover = true;
+
 	ConfigFileEntry.nicklen = NICKLEN;
 	ConfigFileEntry.certfp_method = RB_SSL_CERTFP_METH_CERT_SHA1;
 	ConfigFileEntry.hide_opers_in_whois = 0;
@@ -871,6 +896,25 @@ read_conf(void)
 	construct_cflags_strings();
 }
 
+/* one ssld per CPU, leaving one for the ircd itself */
+static int
+auto_ssld_count(void)
+{
+	long ncpu = -1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if(ncpu <= 2)
+		return 1;
+
+	if(ncpu - 1 > SSLD_COUNT_AUTO_MAX)
+		return SSLD_COUNT_AUTO_MAX;
+
+	return ncpu - 1;
+}
+
 static void
 validate_conf(void)
 {
@@ -887,7 +931,7 @@ validate_conf(void)
 		ServerInfo.network_name = rb_strdup(NETWORK_NAME_DEFAULT);
 
 	if(ServerInfo.ssld_count < 1)
-		ServerInfo.ssld_count = 1;
+		ServerInfo.ssld_count = auto_ssld_count();
 
 	/* XXX: configurable? */
 	ServerInfo.wsockd_count = 1;
@@ -908,6 +952,13 @@ validate_conf(void)
 		start_ssldaemon(start);
 	}
 
+	if(ServerInfo.wsock_deflate_window_bits < WSOCK_DEFLATE_BITS_MIN)
+		ServerInfo.wsock_deflate_window_bits = WSOCK_DEFLATE_BITS_MIN;
+	else if(ServerInfo.wsock_deflate_window_bits > WSOCK_DEFLATE_BITS_MAX)
+		ServerInfo.wsock_deflate_window_bits = WSOCK_DEFLATE_BITS_MAX;
+
+	wsockd_update_config();
+
 	if(ServerInfo.wsockd_count > get_wsockd_count())
 	{
 		int start = ServerInfo.wsockd_count - get_wsockd_count();
@@ -957,6 +1008,12 @@ validate_conf(void)
 		CharAttrs['&'] &= ~CHANPFX_C;
 
 	chantypes_update();
+
+	if(ConfigFileEntry.slow_loop_pass < 0)
+		ConfigFileEntry.slow_loop_pass = 0;
+	if(ConfigFileEntry.loop_stats_interval < 0)
+		ConfigFileEntry.loop_stats_interval = 0;
+	update_loop_stats();
 }
 
 /* add_temp_kline()
@@ -1155,10 +1212,10 @@ deactivate_conf(struct ConfItem *aconf, time_t now)
 			aconf->clients--;
 			break;
 		case CONF_XLINE:
-			rb_dlinkFindDestroy(aconf, &xline_conf_list);
+			del_xline_conf(aconf);
 			break;
 		case CONF_RESV_NICK:
-			rb_dlinkFindDestroy(aconf, &resv_conf_list);
+			del_nick_resv_conf(aconf);
 			break;
 		case CONF_RESV_CHANNEL:
 			del_from_resv_hash(aconf->host, aconf);
@@ -1526,7 +1583,7 @@ clear_out_old_conf(void)
 	rb_free(ServerInfo.network_name);
 	ServerInfo.network_name = NULL;
 
-	ServerInfo.ssld_count = 1;
+	ServerInfo.ssld_count = 0;
 
 	/* clean out AdminInfo */
 	rb_free(AdminInfo.name);
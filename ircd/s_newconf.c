@@ -38,6 +38,7 @@
 #include "s_serv.h"
 #include "send.h"
 #include "hostmask.h"
+#include "maskindex.h"
 #include "newconf.h"
 #include "hash.h"
 #include "rb_dictionary.h"
@@ -51,6 +52,8 @@ rb_dlink_list oper_conf_list;
 rb_dlink_list server_conf_list;
 rb_dlink_list xline_conf_list;
 rb_dlink_list resv_conf_list;	/* nicks only! */
+struct mask_index *xline_index;
+struct mask_index *nick_resv_index;
 rb_dlink_list nd_list;		/* nick delay */
 rb_dlink_list tgchange_list;
 
@@ -68,6 +71,8 @@ void
 init_s_newconf(void)
 {
 	tgchange_tree = rb_new_patricia(PATRICIA_BITS);
+	xline_index = mask_index_create();
+	nick_resv_index = mask_index_create();
 	nd_heap = rb_bh_create(sizeof(struct nd_entry), ND_HEAP_SIZE, "nd_heap");
 	expire_nd_entries_ev = rb_event_addish("expire_nd_entries", expire_nd_entries, NULL, 30);
 	expire_temp_rxlines_ev = rb_event_addish("expire_temp_rxlines", expire_temp_rxlines, NULL, 60);
@@ -119,8 +124,8 @@ clear_s_newconf_bans(void)
 		if(aconf->hold)
 			continue;
 
+		del_xline_conf(aconf);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &xline_conf_list);
 	}
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, resv_conf_list.head)
@@ -131,8 +136,8 @@ clear_s_newconf_bans(void)
 		if(aconf->hold)
 			continue;
 
+		del_nick_resv_conf(aconf);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &resv_conf_list);
 	}
 
 	clear_resv_hash();
@@ -529,79 +534,74 @@ disable_server_conf_autoconn(const char *name)
 	}
 }
 
-struct ConfItem *
-find_xline(const char *gecos, int counter)
+void
+add_xline_conf(struct ConfItem *aconf)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	rb_dlink_node *ptr = rb_make_rb_dlink_node();
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
-	{
-		aconf = ptr->data;
+	rb_dlinkAdd(aconf, ptr, &xline_conf_list);
+	mask_index_add(xline_index, aconf, ptr);
+}
 
-		if(match_esc(aconf->host, gecos))
-		{
-			if(counter)
-				aconf->port++;
-			return aconf;
-		}
-	}
+void
+del_xline_conf(struct ConfItem *aconf)
+{
+	rb_dlink_node *ptr = mask_index_delete(xline_index, aconf);
 
-	return NULL;
+	if(ptr != NULL)
+		rb_dlinkDestroy(ptr, &xline_conf_list);
 }
 
-struct ConfItem *
-find_xline_mask(const char *gecos)
+void
+add_nick_resv_conf(struct ConfItem *aconf)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	rb_dlink_node *ptr = rb_make_rb_dlink_node();
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
-	{
-		aconf = ptr->data;
+	rb_dlinkAdd(aconf, ptr, &resv_conf_list);
+	mask_index_add(nick_resv_index, aconf, ptr);
+}
 
-		if(!irccmp(aconf->host, gecos))
-			return aconf;
-	}
+void
+del_nick_resv_conf(struct ConfItem *aconf)
+{
+	rb_dlink_node *ptr = mask_index_delete(nick_resv_index, aconf);
 
-	return NULL;
+	if(ptr != NULL)
+		rb_dlinkDestroy(ptr, &resv_conf_list);
 }
 
 struct ConfItem *
-find_nick_resv(const char *name)
+find_xline(const char *gecos, int counter)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	struct ConfItem *aconf = mask_index_find(xline_index, gecos);
 
-	RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-	{
-		aconf = ptr->data;
+	if(aconf != NULL && counter)
+		aconf->port++;
 
-		if(match_esc(aconf->host, name))
-		{
-			aconf->port++;
-			return aconf;
-		}
-	}
+	return aconf;
+}
 
-	return NULL;
+struct ConfItem *
+find_xline_mask(const char *gecos)
+{
+	return mask_index_find_mask(xline_index, gecos);
 }
 
 struct ConfItem *
-find_nick_resv_mask(const char *name)
+find_nick_resv(const char *name)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	struct ConfItem *aconf = mask_index_find(nick_resv_index, name);
 
-	RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-	{
-		aconf = ptr->data;
+	if(aconf != NULL)
+		aconf->port++;
 
-		if(!irccmp(aconf->host, name))
-			return aconf;
-	}
+	return aconf;
+}
 
-	return NULL;
+struct ConfItem *
+find_nick_resv_mask(const char *name)
+{
+	return mask_index_find_mask(nick_resv_index, name);
 }
 
 /* clean_resv_nick()
@@ -773,8 +773,8 @@ expire_temp_rxlines(void *unused)
 				sendto_realops_snomask(SNO_GENERAL, L_ALL,
 						"Temporary RESV for [%s] expired",
 						aconf->host);
+			del_nick_resv_conf(aconf);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &resv_conf_list);
 		}
 	}
 
@@ -790,8 +790,8 @@ expire_temp_rxlines(void *unused)
 				sendto_realops_snomask(SNO_GENERAL, L_ALL,
 						"Temporary X-line for [%s] expired",
 						aconf->host);
+			del_xline_conf(aconf);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &xline_conf_list);
 		}
 	}
 }
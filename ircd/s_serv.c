@@ -86,6 +86,7 @@ unsigned int CAP_EUID;
 unsigned int CAP_EOPMOD;
 unsigned int CAP_BAN;
 unsigned int CAP_MLOCK;
+unsigned int CAP_ZIP;
 
 unsigned int CLICAP_MULTI_PREFIX;
 unsigned int CLICAP_ACCOUNT_NOTIFY;
@@ -126,6 +127,7 @@ init_builtin_capabs(void)
 	CAP_EOPMOD = capability_put(serv_capindex, "EOPMOD", NULL);
 	CAP_BAN = capability_put(serv_capindex, "BAN", NULL);
 	CAP_MLOCK = capability_put(serv_capindex, "MLOCK", NULL);
+	CAP_ZIP = capability_put(serv_capindex, "ZIP", NULL);
 
 	capability_require(serv_capindex, "QS");
 	capability_require(serv_capindex, "EX");
@@ -335,6 +337,18 @@ try_connections(void *unused)
 	serv_connect(server_p, 0);
 }
 
+/*
+ * server_can_zip
+ *
+ * inputs	- connect{} block of the server
+ * output	- whether we offer ZIP to it
+ */
+static bool
+server_can_zip(struct server_conf *server_p)
+{
+	return ServerConfCompressed(server_p) && ircd_zlib_ok && get_ssld_count() > 0;
+}
+
 int
 check_server(const char *name, struct Client *client_p)
 {
@@ -445,6 +459,10 @@ check_server(const char *name, struct Client *client_p)
 	if(!ServerConfTb(server_p))
 		ClearCap(client_p, CAP_TB);
 
+	/* likewise ZIP, which we only offered if we can do it */
+	if(!server_can_zip(server_p))
+		ClearCap(client_p, CAP_ZIP);
+
 	return 0;
 }
 
@@ -533,180 +551,451 @@ burst_modes_TS6(struct Client *client_p, struct Channel *chptr,
 }
 
 /*
- * burst_TS6
+ * Bursts are streamed: a new link is sent a slice of its burst whenever
+ * its sendq drains below BURST_SENDQ_LOW, until the sendq reaches
+ * BURST_SENDQ_HIGH, so a big network neither balloons the sendq nor
+ * stalls the event loop.  Clients go out in the order they were
+ * introduced (see burst_client_introduced()), then channels newest
+ * first, each cursor being moved on when what it points at goes away.
  *
- * inputs	- client (server) to send nick towards
- * 		- client to send nick for
- * output	- NONE
- * side effects	- NICK message is sent towards given client_p
+ * Meanwhile the link is sent everything else as usual.  A line from a
+ * client it has not been told about yet, which it would answer with a
+ * KILL, is preceded by that client's burst (see burst_before_send()),
+ * and the cursor skips the client when it gets there.  Clients
+ * introduced after the burst started reach the link the normal way and
+ * count as sent.
+ * Channels need no such care, as a line for a channel the link does
+ * not know yet is ignored or creates it, and the SJOIN later merges.
  */
+#define BURST_SENDQ_HIGH	(256 * 1024)
+#define BURST_SENDQ_LOW		(64 * 1024)
+
+struct ServerBurst
+{
+	rb_dlink_node node;
+	struct Client *client_p;
+	rb_dlink_node *next_client;	/* next client to send */
+	rb_dlink_node *next_channel;	/* next channel, once clients are done */
+	uint64_t sent_serial;		/* clients up to here have been sent */
+	uint64_t end_serial;		/* clients after this came in live */
+	rb_dictionary *sent_early;	/* clients sent ahead of the cursor, by uid */
+	bool channels;
+};
+
+static rb_dlink_list burst_list;
+static uint64_t client_serial;
+
 static void
-burst_TS6(struct Client *client_p)
+burst_client(struct Client *client_p, struct Client *target_p)
 {
 	char ubuf[BUFSIZE];
-	struct Client *target_p;
-	struct Channel *chptr;
-	struct membership *msptr;
 	hook_data_client hclientinfo;
+
+	send_umode(NULL, target_p, 0, ubuf);
+	if(!*ubuf)
+	{
+		ubuf[0] = '+';
+		ubuf[1] = '\0';
+	}
+
+	if(IsCapable(client_p, CAP_EUID))
+		sendto_one(client_p, ":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
+			   target_p->servptr->id, target_p->name,
+			   target_p->hopcount + 1,
+			   (long) target_p->tsinfo, ubuf,
+			   target_p->username, target_p->host,
+			   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
+			   target_p->id,
+			   IsDynSpoof(target_p) ? target_p->orighost : "*",
+			   EmptyString(target_p->user->suser) ? "*" : target_p->user->suser,
+			   target_p->info);
+	else
+		sendto_one(client_p, ":%s UID %s %d %ld %s %s %s %s %s :%s",
+			   target_p->servptr->id, target_p->name,
+			   target_p->hopcount + 1,
+			   (long) target_p->tsinfo, ubuf,
+			   target_p->username, target_p->host,
+			   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
+			   target_p->id, target_p->info);
+
+	if(!EmptyString(target_p->certfp))
+		sendto_one(client_p, ":%s ENCAP * CERTFP :%s",
+				use_id(target_p), target_p->certfp);
+
+	if(!IsCapable(client_p, CAP_EUID))
+	{
+		if(IsDynSpoof(target_p))
+			sendto_one(client_p, ":%s ENCAP * REALHOST %s",
+					use_id(target_p), target_p->orighost);
+		if(!EmptyString(target_p->user->suser))
+			sendto_one(client_p, ":%s ENCAP * LOGIN %s",
+					use_id(target_p), target_p->user->suser);
+	}
+
+	if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
+		sendto_one(client_p, ":%s AWAY :%s",
+			   use_id(target_p),
+			   target_p->user->away);
+
+	if (IsOper(target_p) && target_p->user && target_p->user->opername)
+	{
+		if (target_p->user->privset)
+			sendto_one(client_p, ":%s OPER %s %s",
+					use_id(target_p),
+					target_p->user->opername,
+					target_p->user->privset->name);
+		else
+			sendto_one(client_p, ":%s OPER %s",
+					use_id(target_p),
+					target_p->user->opername);
+	}
+
+	hclientinfo.client = client_p;
+	hclientinfo.target = target_p;
+	call_hook(h_burst_client, &hclientinfo);
+}
+
+static void
+burst_channel(struct Client *client_p, struct Channel *chptr)
+{
+	struct membership *msptr;
 	hook_data_channel hchaninfo;
-	rb_dlink_node *ptr;
 	rb_dlink_node *uptr;
 	char *t;
 	int tlen, mlen;
 	int cur_len = 0;
 
-	hclientinfo.client = hchaninfo.client = client_p;
+	cur_len = mlen = sprintf(buf, ":%s SJOIN %ld %s %s :", me.id,
+			(long) chptr->channelts, chptr->chname,
+			channel_modes(chptr, client_p));
 
-	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	t = buf + mlen;
+
+	RB_DLINK_FOREACH(uptr, chptr->members.head)
 	{
-		target_p = ptr->data;
+		msptr = uptr->data;
 
-		if(!IsPerson(target_p))
-			continue;
+		tlen = strlen(use_id(msptr->client_p)) + 1;
+		if(is_chanop(msptr))
+			tlen++;
+		if(is_voiced(msptr))
+			tlen++;
 
-		if(MyClient(target_p->from) && target_p->localClient->att_sconf != NULL && ServerConfNoExport(target_p->localClient->att_sconf))
-			continue;
-
-		send_umode(NULL, target_p, 0, ubuf);
-		if(!*ubuf)
+		if(cur_len + tlen >= BUFSIZE - 3)
 		{
-			ubuf[0] = '+';
-			ubuf[1] = '\0';
+			*(t-1) = '\0';
+			sendto_one(client_p, "%s", buf);
+			cur_len = mlen;
+			t = buf + mlen;
 		}
 
-		if(IsCapable(client_p, CAP_EUID))
-			sendto_one(client_p, ":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
-				   target_p->servptr->id, target_p->name,
-				   target_p->hopcount + 1,
-				   (long) target_p->tsinfo, ubuf,
-				   target_p->username, target_p->host,
-				   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-				   target_p->id,
-				   IsDynSpoof(target_p) ? target_p->orighost : "*",
-				   EmptyString(target_p->user->suser) ? "*" : target_p->user->suser,
-				   target_p->info);
-		else
-			sendto_one(client_p, ":%s UID %s %d %ld %s %s %s %s %s :%s",
-				   target_p->servptr->id, target_p->name,
-				   target_p->hopcount + 1,
-				   (long) target_p->tsinfo, ubuf,
-				   target_p->username, target_p->host,
-				   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-				   target_p->id, target_p->info);
+		sprintf(t, "%s%s ", find_channel_status(msptr, 1),
+			   use_id(msptr->client_p));
 
-		if(!EmptyString(target_p->certfp))
-			sendto_one(client_p, ":%s ENCAP * CERTFP :%s",
-					use_id(target_p), target_p->certfp);
+		cur_len += tlen;
+		t += tlen;
+	}
+
+	if (rb_dlink_list_length(&chptr->members) > 0)
+	{
+		/* remove trailing space */
+		*(t-1) = '\0';
+	}
+	sendto_one(client_p, "%s", buf);
+
+	if(rb_dlink_list_length(&chptr->banlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
+
+	if(IsCapable(client_p, CAP_EX) &&
+	   rb_dlink_list_length(&chptr->exceptlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
+
+	if(IsCapable(client_p, CAP_IE) &&
+	   rb_dlink_list_length(&chptr->invexlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
+
+	if(rb_dlink_list_length(&chptr->quietlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
+
+	if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
+		sendto_one(client_p, ":%s TB %s %ld %s%s:%s",
+			   me.id, chptr->chname, (long) chptr->topic_time,
+			   ConfigChannel.burst_topicwho ? chptr->topic_info : "",
+			   ConfigChannel.burst_topicwho ? " " : "",
+			   chptr->topic);
+
+	if(IsCapable(client_p, CAP_MLOCK))
+		sendto_one(client_p, ":%s MLOCK %ld %s :%s",
+			   me.id, (long) chptr->channelts, chptr->chname,
+			   EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
+
+	hchaninfo.client = client_p;
+	hchaninfo.chptr = chptr;
+	call_hook(h_burst_channel, &hchaninfo);
+}
 
-		if(!IsCapable(client_p, CAP_EUID))
+/* true if the burst should wait for send_queued_write() to resume it */
+static bool
+burst_full(struct Client *client_p, unsigned long high)
+{
+	if(IsAnyDead(client_p))
+		return true;
+
+	if(rb_linebuf_len(&client_p->localClient->buf_sendq) < high)
+		return false;
+
+	send_queued(client_p);
+	return IsAnyDead(client_p) || IsFlush(client_p);
+}
+
+static void
+burst_free(struct ServerBurst *burst)
+{
+	rb_dlinkDelete(&burst->node, &burst_list);
+	burst->client_p->localClient->burst = NULL;
+	if(burst->sent_early != NULL)
+		rb_dictionary_destroy(burst->sent_early, NULL, NULL);
+	rb_free(burst);
+}
+
+/*
+ * burst_run
+ *
+ * inputs	- server being burst to
+ * output	- NONE
+ * side effects	- sends its burst for as long as the socket takes it,
+ *		  and finishes it off once everything is sent
+ */
+static void
+burst_run(struct Client *client_p)
+{
+	struct ServerBurst *burst = client_p->localClient->burst;
+	struct Client *target_p;
+	struct Channel *chptr;
+	hook_data_client hclientinfo;
+	unsigned long high;
+
+	high = get_sendq(client_p) / 2;
+	if(high > BURST_SENDQ_HIGH)
+		high = BURST_SENDQ_HIGH;
+
+	while(!burst->channels)
+	{
+		if(burst_full(client_p, high))
+			return;
+
+		if(burst->next_client == NULL)
 		{
-			if(IsDynSpoof(target_p))
-				sendto_one(client_p, ":%s ENCAP * REALHOST %s",
-						use_id(target_p), target_p->orighost);
-			if(!EmptyString(target_p->user->suser))
-				sendto_one(client_p, ":%s ENCAP * LOGIN %s",
-						use_id(target_p), target_p->user->suser);
+			burst->channels = true;
+			burst->next_channel = global_channel_list.head;
+			break;
 		}
 
-		if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
-			sendto_one(client_p, ":%s AWAY :%s",
-				   use_id(target_p),
-				   target_p->user->away);
-
-		if (IsOper(target_p) && target_p->user && target_p->user->opername)
+		target_p = burst->next_client->data;
+		if(IsPerson(target_p) && target_p->introduced > burst->end_serial)
 		{
-			if (target_p->user->privset)
-				sendto_one(client_p, ":%s OPER %s %s",
-						use_id(target_p),
-						target_p->user->opername,
-						target_p->user->privset->name);
-			else
-				sendto_one(client_p, ":%s OPER %s",
-						use_id(target_p),
-						target_p->user->opername);
+			/* the rest came in after we started */
+			burst->next_client = NULL;
+			continue;
 		}
+		burst->next_client = burst->next_client->next;
+
+		if(!IsPerson(target_p))
+			continue;
+		burst->sent_serial = target_p->introduced;
+
+		if(burst->sent_early != NULL && rb_dictionary_delete(burst->sent_early, target_p->id) != NULL)
+			continue;
+
+		if(MyClient(target_p->from) && target_p->localClient->att_sconf != NULL && ServerConfNoExport(target_p->localClient->att_sconf))
+			continue;
 
-		hclientinfo.target = target_p;
-		call_hook(h_burst_client, &hclientinfo);
+		burst_client(client_p, target_p);
 	}
 
-	RB_DLINK_FOREACH(ptr, global_channel_list.head)
+	while(burst->next_channel != NULL)
 	{
-		chptr = ptr->data;
+		if(burst_full(client_p, high))
+			return;
+
+		chptr = burst->next_channel->data;
+		burst->next_channel = burst->next_channel->next;
 
 		if(*chptr->chname != '#')
 			continue;
 
-		cur_len = mlen = sprintf(buf, ":%s SJOIN %ld %s %s :", me.id,
-				(long) chptr->channelts, chptr->chname,
-				channel_modes(chptr, client_p));
+		burst_channel(client_p, chptr);
+	}
 
-		t = buf + mlen;
+	burst_free(burst);
 
-		RB_DLINK_FOREACH(uptr, chptr->members.head)
-		{
-			msptr = uptr->data;
+	hclientinfo.client = client_p;
+	hclientinfo.target = NULL;
+	call_hook(h_burst_finished, &hclientinfo);
 
-			tlen = strlen(use_id(msptr->client_p)) + 1;
-			if(is_chanop(msptr))
-				tlen++;
-			if(is_voiced(msptr))
-				tlen++;
+	/* Always send a PING after connect burst is done */
+	sendto_one(client_p, "PING :%s", get_id(&me, client_p));
+}
 
-			if(cur_len + tlen >= BUFSIZE - 3)
-			{
-				*(t-1) = '\0';
-				sendto_one(client_p, "%s", buf);
-				cur_len = mlen;
-				t = buf + mlen;
-			}
+/*
+ * burst_resume
+ *
+ * inputs	- server whose sendq has been written out
+ * output	- NONE
+ * side effects	- carries on with its burst, if any, once the sendq
+ *		  is below the low water mark
+ */
+void
+burst_resume(struct Client *client_p)
+{
+	if(client_p->localClient->burst == NULL || IsAnyDead(client_p))
+		return;
 
-			sprintf(t, "%s%s ", find_channel_status(msptr, 1),
-				   use_id(msptr->client_p));
+	if(rb_linebuf_len(&client_p->localClient->buf_sendq) >= BURST_SENDQ_LOW)
+		return;
 
-			cur_len += tlen;
-			t += tlen;
-		}
+	burst_run(client_p);
+}
 
-		if (rb_dlink_list_length(&chptr->members) > 0)
-		{
-			/* remove trailing space */
-			*(t-1) = '\0';
-		}
-		sendto_one(client_p, "%s", buf);
+/*
+ * burst_start
+ *
+ * inputs	- server to burst to
+ * output	- NONE
+ * side effects	- starts sending it our clients and channels
+ */
+static void
+burst_start(struct Client *client_p)
+{
+	struct ServerBurst *burst;
 
-		if(rb_dlink_list_length(&chptr->banlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
+	burst = rb_malloc(sizeof(struct ServerBurst));
+	burst->client_p = client_p;
+	burst->next_client = global_client_list.head;
+	burst->end_serial = client_serial;
+	client_p->localClient->burst = burst;
+	rb_dlinkAdd(burst, &burst->node, &burst_list);
 
-		if(IsCapable(client_p, CAP_EX) &&
-		   rb_dlink_list_length(&chptr->exceptlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
+	burst_run(client_p);
+}
 
-		if(IsCapable(client_p, CAP_IE) &&
-		   rb_dlink_list_length(&chptr->invexlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
+/*
+ * burst_client_introduced
+ *
+ * inputs	- client being introduced to the network
+ * output	- NONE
+ * side effects	- client is moved to the end of global_client_list, so
+ *		  that the list holds clients in the order they were
+ *		  introduced, and numbered accordingly
+ */
+void
+burst_client_introduced(struct Client *client_p)
+{
+	burst_unlink_client(client_p);
+	rb_dlinkDelete(&client_p->node, &global_client_list);
+	rb_dlinkAddTail(client_p, &client_p->node, &global_client_list);
+	client_p->introduced = ++client_serial;
+}
 
-		if(rb_dlink_list_length(&chptr->quietlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
+/*
+ * burst_unlink_client
+ * burst_unlink_channel
+ *
+ * inputs	- client or channel leaving its list
+ * output	- NONE
+ * side effects	- moves on any burst about to send it
+ */
+void
+burst_unlink_client(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+	struct ServerBurst *burst;
 
-		if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
-			sendto_one(client_p, ":%s TB %s %ld %s%s:%s",
-				   me.id, chptr->chname, (long) chptr->topic_time,
-				   ConfigChannel.burst_topicwho ? chptr->topic_info : "",
-				   ConfigChannel.burst_topicwho ? " " : "",
-				   chptr->topic);
+	RB_DLINK_FOREACH(ptr, burst_list.head)
+	{
+		burst = ptr->data;
+		if(burst->next_client == &client_p->node)
+			burst->next_client = client_p->node.next;
+		if(burst->sent_early != NULL && IsPerson(client_p))
+			rb_dictionary_delete(burst->sent_early, client_p->id);
+	}
+}
 
-		if(IsCapable(client_p, CAP_MLOCK))
-			sendto_one(client_p, ":%s MLOCK %ld %s :%s",
-				   me.id, (long) chptr->channelts, chptr->chname,
-				   EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
+void
+burst_unlink_channel(struct Channel *chptr)
+{
+	rb_dlink_node *ptr;
+	struct ServerBurst *burst;
 
-		hchaninfo.chptr = chptr;
-		call_hook(h_burst_channel, &hchaninfo);
+	RB_DLINK_FOREACH(ptr, burst_list.head)
+	{
+		burst = ptr->data;
+		if(burst->next_channel == &chptr->node)
+			burst->next_channel = chptr->node.next;
 	}
+}
 
-	hclientinfo.target = NULL;
-	call_hook(h_burst_finished, &hclientinfo);
+/*
+ * burst_cancel
+ *
+ * inputs	- server going away
+ * output	- NONE
+ * side effects	- drops what remains of its burst
+ */
+void
+burst_cancel(struct Client *client_p)
+{
+	if(client_p->localClient->burst != NULL)
+		burst_free(client_p->localClient->burst);
+}
+
+/*
+ * burst_before_send
+ *
+ * inputs	- server being burst to, line about to be queued for it
+ * output	- NONE
+ * side effects	- if the line comes from a client the server has not
+ *		  been sent yet, that client is sent first
+ */
+void
+burst_before_send(struct Client *client_p, buf_head_t *linebuf)
+{
+	struct ServerBurst *burst = client_p->localClient->burst;
+	struct Client *target_p;
+	buf_line_t *line;
+	char uid[IDLEN];
+
+	if(rb_linebuf_numlines(linebuf) == 0)
+		return;
+
+	/* only lines sent from a uid, ":<uid> ..." */
+	line = linebuf->lines[linebuf->first];
+	if(line->len <= IDLEN || line->buf[0] != ':' || !IsDigit(line->buf[1]) ||
+	   line->buf[IDLEN] != ' ')
+		return;
+
+	memcpy(uid, line->buf + 1, IDLEN - 1);
+	uid[IDLEN - 1] = '\0';
+	target_p = find_id(uid);
+	if(target_p == NULL || !IsPerson(target_p))
+		return;
+
+	if(target_p->introduced <= burst->sent_serial ||
+	   target_p->introduced > burst->end_serial)
+		return;
+
+	if(burst->sent_early == NULL)
+		burst->sent_early = rb_dictionary_create("burst sent early", strcmp);
+	else if(rb_dictionary_find(burst->sent_early, target_p->id) != NULL)
+		return;
+
+	/* before the burst, as it sends lines from this client too */
+	rb_dictionary_add(burst->sent_early, target_p->id, target_p);
+
+	if(MyClient(target_p->from) && target_p->localClient->att_sconf != NULL && ServerConfNoExport(target_p->localClient->att_sconf))
+		return;
+
+	burst_client(client_p, target_p);
 }
 
 /*
@@ -790,7 +1079,8 @@ server_estab(struct Client *client_p)
 
 		/* pass info to new server */
 		send_capabilities(client_p, default_server_capabs | CAP_MASK
-				  | (ServerConfTb(server_p) ? CAP_TB : 0));
+				  | (ServerConfTb(server_p) ? CAP_TB : 0)
+				  | (server_can_zip(server_p) ? CAP_ZIP : 0));
 
 		sendto_one(client_p, "SERVER %s 1 :%s%s",
 			   me.name,
@@ -806,6 +1096,14 @@ server_estab(struct Client *client_p)
 	if(IsAnyDead(client_p))
 		return CLIENT_EXITED;
 
+	/* everything after our SERVER line is compressed */
+	if(IsCapable(client_p, CAP_ZIP))
+	{
+		start_zlib_session(client_p);
+		if(IsAnyDead(client_p))
+			return CLIENT_EXITED;
+	}
+
 	sendto_one(client_p, "SVINFO %d %d 0 :%ld", TS_CURRENT, TS_MIN, (long int)rb_current_time());
 
 	rb_dlinkAdd(client_p, &client_p->lnode, &me.serv->servers);
@@ -942,10 +1240,7 @@ server_estab(struct Client *client_p)
 	if(IsCapable(client_p, CAP_BAN))
 		burst_ban(client_p);
 
-	burst_TS6(client_p);
-
-	/* Always send a PING after connect burst is done */
-	sendto_one(client_p, "PING :%s", get_id(&me, client_p));
+	burst_start(client_p);
 
 	free_pre_client(client_p);
 
@@ -1302,7 +1597,8 @@ serv_connect_callback(rb_fde_t *F, int status, void *data)
 
 	/* pass my info to the new server */
 	send_capabilities(client_p, default_server_capabs | CAP_MASK
-			  | (ServerConfTb(server_p) ? CAP_TB : 0));
+			  | (ServerConfTb(server_p) ? CAP_TB : 0)
+			  | (server_can_zip(server_p) ? CAP_ZIP : 0));
 
 	sendto_one(client_p, "SERVER %s 1 :%s%s",
 		   me.name,
@@ -770,6 +770,8 @@ introduce_client(struct Client *client_p, struct Client *source_p, struct User *
 
 	s_assert(has_id(source_p));
 
+	burst_client_introduced(source_p);
+
 	if (use_euid)
 		sendto_server(client_p, NULL, CAP_EUID | CAP_TS6, NOCAPS,
 				":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
@@ -34,6 +34,7 @@
 #include "s_serv.h"
 #include "s_conf.h"
 #include "s_newconf.h"
+#include "s_stats.h"
 #include "logger.h"
 #include "hook.h"
 #include "monitor.h"
@@ -45,6 +46,7 @@
 #define CLIENT_CAPS_ONLY(x)	((IsClient((x)) && (x)->localClient) ? (x)->localClient->caps : 0)
 
 static void send_queued_write(rb_fde_t *F, void *data);
+static void send_deferred(struct Client *to);
 
 unsigned long current_serial = 0L;
 
@@ -68,6 +70,14 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
 	if(!MyConnect(to) || IsIOError(to))
 		return 0;
 
+	/* the server may have yet to be sent this line's source */
+	if(to->localClient->burst != NULL)
+	{
+		burst_before_send(to, linebuf);
+		if(IsIOError(to))
+			return 0;
+	}
+
 	if(rb_linebuf_len(&to->localClient->buf_sendq) > get_sendq(to))
 	{
 		dead_link(to, 1);
@@ -104,10 +114,122 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
 	to->localClient->sendM += 1;
 	me.localClient->sendM += 1;
 	if(rb_linebuf_len(&to->localClient->buf_sendq) > 0)
-		send_queued(to);
+	{
+		if(ConfigFileEntry.deferred_flush)
+			send_deferred(to);
+		else
+			send_queued(to);
+	}
 	return 0;
 }
 
+/*
+ * Deferred flushing
+ *
+ * With general::deferred_flush, a client with something new in its sendq
+ * goes on deferred_flush_list instead of being written to straight away,
+ * and send_deferred_flush() writes each of them once at the end of the
+ * event loop pass, so lines sent to the same client while handling one
+ * pass go out in one writev.
+ *
+ * A client is written to sooner once its sendq reaches
+ * DEFERRED_FLUSH_SENDQ, and the whole list is flushed once the oldest
+ * client on it has waited deferred_flush_delay milliseconds, so a long
+ * pass (a netburst, say) doesn't hold up interactive traffic.
+ */
+static rb_dlink_list deferred_flush_list;
+static struct timeval deferred_since;	/* when the list last became non-empty */
+static unsigned int deferred_checks;
+
+#define DEFERRED_CHECK_INTERVAL 64	/* sends between checks of the clock */
+
+static bool
+deferred_overdue(void)
+{
+	struct timeval now;
+	long msec;
+
+	rb_gettimeofday(&now, NULL);
+	msec = (now.tv_sec - deferred_since.tv_sec) * 1000 +
+		(now.tv_usec - deferred_since.tv_usec) / 1000;
+
+	return msec >= ConfigFileEntry.deferred_flush_delay;
+}
+
+static void
+send_deferred(struct Client *to)
+{
+	/* waiting for the socket to be writable anyway */
+	if(IsFlush(to))
+		return;
+
+	if(rb_linebuf_len(&to->localClient->buf_sendq) >= DEFERRED_FLUSH_SENDQ)
+	{
+		send_cancel_deferred(to);
+		ServerStats.is_dfearly++;
+		send_queued(to);
+		return;
+	}
+
+	if(IsDeferred(to))
+		ServerStats.is_dfsaved++;
+	else
+	{
+		if(rb_dlink_list_length(&deferred_flush_list) == 0)
+		{
+			rb_gettimeofday(&deferred_since, NULL);
+			deferred_checks = 0;
+		}
+
+		SetDeferred(to);
+		rb_dlinkAddTail(to, &to->localClient->flush_node, &deferred_flush_list);
+	}
+
+	if(++deferred_checks % DEFERRED_CHECK_INTERVAL == 0 && deferred_overdue())
+	{
+		ServerStats.is_dfearly += rb_dlink_list_length(&deferred_flush_list);
+		send_deferred_flush();
+	}
+}
+
+/* send_deferred_flush()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - every client on the deferred flush list is written to
+ */
+void
+send_deferred_flush(void)
+{
+	rb_dlink_node *ptr;
+
+	while((ptr = deferred_flush_list.head) != NULL)
+	{
+		struct Client *to = ptr->data;
+
+		rb_dlinkDelete(ptr, &deferred_flush_list);
+		ClearDeferred(to);
+		ServerStats.is_dflush++;
+		send_queued(to);
+	}
+}
+
+/* send_cancel_deferred()
+ *
+ * inputs	- client
+ * outputs	- none
+ * side effects - client is taken off the deferred flush list, if on it
+ */
+void
+send_cancel_deferred(struct Client *to)
+{
+	if(!IsDeferred(to))
+		return;
+
+	rb_dlinkDelete(&to->localClient->flush_node, &deferred_flush_list);
+	ClearDeferred(to);
+}
+
 /* send_linebuf_remote()
  *
  * inputs	- client to attach to, sender, linebuf
@@ -209,6 +331,9 @@ send_queued_write(rb_fde_t *F, void *data)
 	struct Client *to = data;
 	ClearFlush(to);
 	send_queued(to);
+
+	if(to->localClient->burst != NULL)
+		burst_resume(to);
 }
 
 /*
@@ -1035,13 +1160,17 @@ sendto_match_butone(struct Client *one, struct Client *source_p,
 
 	if(what == MATCH_HOST)
 	{
+		struct match_prog *prog = match_compile(mask);
+
 		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
 		{
 			target_p = ptr->data;
 
-			if(match(mask, target_p->host))
+			if(match_prog(prog, target_p->host))
 				_send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAPS_ONLY(target_p)));
 		}
+
+		match_prog_free(prog);
 	}
 	/* what = MATCH_SERVER, if it doesnt match us, just send remote */
 	else if(match(mask, me.name))
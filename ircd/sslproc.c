@@ -41,6 +41,7 @@ static int ssld_count;
 static char tmpbuf[READBUF_SIZE];
 static char nul = '\0';
 
+#define ZIPSTATS_TIME 10
 #define MAXPASSFD 4
 #define READSIZE 1024
 typedef struct _ssl_ctl_buf
@@ -57,6 +58,7 @@ struct _ssl_ctl
 {
 	rb_dlink_node node;
 	int cli_count;
+	int handshakes;			/* of cli_count, not yet open */
 	rb_fde_t *F;
 	rb_fde_t *P;
 	pid_t pid;
@@ -353,6 +355,8 @@ ssl_process_open_fd(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 	if(client_p == NULL || client_p->localClient == NULL)
 		return;
 
+	ssld_handshake_done(client_p);
+
 	if(client_p->localClient->ssl_callback)
 	{
 		SSL_OPEN_CB *hdl = client_p->localClient->ssl_callback;
@@ -385,6 +389,8 @@ ssl_process_dead_fd(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 		ilog(L_SERVER, "ssld error for %s: %s", log_client_name(client_p, SHOW_IP), reason);
 	}
 
+	ssld_handshake_done(client_p);
+
 	/* if there is still a pending callback, call it now */
 	if(client_p->localClient->ssl_callback)
 	{
@@ -489,6 +495,58 @@ ssl_process_certfp(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 	client_p->certfp = certfp_string;
 }
 
+/*
+ * S <server> <data in> <wire in> <data out> <wire out>, each counted
+ * since the previous sample
+ */
+static void
+ssl_process_zipstats(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+	struct Client *server;
+	struct ZipStats *zips;
+	char *parv[7];
+	unsigned long long in, in_wire, out, out_wire;
+	time_t elapsed;
+
+	if(ctl_buf->buf[ctl_buf->buflen - 1] != '\0')
+		return;
+	if(rb_string_to_array(ctl_buf->buf, parv, 6) != 6)
+		return;
+
+	server = find_server(NULL, parv[1]);
+	if(server == NULL || !MyConnect(server) || server->localClient->z_ctl != ctl)
+		return;
+
+	zips = server->localClient->zipstats;
+
+	in = strtoull(parv[2], NULL, 10);
+	in_wire = strtoull(parv[3], NULL, 10);
+	out = strtoull(parv[4], NULL, 10);
+	out_wire = strtoull(parv[5], NULL, 10);
+
+	zips->in += in;
+	zips->in_wire += in_wire;
+	zips->out += out;
+	zips->out_wire += out_wire;
+
+	if(zips->in > 0)
+		zips->in_ratio = ((double) (zips->in - zips->in_wire) / (double) zips->in) * 100.00;
+	else
+		zips->in_ratio = 0;
+
+	if(zips->out > 0)
+		zips->out_ratio = ((double) (zips->out - zips->out_wire) / (double) zips->out) * 100.00;
+	else
+		zips->out_ratio = 0;
+
+	elapsed = rb_current_time() - (zips->last ? zips->last : server->localClient->firsttime);
+	if(elapsed <= 0)
+		elapsed = 1;
+	zips->in_rate = (double) in / elapsed;
+	zips->out_rate = (double) out / elapsed;
+	zips->last = rb_current_time();
+}
+
 static void
 ssl_process_cmd_recv(ssl_ctl_t * ctl)
 {
@@ -538,6 +596,10 @@ ssl_process_cmd_recv(ssl_ctl_t * ctl)
 			if (len > sizeof(ctl->version) - 1)
 				len = sizeof(ctl->version) - 1;
 			strncpy(ctl->version, &ctl_buf->buf[1], len);
+			break;
+		case 'S':
+			ssl_process_zipstats(ctl, ctl_buf);
+			break;
 		case 'z':
 			ircd_zlib_ok = 0;
 			break;
@@ -588,6 +650,13 @@ ssl_read_ctl(rb_fde_t * F, void *data)
 	rb_setselect(ctl->F, RB_SELECT_READ, ssl_read_ctl, ctl);
 }
 
+/*
+ * Handshakes cost far more than moving data for an open connection, so
+ * new connections go to the ssld with the fewest handshakes in progress
+ * and only then to the one with the fewest connections.  During a
+ * reconnect storm this spreads the handshakes over every ssld (and CPU)
+ * instead of piling them onto whichever one has the fewest clients.
+ */
 static ssl_ctl_t *
 which_ssld(void)
 {
@@ -606,12 +675,39 @@ which_ssld(void)
 			lowest = ctl;
 			continue;
 		}
-		if(ctl->cli_count < lowest->cli_count)
+		if(ctl->handshakes < lowest->handshakes ||
+				(ctl->handshakes == lowest->handshakes &&
+				 ctl->cli_count < lowest->cli_count))
 			lowest = ctl;
 	}
 	return (lowest);
 }
 
+static void
+ssld_start_handshake(ssl_ctl_t *ctl, uint32_t id)
+{
+	struct Client *client_p = find_cli_connid_hash(id);
+
+	if(client_p == NULL || client_p->localClient == NULL)
+		return;
+
+	SetSSLHandshake(client_p);
+	ctl->handshakes++;
+}
+
+void
+ssld_handshake_done(struct Client *client_p)
+{
+	ssl_ctl_t *ctl = client_p->localClient->ssl_ctl;
+
+	if(!IsSSLHandshake(client_p))
+		return;
+
+	ClearSSLHandshake(client_p);
+	if(ctl != NULL)
+		ctl->handshakes--;
+}
+
 static void
 ssl_write_ctl(rb_fde_t * F, void *data)
 {
@@ -762,6 +858,7 @@ start_ssld_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	if(!ctl)
 		return NULL;
 	ctl->cli_count++;
+	ssld_start_handshake(ctl, id);
 	ssl_cmd_write_queue(ctl, F, 2, buf, sizeof(buf));
 	return ctl;
 }
@@ -782,10 +879,98 @@ start_ssld_connect(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	if(!ctl)
 		return NULL;
 	ctl->cli_count++;
+	ssld_start_handshake(ctl, id);
 	ssl_cmd_write_queue(ctl, F, 2, buf, sizeof(buf));
 	return ctl;
 }
 
+/*
+ * start_zlib_session
+ *
+ * Hands a server link that both ends agreed to compress over to ssld,
+ * straight after our SERVER line has gone out.  Anything already read
+ * beyond the peer's SERVER line is compressed and goes to ssld along
+ * with the link; it is still raw in the recvq because servers in the
+ * handshake are read in binary mode.
+ */
+void
+start_zlib_session(struct Client *server)
+{
+	rb_fde_t *F[2];
+	rb_fde_t *xF1, *xF2;
+	ssl_ctl_t *ctl;
+	char *buf;
+	size_t hdr = sizeof(uint8_t) + sizeof(uint32_t);
+	size_t recvqlen, len;
+	int cpylen;
+
+	recvqlen = rb_linebuf_len(&server->localClient->buf_recvq);
+	len = hdr + recvqlen;
+
+	/* what we sent so far must leave uncompressed */
+	send_cancel_deferred(server);
+	send_queued(server);
+
+	ctl = which_ssld();
+	if(ctl == NULL || len > READBUF_SIZE ||
+	   rb_linebuf_len(&server->localClient->buf_sendq) > 0)
+	{
+		exit_client(server, server, &me, "Error during zlib startup");
+		return;
+	}
+
+	if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF1, &xF2, "Initial zlib socketpairs") == -1)
+	{
+		ilog_error("rb_socketpair failed for zlib session");
+		exit_client(server, server, &me, "Error during zlib startup");
+		return;
+	}
+
+	server->localClient->zipstats = rb_malloc(sizeof(struct ZipStats));
+	server->localClient->zipstats->id = connid_get(server);
+
+	buf = rb_malloc(len);
+	buf[0] = 'Z';
+	uint32_to_buf(&buf[1], server->localClient->zipstats->id);
+
+	for(len = hdr; (cpylen = rb_linebuf_get(&server->localClient->buf_recvq, &buf[len],
+			recvqlen - (len - hdr), LINEBUF_PARTIAL, LINEBUF_RAW)) > 0; len += cpylen)
+		;
+
+	F[0] = server->localClient->F;
+	F[1] = xF1;
+	server->localClient->F = xF2;
+	ClearFlush(server);
+	rb_set_buffers(xF2, READBUF_SIZE);
+
+	server->localClient->z_ctl = ctl;
+	ctl->cli_count++;
+	ssl_cmd_write_queue(ctl, F, 2, buf, len);
+	rb_free(buf);
+}
+
+static void
+collect_zipstats(void *unused)
+{
+	rb_dlink_node *ptr;
+	struct Client *target_p;
+	char buf[sizeof(uint8_t) + sizeof(uint32_t) + HOSTLEN + 1];
+	size_t len;
+
+	RB_DLINK_FOREACH(ptr, serv_list.head)
+	{
+		target_p = ptr->data;
+		if(target_p->localClient->zipstats == NULL)
+			continue;
+
+		len = sizeof(uint8_t) + sizeof(uint32_t);
+		buf[0] = 'S';
+		uint32_to_buf(&buf[1], target_p->localClient->zipstats->id);
+		len += rb_strlcpy(&buf[len], target_p->name, sizeof(buf) - len) + 1;
+		ssl_cmd_write_queue(target_p->localClient->z_ctl, NULL, 0, buf, len);
+	}
+}
+
 void
 ssld_decrement_clicount(ssl_ctl_t * ctl)
 {
@@ -844,4 +1029,5 @@ void
 init_ssld(void)
 {
 	rb_event_addish("cleanup_dead_ssld", cleanup_dead_ssl, NULL, 60);
+	rb_event_addish("collect_zipstats", collect_zipstats, NULL, ZIPSTATS_TIME);
 }
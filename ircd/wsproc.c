@@ -35,6 +35,7 @@
 #include "packet.h"
 
 static void ws_read_ctl(rb_fde_t * F, void *data);
+static void wsockd_update_config_one(ws_ctl_t *ctl);
 static int wsockd_count;
 
 #define MAXPASSFD 4
@@ -60,6 +61,7 @@ struct ws_ctl
 	rb_dlink_list writeq;
 	uint8_t shutdown;
 	uint8_t dead;
+	struct wsockd_stats stats;
 };
 
 static rb_dlink_list wsock_daemons;
@@ -318,6 +320,7 @@ start_wsockd(int count)
 		rb_close(F2);
 		rb_close(P1);
 		ctl = allocate_ws_daemon(F1, P2, pid);
+		wsockd_update_config_one(ctl);
 		ws_read_ctl(ctl->F, ctl);
 		ws_do_pipe(P2, ctl);
 
@@ -351,6 +354,14 @@ ws_process_dead_fd(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
 	exit_client(client_p, client_p, &me, reason);
 }
 
+static void
+ws_process_stats(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
+{
+	if(ctl_buf->buflen != 1 + sizeof(ctl->stats))
+		return;
+
+	memcpy(&ctl->stats, &ctl_buf->buf[1], sizeof(ctl->stats));
+}
 
 static void
 ws_process_cmd_recv(ws_ctl_t * ctl)
@@ -369,6 +380,9 @@ ws_process_cmd_recv(ws_ctl_t * ctl)
 		case 'D':
 			ws_process_dead_fd(ctl, ctl_buf);
 			break;
+		case 'S':
+			ws_process_stats(ctl, ctl_buf);
+			break;
 		default:
 			ilog(L_MAIN, "Received invalid command from wsockd: %s", ctl_buf->buf);
 			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE, "Received invalid command from wsockd");
@@ -521,6 +535,38 @@ start_wsockd_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	return ctl;
 }
 
+/*
+ * 'Z' <deflate> <window bits> <no context takeover>: permessage-deflate
+ * settings for connections accepted from now on
+ */
+static void
+wsockd_update_config_one(ws_ctl_t *ctl)
+{
+	char buf[4];
+
+	buf[0] = 'Z';
+	buf[1] = ServerInfo.wsock_deflate ? 1 : 0;
+	buf[2] = ServerInfo.wsock_deflate_window_bits;
+	buf[3] = ServerInfo.wsock_deflate_no_context_takeover ? 1 : 0;
+	ws_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
+}
+
+void
+wsockd_update_config(void)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, wsock_daemons.head)
+	{
+		ws_ctl_t *ctl = ptr->data;
+
+		if (ctl->dead || ctl->shutdown)
+			continue;
+
+		wsockd_update_config_one(ctl);
+	}
+}
+
 void
 wsockd_decrement_clicount(ws_ctl_t * ctl)
 {
@@ -561,7 +607,7 @@ get_wsockd_count(void)
 }
 
 void
-wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status), void *data)
+wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status, const struct wsockd_stats *stats), void *data)
 {
 	rb_dlink_node *ptr, *next;
 	ws_ctl_t *ctl;
@@ -570,7 +616,8 @@ wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsoc
 		ctl = ptr->data;
 		func(data, ctl->pid, ctl->cli_count,
 			ctl->dead ? WSOCKD_DEAD :
-				(ctl->shutdown ? WSOCKD_SHUTDOWN : WSOCKD_ACTIVE));
+				(ctl->shutdown ? WSOCKD_SHUTDOWN : WSOCKD_ACTIVE),
+			&ctl->stats);
 	}
 }
 
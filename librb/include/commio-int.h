@@ -153,11 +153,13 @@ rb_find_fd(int fd)
 int rb_setup_fd(rb_fde_t *F);
 void rb_connect_callback(rb_fde_t *F, int status);
 
+/* event loop accounting, in rb_lib.c */
+void rb_loop_run_fd(PF * hdl, rb_fde_t *F, void *data);
+int rb_loop_timing(void);
+uint64_t rb_loop_clock(void);
+void rb_loop_culprit(uint64_t start, const char *format, ...)
+	__attribute((format(printf, 2, 3)));
 
-int rb_io_sched_event(struct ev_entry *ev, int when);
-void rb_io_unsched_event(struct ev_entry *ev);
-int rb_io_supports_event(void);
-void rb_io_init_event(void);
 
 /* epoll versions */
 void rb_setselect_epoll(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
@@ -165,11 +167,11 @@ int rb_init_netio_epoll(void);
 int rb_select_epoll(long);
 int rb_setup_fd_epoll(rb_fde_t *F);
 
-void rb_epoll_init_event(void);
-int rb_epoll_sched_event(struct ev_entry *event, int when);
-void rb_epoll_unsched_event(struct ev_entry *event);
-int rb_epoll_supports_event(void);
-
+/* io_uring versions */
+void rb_setselect_uring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
+int rb_init_netio_uring(void);
+int rb_select_uring(long);
+int rb_setup_fd_uring(rb_fde_t *F);
 
 /* poll versions */
 void rb_setselect_poll(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
@@ -189,11 +191,6 @@ int rb_init_netio_sigio(void);
 int rb_select_sigio(long);
 int rb_setup_fd_sigio(rb_fde_t *F);
 
-void rb_sigio_init_event(void);
-int rb_sigio_sched_event(struct ev_entry *event, int when);
-void rb_sigio_unsched_event(struct ev_entry *event);
-int rb_sigio_supports_event(void);
-
 
 /* ports versions */
 void rb_setselect_ports(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
@@ -201,20 +198,10 @@ int rb_init_netio_ports(void);
 int rb_select_ports(long);
 int rb_setup_fd_ports(rb_fde_t *F);
 
-void rb_ports_init_event(void);
-int rb_ports_sched_event(struct ev_entry *event, int when);
-void rb_ports_unsched_event(struct ev_entry *event);
-int rb_ports_supports_event(void);
-
 
 /* kqueue versions */
 void rb_setselect_kqueue(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
 int rb_init_netio_kqueue(void);
 int rb_select_kqueue(long);
 int rb_setup_fd_kqueue(rb_fde_t *F);
-
-void rb_kqueue_init_event(void);
-int rb_kqueue_sched_event(struct ev_entry *event, int when);
-void rb_kqueue_unsched_event(struct ev_entry *event);
-int rb_kqueue_supports_event(void);
 #endif
@@ -22,17 +22,39 @@
  *
  */
 
+/* a timer on the wheel in timer.c, embedded in whatever it times */
+struct rb_timer
+{
+	rb_dlink_node node;
+	rb_dlink_list *slot;	/* NULL when not pending */
+	uint64_t expires;	/* in wheel ticks */
+	void (*func) (void *);
+	void *arg;
+};
+
+struct rb_timer_stats
+{
+	unsigned long pending;
+	unsigned long long fired;
+	unsigned long long late_total;	/* milliseconds, summed over fired */
+	unsigned long late_max;
+};
+
+void rb_timer_set(struct rb_timer *, long msec, void (*func) (void *), void *arg);
+void rb_timer_cancel(struct rb_timer *);
+void rb_timer_run(void);
+long rb_timer_next(void);
+void rb_timer_get_stats(struct rb_timer_stats *);
+
 struct ev_entry
 {
 	rb_dlink_node node;
+	struct rb_timer timer;
 	EVH *func;
 	void *arg;
 	char *name;
 	time_t frequency;
 	time_t when;
-	time_t next;
 	void *data;
-	void *comm_ptr;
 	int dead;
 };
-void rb_event_io_register_all(void);
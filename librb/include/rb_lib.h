@@ -151,6 +151,38 @@ char *alloca();
 typedef void log_cb(const char *buffer);
 typedef void restart_cb(const char *buffer);
 typedef void die_cb(const char *buffer);
+typedef void loop_cb(void);
+
+/* pass times less the wait: under 16us, then doubling, the last open ended */
+#define RB_LOOP_BUCKETS 16
+
+struct rb_loop_stats
+{
+	unsigned long long passes;
+	unsigned long long wait_ns;	/* blocked waiting for fds */
+	unsigned long long io_ns;	/* running fd callbacks */
+	unsigned long long timer_ns;	/* running events and fd timeouts */
+	unsigned long long hook_ns;	/* in the loop hook */
+	unsigned long long max_ns;	/* longest pass, less the wait */
+	unsigned long long ready;	/* fds whose callbacks ran, all passes */
+	unsigned long ready_max;	/* most in one pass */
+	unsigned long slow;		/* passes over the slow threshold */
+	unsigned long buckets[RB_LOOP_BUCKETS];
+};
+
+/* what a slow pass spent its time on */
+struct rb_loop_pass
+{
+	unsigned long long pass_ns;
+	unsigned long long io_ns;
+	unsigned long long timer_ns;
+	unsigned long long hook_ns;
+	unsigned long ready;
+	const char *culprit;		/* the longest single callback */
+	unsigned long long culprit_ns;
+};
+
+typedef void loop_slow_cb(const struct rb_loop_pass *);
 
 char *rb_ctime(const time_t, char *, size_t);
 char *rb_date(const time_t, char *, size_t);
@@ -163,6 +195,9 @@ const char *rb_lib_version(void);
 void rb_lib_init(log_cb * xilog, restart_cb * irestart, die_cb * idie, int closeall, int maxfds,
 		 size_t dh_size, size_t fd_heap_size);
 void rb_lib_loop(long delay) __attribute__((noreturn));
+void rb_set_loop_hook(loop_cb * hook);
+void rb_set_loop_slow(unsigned long msec, loop_slow_cb * cb);
+void rb_get_loop_stats(struct rb_loop_stats *);
 
 time_t rb_current_time(void);
 const struct timeval *rb_current_time_tv(void);
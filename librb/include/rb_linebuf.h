@@ -44,18 +44,33 @@ struct _buf_head;
 #define LINEBUF_SIZE            (512 + 510)
 #define CRLF_LEN                2
 
+/*
+ * Lines are allocated from a handful of size classes, so a typical short
+ * line does not pin a full LINEBUF_SIZE buffer.  buf holds at most
+ * LINEBUF_SIZE + CRLF_LEN + 1 bytes; a partial line being parsed is moved
+ * to a bigger class as it grows.
+ */
 typedef struct _buf_line
 {
-	char buf[LINEBUF_SIZE + CRLF_LEN + 1];
 	uint8_t terminated;	/* Whether we've terminated the buffer */
 	uint8_t raw;		/* Whether this linebuf may hold 8-bit data */
+	uint8_t sizeclass;	/* Which size class heap this line came from */
 	int len;		/* How much data we've got */
 	int refcount;		/* how many linked lists are we in? */
+	char buf[];
 } buf_line_t;
 
+/*
+ * The lines of a buf_head_t are kept in a ring of references rather than a
+ * dlink list, so attaching a shared line to another buffer (channel fan-out)
+ * does not need a list node allocation.  The ring grows by doubling and is
+ * only freed when the buffer is emptied by rb_linebuf_donebuf().
+ */
 typedef struct _buf_head
 {
-	rb_dlink_list list;	/* the actual dlink list */
+	buf_line_t **lines;	/* ring of lines, linecap entries */
+	int linecap;		/* size of the ring, zero or a power of two */
+	int first;		/* index of the oldest line in the ring */
 	int len;		/* length of all the data */
 	int alloclen;		/* Actual allocated data length */
 	int writeofs;		/* offset in the first line for the write */
@@ -75,6 +90,7 @@ int rb_linebuf_get(buf_head_t *, char *, int, int, int);
 void rb_linebuf_put(buf_head_t *, const rb_strf_t *);
 void rb_linebuf_attach(buf_head_t *, buf_head_t *);
 void rb_count_rb_linebuf_memory(size_t *, size_t *);
+size_t rb_linebuf_memory_saved(void);
 int rb_linebuf_flush(rb_fde_t *F, buf_head_t *);
 
 
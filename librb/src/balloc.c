@@ -57,18 +57,54 @@
 #include <librb_config.h>
 #include <rb_lib.h>
 
+#if defined(HAVE_MMAP) && !defined(NOBALLOC)
+#include <sys/mman.h>
+#if !defined(MAP_ANON) && defined(MAP_ANONYMOUS)
+#define MAP_ANON MAP_ANONYMOUS
+#endif
+#endif
+
 static void _rb_bh_fail(const char *reason, const char *file, int line) __attribute__((noreturn));
 
 static uintptr_t offset_pad;
+static size_t bh_pagesize;
+
+/*
+ * A block is one page aligned chunk of memory carved up into elements.
+ * The rb_heap_block header lives at the start of the chunk, and every
+ * element is preceded by offset_pad bytes holding a pointer back to its
+ * block, so rb_bh_free() can find the block without searching.
+ *
+ * While an element is free its first bytes are reused as the link to the
+ * next element on the heap's free list.  The list is singly linked so that
+ * alloc and free only ever touch the element itself.
+ */
+typedef struct rb_heap_block
+{
+	rb_dlink_node node;	/* entry in the heap's block_list */
+	size_t alloc_size;	/* size of the chunk, a multiple of the page size */
+	unsigned long free_count;	/* elements of this block on the free list */
+	int release;		/* being handed back by rb_bh_cleanup() */
+	char *elems;		/* first element slot */
+} rb_heap_block;
+
+typedef struct rb_heap_free
+{
+	struct rb_heap_free *next;
+} rb_heap_free;
 
 /* information for the root node of the heap */
 struct rb_bh
 {
 	rb_dlink_node hlist;
 	size_t elemSize;	/* Size of each element to be stored */
+	size_t elemStride;	/* elemSize plus the block pointer, padded */
+	size_t blockSize;	/* Size of each block, page aligned */
 	unsigned long elemsPerBlock;	/* Number of elements per block */
+	unsigned long used;	/* Number of elements handed out */
+	unsigned long free_count;	/* Number of elements on free_list */
 	rb_dlink_list block_list;
-	rb_dlink_list free_list;
+	rb_heap_free *free_list;
 	char *desc;
 };
 
@@ -76,6 +112,9 @@ static rb_dlink_list *heap_lists;
 
 #define rb_bh_fail(x) _rb_bh_fail(x, __FILE__, __LINE__)
 
+#define BH_ELEM_BLOCK(ptr) (*(rb_heap_block **)((uintptr_t)(ptr) - offset_pad))
+#define BH_ALIGN(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+
 static void
 _rb_bh_fail(const char *reason, const char *file, int line)
 {
@@ -83,6 +122,82 @@ _rb_bh_fail(const char *reason, const char *file, int line)
 	abort();
 }
 
+#ifndef NOBALLOC
+/*
+ * static void *get_block(size_t size)
+ *
+ * Input: Size of block to allocate, a multiple of the page size
+ * Output: Pointer to new block
+ * Side Effects: None
+ */
+static void *
+get_block(size_t size)
+{
+	void *ptr;
+#if defined(HAVE_MMAP) && defined(MAP_ANON)
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if(ptr == MAP_FAILED)
+		ptr = NULL;
+#else
+	if(posix_memalign(&ptr, bh_pagesize, size) != 0)
+		ptr = NULL;
+#endif
+	return (ptr);
+}
+
+static void
+free_block(void *ptr, size_t size)
+{
+#if defined(HAVE_MMAP) && defined(MAP_ANON)
+	munmap(ptr, size);
+#else
+	free(ptr);
+#endif
+}
+
+/*
+ * static int newblock(rb_bh *bh)
+ *
+ * Input: Pointer to the heap to grow
+ * Output: 0 on success, 1 if no memory could be had
+ * Side Effects: Every element of the new block goes on the heap's free list
+ */
+static int
+newblock(rb_bh *bh)
+{
+	rb_heap_block *b;
+	char *offset;
+	unsigned long i;
+
+	b = get_block(bh->blockSize);
+	if(b == NULL)
+		return (1);
+
+	b->alloc_size = bh->blockSize;
+	b->free_count = bh->elemsPerBlock;
+	b->release = 0;
+	b->elems = (char *)b + BH_ALIGN(sizeof(rb_heap_block), offset_pad);
+	b->node.prev = b->node.next = NULL;
+
+	/* thread the free list through the block back to front, so the
+	 * elements are handed out in address order */
+	offset = b->elems + bh->elemStride * bh->elemsPerBlock;
+	for(i = 0; i < bh->elemsPerBlock; i++)
+	{
+		rb_heap_free *elem;
+
+		offset -= bh->elemStride;
+		*(rb_heap_block **)offset = b;
+		elem = (rb_heap_free *)(offset + offset_pad);
+		elem->next = bh->free_list;
+		bh->free_list = elem;
+	}
+	bh->free_count += bh->elemsPerBlock;
+	rb_dlinkAdd(b, &b->node, &bh->block_list);
+	return (0);
+}
+#endif /* !NOBALLOC */
+
 /*
  * void rb_init_bh(void)
  *
@@ -106,6 +221,12 @@ rb_init_bh(void)
 		offset_pad &= ~(__alignof__(long long) - 1);
 	}
 #endif
+
+#ifdef _SC_PAGESIZE
+	bh_pagesize = sysconf(_SC_PAGESIZE);
+#endif
+	if(bh_pagesize == 0 || bh_pagesize == (size_t)-1)
+		bh_pagesize = 4096;
 }
 
 /* ************************************************************************ */
@@ -119,7 +240,8 @@ rb_init_bh(void)
 /*   elemsize (IN):  Size of the basic element to be stored                 */
 /*   elemsperblock (IN):  Number of elements to be stored in a single block */
 /*         of memory.  When the blockheap runs out of free memory, it will  */
-/*         allocate elemsize * elemsperblock more.                          */
+/*         allocate elemsize * elemsperblock more.  The block is rounded up */
+/*         to whole pages and any slack is used for extra elements.         */
 /* Returns:                                                                 */
 /*   Pointer to new rb_bh, or NULL if unsuccessful                      */
 /* ************************************************************************ */
@@ -142,7 +264,11 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 	/* Allocate our new rb_bh */
 	bh = rb_malloc(sizeof(rb_bh));
 	bh->elemSize = elemsize;
-	bh->elemsPerBlock = elemsperblock;
+	bh->elemStride = offset_pad + BH_ALIGN(elemsize, offset_pad);
+	bh->blockSize = BH_ALIGN(BH_ALIGN(sizeof(rb_heap_block), offset_pad) +
+				 bh->elemStride * elemsperblock, bh_pagesize);
+	bh->elemsPerBlock = (bh->blockSize - BH_ALIGN(sizeof(rb_heap_block), offset_pad)) /
+				bh->elemStride;
 	if(desc != NULL)
 		bh->desc = rb_strdup(desc);
 
@@ -159,7 +285,7 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 /*    rb_bh_alloc                                                        */
 /* Description:                                                             */
 /*    Returns a pointer to a struct within our rb_bh that's free for    */
-/*    the taking.                                                           */
+/*    the taking.  The memory is zeroed, as with rb_malloc().               */
 /* Parameters:                                                              */
 /*    bh (IN):  Pointer to the Blockheap.                                   */
 /* Returns:                                                                 */
@@ -169,13 +295,37 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 void *
 rb_bh_alloc(rb_bh *bh)
 {
+#ifndef NOBALLOC
+	rb_heap_free *new_elem;
+#endif
+
 	lrb_assert(bh != NULL);
 	if(rb_unlikely(bh == NULL))
 	{
 		rb_bh_fail("Cannot allocate if bh == NULL");
 	}
 
+#ifdef NOBALLOC
+	bh->used++;
 	return (rb_malloc(bh->elemSize));
+#else
+	if(bh->free_list == NULL)
+	{
+		/* Allocate new block and assign */
+		/* newblock returns 1 if unsuccessful, 0 if not */
+		if(rb_unlikely(newblock(bh)))
+			rb_outofmemory();
+	}
+
+	new_elem = bh->free_list;
+	bh->free_list = new_elem->next;
+	BH_ELEM_BLOCK(new_elem)->free_count--;
+	bh->free_count--;
+	bh->used++;
+
+	memset(new_elem, 0, bh->elemSize);
+	return (new_elem);
+#endif
 }
 
 
@@ -193,6 +343,11 @@ rb_bh_alloc(rb_bh *bh)
 int
 rb_bh_free(rb_bh *bh, void *ptr)
 {
+#ifndef NOBALLOC
+	rb_heap_block *block;
+	rb_heap_free *elem;
+#endif
+
 	lrb_assert(bh != NULL);
 	lrb_assert(ptr != NULL);
 
@@ -208,11 +363,111 @@ rb_bh_free(rb_bh *bh, void *ptr)
 		return (1);
 	}
 
+#ifdef NOBALLOC
 	rb_free(ptr);
+#else
+	block = BH_ELEM_BLOCK(ptr);
+	if(rb_unlikely((char *)ptr < block->elems || (char *)ptr >= (char *)block + block->alloc_size))
+	{
+		rb_bh_fail("rb_bh_free() bogus pointer");
+	}
+	block->free_count++;
+	bh->free_count++;
+
+	/* freshly freed elements go first, they are most likely still in cache */
+	elem = ptr;
+	elem->next = bh->free_list;
+	bh->free_list = elem;
+#endif
+	bh->used--;
 	return (0);
 }
 
 
+/* ************************************************************************ */
+/* FUNCTION DOCUMENTATION:                                                  */
+/*    rb_bh_cleanup                                                         */
+/* Description:                                                             */
+/*    Hands blocks with no elements in use back to the operating system.   */
+/*    One empty block is kept around so a heap that hovers at a block       */
+/*    boundary does not map and unmap on every allocation.                  */
+/* Parameters:                                                              */
+/*    bh (IN):  Pointer to the rb_bh to clean up.                          */
+/* Returns:                                                                 */
+/*    Number of bytes released                                              */
+/* ************************************************************************ */
+size_t
+rb_bh_cleanup(rb_bh *bh)
+{
+	size_t released = 0;
+#ifndef NOBALLOC
+	rb_dlink_node *ptr, *next;
+	rb_heap_block *b;
+	rb_heap_free **elem;
+	int kept = 0, found = 0;
+
+	if(bh == NULL)
+		return (0);
+
+	RB_DLINK_FOREACH(ptr, bh->block_list.head)
+	{
+		b = ptr->data;
+		if(b->free_count != bh->elemsPerBlock)
+			continue;
+
+		if(!kept)
+		{
+			kept = 1;
+			continue;
+		}
+
+		b->release = 1;
+		found = 1;
+	}
+
+	if(!found)
+		return (0);
+
+	/* unthread the doomed blocks' elements from the free list */
+	elem = &bh->free_list;
+	while(*elem != NULL)
+	{
+		if(BH_ELEM_BLOCK(*elem)->release)
+		{
+			*elem = (*elem)->next;
+			bh->free_count--;
+		}
+		else
+			elem = &(*elem)->next;
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, bh->block_list.head)
+	{
+		b = ptr->data;
+		if(!b->release)
+			continue;
+
+		rb_dlinkDelete(&b->node, &bh->block_list);
+		released += b->alloc_size;
+		free_block(b, b->alloc_size);
+	}
+#endif
+	return (released);
+}
+
+size_t
+rb_bh_cleanup_all(void)
+{
+	rb_dlink_node *ptr;
+	size_t released = 0;
+
+	RB_DLINK_FOREACH(ptr, heap_lists->head)
+	{
+		released += rb_bh_cleanup(ptr->data);
+	}
+	return (released);
+}
+
 /* ************************************************************************ */
 /* FUNCTION DOCUMENTATION:                                                  */
 /*    rb_bhDestroy                                                      */
@@ -226,9 +481,22 @@ rb_bh_free(rb_bh *bh, void *ptr)
 int
 rb_bh_destroy(rb_bh *bh)
 {
+#ifndef NOBALLOC
+	rb_dlink_node *ptr, *next;
+	rb_heap_block *b;
+#endif
+
 	if(bh == NULL)
 		return (1);
 
+#ifndef NOBALLOC
+	RB_DLINK_FOREACH_SAFE(ptr, next, bh->block_list.head)
+	{
+		b = ptr->data;
+		free_block(b, b->alloc_size);
+	}
+#endif
+
 	rb_dlinkDelete(&bh->hlist, heap_lists);
 	rb_free(bh->desc);
 	rb_free(bh);
@@ -236,17 +504,46 @@ rb_bh_destroy(rb_bh *bh)
 	return (0);
 }
 
+/*
+ * static void bh_count(rb_bh *bh, size_t *used, size_t *freem, size_t *memusage,
+ *		        size_t *heapalloc)
+ *
+ * Works out the element and byte counts reported by the usage functions.
+ * heapalloc counts whole blocks, including the per element block pointers
+ * and any padding, so it is what the heap really costs.
+ */
+static void
+bh_count(rb_bh *bh, size_t *used, size_t *freem, size_t *memusage, size_t *heapalloc)
+{
+	*used = bh->used;
+	*freem = bh->free_count;
+	*memusage = bh->used * bh->elemSize;
+#ifdef NOBALLOC
+	*heapalloc = *memusage;
+#else
+	*heapalloc = rb_dlink_list_length(&bh->block_list) * bh->blockSize;
+#endif
+}
+
 void
-rb_bh_usage(rb_bh *bh __attribute__((unused)), size_t *bused, size_t *bfree, size_t *bmemusage, const char **desc)
+rb_bh_usage(rb_bh *bh, size_t *bused, size_t *bfree, size_t *bmemusage, const char **desc)
 {
+	size_t used, freem, memusage, heapalloc;
+	static const char *unnamed = "(unnamed_heap)";
+
+	if(bh == NULL)
+		return;
+
+	bh_count(bh, &used, &freem, &memusage, &heapalloc);
+
 	if(bused != NULL)
-		*bused = 0;
+		*bused = used;
 	if(bfree != NULL)
-		*bfree = 0;
+		*bfree = freem;
 	if(bmemusage != NULL)
-		*bmemusage = 0;
+		*bmemusage = memusage;
 	if(desc != NULL)
-		*desc = "no blockheap";
+		*desc = bh->desc != NULL ? bh->desc : unnamed;
 }
 
 void
@@ -256,7 +553,7 @@ rb_bh_usage_all(rb_bh_usage_cb *cb, void *data)
 	rb_bh *bh;
 	size_t used, freem, memusage, heapalloc;
 	static const char *unnamed = "(unnamed_heap)";
-	const char *desc = unnamed;
+	const char *desc;
 
 	if(cb == NULL)
 		return;
@@ -264,12 +561,8 @@ rb_bh_usage_all(rb_bh_usage_cb *cb, void *data)
 	RB_DLINK_FOREACH(ptr, heap_lists->head)
 	{
 		bh = (rb_bh *)ptr->data;
-		freem = rb_dlink_list_length(&bh->free_list);
-		used = (rb_dlink_list_length(&bh->block_list) * bh->elemsPerBlock) - freem;
-		memusage = used * bh->elemSize;
-		heapalloc = (freem + used) * bh->elemSize;
-		if(bh->desc != NULL)
-			desc = bh->desc;
+		bh_count(bh, &used, &freem, &memusage, &heapalloc);
+		desc = bh->desc != NULL ? bh->desc : unnamed;
 		cb(used, freem, memusage, heapalloc, desc, data);
 	}
 	return;
@@ -279,16 +572,15 @@ void
 rb_bh_total_usage(size_t *total_alloc, size_t *total_used)
 {
 	rb_dlink_node *ptr;
-	size_t total_memory = 0, used_memory = 0, used, freem;
+	size_t total_memory = 0, used_memory = 0, used, freem, memusage, heapalloc;
 	rb_bh *bh;
 
 	RB_DLINK_FOREACH(ptr, heap_lists->head)
 	{
 		bh = (rb_bh *)ptr->data;
-		freem = rb_dlink_list_length(&bh->free_list);
-		used = (rb_dlink_list_length(&bh->block_list) * bh->elemsPerBlock) - freem;
-		used_memory += used * bh->elemSize;
-		total_memory += (freem + used) * bh->elemSize;
+		bh_count(bh, &used, &freem, &memusage, &heapalloc);
+		used_memory += memusage;
+		total_memory += heapalloc;
 	}
 
 	if(total_alloc != NULL)
@@ -41,8 +41,7 @@
 struct timeout_data
 {
 	rb_fde_t *F;
-	rb_dlink_node node;
-	time_t timeout;
+	struct rb_timer timer;
 	PF *timeout_handler;
 	void *timeout_data;
 };
@@ -50,11 +49,8 @@ struct timeout_data
 rb_dlink_list *rb_fd_table;
 static rb_bh *fd_heap;
 
-static rb_dlink_list timeout_list;
 static rb_dlink_list closed_list;
 
-static struct ev_entry *rb_timeout_ev;
-
 
 static const char *rb_err_str[] = { "Comm OK", "Error during bind()",
 	"Error during DNS lookup", "connect timeout",
@@ -261,10 +257,36 @@ rb_clear_cloexec(rb_fde_t *F)
 	return 1;
 }
 
+static void
+rb_timeout_fire(void *arg)
+{
+	struct timeout_data *td = arg;
+	rb_fde_t *F = td->F;
+	PF *hdl = td->timeout_handler;
+	void *data = td->timeout_data;
+
+	F->timeout = NULL;
+	rb_free(td);
+	if(!IsFDOpen(F))
+		return;
+
+	if(rb_loop_timing())
+	{
+		uint64_t start = rb_loop_clock();
+		int fd = F->fd;
+
+		hdl(F, data);
+		rb_loop_culprit(start, "timeout on fd %d", fd);
+	}
+	else
+		hdl(F, data);
+}
+
 /*
  * rb_settimeout() - set the socket timeout
  *
- * Set the timeout for the fd
+ * Set the timeout for the fd.  Setting it again replaces the old one;
+ * all of them share the event timer wheel, so this is O(1).
  */
 void
 rb_settimeout(rb_fde_t *F, time_t timeout, PF * callback, void *cbdata)
@@ -280,14 +302,9 @@ rb_settimeout(rb_fde_t *F, time_t timeout, PF * callback, void *cbdata)
 	{
 		if(td == NULL)
 			return;
-		rb_dlinkDelete(&td->node, &timeout_list);
+		rb_timer_cancel(&td->timer);
 		rb_free(td);
 		F->timeout = NULL;
-		if(rb_dlink_list_length(&timeout_list) == 0)
-		{
-			rb_event_delete(rb_timeout_ev);
-			rb_timeout_ev = NULL;
-		}
 		return;
 	}
 
@@ -295,49 +312,9 @@ rb_settimeout(rb_fde_t *F, time_t timeout, PF * callback, void *cbdata)
 		td = F->timeout = rb_malloc(sizeof(struct timeout_data));
 
 	td->F = F;
-	td->timeout = rb_current_time() + timeout;
 	td->timeout_handler = callback;
 	td->timeout_data = cbdata;
-	rb_dlinkAdd(td, &td->node, &timeout_list);
-	if(rb_timeout_ev == NULL)
-	{
-		rb_timeout_ev = rb_event_add("rb_checktimeouts", rb_checktimeouts, NULL, 5);
-	}
-}
-
-/*
- * rb_checktimeouts() - check the socket timeouts
- *
- * All this routine does is call the given callback/cbdata, without closing
- * down the file descriptor. When close handlers have been implemented,
- * this will happen.
- */
-void
-rb_checktimeouts(void *notused __attribute__((unused)))
-{
-	rb_dlink_node *ptr, *next;
-	struct timeout_data *td;
-	rb_fde_t *F;
-	PF *hdl;
-	void *data;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, timeout_list.head)
-	{
-		td = ptr->data;
-		F = td->F;
-		if(F == NULL || !IsFDOpen(F))
-			continue;
-
-		if(td->timeout < rb_current_time())
-		{
-			hdl = td->timeout_handler;
-			data = td->timeout_data;
-			rb_dlinkDelete(&td->node, &timeout_list);
-			F->timeout = NULL;
-			rb_free(td);
-			hdl(F, data);
-		}
-	}
+	rb_timer_set(&td->timer, timeout * 1000, rb_timeout_fire, td);
 }
 
 static int
@@ -2010,10 +1987,6 @@ rb_inet_socketpair(int family, int type, int protocol, int fd[2])
 static void (*setselect_handler) (rb_fde_t *, unsigned int, PF *, void *);
 static int (*select_handler) (long);
 static int (*setup_fd_handler) (rb_fde_t *);
-static int (*io_sched_event) (struct ev_entry *, int);
-static void (*io_unsched_event) (struct ev_entry *);
-static int (*io_supports_event) (void);
-static void (*io_init_event) (void);
 static char iotype[25];
 
 const char *
@@ -2022,12 +1995,6 @@ rb_get_iotype(void)
 	return iotype;
 }
 
-static int
-rb_unsupported_event(void)
-{
-	return 0;
-}
-
 static int
 try_kqueue(void)
 {
@@ -2036,10 +2003,6 @@ try_kqueue(void)
 		setselect_handler = rb_setselect_kqueue;
 		select_handler = rb_select_kqueue;
 		setup_fd_handler = rb_setup_fd_kqueue;
-		io_sched_event = rb_kqueue_sched_event;
-		io_unsched_event = rb_kqueue_unsched_event;
-		io_init_event = rb_kqueue_init_event;
-		io_supports_event = rb_kqueue_supports_event;
 		rb_strlcpy(iotype, "kqueue", sizeof(iotype));
 		return 0;
 	}
@@ -2054,16 +2017,26 @@ try_epoll(void)
 		setselect_handler = rb_setselect_epoll;
 		select_handler = rb_select_epoll;
 		setup_fd_handler = rb_setup_fd_epoll;
-		io_sched_event = rb_epoll_sched_event;
-		io_unsched_event = rb_epoll_unsched_event;
-		io_supports_event = rb_epoll_supports_event;
-		io_init_event = rb_epoll_init_event;
 		rb_strlcpy(iotype, "epoll", sizeof(iotype));
 		return 0;
 	}
 	return -1;
 }
 
+static int
+try_uring(void)
+{
+	if(!rb_init_netio_uring())
+	{
+		setselect_handler = rb_setselect_uring;
+		select_handler = rb_select_uring;
+		setup_fd_handler = rb_setup_fd_uring;
+		rb_strlcpy(iotype, "io_uring", sizeof(iotype));
+		return 0;
+	}
+	return -1;
+}
+
 static int
 try_ports(void)
 {
@@ -2072,10 +2045,6 @@ try_ports(void)
 		setselect_handler = rb_setselect_ports;
 		select_handler = rb_select_ports;
 		setup_fd_handler = rb_setup_fd_ports;
-		io_sched_event = rb_ports_sched_event;
-		io_unsched_event = rb_ports_unsched_event;
-		io_init_event =  rb_ports_init_event;
-		io_supports_event = rb_ports_supports_event;
 		rb_strlcpy(iotype, "ports", sizeof(iotype));
 		return 0;
 	}
@@ -2090,10 +2059,6 @@ try_devpoll(void)
 		setselect_handler = rb_setselect_devpoll;
 		select_handler = rb_select_devpoll;
 		setup_fd_handler = rb_setup_fd_devpoll;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "devpoll", sizeof(iotype));
 		return 0;
 	}
@@ -2108,11 +2073,6 @@ try_sigio(void)
 		setselect_handler = rb_setselect_sigio;
 		select_handler = rb_select_sigio;
 		setup_fd_handler = rb_setup_fd_sigio;
-		io_sched_event = rb_sigio_sched_event;
-		io_unsched_event = rb_sigio_unsched_event;
-		io_supports_event = rb_sigio_supports_event;
-		io_init_event = rb_sigio_init_event;
-
 		rb_strlcpy(iotype, "sigio", sizeof(iotype));
 		return 0;
 	}
@@ -2127,49 +2087,12 @@ try_poll(void)
 		setselect_handler = rb_setselect_poll;
 		select_handler = rb_select_poll;
 		setup_fd_handler = rb_setup_fd_poll;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "poll", sizeof(iotype));
 		return 0;
 	}
 	return -1;
 }
 
-int
-rb_io_sched_event(struct ev_entry *ev, int when)
-{
-	if(ev == NULL || io_supports_event == NULL || io_sched_event == NULL
-	   || !io_supports_event())
-		return 0;
-	return io_sched_event(ev, when);
-}
-
-void
-rb_io_unsched_event(struct ev_entry *ev)
-{
-	if(ev == NULL || io_supports_event == NULL || io_unsched_event == NULL
-	   || !io_supports_event())
-		return;
-	io_unsched_event(ev);
-}
-
-int
-rb_io_supports_event(void)
-{
-	if(io_supports_event == NULL)
-		return 0;
-	return io_supports_event();
-}
-
-void
-rb_io_init_event(void)
-{
-	io_init_event();
-	rb_event_io_register_all();
-}
-
 void
 rb_init_netio(void)
 {
@@ -2184,6 +2107,11 @@ rb_init_netio(void)
 			if(!try_epoll())
 				return;
 		}
+		else if(!strcmp("io_uring", ioenv))
+		{
+			if(!try_uring())
+				return;
+		}
 		else if(!strcmp("kqueue", ioenv))
 		{
 			if(!try_kqueue())
@@ -2213,6 +2141,8 @@ rb_init_netio(void)
 
 	if(!try_kqueue())
 		return;
+	if(!try_uring())
+		return;
 	if(!try_epoll())
 		return;
 	if(!try_ports())
@@ -234,7 +234,7 @@ rb_select_devpoll(long delay)
 				if((hdl = F->read_handler) != NULL)
 				{
 					F->read_handler = NULL;
-					hdl(F, F->read_data);
+					rb_loop_run_fd(hdl, F, F->read_data);
 					/*
 					 * this call used to be with a NULL pointer, BUT
 					 * in the devpoll case we only want to update the
@@ -254,7 +254,7 @@ rb_select_devpoll(long delay)
 				if((hdl = F->write_handler) != NULL)
 				{
 					F->write_handler = NULL;
-					hdl(F, F->write_data);
+					rb_loop_run_fd(hdl, F, F->write_data);
 					/* See above similar code in the read case */
 					devpoll_update_events(F,
 							      RB_SELECT_WRITE, F->write_handler);
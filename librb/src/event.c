@@ -49,8 +49,13 @@
 #define EV_NAME_LEN 33
 static char last_event_ran[EV_NAME_LEN];
 static rb_dlink_list event_list;
+static rb_dlink_list dead_event_list;	/* deleted, freed by rb_event_run() */
 
-static time_t event_time_min = -1;
+static void
+rb_event_timer(void *ev)
+{
+	rb_run_one_event(ev);
+}
 
 /*
  * struct ev_entry *
@@ -85,15 +90,11 @@ rb_event_add_common(const char *name, EVH * func, void *arg, time_t when, time_t
 	ev->name = rb_strndup(name, EV_NAME_LEN);
 	ev->arg = arg;
 	ev->when = rb_current_time() + when;
-	ev->next = when;
 	ev->frequency = frequency;
 	ev->dead = 0;
 
-	if((ev->when < event_time_min) || (event_time_min == -1))
-		event_time_min = ev->when;
-
 	rb_dlinkAdd(ev, &ev->node, &event_list);
-	rb_io_sched_event(ev, when);
+	rb_timer_set(&ev->timer, when * 1000, rb_event_timer, ev);
 	return ev;
 }
 
@@ -140,12 +141,13 @@ rb_event_addonce(const char *name, EVH * func, void *arg, time_t when)
 void
 rb_event_delete(struct ev_entry *ev)
 {
-	if(ev == NULL)
+	if(ev == NULL || ev->dead)
 		return;
 
 	ev->dead = 1;
 
-	rb_io_unsched_event(ev);
+	rb_timer_cancel(&ev->timer);
+	rb_dlinkMoveNode(&ev->node, &event_list, &dead_event_list);
 }
 
 /*
@@ -196,16 +198,31 @@ rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish)
 void
 rb_run_one_event(struct ev_entry *ev)
 {
+	time_t next;
+
 	rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-	ev->func(ev->arg);
+	if(rb_loop_timing())
+	{
+		uint64_t start = rb_loop_clock();
+
+		ev->func(ev->arg);
+		rb_loop_culprit(start, "event %s", last_event_ran);
+	}
+	else
+		ev->func(ev->arg);
+
+	/* it may have deleted itself */
+	if(ev->dead)
+		return;
+
 	if(!ev->frequency)
 	{
 		rb_event_delete(ev);
 		return;
 	}
-	ev->when = rb_current_time() + rb_event_frequency(ev->frequency);
-	if((ev->when < event_time_min) || (event_time_min == -1))
-		event_time_min = ev->when;
+	next = rb_event_frequency(ev->frequency);
+	ev->when = rb_current_time() + next;
+	rb_timer_set(&ev->timer, next * 1000, rb_event_timer, ev);
 }
 
 /*
@@ -213,7 +230,8 @@ rb_run_one_event(struct ev_entry *ev)
  *
  * Input: None
  * Output: None
- * Side Effects: Runs pending events in the event list
+ * Side Effects: Runs the events and fd timeouts that are due, and frees
+ *		 deleted events
  */
 void
 rb_event_run(void)
@@ -221,60 +239,14 @@ rb_event_run(void)
 	rb_dlink_node *ptr, *next;
 	struct ev_entry *ev;
 
-	if(rb_io_supports_event())
-		return;
-
-	event_time_min = -1;
-	RB_DLINK_FOREACH_SAFE(ptr, next, event_list.head)
-	{
-		ev = ptr->data;
-		if (ev->dead)
-		{
-			rb_dlinkDelete(&ev->node, &event_list);
-			rb_free(ev->name);
-			rb_free(ev);
-			continue;
-		}
-		if(ev->when <= rb_current_time())
-		{
-			rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-			ev->func(ev->arg);
-
-			/* event is scheduled more than once */
-			if(ev->frequency)
-			{
-				ev->when = rb_current_time() + rb_event_frequency(ev->frequency);
-				if((ev->when < event_time_min) || (event_time_min == -1))
-					event_time_min = ev->when;
-			}
-			else
-			{
-				rb_dlinkDelete(&ev->node, &event_list);
-				rb_free(ev->name);
-				rb_free(ev);
-			}
-		}
-		else
-		{
-			if((ev->when < event_time_min) || (event_time_min == -1))
-				event_time_min = ev->when;
-		}
-	}
-}
-
-void
-rb_event_io_register_all(void)
-{
-	rb_dlink_node *ptr;
-	struct ev_entry *ev;
-
-	if(!rb_io_supports_event())
-		return;
+	rb_timer_run();
 
-	RB_DLINK_FOREACH(ptr, event_list.head)
+	RB_DLINK_FOREACH_SAFE(ptr, next, dead_event_list.head)
 	{
 		ev = ptr->data;
-		rb_io_sched_event(ev, ev->next);
+		rb_dlinkDelete(&ev->node, &dead_event_list);
+		rb_free(ev->name);
+		rb_free(ev);
 	}
 }
 
@@ -297,10 +269,43 @@ rb_dump_events(void (*func) (char *, void *), void *ptr)
 	char buf[512];
 	rb_dlink_node *dptr;
 	struct ev_entry *ev;
+	struct rb_timer_stats st;
+	struct rb_loop_stats ls;
+	unsigned long long busy;
+	size_t len;
+	int i;
 
 	snprintf(buf, sizeof buf, "Last event to run: %s", last_event_ran);
 	func(buf, ptr);
 
+	rb_get_loop_stats(&ls);
+	busy = ls.io_ns + ls.timer_ns + ls.hook_ns;
+	snprintf(buf, sizeof buf, "Loop: %llu passes, busy %llu us on average, %llu us at most, "
+		 "%llu%% of the time; %lu slow",
+		 ls.passes, ls.passes ? busy / ls.passes / 1000 : 0, ls.max_ns / 1000,
+		 busy + ls.wait_ns ? busy * 100 / (busy + ls.wait_ns) : 0, ls.slow);
+	func(buf, ptr);
+
+	snprintf(buf, sizeof buf, "Loop: busy %llu ms in fd callbacks, %llu ms in timers, "
+		 "%llu ms in the loop hook; %llu.%02llu fds ready per pass, %lu at most",
+		 ls.io_ns / 1000000, ls.timer_ns / 1000000, ls.hook_ns / 1000000,
+		 ls.passes ? ls.ready / ls.passes : 0,
+		 ls.passes ? ls.ready * 100 / ls.passes % 100 : 0, ls.ready_max);
+	func(buf, ptr);
+
+	len = rb_strlcpy(buf, "Loop: passes busy under 16us, 32us, ...:", sizeof buf);
+	for(i = 0; i < RB_LOOP_BUCKETS && len < sizeof buf; i++)
+		len += snprintf(buf + len, sizeof buf - len, " %lu", ls.buckets[i]);
+	func(buf, ptr);
+
+	rb_timer_get_stats(&st);
+	snprintf(buf, sizeof buf, "Timers: %lu pending (%lu events, %lu fd timeouts), %llu fired, "
+		 "late by %llu ms on average, %lu ms at most",
+		 st.pending, rb_dlink_list_length(&event_list),
+		 st.pending - rb_dlink_list_length(&event_list), st.fired,
+		 st.fired ? st.late_total / st.fired : 0, st.late_max);
+	func(buf, ptr);
+
 	rb_strlcpy(buf, "Operation                    Next Execution", sizeof buf);
 	func(buf, ptr);
 
@@ -337,7 +342,9 @@ rb_set_back_events(time_t by)
 void
 rb_event_update(struct ev_entry *ev, time_t freq)
 {
-	if(ev == NULL)
+	time_t next;
+
+	if(ev == NULL || ev->dead)
 		return;
 
 	ev->frequency = freq;
@@ -345,14 +352,27 @@ rb_event_update(struct ev_entry *ev, time_t freq)
 	/* update when it's scheduled to run if it's higher
 	 * than the new frequency
 	 */
-	time_t next = rb_event_frequency(freq);
+	next = rb_event_frequency(freq);
 	if((rb_current_time() + next) < ev->when)
+	{
 		ev->when = rb_current_time() + next;
-	return;
+		rb_timer_set(&ev->timer, next * 1000, rb_event_timer, ev);
+	}
 }
 
+/*
+ * time_t rb_event_next(void)
+ *
+ * Input: None
+ * Output: When the next event or fd timeout is due, or -1 if none are
+ * Side Effects: None
+ */
 time_t
 rb_event_next(void)
 {
-	return event_time_min;
+	long next = rb_timer_next();
+
+	if(next < 0)
+		return -1;
+	return rb_current_time() + (next + 999) / 1000;
 }
@@ -0,0 +1,455 @@
+/*
+ *  librb: a library used by ircd-ratbox and other things
+ *  io_uring.c: Linux io_uring based network routines.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+#define _GNU_SOURCE 1
+
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <commio-int.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_POLL_H)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/syscall.h>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_POLL_ADD_MULTI) && defined(IORING_FEAT_RSRC_TAGS)
+#define USING_IO_URING
+
+/*
+ * This is a readiness backend like epoll: every fd with a handler has a
+ * multishot IORING_OP_POLL_ADD outstanding, and the poll submissions for
+ * a whole pass go to the kernel in the same io_uring_enter() that waits
+ * for completions, instead of one epoll_ctl() each.
+ *
+ * Completions are tagged with the fd and a per-fd generation, bumped
+ * whenever a poll is armed or cancelled, so a completion that arrives for
+ * a poll we have since replaced, or for a closed and reused fd, is
+ * recognised as stale without touching its old rb_fde_t.
+ */
+#define URING_ENTRIES 1024
+
+struct uring_info
+{
+	int fd;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int cq_mask;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned int sq_local_tail;	/* sqes filled but not yet published */
+	unsigned int to_submit;
+	int flush_now;			/* a cancel is queued, submit it this pass */
+	uint32_t *gen;
+	int gen_size;
+};
+
+static struct uring_info *ur_info;
+
+static int
+uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+uring_enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, ur_info->fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int
+uring_submit(unsigned int min_complete, unsigned int flags, void *arg, size_t argsz)
+{
+	unsigned int n = ur_info->to_submit;
+	int ret;
+
+	__atomic_store_n(ur_info->sq_tail, ur_info->sq_local_tail, __ATOMIC_RELEASE);
+	ret = uring_enter(n, min_complete, flags, arg, argsz);
+	if(ret >= 0)
+		ur_info->to_submit -= (unsigned int)ret < n ? (unsigned int)ret : n;
+	ur_info->flush_now = 0;
+	return ret;
+}
+
+static struct io_uring_sqe *
+uring_get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head = __atomic_load_n(ur_info->sq_head, __ATOMIC_ACQUIRE);
+
+	if(ur_info->sq_local_tail - head >= ur_info->sq_entries)
+	{
+		/* ring is full of unsubmitted entries, push them out now */
+		if(uring_submit(0, 0, NULL, 0) < 0)
+		{
+			rb_lib_log("uring_get_sqe(): io_uring_enter failed: %s", strerror(errno));
+			abort();
+		}
+		head = __atomic_load_n(ur_info->sq_head, __ATOMIC_ACQUIRE);
+		if(ur_info->sq_local_tail - head >= ur_info->sq_entries)
+		{
+			rb_lib_log("uring_get_sqe(): submission queue stuck full");
+			abort();
+		}
+	}
+
+	sqe = &ur_info->sqes[ur_info->sq_local_tail & ur_info->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ur_info->sq_array[ur_info->sq_local_tail & ur_info->sq_mask] = ur_info->sq_local_tail & ur_info->sq_mask;
+	ur_info->sq_local_tail++;
+	ur_info->to_submit++;
+	return sqe;
+}
+
+static uint32_t *
+uring_gen(int fd)
+{
+	if(fd >= ur_info->gen_size)
+	{
+		int size = ur_info->gen_size;
+
+		while(size <= fd)
+			size *= 2;
+		ur_info->gen = rb_realloc(ur_info->gen, sizeof(uint32_t) * size);
+		memset(ur_info->gen + ur_info->gen_size, 0, sizeof(uint32_t) * (size - ur_info->gen_size));
+		ur_info->gen_size = size;
+	}
+	return &ur_info->gen[fd];
+}
+
+static uint64_t
+uring_user_data(int fd, uint32_t gen)
+{
+	return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+/* replace whatever poll F has outstanding with one for flags, or none */
+static void
+uring_rearm(rb_fde_t *F, int flags)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t *gen = uring_gen(F->fd);
+
+	if(F->pflags != 0)
+	{
+		sqe = uring_get_sqe();
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = uring_user_data(F->fd, *gen);
+		sqe->user_data = 0;
+		(*gen)++;
+		/* the poll holds a reference on the file until this goes in */
+		if(flags == 0)
+			ur_info->flush_now = 1;
+	}
+
+	F->pflags = flags;
+	if(flags == 0)
+		return;
+
+	sqe = uring_get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = F->fd;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = (uint32_t)flags;
+	sqe->user_data = uring_user_data(F->fd, ++(*gen));
+}
+
+static void
+uring_unmap(struct io_uring_params *p, void *sq, size_t sq_len, void *cq, size_t cq_len)
+{
+	if(ur_info->sqes != NULL && ur_info->sqes != MAP_FAILED)
+		munmap(ur_info->sqes, p->sq_entries * sizeof(struct io_uring_sqe));
+	if(cq != NULL && cq != MAP_FAILED && cq != sq)
+		munmap(cq, cq_len);
+	if(sq != NULL && sq != MAP_FAILED)
+		munmap(sq, sq_len);
+}
+
+/*
+ * rb_init_netio
+ *
+ * This is a needed exported function which will be called to initialise
+ * the network loop code.
+ */
+int
+rb_init_netio_uring(void)
+{
+	struct io_uring_params p;
+	size_t sq_len = 0, cq_len = 0;
+	void *sq = NULL, *cq = NULL;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = uring_setup(URING_ENTRIES, &p);
+	if(fd < 0)
+		return -1;
+
+	ur_info = rb_malloc(sizeof(struct uring_info));
+	ur_info->fd = fd;
+
+	/*
+	 * we need a timeout on the wait, completions must never be lost, and
+	 * multishot poll came in with resource tags (5.13); older kernels
+	 * reject IORING_POLL_ADD_MULTI outright, so leave them to epoll
+	 */
+	if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)
+	   || !(p.features & IORING_FEAT_RSRC_TAGS))
+		goto fail;
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		sq_len = cq_len = sq_len > cq_len ? sq_len : cq_len;
+
+	sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(sq == MAP_FAILED)
+		goto fail;
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else
+	{
+		cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(cq == MAP_FAILED)
+			goto fail;
+	}
+	ur_info->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(ur_info->sqes == MAP_FAILED)
+		goto fail;
+
+	ur_info->sq_head = (unsigned int *)((char *)sq + p.sq_off.head);
+	ur_info->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+	ur_info->sq_mask = *(unsigned int *)((char *)sq + p.sq_off.ring_mask);
+	ur_info->sq_entries = *(unsigned int *)((char *)sq + p.sq_off.ring_entries);
+	ur_info->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+	ur_info->sq_local_tail = *ur_info->sq_tail;
+	ur_info->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+	ur_info->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+	ur_info->cq_mask = *(unsigned int *)((char *)cq + p.cq_off.ring_mask);
+	ur_info->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+
+	ur_info->gen_size = getdtablesize();
+	if(ur_info->gen_size < 64)
+		ur_info->gen_size = 64;
+	ur_info->gen = rb_malloc(sizeof(uint32_t) * ur_info->gen_size);
+
+	rb_open(fd, RB_FD_UNKNOWN, "io_uring file descriptor");
+	return 0;
+
+fail:
+	uring_unmap(&p, sq, sq_len, cq, cq_len);
+	close(fd);
+	rb_free(ur_info);
+	ur_info = NULL;
+	return -1;
+}
+
+int
+rb_setup_fd_uring(rb_fde_t *F __attribute__((unused)))
+{
+	return 0;
+}
+
+/*
+ * rb_setselect
+ *
+ * This is a needed exported function which will be called to register
+ * and deregister interest in a pending IO state for a given FD.
+ */
+void
+rb_setselect_uring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+	int flags = F->pflags;
+
+	lrb_assert(IsFDOpen(F));
+
+	if(type & RB_SELECT_READ)
+	{
+		if(handler != NULL)
+			flags |= POLLIN;
+		else
+			flags &= ~POLLIN;
+		F->read_handler = handler;
+		F->read_data = client_data;
+	}
+
+	if(type & RB_SELECT_WRITE)
+	{
+		if(handler != NULL)
+			flags |= POLLOUT;
+		else
+			flags &= ~POLLOUT;
+		F->write_handler = handler;
+		F->write_data = client_data;
+	}
+
+	if(flags != F->pflags)
+		uring_rearm(F, flags);
+}
+
+/*
+ * rb_select
+ *
+ * Called to do the new-style IO, courtesy of squid (like most of this
+ * new IO code). This routine handles the stuff we've hidden in
+ * rb_setselect and fd_table[] and calls callbacks for IO ready
+ * events.
+ */
+int
+rb_select_uring(long delay)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int head, tail;
+	int ret, o_errno;
+
+	memset(&arg, 0, sizeof(arg));
+	if(delay >= 0)
+	{
+		ts.tv_sec = delay / 1000;
+		ts.tv_nsec = (delay % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+
+	ret = 0;
+	head = *ur_info->cq_head;
+	if(head == __atomic_load_n(ur_info->cq_tail, __ATOMIC_ACQUIRE))
+		ret = uring_submit(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	else if(ur_info->to_submit > 0)
+		ret = uring_submit(0, 0, NULL, 0);
+
+	/* save errno as rb_set_time() will likely clobber it */
+	o_errno = errno;
+	rb_set_time();
+	errno = o_errno;
+
+	if(ret < 0 && o_errno != ETIME && !rb_ignore_errno(o_errno))
+		return RB_ERROR;
+
+	tail = __atomic_load_n(ur_info->cq_tail, __ATOMIC_ACQUIRE);
+	while(head != tail)
+	{
+		struct io_uring_cqe cqe = ur_info->cqes[head & ur_info->cq_mask];
+		int fd, events, flags;
+		rb_fde_t *F;
+		PF *hdl;
+		void *data;
+
+		head++;
+		__atomic_store_n(ur_info->cq_head, head, __ATOMIC_RELEASE);
+
+		if(cqe.user_data == 0)
+			continue;
+
+		fd = (int)(uint32_t)cqe.user_data;
+		if(fd >= ur_info->gen_size || ur_info->gen[fd] != (uint32_t)(cqe.user_data >> 32))
+			continue;
+
+		F = rb_find_fd(fd);
+		if(F == NULL || !IsFDOpen(F))
+			continue;
+
+		/* a multishot poll without F_MORE is finished and must be re-armed */
+		if(!(cqe.flags & IORING_CQE_F_MORE))
+			F->pflags = 0;
+
+		events = cqe.res < 0 ? POLLERR : cqe.res;
+
+		if(events & (POLLIN | POLLHUP | POLLERR))
+		{
+			hdl = F->read_handler;
+			data = F->read_data;
+			F->read_handler = NULL;
+			F->read_data = NULL;
+			if(hdl)
+				rb_loop_run_fd(hdl, F, data);
+		}
+
+		if(!IsFDOpen(F))
+			continue;
+		if(events & (POLLOUT | POLLHUP | POLLERR))
+		{
+			hdl = F->write_handler;
+			data = F->write_data;
+			F->write_handler = NULL;
+			F->write_data = NULL;
+			if(hdl)
+				rb_loop_run_fd(hdl, F, data);
+		}
+
+		if(!IsFDOpen(F))
+			continue;
+
+		flags = 0;
+		if(F->read_handler != NULL)
+			flags |= POLLIN;
+		if(F->write_handler != NULL)
+			flags |= POLLOUT;
+
+		if(flags != F->pflags)
+			uring_rearm(F, flags);
+	}
+
+	/* let cancelled polls drop their files before the fds are closed */
+	if(ur_info->flush_now && uring_submit(0, 0, NULL, 0) < 0)
+		rb_lib_log("rb_select_uring(): io_uring_enter failed: %s", strerror(errno));
+
+	return RB_OK;
+}
+
+#endif
+#endif
+
+#ifndef USING_IO_URING
+int
+rb_init_netio_uring(void)
+{
+	return ENOSYS;
+}
+
+void
+rb_setselect_uring(rb_fde_t *F __attribute__((unused)), unsigned int type __attribute__((unused)), PF * handler __attribute__((unused)), void *client_data __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return;
+}
+
+int
+rb_select_uring(long delay __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int
+rb_setup_fd_uring(rb_fde_t *F __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif /* !USING_IO_URING */
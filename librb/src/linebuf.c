@@ -23,14 +23,45 @@
  *
  */
 
+#include <stddef.h>
 #include <librb_config.h>
 #include <rb_lib.h>
 #include <commio-int.h>
 
-static rb_bh *rb_linebuf_heap;
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* size classes, as whole element sizes; the last one fits a full line */
+#define LINEBUF_FULL_ELEM	(offsetof(buf_line_t, buf) + LINEBUF_SIZE + CRLF_LEN + 1)
+#define LINEBUF_CLASSES		4
+
+static const size_t rb_linebuf_class_size[LINEBUF_CLASSES] = {
+	128, 256, 512, LINEBUF_FULL_ELEM
+};
+static const char *rb_linebuf_class_desc[LINEBUF_CLASSES] = {
+	"librb_linebuf_heap_128", "librb_linebuf_heap_256",
+	"librb_linebuf_heap_512", "librb_linebuf_heap"
+};
+
+#define rb_linebuf_capacity(x)	(rb_linebuf_class_size[(x)->sizeclass] - offsetof(buf_line_t, buf))
+
+static rb_bh *rb_linebuf_heap[LINEBUF_CLASSES];
 
 static int bufline_count = 0;
 
+/* initial size of a buf_head_t's line ring */
+#define LINEBUF_RING_MIN	16
+/* rings bigger than this are given back once they drain */
+#define LINEBUF_RING_KEEP	1024
+
+/* the nth line in a buf_head_t, counting from the oldest */
+#define rb_linebuf_line(bh, n)	((bh)->lines[((bh)->first + (n)) & ((bh)->linecap - 1)])
+#define rb_linebuf_head(bh)	((bh)->numlines ? rb_linebuf_line(bh, 0) : NULL)
+#define rb_linebuf_tail(bh)	((bh)->numlines ? rb_linebuf_line(bh, (bh)->numlines - 1) : NULL)
+
 /*
  * rb_linebuf_init
  *
@@ -40,14 +71,34 @@ static int bufline_count = 0;
 void
 rb_linebuf_init(size_t heap_size)
 {
-	rb_linebuf_heap = rb_bh_create(sizeof(buf_line_t), heap_size, "librb_linebuf_heap");
+	int i;
+
+	for(i = 0; i < LINEBUF_CLASSES; i++)
+		rb_linebuf_heap[i] = rb_bh_create(rb_linebuf_class_size[i], heap_size,
+						  rb_linebuf_class_desc[i]);
 }
 
+/*
+ * rb_linebuf_allocate
+ *
+ * Allocate a line from the smallest size class with room for size bytes
+ * of data, including the terminating NUL.
+ */
 static buf_line_t *
-rb_linebuf_allocate(void)
+rb_linebuf_allocate(size_t size)
 {
 	buf_line_t *t;
-	t = rb_bh_alloc(rb_linebuf_heap);
+	int i;
+
+	lrb_assert(size <= LINEBUF_SIZE + CRLF_LEN + 1);
+	for(i = 0; i < LINEBUF_CLASSES - 1; i++)
+	{
+		if(size + offsetof(buf_line_t, buf) <= rb_linebuf_class_size[i])
+			break;
+	}
+
+	t = rb_bh_alloc(rb_linebuf_heap[i]);
+	t->sizeclass = i;
 	return (t);
 
 }
@@ -55,47 +106,125 @@ rb_linebuf_allocate(void)
 static void
 rb_linebuf_free(buf_line_t * p)
 {
-	rb_bh_free(rb_linebuf_heap, p);
+	rb_bh_free(rb_linebuf_heap[p->sizeclass], p);
+}
+
+/*
+ * rb_linebuf_grow
+ *
+ * Double the size of the line ring, unwrapping it as we go.
+ */
+static void
+rb_linebuf_grow(buf_head_t * bufhead)
+{
+	buf_line_t **lines;
+	int linecap, i;
+
+	linecap = bufhead->linecap ? bufhead->linecap * 2 : LINEBUF_RING_MIN;
+	lines = rb_malloc(sizeof(buf_line_t *) * linecap);
+
+	for(i = 0; i < bufhead->numlines; i++)
+		lines[i] = rb_linebuf_line(bufhead, i);
+
+	rb_free(bufhead->lines);
+	bufhead->lines = lines;
+	bufhead->linecap = linecap;
+	bufhead->first = 0;
+}
+
+/*
+ * rb_linebuf_link_line
+ *
+ * Append a reference to the given line to the end of the linebuf.
+ */
+static inline void
+rb_linebuf_link_line(buf_head_t * bufhead, buf_line_t * bufline)
+{
+	if(rb_unlikely(bufhead->numlines == bufhead->linecap))
+		rb_linebuf_grow(bufhead);
+
+	rb_linebuf_line(bufhead, bufhead->numlines) = bufline;
+	bufline->refcount++;
+
+	/* And finally, update the allocated size */
+	bufhead->alloclen++;
+	bufhead->numlines++;
 }
 
 /*
  * rb_linebuf_new_line
  *
- * Create a new line, and link it to the given linebuf.
- * It will be initially empty.
+ * Create a new line with room for size bytes, and link it to the given
+ * linebuf.  It will be initially empty.
  */
 static buf_line_t *
-rb_linebuf_new_line(buf_head_t * bufhead)
+rb_linebuf_new_line(buf_head_t * bufhead, size_t size)
 {
 	buf_line_t *bufline;
 
-	bufline = rb_linebuf_allocate();
+	bufline = rb_linebuf_allocate(size);
 	if(bufline == NULL)
 		return NULL;
 	++bufline_count;
 
 	/* Stick it at the end of the buf list */
-	rb_dlinkAddTailAlloc(bufline, &bufhead->list);
-	bufline->refcount++;
-
-	/* And finally, update the allocated size */
-	bufhead->alloclen++;
-	bufhead->numlines++;
+	rb_linebuf_link_line(bufhead, bufline);
 
 	return bufline;
 }
 
+/*
+ * rb_linebuf_reserve
+ *
+ * Make sure the partial line at the tail of the linebuf has room for
+ * another cpylen bytes (clamped to a full line), moving it to a bigger
+ * size class if it has to.  If bufline is NULL a new line is created.
+ */
+static buf_line_t *
+rb_linebuf_reserve(buf_head_t * bufhead, buf_line_t * bufline, int cpylen)
+{
+	buf_line_t *newline;
+	size_t need;
+
+	need = (bufline != NULL ? bufline->len : 0) + cpylen;
+	if(need > LINEBUF_SIZE)
+		need = LINEBUF_SIZE;
+	need++;
+
+	if(bufline == NULL)
+		return rb_linebuf_new_line(bufhead, need);
+
+	if(need <= rb_linebuf_capacity(bufline))
+		return bufline;
+
+	/* lines still being parsed are never shared */
+	lrb_assert(bufline->refcount == 1);
+	lrb_assert(rb_linebuf_tail(bufhead) == bufline);
+
+	newline = rb_linebuf_allocate(need);
+	newline->terminated = bufline->terminated;
+	newline->raw = bufline->raw;
+	newline->len = bufline->len;
+	newline->refcount = bufline->refcount;
+	memcpy(newline->buf, bufline->buf, bufline->len);
+
+	rb_linebuf_line(bufhead, bufhead->numlines - 1) = newline;
+	rb_linebuf_free(bufline);
+	return newline;
+}
+
 
 /*
  * rb_linebuf_done_line
  *
- * We've finished with the given line, so deallocate it
+ * We've finished with the first line in the linebuf, so deallocate it
  */
 static void
-rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *node)
+rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline)
 {
-	/* Remove it from the linked list */
-	rb_dlinkDestroy(node, &bufhead->list);
+	/* Remove it from the ring */
+	lrb_assert(rb_linebuf_head(bufhead) == bufline);
+	bufhead->first = (bufhead->first + 1) & (bufhead->linecap - 1);
 
 	/* Update the allocated size */
 	bufhead->alloclen--;
@@ -103,6 +232,15 @@ rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *
 	lrb_assert(bufhead->len >= 0);
 	bufhead->numlines--;
 
+	/* don't hang on to a huge ring after a backlog has drained */
+	if(bufhead->numlines == 0 && bufhead->linecap > LINEBUF_RING_KEEP)
+	{
+		rb_free(bufhead->lines);
+		bufhead->lines = NULL;
+		bufhead->linecap = 0;
+		bufhead->first = 0;
+	}
+
 	bufline->refcount--;
 	lrb_assert(bufline->refcount >= 0);
 
@@ -117,30 +255,88 @@ rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *
 
 
 /*
- * skip to end of line or the crlfs, return the number of bytes ..
+ * rb_linebuf_find_eol
+ *
+ * Returns the offset of the first CR or LF in ch[0..len), or len if
+ * there is none.  A server link hands us whole read buffers of lines,
+ * so this looks at a vector (or failing that a word) at a time.
  */
 static inline int
-rb_linebuf_skip_crlf(char *ch, int len)
+rb_linebuf_find_eol(const char *ch, int len)
 {
-	int orig_len = len;
+	int i = 0;
+
+#if defined(__GNUC__) && defined(__AVX2__)
+	const __m256i cr32 = _mm256_set1_epi8('\r');
+	const __m256i lf32 = _mm256_set1_epi8('\n');
 
-	/* First, skip until the first non-CRLF */
-	for(; len; len--, ch++)
+	for(; i + 32 <= len; i += 32)
 	{
-		if(*ch == '\r')
+		__m256i v = _mm256_loadu_si256((const __m256i *)(ch + i));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, cr32), _mm256_cmpeq_epi8(v, lf32)));
+
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+#if defined(__GNUC__) && defined(__SSE2__)
+	const __m128i cr16 = _mm_set1_epi8('\r');
+	const __m128i lf16 = _mm_set1_epi8('\n');
+
+	for(; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(ch + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(v, cr16), _mm_cmpeq_epi8(v, lf16)));
+
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+#else
+	/* a word has a CR or LF if xoring it with them leaves a zero byte */
+	const uint64_t ones = UINT64_C(0x0101010101010101);
+	const uint64_t highs = UINT64_C(0x8080808080808080);
+
+	for(; i + 8 <= len; i += 8)
+	{
+		uint64_t w, cr, lf;
+
+		memcpy(&w, ch + i, sizeof(w));
+		cr = w ^ (ones * '\r');
+		lf = w ^ (ones * '\n');
+		if(((cr - ones) & ~cr & highs) | ((lf - ones) & ~lf & highs))
 			break;
-		else if(*ch == '\n')
+	}
+#endif
+
+	for(; i < len; i++)
+	{
+		if(ch[i] == '\r' || ch[i] == '\n')
 			break;
 	}
+	return i;
+}
+
+/*
+ * skip to end of line or the crlfs, return the number of bytes ..
+ */
+static inline int
+rb_linebuf_skip_crlf(char *ch, int len)
+{
+	int i;
+
+	/* First, skip until the first CR or LF */
+	i = rb_linebuf_find_eol(ch, len);
 
 	/* Then, skip until the last CRLF */
-	for(; len; len--, ch++)
+	for(; i < len; i++)
 	{
-		if((*ch != '\r') && (*ch != '\n'))
+		if((ch[i] != '\r') && (ch[i] != '\n'))
 			break;
 	}
-	lrb_assert(orig_len > len);
-	return (orig_len - len);
+	lrb_assert(i > 0);
+	return i;
 }
 
 
@@ -165,11 +361,15 @@ rb_linebuf_newbuf(buf_head_t * bufhead)
 void
 rb_linebuf_donebuf(buf_head_t * bufhead)
 {
-	while(bufhead->list.head != NULL)
+	while(bufhead->numlines > 0)
 	{
-		rb_linebuf_done_line(bufhead, (buf_line_t *) bufhead->list.head->data,
-				     bufhead->list.head);
+		rb_linebuf_done_line(bufhead, rb_linebuf_head(bufhead));
 	}
+
+	rb_free(bufhead->lines);
+	bufhead->lines = NULL;
+	bufhead->linecap = 0;
+	bufhead->first = 0;
 }
 
 /*
@@ -197,21 +397,23 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 {
 	int cpylen = 0;		/* how many bytes we've copied */
 	char *ch = data;	/* Pointer to where we are in the read data */
-	char *bufch = bufline->buf + bufline->len;
+	char *bufch;
 	int clen = 0;		/* how many bytes we've processed,
 				   and don't ever want to see again.. */
 
 	/* If its full or terminated, ignore it */
-
-	bufline->raw = 0;
-	lrb_assert(bufline->len <= LINEBUF_SIZE);
-	if(bufline->terminated == 1)
+	if(bufline != NULL && bufline->terminated == 1)
 		return 0;
 
 	clen = cpylen = rb_linebuf_skip_crlf(ch, len);
 	if(clen == -1)
 		return -1;
 
+	bufline = rb_linebuf_reserve(bufhead, bufline, cpylen);
+	bufline->raw = 0;
+	lrb_assert(bufline->len <= LINEBUF_SIZE);
+	bufch = bufline->buf + bufline->len;
+
 	/* This is the ~overflow case..This doesn't happen often.. */
 	if(cpylen > (LINEBUF_SIZE - bufline->len))
 	{
@@ -271,21 +473,23 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 {
 	int cpylen = 0;		/* how many bytes we've copied */
 	char *ch = data;	/* Pointer to where we are in the read data */
-	char *bufch = bufline->buf + bufline->len;
+	char *bufch;
 	int clen = 0;		/* how many bytes we've processed,
 				   and don't ever want to see again.. */
 
 	/* If its full or terminated, ignore it */
-
-	bufline->raw = 1;
-	lrb_assert(bufline->len <= LINEBUF_SIZE);
-	if(bufline->terminated == 1)
+	if(bufline != NULL && bufline->terminated == 1)
 		return 0;
 
 	clen = cpylen = rb_linebuf_skip_crlf(ch, len);
 	if(clen == -1)
 		return -1;
 
+	bufline = rb_linebuf_reserve(bufhead, bufline, cpylen);
+	bufline->raw = 1;
+	lrb_assert(bufline->len <= LINEBUF_SIZE);
+	bufch = bufline->buf + bufline->len;
+
 	/* This is the overflow case..This doesn't happen often.. */
 	if(cpylen > (LINEBUF_SIZE - bufline->len))
 	{
@@ -344,10 +548,10 @@ rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 	int linecnt = 0;
 
 	/* First, if we have a partial buffer, try to squeze data into it */
-	if(bufhead->list.tail != NULL)
+	if(bufhead->numlines > 0)
 	{
 		/* Check we're doing the partial buffer thing */
-		bufline = bufhead->list.tail->data;
+		bufline = rb_linebuf_tail(bufhead);
 		/* just try, the worst it could do is *reject* us .. */
 		if(!raw)
 			cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
@@ -371,14 +575,11 @@ rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 	/* Next, the loop */
 	while(len > 0)
 	{
-		/* We obviously need a new buffer, so .. */
-		bufline = rb_linebuf_new_line(bufhead);
-
-		/* And parse */
+		/* We obviously need a new buffer, which the copy sizes to fit */
 		if(!raw)
-			cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
+			cpylen = rb_linebuf_copy_line(bufhead, NULL, data, len);
 		else
-			cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, len);
+			cpylen = rb_linebuf_copy_raw(bufhead, NULL, data, len);
 
 		if(cpylen == -1)
 			return -1;
@@ -406,10 +607,10 @@ rb_linebuf_get(buf_head_t * bufhead, char *buf, int buflen, int partial, int raw
 	char *start, *ch;
 
 	/* make sure we have a line */
-	if(bufhead->list.head == NULL)
+	if(bufhead->numlines == 0)
 		return 0;	/* Obviously not.. hrm. */
 
-	bufline = bufhead->list.head->data;
+	bufline = rb_linebuf_head(bufhead);
 
 	/* make sure that the buffer was actually *terminated */
 	if(!(partial || bufline->terminated))
@@ -452,7 +653,7 @@ rb_linebuf_get(buf_head_t * bufhead, char *buf, int buflen, int partial, int raw
 	lrb_assert(cpylen >= 0);
 
 	/* Deallocate the line */
-	rb_linebuf_done_line(bufhead, bufline, bufhead->list.head);
+	rb_linebuf_done_line(bufhead, bufline);
 
 	/* return how much we copied */
 	return cpylen;
@@ -467,20 +668,14 @@ rb_linebuf_get(buf_head_t * bufhead, char *buf, int buflen, int partial, int raw
 void
 rb_linebuf_attach(buf_head_t * bufhead, buf_head_t * new)
 {
-	rb_dlink_node *ptr;
 	buf_line_t *line;
+	int i;
 
-	RB_DLINK_FOREACH(ptr, new->list.head)
+	for(i = 0; i < new->numlines; i++)
 	{
-		line = ptr->data;
-		rb_dlinkAddTailAlloc(line, &bufhead->list);
-
-		/* Update the allocated size */
-		bufhead->alloclen++;
+		line = rb_linebuf_line(new, i);
+		rb_linebuf_link_line(bufhead, line);
 		bufhead->len += line->len;
-		bufhead->numlines++;
-
-		line->refcount++;
 	}
 }
 
@@ -493,25 +688,27 @@ void
 rb_linebuf_put(buf_head_t *bufhead, const rb_strf_t *strings)
 {
 	buf_line_t *bufline;
+	char buf[LINEBUF_SIZE + 1];
 	size_t len = 0;
 	int ret;
 
 	/* make sure the previous line is terminated */
-	if (bufhead->list.tail) {
-		bufline = bufhead->list.tail->data;
+	if (bufhead->numlines > 0) {
+		bufline = rb_linebuf_tail(bufhead);
 		lrb_assert(bufline->terminated);
 	}
 
-	/* create a new line */
-	bufline = rb_linebuf_new_line(bufhead);
-
-	ret = rb_fsnprint(bufline->buf, LINEBUF_SIZE + 1, strings);
+	ret = rb_fsnprint(buf, sizeof(buf), strings);
 	if (ret > 0)
 		len += ret;
 
 	if (len > LINEBUF_SIZE)
 		len = LINEBUF_SIZE;
 
+	/* create a new line just big enough */
+	bufline = rb_linebuf_new_line(bufhead, len + CRLF_LEN + 1);
+	memcpy(bufline->buf, buf, len);
+
 	/* add trailing CRLF */
 	bufline->buf[len++] = '\r';
 	bufline->buf[len++] = '\n';
@@ -548,23 +745,20 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 #ifdef HAVE_WRITEV
 	if(!rb_fd_ssl(F))
 	{
-		rb_dlink_node *ptr;
 		int x = 0, y;
 		int xret;
 		static struct rb_iovec vec[RB_UIO_MAXIOV];
 
 		memset(vec, 0, sizeof(vec));
 		/* Check we actually have a first buffer */
-		if(bufhead->list.head == NULL)
+		if(bufhead->numlines == 0)
 		{
 			/* nope, so we return none .. */
 			errno = EWOULDBLOCK;
 			return -1;
 		}
 
-		ptr = bufhead->list.head;
-
-		bufline = ptr->data;
+		bufline = rb_linebuf_head(bufhead);
 		if(!bufline->terminated)
 		{
 			errno = EWOULDBLOCK;
@@ -574,20 +768,18 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 
 		vec[x].iov_base = bufline->buf + bufhead->writeofs;
 		vec[x++].iov_len = bufline->len - bufhead->writeofs;
-		ptr = ptr->next;
 
 		do
 		{
-			if(ptr == NULL)
+			if(x >= bufhead->numlines)
 				break;
 
-			bufline = ptr->data;
+			bufline = rb_linebuf_line(bufhead, x);
 			if(!bufline->terminated)
 				break;
 
 			vec[x].iov_base = bufline->buf;
 			vec[x].iov_len = bufline->len;
-			ptr = ptr->next;
 
 		}
 		while(++x < RB_UIO_MAXIOV);
@@ -602,17 +794,14 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 		if(retval <= 0)
 			return retval;
 
-		ptr = bufhead->list.head;
-
 		for(y = 0; y < x; y++)
 		{
-			bufline = ptr->data;
+			bufline = rb_linebuf_head(bufhead);
 
 			if(xret >= bufline->len - bufhead->writeofs)
 			{
 				xret -= bufline->len - bufhead->writeofs;
-				ptr = ptr->next;
-				rb_linebuf_done_line(bufhead, bufline, bufhead->list.head);
+				rb_linebuf_done_line(bufhead, bufline);
 				bufhead->writeofs = 0;
 			}
 			else
@@ -629,14 +818,14 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 	/* this is the non-writev case */
 
 	/* Check we actually have a first buffer */
-	if(bufhead->list.head == NULL)
+	if(bufhead->numlines == 0)
 	{
 		/* nope, so we return none .. */
 		errno = EWOULDBLOCK;
 		return -1;
 	}
 
-	bufline = bufhead->list.head->data;
+	bufline = rb_linebuf_head(bufhead);
 
 	/* And that its actually full .. */
 	if(!bufline->terminated)
@@ -660,7 +849,7 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 	{
 		bufhead->writeofs = 0;
 		lrb_assert(bufhead->len >= 0);
-		rb_linebuf_done_line(bufhead, bufline, bufhead->list.head);
+		rb_linebuf_done_line(bufhead, bufline);
 	}
 
 	/* Return line length */
@@ -676,5 +865,31 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 void
 rb_count_rb_linebuf_memory(size_t *count, size_t *rb_linebuf_memory_used)
 {
-	rb_bh_usage(rb_linebuf_heap, count, NULL, rb_linebuf_memory_used, NULL);
+	size_t total_count = 0, total_used = 0, c, u;
+	int i;
+
+	for(i = 0; i < LINEBUF_CLASSES; i++)
+	{
+		rb_bh_usage(rb_linebuf_heap[i], &c, NULL, &u, NULL);
+		total_count += c;
+		total_used += u;
+	}
+
+	if(count != NULL)
+		*count = total_count;
+	if(rb_linebuf_memory_used != NULL)
+		*rb_linebuf_memory_used = total_used;
+}
+
+/*
+ * how much less memory the linebufs in use take than they
+ * would if every line were full sized
+ */
+size_t
+rb_linebuf_memory_saved(void)
+{
+	size_t count, used;
+
+	rb_count_rb_linebuf_memory(&count, &used);
+	return count * LINEBUF_FULL_ELEM - used;
 }
@@ -207,7 +207,7 @@ rb_select_poll(long delay)
 			F->read_handler = NULL;
 			F->read_data = NULL;
 			if(hdl)
-				hdl(F, data);
+				rb_loop_run_fd(hdl, F, data);
 		}
 
 		if(IsFDOpen(F) && (revents & (POLLWRNORM | POLLOUT | POLLHUP | POLLERR)))
@@ -217,7 +217,7 @@ rb_select_poll(long delay)
 			F->write_handler = NULL;
 			F->write_data = NULL;
 			if(hdl)
-				hdl(F, data);
+				rb_loop_run_fd(hdl, F, data);
 		}
 
 		if(F->read_handler == NULL)
@@ -26,10 +26,22 @@
 #include <rb_lib.h>
 #include <commio-int.h>
 #include <commio-ssl.h>
+#include <event-int.h>
 
 static log_cb *rb_log;
 static restart_cb *rb_restart;
 static die_cb *rb_die;
+static loop_cb *rb_loop_hook;
+static loop_slow_cb *rb_loop_slow;
+
+/* event loop accounting for the current pass, see rb_lib_loop() */
+static struct rb_loop_stats loop_stats;
+static uint64_t loop_slow_ns;		/* 0 if not looking for slow passes */
+static uint64_t loop_wake;		/* when the first fd callback ran */
+static rb_fde_t *loop_last_fd;
+static unsigned long loop_ready;
+static char loop_culprit[128];
+static uint64_t loop_culprit_ns;
 
 static struct timeval rb_time;
 static char errbuf[512];
@@ -208,44 +220,171 @@ rb_lib_init(log_cb * ilog, restart_cb * irestart, die_cb * idie, int closeall, i
 	rb_fdlist_init(closeall, maxcon, fd_heap_size);
 	rb_init_netio();
 	rb_init_rb_dlink_nodes(dh_size);
-	if(rb_io_supports_event())
-	{
-		rb_io_init_event();
-	}
 }
 
+/* called by rb_lib_loop() after each pass of the event loop, once the
+ * callbacks for that pass have run */
 void
-rb_lib_loop(long delay)
+rb_set_loop_hook(loop_cb * hook)
 {
-	time_t next;
-	rb_set_time();
+	rb_loop_hook = hook;
+}
+
+/* called by rb_lib_loop() after a pass longer than msec, 0 for never.
+ * Looking for slow passes times every callback to find the culprit.
+ */
+void
+rb_set_loop_slow(unsigned long msec, loop_slow_cb * cb)
+{
+	loop_slow_ns = (uint64_t)msec * 1000000;
+	rb_loop_slow = cb;
+}
+
+void
+rb_get_loop_stats(struct rb_loop_stats *st)
+{
+	*st = loop_stats;
+}
+
+uint64_t
+rb_loop_clock(void)
+{
+	struct timespec ts;
 
-	if(rb_io_supports_event())
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int
+rb_loop_timing(void)
+{
+	return loop_slow_ns != 0;
+}
+
+/* a callback begun at start has just returned; remember it if it is the
+ * longest this pass
+ */
+void
+rb_loop_culprit(uint64_t start, const char *format, ...)
+{
+	uint64_t ns = rb_loop_clock() - start;
+	va_list args;
+
+	if(ns <= loop_culprit_ns)
+		return;
+
+	loop_culprit_ns = ns;
+	va_start(args, format);
+	vsnprintf(loop_culprit, sizeof(loop_culprit), format, args);
+	va_end(args);
+}
+
+/* runs an fd's read or write callback for the backends, counting the
+ * fds ready this pass; the first one marks the end of the wait
+ */
+void
+rb_loop_run_fd(PF * hdl, rb_fde_t *F, void *data)
+{
+	char desc[64];
+	uint64_t start;
+	int fd;
+
+	if(F != loop_last_fd)
+	{
+		if(loop_ready++ == 0)
+			loop_wake = rb_loop_clock();
+		loop_last_fd = F;
+	}
+
+	if(loop_slow_ns == 0)
+	{
+		hdl(F, data);
+		return;
+	}
+
+	/* the callback may close F */
+	fd = F->fd;
+	rb_strlcpy(desc, F->desc != NULL ? F->desc : "", sizeof(desc));
+
+	start = rb_loop_clock();
+	hdl(F, data);
+	rb_loop_culprit(start, "fd %d (%s)", fd, desc);
+}
+
+static void
+loop_account(uint64_t start, uint64_t selected, uint64_t timers, uint64_t end)
+{
+	uint64_t wake = loop_ready > 0 ? loop_wake : selected;
+	uint64_t pass = end - wake, us;
+	int bucket = 0;
+
+	loop_stats.passes++;
+	loop_stats.wait_ns += wake - start;
+	loop_stats.io_ns += selected - wake;
+	loop_stats.timer_ns += timers - selected;
+	loop_stats.hook_ns += end - timers;
+	loop_stats.ready += loop_ready;
+	if(loop_ready > loop_stats.ready_max)
+		loop_stats.ready_max = loop_ready;
+	if(pass > loop_stats.max_ns)
+		loop_stats.max_ns = pass;
+
+	for(us = pass / 16000; us > 0 && bucket < RB_LOOP_BUCKETS - 1; us >>= 1)
+		bucket++;
+	loop_stats.buckets[bucket]++;
+
+	if(loop_slow_ns != 0 && pass >= loop_slow_ns)
 	{
-		while(1)
-			rb_select(-1);
+		struct rb_loop_pass info;
+
+		loop_stats.slow++;
+		if(rb_loop_slow == NULL)
+			return;
+
+		info.pass_ns = pass;
+		info.io_ns = selected - wake;
+		info.timer_ns = timers - selected;
+		info.hook_ns = end - timers;
+		info.ready = loop_ready;
+		info.culprit = loop_culprit_ns > 0 ? loop_culprit : NULL;
+		info.culprit_ns = loop_culprit_ns;
+		rb_loop_slow(&info);
 	}
+}
+
+void
+rb_lib_loop(long delay)
+{
+	uint64_t start, selected, timers;
 
+	rb_set_time();
 
 	while(1)
 	{
+		loop_ready = 0;
+		loop_last_fd = NULL;
+		loop_culprit_ns = 0;
+		start = rb_loop_clock();
+
+		/* sleep until the next event or fd timeout is due */
 		if(delay == 0)
-		{
-			if((next = rb_event_next()) > 0)
-			{
-				next -= rb_current_time();
-				if(next <= 0)
-					next = 1000;
-				else
-					next *= 1000;
-			}
-			else
-				next = -1;
-			rb_select(next);
-		}
+			rb_select(rb_timer_next());
 		else
 			rb_select(delay);
+		selected = rb_loop_clock();
+
 		rb_event_run();
+		timers = rb_loop_clock();
+
+		if(rb_loop_hook != NULL)
+		{
+			uint64_t hook = timers;
+
+			rb_loop_hook();
+			if(loop_slow_ns != 0)
+				rb_loop_culprit(hook, "loop hook");
+		}
+		loop_account(start, selected, timers, rb_loop_clock());
 	}
 }
 
@@ -0,0 +1,246 @@
+/*
+ *  librb: a library used by ircd-ratbox and other things
+ *  timer.c: hierarchical timer wheel for events and fd timeouts
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <event-int.h>
+
+/*
+ * Four levels of 64 slots with 10ms ticks: level 0 holds whatever is due
+ * in the next 640ms, level 1 the next 41 seconds, level 2 the next 43
+ * minutes and level 3 the next 46 hours.  Anything further out is parked
+ * in the last slot it can reach and re-filed when that slot comes round.
+ * Whenever level 0 wraps, the next slot of level 1 is redistributed into
+ * level 0, and so on upwards, so adding and cancelling a timer are O(1)
+ * and each timer is moved at most once per level.
+ *
+ * The wheel keeps its own clock from rb_current_time_tv(), which only
+ * ever moves forwards: if the system clock is stepped back, timers fire
+ * late by that much rather than all at once.
+ */
+#define TIMER_TICK	10	/* milliseconds */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_SPAN	((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static rb_dlink_list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_tick;	/* next tick to run */
+static uint64_t wheel_ms;	/* wheel clock, never goes backwards */
+static uint64_t wheel_last;	/* system clock at the last update */
+static struct rb_timer_stats stats;
+
+static uint64_t
+wheel_clock(void)
+{
+	const struct timeval *tv = rb_current_time_tv();
+	uint64_t now = (uint64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+
+	if(wheel_last != 0 && now > wheel_last)
+		wheel_ms += now - wheel_last;
+	wheel_last = now;
+	return wheel_ms;
+}
+
+static void
+timer_link(struct rb_timer *t)
+{
+	uint64_t expires = t->expires, delta;
+	int level;
+
+	if(expires < wheel_tick)
+		expires = wheel_tick;
+	delta = expires - wheel_tick;
+	if(delta >= WHEEL_SPAN)
+		expires = wheel_tick + WHEEL_SPAN - 1, delta = WHEEL_SPAN - 1;
+
+	for(level = 0; level < WHEEL_LEVELS - 1; level++)
+	{
+		if(delta < ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+
+	t->slot = &wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	rb_dlinkAdd(t, &t->node, t->slot);
+}
+
+static void
+timer_unlink(struct rb_timer *t)
+{
+	rb_dlinkDelete(&t->node, t->slot);
+	t->slot = NULL;
+}
+
+/*
+ * rb_timer_set
+ *
+ * (Re)arms t to call func(arg) msec from now, replacing any pending
+ * expiry it had.
+ */
+void
+rb_timer_set(struct rb_timer *t, long msec, void (*func) (void *), void *arg)
+{
+	if(t->slot != NULL)
+		timer_unlink(t);
+	else
+		stats.pending++;
+
+	if(msec < 0)
+		msec = 0;
+	t->func = func;
+	t->arg = arg;
+	t->expires = wheel_clock() / TIMER_TICK + (msec + TIMER_TICK - 1) / TIMER_TICK;
+	timer_link(t);
+}
+
+void
+rb_timer_cancel(struct rb_timer *t)
+{
+	if(t->slot == NULL)
+		return;
+	timer_unlink(t);
+	stats.pending--;
+}
+
+static void
+timer_cascade(int level, unsigned int idx)
+{
+	rb_dlink_list *list = &wheel[level][idx];
+	struct rb_timer *t;
+
+	while(list->head != NULL)
+	{
+		t = list->head->data;
+		timer_unlink(t);
+		timer_link(t);
+	}
+}
+
+/*
+ * rb_timer_run
+ *
+ * Runs every timer that has come due.  Callbacks may set and cancel
+ * timers, including their own.
+ */
+void
+rb_timer_run(void)
+{
+	uint64_t now = wheel_clock(), target = now / TIMER_TICK;
+	struct rb_timer *t;
+	unsigned int idx;
+	int level;
+
+	while(wheel_tick <= target)
+	{
+		if(stats.pending == 0)
+		{
+			wheel_tick = target + 1;
+			break;
+		}
+
+		idx = wheel_tick & WHEEL_MASK;
+		for(level = 1; idx == 0 && level < WHEEL_LEVELS; level++)
+		{
+			idx = (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+			timer_cascade(level, idx);
+		}
+
+		idx = wheel_tick & WHEEL_MASK;
+		wheel_tick++;
+
+		/* anything armed from a callback lands in a later slot */
+		while(wheel[0][idx].head != NULL)
+		{
+			unsigned long late;
+
+			t = wheel[0][idx].head->data;
+			timer_unlink(t);
+			stats.pending--;
+
+			late = now > t->expires * TIMER_TICK ? now - t->expires * TIMER_TICK : 0;
+			stats.fired++;
+			stats.late_total += late;
+			if(late > stats.late_max)
+				stats.late_max = late;
+
+			t->func(t->arg);
+		}
+	}
+}
+
+/*
+ * rb_timer_next
+ *
+ * Returns how many milliseconds the event loop may sleep before a timer
+ * is due, or -1 if none are pending.  For the upper levels this is the
+ * time of the next cascade that has anything to move, which is never
+ * later than the timers it holds.
+ */
+long
+rb_timer_next(void)
+{
+	uint64_t next = UINT64_MAX, base, now;
+	unsigned int i;
+	int level;
+
+	if(stats.pending == 0)
+		return -1;
+
+	for(i = 0; i < WHEEL_SIZE; i++)
+	{
+		if(wheel[0][(wheel_tick + i) & WHEEL_MASK].head != NULL)
+		{
+			next = wheel_tick + i;
+			break;
+		}
+	}
+
+	/* a cascade can bring in timers due before the level 0 one */
+	for(level = 1; level < WHEEL_LEVELS; level++)
+	{
+		base = wheel_tick >> (WHEEL_BITS * level);
+		/* the current slot was already cascaded unless we sit right on it */
+		for(i = ((base << (WHEEL_BITS * level)) == wheel_tick) ? 0 : 1; i <= WHEEL_SIZE; i++)
+		{
+			if(((base + i) << (WHEEL_BITS * level)) >= next)
+				break;
+			if(wheel[level][(base + i) & WHEEL_MASK].head != NULL)
+			{
+				next = (base + i) << (WHEEL_BITS * level);
+				break;
+			}
+		}
+	}
+
+	if(next == UINT64_MAX)
+		return -1;
+
+	now = wheel_clock();
+	if(next * TIMER_TICK <= now)
+		return 0;
+	return (long)(next * TIMER_TICK - now);
+}
+
+void
+rb_timer_get_stats(struct rb_timer_stats *st)
+{
+	*st = stats;
+}
@@ -162,6 +162,8 @@ ms_ban(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 		aconf->user = NULL;
 		rb_free(aconf->host);
 		aconf->host = NULL;
+		match_prog_free(aconf->host_prog);
+		aconf->host_prog = NULL;
 		operhash_delete(aconf->info.oper);
 		aconf->info.oper = NULL;
 		rb_free(aconf->passwd);
@@ -295,7 +297,7 @@ ms_ban(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 				remove_reject_mask(aconf->host, NULL);
 			else
 			{
-				rb_dlinkAddAlloc(aconf, &xline_conf_list);
+				add_xline_conf(aconf);
 				check_xlines();
 			}
 			break;
@@ -308,7 +310,7 @@ ms_ban(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 			break;
 		case CONF_RESV_NICK:
 			if (!(aconf->status & CONF_ILLEGAL))
-				rb_dlinkAddAlloc(aconf, &resv_conf_list);
+				add_nick_resv_conf(aconf);
 			break;
 	}
 	sendto_server(client_p, NULL, CAP_BAN|CAP_TS6, NOCAPS,
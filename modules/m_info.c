@@ -526,6 +526,31 @@ static struct InfoStruct info_table[] = {
 		"The minimum time between aways",
 		INFO_DECIMAL(&ConfigFileEntry.away_interval),
 	},
+	{
+		"deferred_flush",
+		"Write to clients once per event loop pass",
+		INFO_INTBOOL_YN(&ConfigFileEntry.deferred_flush),
+	},
+	{
+		"deferred_flush_delay",
+		"Longest time in milliseconds a deferred write waits",
+		INFO_DECIMAL(&ConfigFileEntry.deferred_flush_delay),
+	},
+	{
+		"command_timing",
+		"Time command handlers and hook functions",
+		INFO_INTBOOL_YN(&ConfigFileEntry.command_timing),
+	},
+	{
+		"slow_loop_pass",
+		"Log event loop passes longer than this many milliseconds",
+		INFO_DECIMAL(&ConfigFileEntry.slow_loop_pass),
+	},
+	{
+		"loop_stats_interval",
+		"How often event loop statistics are logged",
+		INFO_DECIMAL(&ConfigFileEntry.loop_stats_interval),
+	},
 	{
 		"tls_ciphers_oper_only",
 		"TLS cipher strings are hidden in whois for non-opers",
@@ -194,8 +194,8 @@ rehash_txlines(struct Client *source_p)
 		if(!aconf->hold || aconf->lifetime)
 			continue;
 
+		del_xline_conf(aconf);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &xline_conf_list);
 	}
 }
 
@@ -228,8 +228,8 @@ rehash_tresvs(struct Client *source_p)
 		if(!aconf->hold || aconf->lifetime)
 			continue;
 
+		del_nick_resv_conf(aconf);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &resv_conf_list);
 	}
 }
 
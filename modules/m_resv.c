@@ -355,7 +355,7 @@ parse_resv(struct Client *source_p, const char *name, const char *reason, int te
 			bandb_add(BANDB_RESV, source_p, aconf->host, NULL, aconf->passwd, NULL, 0);
 		}
 
-		rb_dlinkAddAlloc(aconf, &resv_conf_list);
+		add_nick_resv_conf(aconf);
 		resv_nick_fnc(aconf->host, aconf->passwd, temp_time);
 	}
 	else
@@ -490,7 +490,6 @@ static void
 remove_resv(struct Client *source_p, const char *name, int propagated)
 {
 	struct ConfItem *aconf = NULL;
-	rb_dlink_node *ptr;
 	time_t now;
 
 	if(IsChannelName(name))
@@ -558,17 +557,7 @@ remove_resv(struct Client *source_p, const char *name, int propagated)
 	}
 	else
 	{
-		RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-		{
-			aconf = ptr->data;
-
-			if(irccmp(aconf->host, name))
-				aconf = NULL;
-			else
-				break;
-		}
-
-		if(aconf == NULL)
+		if((aconf = find_nick_resv_mask(name)) == NULL)
 		{
 			if(propagated && rb_dlink_list_length(&cluster_conf_list))
 				cluster_generic(source_p, "UNRESV", SHARED_UNRESV, CAP_CLUSTER, "%s", name);
@@ -627,8 +616,7 @@ remove_resv(struct Client *source_p, const char *name, int propagated)
 					       "%s has removed the temporary RESV for: [%s]",
 					       get_oper_name(source_p), name);
 		}
-		/* already have ptr from the loop above.. */
-		rb_dlinkDestroy(ptr, &resv_conf_list);
+		del_nick_resv_conf(aconf);
 	}
 	free_conf(aconf);
 
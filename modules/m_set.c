@@ -66,6 +66,7 @@ struct SetStruct
 static void quote_adminstring(struct Client *, const char *, int);
 static void quote_autoconn(struct Client *, const char *, int);
 static void quote_autoconnall(struct Client *, const char *, int);
+static void quote_cmdtiming(struct Client *, const char *, int);
 static void quote_floodcount(struct Client *, const char *, int);
 static void quote_identtimeout(struct Client *, const char *, int);
 static void quote_max(struct Client *, const char *, int);
@@ -93,6 +94,7 @@ static struct SetStruct set_cmd_table[] = {
 	{"ADMINSTRING",	quote_adminstring,	true,	false	},
 	{"AUTOCONN", 	quote_autoconn, 	true,	true	},
 	{"AUTOCONNALL", quote_autoconnall, 	false,	true	},
+	{"CMDTIMING",	quote_cmdtiming,	true,	false	},
 	{"FLOODCOUNT", 	quote_floodcount, 	false,	true	},
 	{"IDENTTIMEOUT", quote_identtimeout,	false,	true	},
 	{"MAX", 	quote_max, 		false,	true	},
@@ -338,6 +340,36 @@ quote_spamtime(struct Client *source_p, const char *arg, int newval)
 	}
 }
 
+/* SET CMDTIMING */
+static void
+quote_cmdtiming(struct Client *source_p, const char *charval, int intval)
+{
+	if(charval == NULL)
+		sendto_one_notice(source_p, ":CMDTIMING is currently %s",
+				  ConfigFileEntry.command_timing ? "ON" : "OFF");
+	else if(!irccmp(charval, "ON"))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				     "%s is enabling command timing", get_oper_name(source_p));
+		ConfigFileEntry.command_timing = true;
+	}
+	else if(!irccmp(charval, "OFF"))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				     "%s is disabling command timing", get_oper_name(source_p));
+		ConfigFileEntry.command_timing = false;
+	}
+	else if(!irccmp(charval, "RESET"))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				     "%s is resetting command timings", get_oper_name(source_p));
+		reset_command_timing();
+		hook_stats_reset();
+	}
+	else
+		sendto_one_notice(source_p, ":CMDTIMING must be ON, OFF or RESET");
+}
+
 /* this table is what splitmode may be set to */
 static const char *splitmode_values[] = {
 	"OFF",
@@ -23,6 +23,8 @@
  */
 
 #include "stdinc.h"
+#include "banmatch.h"
+#include "maskindex.h"
 #include "class.h"		/* report_classes */
 #include "client.h"		/* Client */
 #include "match.h"
@@ -46,6 +48,7 @@
 #include "whowas.h"
 #include "rb_radixtree.h"
 #include "sslproc.h"
+#include "wsproc.h"
 #include "s_assert.h"
 
 static const char stats_desc[] =
@@ -98,6 +101,7 @@ struct stats_cmd
 static void stats_dns_servers(struct Client *);
 static void stats_delay(struct Client *);
 static void stats_hash(struct Client *);
+static void stats_hooks(struct Client *);
 static void stats_connect(struct Client *);
 static void stats_tdeny(struct Client *);
 static void stats_deny(struct Client *);
@@ -108,6 +112,7 @@ static void stats_auth(struct Client *);
 static void stats_tklines(struct Client *);
 static void stats_klines(struct Client *);
 static void stats_messages(struct Client *);
+static void stats_message_timing(struct Client *);
 static void stats_dnsbl(struct Client *);
 static void stats_oper(struct Client *);
 static void stats_privset(struct Client *);
@@ -121,6 +126,7 @@ static void stats_usage(struct Client *);
 static void stats_tstats(struct Client *);
 static void stats_uptime(struct Client *);
 static void stats_servers(struct Client *);
+static void stats_wsockd(struct Client *);
 static void stats_tgecos(struct Client *);
 static void stats_gecos(struct Client *);
 static void stats_class(struct Client *);
@@ -157,6 +163,7 @@ static struct stats_cmd stats_cmd_table[256] = {
 	['f'] = HANDLER_NORM(stats_comm,	true,	NULL),
 	['F'] = HANDLER_NORM(stats_comm,	true,	NULL),
 	['g'] = HANDLER_NORM(stats_prop_klines,	false,	"oper:general"),
+	['h'] = HANDLER_NORM(stats_hooks,	false,	"oper:general"),
 	['i'] = HANDLER_NORM(stats_auth,	false,	NULL),
 	['I'] = HANDLER_NORM(stats_auth,	false,	NULL),
 	['k'] = HANDLER_NORM(stats_tklines,	false,	NULL),
@@ -164,7 +171,7 @@ static struct stats_cmd stats_cmd_table[256] = {
 	['l'] = HANDLER_PARV(stats_ltrace,	false,	NULL),
 	['L'] = HANDLER_PARV(stats_ltrace,	false,	NULL),
 	['m'] = HANDLER_NORM(stats_messages,	false,	NULL),
-	['M'] = HANDLER_NORM(stats_messages,	false,	NULL),
+	['M'] = HANDLER_NORM(stats_message_timing,	false,	"oper:general"),
 	['n'] = HANDLER_NORM(stats_dnsbl,	false,	NULL),
 	['o'] = HANDLER_NORM(stats_oper,	false,	NULL),
 	['O'] = HANDLER_NORM(stats_privset,	false,	"oper:privs"),
@@ -181,6 +188,7 @@ static struct stats_cmd stats_cmd_table[256] = {
 	['u'] = HANDLER_NORM(stats_uptime,	false,	NULL),
 	['v'] = HANDLER_NORM(stats_servers,	false,	NULL),
 	['V'] = HANDLER_NORM(stats_servers,	false,	NULL),
+	['W'] = HANDLER_NORM(stats_wsockd,	true,	NULL),
 	['x'] = HANDLER_NORM(stats_tgecos,	false,	"oper:general"),
 	['X'] = HANDLER_NORM(stats_gecos,	false,	"oper:general"),
 	['y'] = HANDLER_NORM(stats_class,	false,	NULL),
@@ -284,6 +292,23 @@ stats_dns_servers (struct Client *source_p)
 	{
 		sendto_one_numeric(source_p, RPL_STATSDEBUG, "A :%s", (char *)n->data);
 	}
+
+	if(dns_cache_stats.updated != 0)
+	{
+		struct dns_cache_stats *st = &dns_cache_stats;
+		unsigned long answered = st->hits + st->neg_hits + st->coalesced;
+		unsigned long total = answered + st->misses;
+
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				"A :DNS cache: %lu entries, %lu hits, %lu negative hits, "
+				"%lu coalesced, %lu misses (%lu%% hit rate), %lu evicted, "
+				"%lu expired, as of %ld seconds ago",
+				st->entries, st->hits, st->neg_hits, st->coalesced, st->misses,
+				total ? answered * 100 / total : 0, st->evicted, st->expired,
+				(long)(rb_current_time() - st->updated));
+	}
+
+	refresh_dns_cache_stats();
 }
 
 static void
@@ -313,6 +338,54 @@ stats_hash(struct Client *source_p)
 
 	rb_dictionary_stats_walk(stats_hash_cb, source_p);
 	rb_radixtree_stats_walk(stats_hash_cb, source_p);
+	hash_stats_walk(stats_hash_cb, source_p);
+}
+
+/* the module whose hook function list has fn in it */
+static const char *
+hook_fn_module(const char *name, hookfn fn)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, module_list.head)
+	{
+		struct module *mod = ptr->data;
+		mapi_hfn_list_av1 *m = NULL;
+
+		if(mod->mapi_version == 1)
+			m = ((struct mapi_mheader_av1 *)mod->mapi_header)->mapi_hfn_list;
+		else if(mod->mapi_version == 2)
+			m = ((struct mapi_mheader_av2 *)mod->mapi_header)->mapi_hfn_list;
+
+		for(; m != NULL && m->hapi_name != NULL; m++)
+		{
+			if(m->fn == fn && !irccmp(m->hapi_name, name))
+				return mod->name;
+		}
+	}
+
+	return "ircd";
+}
+
+static void
+stats_hooks_cb(const char *name, hookfn fn, const struct hook_fn_stats *stats, void *privdata)
+{
+	struct Client *source_p = privdata;
+
+	if(stats->count == 0)
+		return;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "h :%s %s calls %lu total %lluus avg %lluus max %lluus",
+			   name, hook_fn_module(name, fn), stats->count,
+			   stats->total_ns / 1000, stats->total_ns / stats->count / 1000,
+			   stats->max_ns / 1000);
+}
+
+static void
+stats_hooks(struct Client *source_p)
+{
+	hook_stats_walk(stats_hooks_cb, source_p);
 }
 
 static void
@@ -495,6 +568,7 @@ static void
 stats_events (struct Client *source_p)
 {
 	rb_dump_events(stats_events_cb, source_p);
+	dump_ban_check(stats_events_cb, source_p);
 }
 
 static void
@@ -712,6 +786,7 @@ stats_messages(struct Client *source_p)
 {
 	rb_dictionary_iter iter;
 	struct Message *msg;
+	struct MessageTiming *timing;
 
 	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
 	{
@@ -721,6 +796,72 @@ stats_messages(struct Client *source_p)
 				   msg->cmd, msg->count,
 				   msg->bytes, msg->rcount);
 	}
+
+	if(!IsOperGeneral(source_p))
+		return;
+
+	RB_DICTIONARY_FOREACH(timing, &iter, cmd_timing_dict)
+	{
+		for(int i = 0; i < LAST_HANDLER_TYPE; i++)
+		{
+			unsigned long count = timing->handlers[i].count;
+			unsigned long seen = 0;
+			int p99;
+
+			if(count == 0)
+				continue;
+
+			/* the bucket holding the 99th percentile, by its upper bound */
+			for(p99 = 0; p99 < MESSAGE_TIMING_BUCKETS - 1; p99++)
+			{
+				seen += timing->handlers[i].buckets[p99];
+				if(seen * 100 >= count * 99)
+					break;
+			}
+
+			sendto_one_numeric(source_p, RPL_STATSDEBUG,
+					   "m :%s %s calls %lu avg %lluus max %lluus p99 %s%lluus",
+					   timing->cmd, handler_type_name(i), count,
+					   timing->handlers[i].total_ns / count / 1000,
+					   timing->handlers[i].max_ns / 1000,
+					   p99 == MESSAGE_TIMING_BUCKETS - 1 ? ">=" : "<",
+					   1ULL << (p99 == MESSAGE_TIMING_BUCKETS - 1 ? p99 - 1 : p99));
+		}
+	}
+}
+
+/*
+ * STATS M: the handler timings in full, one line per command and handler
+ * type: calls, total and max microseconds, then the histogram buckets,
+ * under 1us and doubling from there, the last holding everything longer.
+ */
+static void
+stats_message_timing(struct Client *source_p)
+{
+	rb_dictionary_iter iter;
+	struct MessageTiming *timing;
+	char buf[MESSAGE_TIMING_BUCKETS * 21];	/* 20 digits and a comma each */
+
+	RB_DICTIONARY_FOREACH(timing, &iter, cmd_timing_dict)
+	{
+		for(int i = 0; i < LAST_HANDLER_TYPE; i++)
+		{
+			size_t len = 0;
+
+			if(timing->handlers[i].count == 0)
+				continue;
+
+			for(int b = 0; b < MESSAGE_TIMING_BUCKETS && len < sizeof(buf); b++)
+				len += snprintf(buf + len, sizeof(buf) - len, "%s%lu",
+						b ? "," : "", timing->handlers[i].buckets[b]);
+
+			sendto_one_numeric(source_p, RPL_STATSDEBUG, "M :%s %s %lu %llu %llu %s",
+					   timing->cmd, handler_type_name(i),
+					   timing->handlers[i].count,
+					   timing->handlers[i].total_ns / 1000,
+					   timing->handlers[i].max_ns / 1000, buf);
+		}
+	}
 }
 
 static void
@@ -735,9 +876,12 @@ stats_dnsbl(struct Client *source_p)
 	RB_DICTIONARY_FOREACH(stats, &iter, dnsbl_stats)
 	{
 		/* use RPL_STATSDEBUG for now -- jilles */
-		sendto_one_numeric(source_p, RPL_STATSDEBUG, "n :%d %s",
-				stats->hits, (const char *)iter.cur->key);
+		sendto_one_numeric(source_p, RPL_STATSDEBUG, "n :%d %s (%u lookups, %u cached)",
+				stats->hits, (const char *)iter.cur->key,
+				stats->answers, stats->cached);
 	}
+
+	refresh_dnsbl_stats();
 }
 
 static void
@@ -921,6 +1065,32 @@ stats_ssld(struct Client *source_p)
 	ssld_foreach_info(stats_ssld_foreach, source_p);
 }
 
+static void
+stats_wsockd_foreach(void *data, pid_t pid, int cli_count, enum wsockd_status status, const struct wsockd_stats *stats)
+{
+	struct Client *source_p = data;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			"W :%ld %c %u deflate %llu out %llu/%llu (%.1f%%) in %llu/%llu (%.1f%%) cpu %llums",
+			(long)pid,
+			status == WSOCKD_DEAD ? 'D' : (status == WSOCKD_SHUTDOWN ? 'S' : 'A'),
+			cli_count,
+			(unsigned long long)stats->deflate_conns,
+			(unsigned long long)stats->deflate_out,
+			(unsigned long long)stats->deflate_in,
+			stats->deflate_in ? 100.0 * stats->deflate_out / stats->deflate_in : 100.0,
+			(unsigned long long)stats->inflate_in,
+			(unsigned long long)stats->inflate_out,
+			stats->inflate_out ? 100.0 * stats->inflate_in / stats->inflate_out : 100.0,
+			(unsigned long long)stats->cpu_usec / 1000);
+}
+
+static void
+stats_wsockd(struct Client *source_p)
+{
+	wsockd_foreach_info(stats_wsockd_foreach, source_p);
+}
+
 static void
 stats_usage (struct Client *source_p)
 {
@@ -1043,6 +1213,9 @@ stats_tstats (struct Client *source_p)
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "T :sasl successes %u fails %u",
 			   sp.is_ssuc, sp.is_sbad);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "T :deferred writes %llu saved %llu early %llu",
+			   sp.is_dflush, sp.is_dfsaved, sp.is_dfearly);
 	sendto_one_numeric(source_p, RPL_STATSDEBUG, "T :Client Server");
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "T :connected %u %u", sp.is_cl, sp.is_sv);
@@ -1174,6 +1347,31 @@ stats_class(struct Client *source_p)
 		report_classes(source_p);
 }
 
+static void
+stats_memory_heap_cb(size_t bused, size_t bfree, size_t bmemusage, size_t heapalloc,
+		     const char *desc, void *data)
+{
+	struct Client *source_p = data;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :blockheap %s elements used %lu free %lu memory in use %lu total allocated %lu",
+			   desc, (unsigned long)bused, (unsigned long)bfree,
+			   (unsigned long)bmemusage, (unsigned long)heapalloc);
+}
+
+static void
+stats_mask_index(struct Client *source_p, const char *name, struct mask_index *idx)
+{
+	struct mask_index_stats st;
+
+	mask_index_stats(idx, &st);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :%s index %u(%lu) unindexed %u lookups %lu checked %lu skipped %lu",
+			   name, st.entries, (unsigned long)st.memory, st.unindexed,
+			   st.lookups, st.checked, st.skipped);
+}
+
 static void
 stats_memory (struct Client *source_p)
 {
@@ -1186,6 +1384,10 @@ stats_memory (struct Client *source_p)
 	int users_counted = 0;	/* user structs */
 
 	int channel_users = 0;
+	int channel_indexed = 0;
+	size_t channel_index_memory = 0;
+	int channel_banmatch = 0;
+	size_t channel_banmatch_memory = 0;
 	int channel_invites = 0;
 	int channel_bans = 0;
 	int channel_except = 0;
@@ -1225,6 +1427,9 @@ stats_memory (struct Client *source_p)
 
 	size_t total_memory = 0;
 
+	size_t bh_total_alloc = 0;
+	size_t bh_total_used = 0;
+
 	whowas_memory_usage(&ww, &wwm);
 
 	RB_DLINK_FOREACH(ptr, global_client_list.head)
@@ -1258,6 +1463,18 @@ stats_memory (struct Client *source_p)
 		channel_users += rb_dlink_list_length(&chptr->members);
 		channel_invites += rb_dlink_list_length(&chptr->invites);
 
+		if(chptr->member_index != NULL)
+		{
+			channel_indexed++;
+			channel_index_memory += channel_member_index_memory(chptr);
+		}
+
+		if(chptr->banmatch != NULL)
+		{
+			channel_banmatch++;
+			channel_banmatch_memory += banmatch_memory(chptr);
+		}
+
 		RB_DLINK_FOREACH(rb_dlink, chptr->banlist.head)
 		{
 			channel_bans++;
@@ -1337,8 +1554,16 @@ stats_memory (struct Client *source_p)
 			   channel_invites,
 			   (unsigned long) channel_invites * sizeof(rb_dlink_node));
 
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Channel member index %u(%lu)",
+			   channel_indexed, (unsigned long) channel_index_memory);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Channel ban matchers %u(%lu)",
+			   channel_banmatch, (unsigned long) channel_banmatch_memory);
+
 	total_channel_memory = channel_memory +
-		channel_ban_memory +
+		channel_ban_memory + channel_index_memory + channel_banmatch_memory +
 		channel_users * sizeof(rb_dlink_node) + channel_invites * sizeof(rb_dlink_node);
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
@@ -1353,8 +1578,9 @@ stats_memory (struct Client *source_p)
 			   CH_MAX, (long)(CH_MAX * sizeof(rb_dlink_list)));
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
-			   "z :linebuf %ld(%ld)",
-			   (long)linebuf_count, (long)linebuf_memory_used);
+			   "z :linebuf %ld(%ld) saved by compact lines %ld",
+			   (long)linebuf_count, (long)linebuf_memory_used,
+			   (long)rb_linebuf_memory_saved());
 
 	count_scache(&number_servers_cached, &mem_servers_cached);
 
@@ -1366,6 +1592,9 @@ stats_memory (struct Client *source_p)
 			   "z :hostname hash %d(%ld)",
 			   HOST_MAX, (long)HOST_MAX * sizeof(rb_dlink_list));
 
+	stats_mask_index(source_p, "X-line", xline_index);
+	stats_mask_index(source_p, "Nick RESV", nick_resv_index);
+
 	total_memory = totww + total_channel_memory + conf_memory +
 		class_count * sizeof(struct Class);
 
@@ -1390,6 +1619,13 @@ stats_memory (struct Client *source_p)
 			   "z :Remote client Memory in use: %ld(%ld)",
 			   (long)remote_client_count,
 			   (long)remote_client_memory_used);
+
+	rb_bh_usage_all(stats_memory_heap_cb, source_p);
+	rb_bh_total_usage(&bh_total_alloc, &bh_total_used);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :blockheaps total allocated %lu in use %lu",
+			   (unsigned long)bh_total_alloc, (unsigned long)bh_total_used);
 }
 
 static void
@@ -1432,6 +1668,20 @@ stats_servlinks (struct Client *source_p)
 			(rb_current_time() > target_p->localClient->lasttime) ?
 			 (rb_current_time() - target_p->localClient->lasttime) : 0,
 			IsOperGeneral (source_p) ? show_capabilities (target_p) : "TS");
+
+		if(target_p->localClient->zipstats != NULL)
+		{
+			struct ZipStats *zips = target_p->localClient->zipstats;
+
+			sendto_one_numeric(source_p, RPL_STATSDEBUG,
+					   "? :Zipstats for %s send[%.2f%% compression (%llu kB data/%llu kB wire) %.1f kB/s] "
+					   "recv[%.2f%% compression (%llu kB data/%llu kB wire) %.1f kB/s]",
+					   target_p->name,
+					   zips->out_ratio, zips->out >> 10, zips->out_wire >> 10,
+					   zips->out_rate / 1024,
+					   zips->in_ratio, zips->in >> 10, zips->in_wire >> 10,
+					   zips->in_rate / 1024);
+		}
 	}
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
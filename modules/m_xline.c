@@ -327,7 +327,7 @@ apply_xline(struct Client *source_p, const char *name, const char *reason, int t
 		ilog(L_KLINE, "X %s 0 %s %s", get_oper_name(source_p), name, aconf->passwd);
 	}
 
-	rb_dlinkAddAlloc(aconf, &xline_conf_list);
+	add_xline_conf(aconf);
 	check_xlines();
 }
 
@@ -523,8 +523,8 @@ remove_xline(struct Client *source_p, const char *name, bool propagated)
 			}
 
 			remove_reject_mask(aconf->host, NULL);
+			del_xline_conf(aconf);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &xline_conf_list);
 			return;
 		}
 	}
@@ -22,6 +22,10 @@
 
 #include "stdinc.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #define MAXPASSFD 4
 #ifndef READBUF_SIZE
 #define READBUF_SIZE 16384
@@ -66,6 +70,15 @@ typedef struct _mod_ctl
 
 static mod_ctl_t *mod_ctl;
 
+#ifdef HAVE_LIBZ
+typedef struct _zlib_stream
+{
+	z_stream instream;
+	z_stream outstream;
+	bool pending;		/* deflated input not flushed out yet */
+} zlib_stream_t;
+#endif
+
 typedef struct _conn
 {
 	rb_dlink_node node;
@@ -135,7 +148,11 @@ static void mod_cmd_write_queue(mod_ctl_t * ctl, const void *data, size_t len);
 static const char *remote_closed = "Remote host closed the connection";
 static bool ssld_ssl_ok;
 static int certfp_method = RB_SSL_CERTFP_METH_CERT_SHA1;
+#ifdef HAVE_LIBZ
+static bool zlib_ok = true;
+#else
 static bool zlib_ok = false;
+#endif
 
 
 static conn_t *
@@ -163,6 +180,15 @@ conn_add_id_hash(conn_t * conn, uint32_t id)
 static void
 free_conn(conn_t * conn)
 {
+#ifdef HAVE_LIBZ
+	if(IsZip(conn))
+	{
+		zlib_stream_t *stream = conn->stream;
+		inflateEnd(&stream->instream);
+		deflateEnd(&stream->outstream);
+		rb_free(stream);
+	}
+#endif
 	rb_free_rawbuffer(conn->modbuf_out);
 	rb_free_rawbuffer(conn->plainbuf_out);
 	rb_free(conn);
@@ -339,6 +365,92 @@ mod_cmd_write_queue(mod_ctl_t * ctl, const void *data, size_t len)
 	mod_write_ctl(ctl->F, ctl);
 }
 
+#ifdef HAVE_LIBZ
+/*
+ * Everything read from the ircd in one pass is deflated as a single run
+ * and only sync-flushed once the plain side runs dry (or we cork), so a
+ * burst compresses as a whole rather than read by read, without holding
+ * back anything the other end is waiting for.
+ */
+static void
+zlib_deflate(conn_t * conn, void *buf, size_t len, int flush)
+{
+	uint8_t outbuf[READBUF_SIZE];
+	zlib_stream_t *stream = conn->stream;
+	z_stream *outstream = &stream->outstream;
+	size_t have;
+	int ret;
+
+	if(flush == Z_NO_FLUSH)
+		stream->pending = true;
+	else if(!stream->pending)
+		return;
+	else
+		stream->pending = false;
+
+	outstream->next_in = buf;
+	outstream->avail_in = len;
+	do
+	{
+		outstream->next_out = outbuf;
+		outstream->avail_out = sizeof(outbuf);
+		ret = deflate(outstream, flush);
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			close_conn(conn, WAIT_PLAIN, "error compressing data: %s", zError(ret));
+			return;
+		}
+		have = sizeof(outbuf) - outstream->avail_out;
+		if(have > 0)
+			conn_mod_write(conn, outbuf, have);
+	}
+	while(outstream->avail_out == 0);
+}
+
+static void
+zlib_inflate(conn_t * conn, void *buf, size_t len)
+{
+	uint8_t outbuf[READBUF_SIZE];
+	z_stream *instream = &((zlib_stream_t *) conn->stream)->instream;
+	size_t have;
+	int ret;
+
+	instream->next_in = buf;
+	instream->avail_in = len;
+	do
+	{
+		instream->next_out = outbuf;
+		instream->avail_out = sizeof(outbuf);
+		ret = inflate(instream, Z_NO_FLUSH);
+		if(ret == Z_STREAM_END)
+		{
+			close_conn(conn, WAIT_PLAIN, "compressed stream ended");
+			return;
+		}
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			close_conn(conn, WAIT_PLAIN, "error decompressing data: %s",
+				   instream->msg != NULL ? instream->msg : zError(ret));
+			return;
+		}
+		have = sizeof(outbuf) - instream->avail_out;
+		if(have > 0)
+			conn_plain_write(conn, outbuf, have);
+	}
+	while(instream->avail_out == 0);
+}
+#endif
+
+static void
+conn_mod_flush(conn_t * conn)
+{
+#ifdef HAVE_LIBZ
+	if(IsZip(conn))
+		zlib_deflate(conn, NULL, 0, Z_SYNC_FLUSH);
+#endif
+	conn_mod_write_sendq(conn->mod_fd, conn);
+}
+
 static bool
 plain_check_cork(conn_t * conn)
 {
@@ -349,7 +461,7 @@ plain_check_cork(conn_t * conn)
 		SetCork(conn);
 		rb_setselect(conn->plain_fd, RB_SELECT_READ, NULL, NULL);
 		/* try to write */
-		conn_mod_write_sendq(conn->mod_fd, conn);
+		conn_mod_flush(conn);
 		return true;
 	}
 	return false;
@@ -387,12 +499,17 @@ conn_plain_read_cb(rb_fde_t *fd, void *data)
 		if(length < 0)
 		{
 			rb_setselect(conn->plain_fd, RB_SELECT_READ, conn_plain_read_cb, conn);
-			conn_mod_write_sendq(conn->mod_fd, conn);
+			conn_mod_flush(conn);
 			return;
 		}
 		conn->plain_in += length;
 
-		conn_mod_write(conn, inbuf, length);
+#ifdef HAVE_LIBZ
+		if(IsZip(conn))
+			zlib_deflate(conn, inbuf, length, Z_NO_FLUSH);
+		else
+#endif
+			conn_mod_write(conn, inbuf, length);
 		if(IsDead(conn))
 			return;
 		if(plain_check_cork(conn))
@@ -485,7 +602,12 @@ conn_mod_read_cb(rb_fde_t *fd, void *data)
 			return;
 		}
 		conn->mod_in += length;
-		conn_plain_write(conn, inbuf, length);
+#ifdef HAVE_LIBZ
+		if(IsZip(conn))
+			zlib_inflate(conn, inbuf, length);
+		else
+#endif
+			conn_plain_write(conn, inbuf, length);
 	}
 }
 
@@ -679,6 +801,58 @@ ssl_process_connect(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	rb_ssl_start_connected(ctlb->F[0], ssl_process_connect_cb, conn, 10);
 }
 
+#ifdef HAVE_LIBZ
+/*
+ * Z: start compressing a server link.  F[0] is the ircd's end of the
+ * link (a socket, or the plain side of an ssld TLS connection), F[1]
+ * the ircd's new end.  Whatever the ircd had already read past the
+ * SERVER line comes along after the id, still compressed.
+ */
+static void
+zlib_process(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	zlib_stream_t *stream;
+	conn_t *conn;
+	uint32_t id;
+
+	conn = make_conn(ctl, ctlb->F[0], ctlb->F[1]);
+	if(rb_get_type(conn->mod_fd) == RB_FD_UNKNOWN)
+		rb_set_type(conn->mod_fd, RB_FD_SOCKET);
+
+	if(rb_get_type(conn->plain_fd) == RB_FD_UNKNOWN)
+		rb_set_type(conn->plain_fd, RB_FD_SOCKET);
+
+	id = buf_to_uint32(&ctlb->buf[1]);
+	conn_add_id_hash(conn, id);
+
+	stream = rb_malloc(sizeof(zlib_stream_t));
+	if(inflateInit(&stream->instream) != Z_OK)
+	{
+		rb_free(stream);
+		close_conn(conn, WAIT_PLAIN, "zlib initialisation failed");
+		return;
+	}
+	if(deflateInit(&stream->outstream, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		inflateEnd(&stream->instream);
+		rb_free(stream);
+		close_conn(conn, WAIT_PLAIN, "zlib initialisation failed");
+		return;
+	}
+	conn->stream = stream;
+	SetZip(conn);
+
+	if(ctlb->buflen > 5)
+	{
+		conn->mod_in += ctlb->buflen - 5;
+		zlib_inflate(conn, &ctlb->buf[5], ctlb->buflen - 5);
+	}
+
+	conn_mod_read_cb(conn->mod_fd, conn);
+	conn_plain_read_cb(conn->plain_fd, conn);
+}
+#endif
+
 static void
 process_stats(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
@@ -687,6 +861,9 @@ process_stats(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	uint8_t *odata;
 	uint32_t id;
 
+	if(ctlb->buflen < 6 || ctlb->buf[ctlb->buflen - 1] != '\0')
+		return;
+
 	id = buf_to_uint32(&ctlb->buf[1]);
 
 	odata = &ctlb->buf[5];
@@ -855,8 +1032,23 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 			}
 
 		case 'Z':
-			send_nozlib_support(ctl, ctl_buf);
-			break;
+			{
+				if (ctl_buf->nfds != 2 || ctl_buf->buflen < 5)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+
+				if(!zlib_ok)
+				{
+					send_nozlib_support(ctl, ctl_buf);
+					break;
+				}
+#ifdef HAVE_LIBZ
+				zlib_process(ctl, ctl_buf);
+#endif
+				break;
+			}
 
 		default:
 			break;
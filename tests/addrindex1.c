@@ -0,0 +1,213 @@
+/*
+ *  addrindex1.c: Test the IP mask trees behind find_conf_by_address()
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include <stdinc.h>
+#include <client.h>
+#include <hostmask.h>
+#include <match.h>
+#include <operhash.h>
+#include <s_conf.h>
+
+#include "ircd_util.h"
+#include "tap/basic.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static struct ConfItem *
+ban(int status, const char *user, const char *host)
+{
+	struct ConfItem *aconf = make_conf();
+
+	aconf->status = status;
+	aconf->user = rb_strdup(user);
+	aconf->host = rb_strdup(host);
+	aconf->passwd = rb_strdup("test");
+	if(IsConfBan(aconf))
+		aconf->info.oper = operhash_add("test");
+	else
+		aconf->info.name = rb_strdup("test");
+	add_conf_by_address(aconf->host, status, aconf->user, NULL, aconf);
+
+	return aconf;
+}
+
+static void
+unban(struct ConfItem *aconf)
+{
+	delete_one_address_conf(aconf->host, aconf);
+}
+
+static struct ConfItem *
+kline_at(const char *ip, const char *user)
+{
+	struct rb_sockaddr_storage addr;
+
+	if(rb_inet_pton_sock(ip, &addr) <= 0)
+		return (struct ConfItem *)-1;
+
+	return find_conf_by_address(NULL, ip, NULL, (struct sockaddr *)&addr,
+			CONF_KILL, GET_SS_FAMILY(&addr), user, NULL);
+}
+
+static struct ConfItem *
+dline_at(const char *ip)
+{
+	struct rb_sockaddr_storage addr;
+
+	if(rb_inet_pton_sock(ip, &addr) <= 0)
+		return (struct ConfItem *)-1;
+
+	return find_dline((struct sockaddr *)&addr, GET_SS_FAMILY(&addr));
+}
+
+static void
+kline1(void)
+{
+	struct ConfItem *a = ban(CONF_KILL, "*", "192.0.2.0/24");
+	struct ConfItem *b = ban(CONF_KILL, "bad", "192.0.2.128/25");
+	struct ConfItem *c = ban(CONF_KILL, "*", "2001:db8::/32");
+
+	is_bool(true, kline_at("192.0.2.1", "user") == a, MSG);
+	is_bool(true, kline_at("192.0.2.200", "bad") == a, MSG);
+	is_bool(true, kline_at("192.0.3.1", "user") == NULL, MSG);
+	is_bool(true, kline_at("2001:db8::1", "user") == c, MSG);
+	is_bool(true, kline_at("2001:db9::1", "user") == NULL, MSG);
+	is_bool(true, kline_at("2002:c000:201::1", "user") == a, MSG);
+
+	unban(a);
+	is_bool(true, kline_at("192.0.2.1", "user") == NULL, MSG);
+	is_bool(true, kline_at("192.0.2.200", "user") == NULL, MSG);
+	is_bool(true, kline_at("192.0.2.200", "bad") == b, MSG);
+
+	unban(b);
+	unban(c);
+	is_bool(true, kline_at("192.0.2.200", "bad") == NULL, MSG);
+	is_bool(true, kline_at("2001:db8::1", "user") == NULL, MSG);
+}
+
+static void
+dline1(void)
+{
+	struct ConfItem *a = ban(CONF_DLINE, "*", "198.51.100.0/24");
+	struct ConfItem *b = ban(CONF_DLINE, "*", "0.0.0.0/0");
+	struct ConfItem *e = ban(CONF_EXEMPTDLINE, "*", "198.51.100.7");
+
+	is_bool(true, dline_at("198.51.100.1") == a, MSG);
+	is_bool(true, dline_at("203.0.113.1") == b, MSG);
+	is_bool(true, dline_at("198.51.100.7") == e, MSG);
+	is_bool(true, dline_at("2001:db8::1") == NULL, MSG);
+
+	unban(b);
+	is_bool(true, dline_at("203.0.113.1") == NULL, MSG);
+	is_bool(true, dline_at("198.51.100.1") == a, MSG);
+
+	unban(e);
+	is_bool(true, dline_at("198.51.100.7") == a, MSG);
+
+	unban(a);
+	is_bool(true, dline_at("198.51.100.1") == NULL, MSG);
+}
+
+/* the highest precedence match over every mask, as the hash probing
+ * used to find */
+static struct ConfItem *
+reference_find(struct sockaddr *addr, struct ConfItem **bans, int count)
+{
+	struct ConfItem *best = NULL;
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		struct rb_sockaddr_storage mask;
+		int bits;
+
+		if(bans[i] == NULL)
+			continue;
+
+		parse_netmask(bans[i]->host, &mask, &bits);
+
+		if(comp_with_mask_sock(addr, (struct sockaddr *)&mask, bits))
+			best = best != NULL ? best : bans[i];
+	}
+
+	return best;
+}
+
+static void
+random1(void)
+{
+	struct ConfItem *bans[2000];
+	int mismatches = 0;
+	char buf[64];
+	int i;
+
+	srand(1);
+
+	/* the first one added has the highest precedence */
+	for(i = 0; i < 2000; i++)
+	{
+		snprintf(buf, sizeof(buf), "10.%d.%d.%d/%d", rand() % 4, rand() % 4,
+				rand() % 256, 8 + rand() % 25);
+		bans[i] = ban(CONF_KILL, "*", buf);
+	}
+
+	for(i = 0; i < 2000; i += 3)
+	{
+		unban(bans[i]);
+		bans[i] = NULL;
+	}
+
+	for(i = 0; i < 5000; i++)
+	{
+		struct rb_sockaddr_storage addr;
+
+		snprintf(buf, sizeof(buf), "10.%d.%d.%d", rand() % 5, rand() % 5, rand() % 256);
+		rb_inet_pton_sock(buf, &addr);
+
+		if(kline_at(buf, "user") != reference_find((struct sockaddr *)&addr, bans, 2000))
+		{
+			diag("kline_at %s", buf);
+			mismatches++;
+		}
+	}
+
+	is_int(0, mismatches, MSG);
+
+	for(i = 0; i < 2000; i++)
+		if(bans[i] != NULL)
+			unban(bans[i]);
+
+	is_bool(true, kline_at("10.0.0.1", "user") == NULL, MSG);
+}
+
+int
+main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+
+	kline1();
+	dline1();
+	random1();
+
+	ircd_util_free();
+
+	return 0;
+}
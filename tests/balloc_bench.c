@@ -0,0 +1,114 @@
+/*
+ *  balloc_bench.c: Compare the block allocator against malloc
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "channel.h"
+
+#define LIVE 20000
+#define ROUNDS 50
+
+static void *live[LIVE];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Each round allocates LIVE elements then frees them in a shuffled order,
+ * roughly what a connect storm followed by a netsplit looks like.
+ */
+static void shuffle(unsigned int *order)
+{
+	unsigned int i, j, t;
+
+	for (i = 0; i < LIVE; i++)
+		order[i] = i;
+	for (i = LIVE - 1; i > 0; i--)
+	{
+		j = rand() % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+static void bench(const char *name, size_t size, int perblock)
+{
+	static unsigned int order[LIVE];
+	rb_bh *bh = rb_bh_create(size, perblock, name);
+	double start, t_malloc, t_bh;
+	int r, i;
+
+	shuffle(order);
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++)
+	{
+		for (i = 0; i < LIVE; i++)
+			live[i] = rb_malloc(size);
+		for (i = 0; i < LIVE; i++)
+			rb_free(live[order[i]]);
+	}
+	t_malloc = now() - start;
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++)
+	{
+		for (i = 0; i < LIVE; i++)
+			live[i] = rb_bh_alloc(bh);
+		for (i = 0; i < LIVE; i++)
+			rb_bh_free(bh, live[order[i]]);
+	}
+	t_bh = now() - start;
+
+	printf("%-20s %6zu bytes  malloc %7.1f ns/op  balloc %7.1f ns/op  (%.2fx)\n",
+		name, size,
+		t_malloc * 1e9 / (2.0 * ROUNDS * LIVE),
+		t_bh * 1e9 / (2.0 * ROUNDS * LIVE),
+		t_malloc / t_bh);
+
+	rb_bh_destroy(bh);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	srand(1);
+
+	bench("rb_dlink_node", sizeof(rb_dlink_node), DNODE_HEAP_SIZE);
+	bench("Ban", sizeof(struct Ban), BAN_HEAP_SIZE);
+	bench("membership", sizeof(struct membership), MEMBER_HEAP_SIZE);
+	bench("Client", sizeof(struct Client), CLIENT_HEAP_SIZE);
+	bench("buf_line_t (full)", offsetof(buf_line_t, buf) + LINEBUF_SIZE + CRLF_LEN + 1,
+		LINEBUF_HEAP_SIZE);
+
+	return 0;
+}
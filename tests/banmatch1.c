@@ -0,0 +1,281 @@
+/*
+ *  banmatch1.c: Test compiled channel ban lists
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include <stdinc.h>
+#include <banmatch.h>
+#include <channel.h>
+#include <match.h>
+#include <numeric.h>
+#include <s_conf.h>
+
+#include "client_util.h"
+#include "ircd_util.h"
+#include "tap/basic.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static struct Channel *channel;
+static struct Client *client4;
+static struct Client *client6;
+
+static void
+set_ban(const char *mask, const char *forward)
+{
+	add_id(&me, channel, mask, forward, &channel->banlist, CHFL_BAN);
+}
+
+static void
+clear_list(rb_dlink_list *list, long mode_type)
+{
+	while(list->head != NULL)
+	{
+		struct Ban *ban = list->head->data;
+		free_ban(del_id(channel, ban->banstr, list, mode_type));
+	}
+}
+
+static void
+clear_bans(void)
+{
+	clear_list(&channel->banlist, CHFL_BAN);
+	clear_list(&channel->exceptlist, CHFL_EXCEPTION);
+	clear_list(&channel->invexlist, CHFL_INVEX);
+}
+
+static int
+banned(struct Client *client)
+{
+	return is_banned(channel, client, NULL, NULL, NULL);
+}
+
+/* the plain list walk is_banned_list() used to do */
+static struct Ban *
+reference_find(rb_dlink_list *list, struct Client *client)
+{
+	struct matchset ms;
+	rb_dlink_node *ptr;
+
+	matchset_for_client(client, &ms);
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		struct Ban *ban = ptr->data;
+
+		if(matches_mask(&ms, ban->banstr))
+			return ban;
+	}
+
+	return NULL;
+}
+
+static void
+single_masks1(void)
+{
+	static const struct
+	{
+		const char *mask;
+		struct Client **client;
+		int expect;
+	} cases[] = {
+		{ "*!*@host.example.com", &client4, CHFL_BAN },
+		{ "*!*@HOST.Example.COM", &client4, CHFL_BAN },
+		{ "*!*@other.example.com", &client4, 0 },
+		{ "*!*@*.example.com", &client4, CHFL_BAN },
+		{ "*!*@*.com", &client4, CHFL_BAN },
+		{ "*!*@*.example.org", &client4, 0 },
+		{ "*!*@*ample.com", &client4, CHFL_BAN },
+		{ "Banned4!*@*", &client4, CHFL_BAN },
+		{ "banned4!*", &client4, CHFL_BAN },
+		{ "banned6!*@*", &client4, 0 },
+		{ "ban*!*@*", &client4, CHFL_BAN },
+		{ "*!user4@*", &client4, CHFL_BAN },
+		{ "*!*@192.0.2.10", &client4, CHFL_BAN },
+		{ "*!*@192.0.2.0/24", &client4, CHFL_BAN },
+		{ "*!*@192.0.2.0/28", &client4, CHFL_BAN },
+		{ "*!*@192.0.3.0/24", &client4, 0 },
+		{ "*!user4@192.0.2.0/24", &client4, CHFL_BAN },
+		{ "*!other@192.0.2.0/24", &client4, 0 },
+		{ "*!*@192.0.2.0/0", &client4, 0 },
+		{ "*!*@2001:db8::/32", &client4, 0 },
+		{ "*!*@2001:db8::/32", &client6, CHFL_BAN },
+		{ "*!*@2001:db8:1::/48", &client6, 0 },
+		{ "*!*@2001:db8::5", &client6, CHFL_BAN },
+		{ "*!*@*", &client6, CHFL_BAN },
+		{ "*", &client6, CHFL_BAN },
+		{ "a@b@c", &client6, 0 },
+	};
+
+	for(size_t i = 0; i < ARRAY_SIZE(cases); i++)
+	{
+		set_ban(cases[i].mask, NULL);
+		is_int(cases[i].expect, banned(*cases[i].client), "%s: %s", __FUNCTION__, cases[i].mask);
+		clear_bans();
+	}
+}
+
+static void
+exceptions1(void)
+{
+	set_ban("*!*@*.example.com", NULL);
+	is_int(CHFL_BAN, banned(client4), MSG);
+
+	add_id(&me, channel, "*!*@192.0.2.0/24", NULL, &channel->exceptlist, CHFL_EXCEPTION);
+	is_int(CHFL_EXCEPTION, banned(client4), MSG);
+
+	ConfigChannel.use_except = false;
+	is_int(CHFL_BAN, banned(client4), MSG);
+	ConfigChannel.use_except = true;
+
+	clear_bans();
+	is_int(0, banned(client4), MSG);
+}
+
+static void
+forward1(void)
+{
+	const char *forward = NULL;
+
+	/* bans are added at the head, so the last one set is checked first */
+	set_ban("*!*@*.example.com", "#first");
+	set_ban("*!*@192.0.2.0/24", "#second");
+	set_ban("*!*@host.example.com", "#third");
+
+	is_int(CHFL_BAN, is_banned(channel, client4, NULL, NULL, &forward), MSG);
+	is_string("#third", forward, MSG);
+
+	/* and again from the verdict cache */
+	forward = NULL;
+	is_int(CHFL_BAN, is_banned(channel, client4, NULL, NULL, &forward), MSG);
+	is_string("#third", forward, MSG);
+
+	free_ban(del_id(channel, "*!*@host.example.com", &channel->banlist, CHFL_BAN));
+	forward = NULL;
+	is_int(CHFL_BAN, is_banned(channel, client4, NULL, NULL, &forward), MSG);
+	is_string("#second", forward, MSG);
+
+	clear_bans();
+}
+
+static void
+verdict_cache1(void)
+{
+	set_ban("banned4!*@*", NULL);
+	is_int(CHFL_BAN, banned(client4), MSG);
+	is_int(CHFL_BAN, banned(client4), MSG);
+
+	rb_strlcpy(client4->name, "renamed4", sizeof(client4->name));
+	invalidate_bancache_user(client4);
+	is_int(0, banned(client4), MSG);
+
+	rb_strlcpy(client4->name, "banned4", sizeof(client4->name));
+	invalidate_bancache_user(client4);
+	is_int(CHFL_BAN, banned(client4), MSG);
+
+	clear_bans();
+	is_int(0, banned(client4), MSG);
+}
+
+static void
+invex1(void)
+{
+	add_id(&me, channel, "*!*@*.example.com", NULL, &channel->invexlist, CHFL_INVEX);
+	channel->mode.mode |= MODE_INVITEONLY;
+
+	is_int(0, can_join(client4, channel, NULL, NULL), MSG);
+	is_int(ERR_INVITEONLYCHAN, can_join(client6, channel, NULL, NULL), MSG);
+
+	channel->mode.mode &= ~MODE_INVITEONLY;
+	clear_bans();
+}
+
+/* build a big list from mask fragments and check every client against
+ * the compiled matcher and a plain walk of the list */
+static void
+many_bans1(void)
+{
+	static const char *nicks[] = { "*", "banned4", "banned6", "ban*", "b?nned4", "*4", "other" };
+	static const char *users[] = { "*", "user4", "user6", "u*", "user?" };
+	static const char *hosts[] = {
+		"*", "host.example.com", "*.example.com", "*.com", "*.example.org",
+		"192.0.2.10", "192.0.2.0/24", "192.0.0.0/16", "198.51.100.0/24",
+		"2001:db8::5", "2001:db8::/32", "2001:db8:1::/48", "ho*st.example.com",
+		"other.example.com", "*.other.example.com"
+	};
+	struct Client *clients[] = { client4, client6 };
+	char mask[BUFSIZE];
+	int mismatches = 0, checked = 0;
+
+	for(size_t h = 0; h < ARRAY_SIZE(hosts); h++)
+	for(size_t u = 0; u < ARRAY_SIZE(users); u++)
+	for(size_t n = 0; n < ARRAY_SIZE(nicks); n++)
+	{
+		/* skip the ones that ban everyone so something is left to test */
+		if(!strcmp(hosts[h], "*") && !strcmp(users[u], "*") && !strcmp(nicks[n], "*"))
+			continue;
+
+		snprintf(mask, sizeof(mask), "%s!%s@%s", nicks[n], users[u], hosts[h]);
+		set_ban(mask, mask);
+
+		for(size_t c = 0; c < ARRAY_SIZE(clients); c++)
+		{
+			struct Ban *expect = reference_find(&channel->banlist, clients[c]);
+			const char *forward = NULL;
+			int result = is_banned(channel, clients[c], NULL, NULL, &forward);
+
+			checked++;
+			if(result != (expect ? CHFL_BAN : 0) ||
+			   (expect != NULL && (forward == NULL || strcmp(forward, expect->forward))))
+				mismatches++;
+		}
+	}
+
+	ok(rb_dlink_list_length(&channel->banlist) > 500, MSG);
+	ok(checked > 1000, MSG);
+	is_int(0, mismatches, MSG);
+
+	clear_bans();
+}
+
+int
+main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	channel = make_channel();
+	client4 = make_local_person_full("banned4", "user4", "host.example.com", "192.0.2.10", TEST_REALNAME);
+	client6 = make_local_person_full("banned6", "user6", "host6.example.org", "2001:db8::5", TEST_REALNAME);
+
+	single_masks1();
+	exceptions1();
+	forward1();
+	verdict_cache1();
+	invex1();
+	many_bans1();
+
+	remove_local_person(client4);
+	remove_local_person(client6);
+
+	client_util_free();
+	ircd_util_free();
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ *  channel_membership1.c: Test find_channel_membership and its index
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include <stdinc.h>
+#include <channel.h>
+#include <hash.h>
+
+#include "client_util.h"
+#include "ircd_util.h"
+#include "tap/basic.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NUM_CLIENTS 300
+
+static struct Client *clients[NUM_CLIENTS];
+static struct Channel *channel;
+
+static int
+count_found(void)
+{
+	int i, found = 0;
+
+	for(i = 0; i < NUM_CLIENTS; i++)
+	{
+		struct membership *msptr = find_channel_membership(channel, clients[i]);
+
+		if(msptr != NULL && msptr->client_p == clients[i] && msptr->chptr == channel)
+			found++;
+	}
+
+	return found;
+}
+
+static void
+index1(void)
+{
+	struct membership *msptr;
+	int i;
+
+	channel = make_channel();
+	channel->mode.mode |= MODE_PERMANENT;
+
+	for(i = 0; i < NUM_CLIENTS; i++)
+	{
+		char nick[NICKLEN];
+
+		snprintf(nick, sizeof(nick), "member%d", i);
+		clients[i] = make_local_person_nick(nick);
+	}
+
+	for(i = 0; i < MEMBER_INDEX_MIN - 1; i++)
+		add_user_to_channel(channel, clients[i], CHFL_PEON);
+
+	ok(channel->member_index == NULL, MSG);
+	is_int(MEMBER_INDEX_MIN - 1, count_found(), MSG);
+
+	for(; i < NUM_CLIENTS; i++)
+		add_user_to_channel(channel, clients[i], i % 3 ? CHFL_PEON : CHFL_CHANOP);
+
+	ok(channel->member_index != NULL, MSG);
+	ok(channel->member_index_size >= NUM_CLIENTS * 2, MSG);
+	is_int(NUM_CLIENTS, count_found(), MSG);
+
+	msptr = find_channel_membership(channel, clients[NUM_CLIENTS - 3]);
+	ok(msptr != NULL && is_chanop(msptr), MSG);
+
+	/* remove every other member so deletions exercise the probe chains */
+	for(i = 0; i < NUM_CLIENTS; i += 2)
+		remove_user_from_channel(find_channel_membership(channel, clients[i]));
+
+	ok(channel->member_index != NULL, MSG);
+	is_int(NUM_CLIENTS / 2, count_found(), MSG);
+
+	for(i = 0; i < NUM_CLIENTS; i++)
+	{
+		msptr = find_channel_membership(channel, clients[i]);
+		if((i % 2 == 0) != (msptr == NULL))
+			break;
+	}
+	is_int(NUM_CLIENTS, i, MSG);
+
+	/* quitting goes through remove_user_from_channels() */
+	for(i = 1; i < NUM_CLIENTS - 2 * (MEMBER_INDEX_MIN / 2 - 1); i += 2)
+		remove_user_from_channels(clients[i]);
+
+	ok(channel->member_index == NULL, MSG);
+	is_int(MEMBER_INDEX_MIN / 2 - 1, count_found(), MSG);
+
+	for(; i < NUM_CLIENTS; i += 2)
+		ok(find_channel_membership(channel, clients[i]) != NULL, MSG);
+
+	for(i = 0; i < NUM_CLIENTS; i++)
+	{
+		remove_user_from_channels(clients[i]);
+		remove_local_person(clients[i]);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	index1();
+
+	client_util_free();
+	ircd_util_free();
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ *  hash1.c: Test the client, channel and hostname lookup tables
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "hash.h"
+#include "hook.h"
+#include "channel.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NAMES 20000
+
+struct Client me;
+
+static struct Client clients[NAMES];
+static char names[NAMES][NICKLEN];
+
+static void case_fold1(void)
+{
+	struct Client a, b;
+
+	add_to_client_hash("Nick[x]", &a);
+	add_to_client_hash("nick{X}", &b);	/* same name, first one stays */
+	ok(find_client("nick{x}") == &a, MSG);
+	ok(find_client("NICK[X]") == &a, MSG);
+	ok(find_named_client("nIcK{X}") == &a, MSG);
+	ok(find_client("nick[y]") == NULL, MSG);
+	ok(find_client("nick[x") == NULL, MSG);
+	ok(find_client("nick[x]x") == NULL, MSG);
+
+	/* ids are case sensitive */
+	add_to_id_hash("0ABAAAAAB", &b);
+	ok(find_id("0ABAAAAAB") == &b, MSG);
+	ok(find_id("0abaaaaab") == NULL, MSG);
+	ok(find_client("0ABAAAAAB") == &b, MSG);
+
+	del_from_client_hash("NICK{X}", &a);
+	ok(find_client("nick[x]") == NULL, MSG);
+	del_from_id_hash("0ABAAAAAB", &b);
+	ok(find_id("0ABAAAAAB") == NULL, MSG);
+}
+
+/* add and delete while the table grows, checking everything each time */
+static void grow1(void)
+{
+	int i, n, wrong = 0;
+
+	for (i = 0; i < NAMES; i++)
+		snprintf(names[i], sizeof(names[i]), "n%d", i);
+
+	for (i = 0; i < NAMES; i++)
+	{
+		add_to_client_hash(names[i], &clients[i]);
+
+		/* every third earlier one goes, so deletes hit both tables */
+		if (i % 3 == 2)
+			del_from_client_hash(names[i / 3 * 2], &clients[i / 3 * 2]);
+
+		if (i % 997 != 0)
+			continue;
+
+		for (n = 0; n <= i; n++)
+		{
+			bool gone = n % 2 == 0 && n / 2 * 3 + 2 <= i;
+			struct Client *found = find_client(names[n]);
+
+			if (found != (gone ? NULL : &clients[n]))
+				wrong++;
+		}
+	}
+	is_int(0, wrong, MSG);
+
+	for (i = 0; i < NAMES; i++)
+		del_from_client_hash(names[i], &clients[i]);
+	for (i = 0; i < NAMES; i++)
+		if (find_client(names[i]) != NULL)
+			wrong++;
+	is_int(0, wrong, MSG);
+}
+
+static void hostname1(void)
+{
+	struct Client a, b;
+	rb_dlink_node *ptr;
+
+	add_to_hostname_hash("Host.Example.COM", &a);
+	add_to_hostname_hash("host.example.com", &b);
+
+	ptr = find_hostname("HOST.example.com");
+	if (ok(ptr != NULL, MSG))
+	{
+		ok(ptr->data == &b, MSG);
+		ok(ptr->next != NULL && ptr->next->data == &a, MSG);
+	}
+
+	del_from_hostname_hash("host.example.com", &a);
+	del_from_hostname_hash("host.example.com", &b);
+	ok(find_hostname("host.example.com") == NULL, MSG);
+}
+
+static void channel1(void)
+{
+	struct Channel *chptr;
+	bool isnew;
+
+	chptr = get_or_create_channel(&me, "#Test[1]", &isnew);
+	ok(isnew, MSG);
+	ok(find_channel("#test{1}") == chptr, MSG);
+	ok(get_or_create_channel(&me, "#TEST{1}", &isnew) == chptr, MSG);
+	ok(!isnew, MSG);
+	ok(rb_radixtree_retrieve(channel_tree, "#test[1]") == chptr, MSG);
+
+	del_from_channel_hash(chptr->chname, chptr);
+	ok(find_channel("#test[1]") == NULL, MSG);
+	ok(rb_radixtree_retrieve(channel_tree, "#test[1]") == NULL, MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+	init_hash();
+	init_hook();
+	init_channels();
+
+	plan_lazy();
+
+	case_fold1();
+	grow1();
+	hostname1();
+	channel1();
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ *  hash_bench.c: client and channel lookups, hash tables against radix trees
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "channel.h"
+#include "hash.h"
+#include "hook.h"
+#include "match.h"
+
+#define NICKS 100000
+#define CHANNELS 20000
+#define LOOKUPS 2000000
+
+struct Client me;
+
+static struct Client clients[NICKS];
+static char nicks[NICKS][NICKLEN];
+static char chans[CHANNELS][CHANNELLEN];
+static const char *queries[LOOKUPS];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a lookup is usually for a name in a different case, and now and then for one that is not there */
+static void make_queries(const char *names, int count, size_t len)
+{
+	static char spare[LOOKUPS / 8][CHANNELLEN];
+
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const char *name = names + (size_t)(rand() % count) * len;
+
+		if (i % 8 == 0)
+		{
+			char *q = spare[i / 8];
+
+			rb_strlcpy(q, name, CHANNELLEN);
+			for (char *p = q; *p; p++)
+				*p = (i % 16 == 0) ? irctoupper(*p) : irctolower(*p);
+			if (i % 64 == 0)
+				q[1] = '~';
+			name = q;
+		}
+		queries[i] = name;
+	}
+}
+
+static void report(const char *what, double t_tree, double t_hash, uintptr_t s_tree, uintptr_t s_hash)
+{
+	printf("%s, %d lookups\n", what, LOOKUPS);
+	printf("  radix tree   %7.2f M lookups/s\n", LOOKUPS / t_tree / 1e6);
+	printf("  hash table   %7.2f M lookups/s  (%.2fx)\n", LOOKUPS / t_hash / 1e6, t_tree / t_hash);
+	if (s_tree != s_hash)
+		printf("  MISMATCH\n");
+}
+
+int main(int argc, char *argv[])
+{
+	rb_radixtree *nick_tree, *chan_tree;
+	uintptr_t s_tree, s_hash;
+	double start, t_tree, t_hash;
+	int i;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+	init_hash();
+	init_hook();
+	init_channels();
+	srand(1);
+
+	nick_tree = rb_radixtree_create("bench nick", irccasecanon);
+	chan_tree = rb_radixtree_create("bench channel", irccasecanon);
+
+	for (i = 0; i < NICKS; i++)
+	{
+		snprintf(nicks[i], sizeof(nicks[i]), "%s%d[%c]", i % 2 ? "Nick" : "guest", i, 'a' + i % 26);
+		add_to_client_hash(nicks[i], &clients[i]);
+		rb_radixtree_add(nick_tree, nicks[i], &clients[i]);
+	}
+
+	for (i = 0; i < CHANNELS; i++)
+	{
+		struct Channel *chptr;
+
+		snprintf(chans[i], sizeof(chans[i]), "#%s-%d", i % 3 ? "Channel" : "x", i);
+		chptr = get_or_create_channel(&me, chans[i], NULL);
+		rb_radixtree_add(chan_tree, chans[i], chptr);
+	}
+
+	make_queries(nicks[0], NICKS, sizeof(nicks[0]));
+
+	s_tree = 0;
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		s_tree += (uintptr_t)rb_radixtree_retrieve(nick_tree, queries[i]);
+	t_tree = now() - start;
+
+	s_hash = 0;
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		s_hash += (uintptr_t)find_named_client(queries[i]);
+	t_hash = now() - start;
+
+	report("find_named_client()", t_tree, t_hash, s_tree, s_hash);
+	if (s_tree != s_hash)
+		return 1;
+
+	make_queries(chans[0], CHANNELS, sizeof(chans[0]));
+
+	s_tree = 0;
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		s_tree += (uintptr_t)rb_radixtree_retrieve(chan_tree, queries[i]);
+	t_tree = now() - start;
+
+	s_hash = 0;
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		s_hash += (uintptr_t)find_channel(queries[i]);
+	t_hash = now() - start;
+
+	report("find_channel()", t_tree, t_hash, s_tree, s_hash);
+	if (s_tree != s_hash)
+		return 1;
+
+	return 0;
+}
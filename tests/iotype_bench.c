@@ -0,0 +1,185 @@
+/*
+ *  iotype_bench.c: librb event loop throughput for each available iotype
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "stdinc.h"
+
+#define PAIRS 2000	/* echoing socketpairs, 4000 fds, fewer if rlimited */
+#define ROUNDS 100	/* messages bounced across each pair */
+#define CHURN 100000	/* socketpairs opened, armed and closed */
+
+/*
+ * Each iotype runs in its own process, since librb picks its backend
+ * once in rb_lib_init() from LIBRB_USE_IOTYPE.  "echo" is steady state:
+ * every pair bounces a line back and forth with the read handlers
+ * re-armed after each one.  "churn" is connection turnover: each
+ * socketpair gets a handler registered and is closed again, which is
+ * where per-fd registration system calls show up.
+ */
+static const char *iotypes[] = { "epoll", "io_uring", "poll", NULL };
+
+static const char line[] = ":nick!user@host PRIVMSG #channel :hello there\r\n";
+static int pairs = PAIRS;
+static int received;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void echo_cb(rb_fde_t *F, void *data)
+{
+	char buf[512];
+	int *count = data;
+	int len;
+
+	while ((len = rb_read(F, buf, sizeof(buf))) > 0)
+	{
+		received++;
+		if (++(*count) < ROUNDS && rb_write(F, buf, len) != len)
+			exit(EXIT_FAILURE);
+	}
+
+	if (len == 0 || !rb_ignore_errno(errno))
+		exit(EXIT_FAILURE);
+
+	rb_setselect(F, RB_SELECT_READ, echo_cb, data);
+}
+
+static double bench_echo(void)
+{
+	static int count[PAIRS * 2];
+	static rb_fde_t *F[PAIRS * 2];
+	double start;
+	int i;
+
+	for (i = 0; i < pairs; i++)
+	{
+		if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &F[i * 2], &F[i * 2 + 1], "bench") == -1)
+			exit(EXIT_FAILURE);
+		rb_setselect(F[i * 2], RB_SELECT_READ, echo_cb, &count[i * 2]);
+		rb_setselect(F[i * 2 + 1], RB_SELECT_READ, echo_cb, &count[i * 2 + 1]);
+	}
+
+	start = now();
+	for (i = 0; i < pairs; i++)
+		rb_write(F[i * 2], line, sizeof(line) - 1);
+
+	while (received < pairs * ROUNDS)
+		rb_select(1000);
+
+	start = now() - start;
+	for (i = 0; i < pairs * 2; i++)
+		rb_close(F[i]);
+	rb_select(0);
+	return received / start;
+}
+
+static void idle_cb(rb_fde_t *F, void *data)
+{
+}
+
+static double bench_churn(void)
+{
+	rb_fde_t *F1, *F2;
+	double start = now();
+	int i;
+
+	for (i = 0; i < CHURN; i++)
+	{
+		if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &F1, &F2, "bench") == -1)
+			exit(EXIT_FAILURE);
+		rb_setselect(F1, RB_SELECT_READ, idle_cb, NULL);
+		rb_setselect(F2, RB_SELECT_READ, idle_cb, NULL);
+		rb_close(F1);
+		rb_close(F2);
+		/* an ircd sees a few connections come and go per loop pass */
+		if (i % 16 == 15)
+			rb_select(0);
+	}
+	rb_select(0);
+	return CHURN / (now() - start);
+}
+
+static void run(const char *iotype)
+{
+	double echo, churn;
+
+	setenv("LIBRB_USE_IOTYPE", iotype, 1);
+	rb_lib_init(NULL, NULL, NULL, 0, 8192, 1024, 4096);
+
+	if (strcmp(rb_get_iotype(), iotype))
+	{
+		printf("%-9s not available here\n", iotype);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	echo = bench_echo();
+	churn = bench_churn();
+	printf("%-9s echo %9.0f lines/s   churn %8.0f pairs/s\n", iotype, echo, churn);
+	fflush(stdout);
+	_exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct rlimit rlim;
+	int i, status, ret = 0;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == 0)
+	{
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+		getrlimit(RLIMIT_NOFILE, &rlim);
+		if (rlim.rlim_cur < PAIRS * 2 + 64)
+			pairs = (rlim.rlim_cur - 64) / 2;
+	}
+
+	printf("%d pairs x %d lines, %d pairs of churn\n", pairs, ROUNDS, CHURN);
+	fflush(stdout);
+
+	for (i = 0; iotypes[i] != NULL; i++)
+	{
+		pid_t pid = fork();
+
+		if (pid == -1)
+		{
+			perror("fork");
+			return EXIT_FAILURE;
+		}
+		if (pid == 0)
+			run(iotypes[i]);
+
+		if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			fprintf(stderr, "%s failed\n", iotypes[i]);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	return ret;
+}
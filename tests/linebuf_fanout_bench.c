@@ -0,0 +1,143 @@
+/*
+ *  linebuf_fanout_bench.c: Channel fan-out through rb_linebuf_attach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+#define MEMBERS 20000
+#define MESSAGES 200
+#define BATCH 10	/* messages queued before each recipient is drained */
+
+static buf_head_t sendq[MEMBERS];
+static rb_dlink_list oldq[MEMBERS];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put_line(buf_head_t *linebuf, int n)
+{
+	char buf[BUFSIZE];
+	rb_strf_t msg = { .format = buf, .format_args = NULL, .next = NULL };
+
+	snprintf(buf, sizeof(buf), ":nick!user@host PRIVMSG #channel :message number %d", n);
+	rb_linebuf_newbuf(linebuf);
+	rb_linebuf_put(linebuf, &msg);
+}
+
+/* the ring of line references used by rb_linebuf_attach() */
+static double bench_ring(void)
+{
+	buf_head_t linebufs[BATCH];
+	char buf[BUFSIZE];
+	double start;
+	int m, b, i;
+
+	for (i = 0; i < MEMBERS; i++)
+		rb_linebuf_newbuf(&sendq[i]);
+
+	start = now();
+	for (m = 0; m < MESSAGES; m += BATCH)
+	{
+		for (b = 0; b < BATCH; b++)
+		{
+			put_line(&linebufs[b], m + b);
+			for (i = 0; i < MEMBERS; i++)
+				rb_linebuf_attach(&sendq[i], &linebufs[b]);
+			rb_linebuf_donebuf(&linebufs[b]);
+		}
+
+		for (i = 0; i < MEMBERS; i++)
+			while (rb_linebuf_get(&sendq[i], buf, sizeof(buf), 0, 1) > 0)
+				;
+	}
+	return now() - start;
+}
+
+/* what rb_linebuf_attach() used to do: one rb_dlink_node per recipient */
+static double bench_dlink(void)
+{
+	buf_head_t linebufs[BATCH];
+	char buf[BUFSIZE];
+	buf_line_t *line;
+	rb_dlink_node *node;
+	double start;
+	int m, b, i;
+
+	start = now();
+	for (m = 0; m < MESSAGES; m += BATCH)
+	{
+		for (b = 0; b < BATCH; b++)
+		{
+			put_line(&linebufs[b], m + b);
+			line = linebufs[b].lines[linebufs[b].first];
+			for (i = 0; i < MEMBERS; i++)
+			{
+				rb_dlinkAddTailAlloc(line, &oldq[i]);
+				line->refcount++;
+			}
+		}
+
+		for (i = 0; i < MEMBERS; i++)
+		{
+			while ((node = oldq[i].head) != NULL)
+			{
+				line = node->data;
+				memcpy(buf, line->buf, line->len);
+				line->refcount--;
+				rb_dlinkDestroy(node, &oldq[i]);
+			}
+		}
+
+		for (b = 0; b < BATCH; b++)
+			rb_linebuf_donebuf(&linebufs[b]);
+	}
+	return now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	double t_ring, t_dlink;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	/* warm up both allocators */
+	bench_dlink();
+	bench_ring();
+
+	t_dlink = bench_dlink();
+	t_ring = bench_ring();
+
+	printf("fan-out to %d members, %d messages\n", MEMBERS, MESSAGES);
+	printf("  dlink node per recipient  %7.1f ns/recipient\n",
+		t_dlink * 1e9 / ((double)MEMBERS * MESSAGES));
+	printf("  line reference ring       %7.1f ns/recipient  (%.2fx)\n",
+		t_ring * 1e9 / ((double)MEMBERS * MESSAGES), t_dlink / t_ring);
+
+	return 0;
+}
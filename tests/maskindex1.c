@@ -0,0 +1,239 @@
+/*
+ *  maskindex1.c: Test the X-line and nick RESV indexes
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include <stdinc.h>
+#include <maskindex.h>
+#include <match.h>
+#include <operhash.h>
+#include <s_conf.h>
+#include <s_newconf.h>
+
+#include "ircd_util.h"
+#include "tap/basic.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static struct ConfItem *
+xline(const char *mask)
+{
+	struct ConfItem *aconf = make_conf();
+
+	aconf->status = CONF_XLINE;
+	aconf->host = rb_strdup(mask);
+	aconf->passwd = rb_strdup("test");
+	aconf->info.oper = operhash_add("test");
+	add_xline_conf(aconf);
+
+	return aconf;
+}
+
+static struct ConfItem *
+resv(const char *mask)
+{
+	struct ConfItem *aconf = make_conf();
+
+	aconf->status = CONF_RESV_NICK;
+	aconf->host = rb_strdup(mask);
+	aconf->passwd = rb_strdup("test");
+	aconf->info.oper = operhash_add("test");
+	add_nick_resv_conf(aconf);
+
+	return aconf;
+}
+
+static void
+unxline(struct ConfItem *aconf)
+{
+	del_xline_conf(aconf);
+	free_conf(aconf);
+}
+
+static void
+clear_xlines(void)
+{
+	while(xline_conf_list.head != NULL)
+		unxline(xline_conf_list.head->data);
+}
+
+/* the list walk find_xline() used to do */
+static struct ConfItem *
+reference_find(const char *gecos)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
+	{
+		struct ConfItem *aconf = ptr->data;
+
+		if(match_esc(aconf->host, gecos))
+			return aconf;
+	}
+
+	return NULL;
+}
+
+static void
+literal1(void)
+{
+	struct ConfItem *a = xline("Some Bot");
+
+	is_bool(true, find_xline("some bot", 0) == a, MSG);
+	is_bool(true, find_xline("SOME BOT", 0) == a, MSG);
+	is_bool(true, find_xline("some bots", 0) == NULL, MSG);
+	is_bool(true, find_xline("some", 0) == NULL, MSG);
+
+	is_bool(true, find_xline_mask("some BOT") == a, MSG);
+	is_bool(true, find_xline_mask("some*") == NULL, MSG);
+
+	unxline(a);
+	is_bool(true, find_xline("some bot", 0) == NULL, MSG);
+	is_int(0, rb_dlink_list_length(&xline_conf_list), MSG);
+}
+
+static void
+wildcard1(void)
+{
+	struct ConfItem *a = xline("*spam*bot*");
+	struct ConfItem *b = xline("??");
+	struct ConfItem *c = xline("free\\s###");
+	struct ConfItem *d = xline("*\\*star*");
+
+	is_bool(true, find_xline("i am a SPAMMY robot", 0) == a, MSG);
+	is_bool(true, find_xline("i am a spammer", 0) == NULL, MSG);
+	is_bool(true, find_xline("ab", 0) == b, MSG);
+	is_bool(true, find_xline("free 123", 0) == c, MSG);
+	is_bool(true, find_xline("free 12a", 0) == NULL, MSG);
+	is_bool(true, find_xline("a *star is born", 0) == d, MSG);
+	is_bool(true, find_xline("a star is born", 0) == NULL, MSG);
+
+	is_bool(true, find_xline_mask("*SPAM*bot*") == a, MSG);
+	is_bool(true, find_xline_mask("*spam*") == NULL, MSG);
+
+	clear_xlines();
+}
+
+static void
+order1(void)
+{
+	struct ConfItem *a = xline("*bot*");
+	struct ConfItem *b = xline("*robot*");
+	struct ConfItem *c = xline("*");
+
+	/* the newest matching entry is the one at the head of the list */
+	is_bool(true, find_xline("robot", 0) == c, MSG);
+	unxline(c);
+	is_bool(true, find_xline("robot", 0) == b, MSG);
+	is_bool(true, find_xline("bot", 0) == a, MSG);
+
+	b->port = 0;
+	find_xline("robot", 1);
+	find_xline("robot", 0);
+	is_int(1, b->port, MSG);
+
+	clear_xlines();
+}
+
+static void
+resv1(void)
+{
+	struct ConfItem *a = resv("guest*");
+	struct ConfItem *b = resv("[admin]");
+
+	a->port = 0;
+	is_bool(true, find_nick_resv("Guest123") == a, MSG);
+	is_int(1, a->port, MSG);
+	is_bool(true, find_nick_resv("{ADMIN}") == b, MSG);
+	is_bool(true, find_nick_resv("admin") == NULL, MSG);
+	is_bool(true, find_nick_resv_mask("{admin}") == b, MSG);
+
+	del_nick_resv_conf(a);
+	free_conf(a);
+	del_nick_resv_conf(b);
+	free_conf(b);
+
+	is_bool(true, find_nick_resv("Guest123") == NULL, MSG);
+	is_int(0, rb_dlink_list_length(&resv_conf_list), MSG);
+}
+
+static void
+random1(void)
+{
+	static const char chars[] = "abcAB ?*#@\\";
+	struct mask_index_stats st;
+	char mask[8], name[12];
+	int mismatches = 0;
+	int i, j;
+
+	srand(1);
+
+	for(i = 0; i < 2000; i++)
+	{
+		int len = 1 + rand() % 7;
+
+		for(j = 0; j < len; j++)
+			mask[j] = chars[rand() % (sizeof(chars) - 1)];
+		mask[len] = '\0';
+
+		xline(mask);
+	}
+
+	for(i = 0; i < 2000; i++)
+	{
+		int len = rand() % 11;
+
+		for(j = 0; j < len; j++)
+			name[j] = chars[rand() % 5];
+		name[len] = '\0';
+
+		if(find_xline(name, 0) != reference_find(name))
+		{
+			diag("find_xline %s", name);
+			mismatches++;
+		}
+	}
+
+	is_int(0, mismatches, MSG);
+
+	mask_index_stats(xline_index, &st);
+	is_int(2000, st.entries, MSG);
+	ok(st.skipped > 0, MSG);
+
+	clear_xlines();
+
+	mask_index_stats(xline_index, &st);
+	is_int(0, st.entries, MSG);
+}
+
+int
+main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+
+	literal1();
+	wildcard1();
+	order1();
+	resv1();
+	random1();
+
+	ircd_util_free();
+
+	return 0;
+}
@@ -25,6 +25,7 @@
 #include "stdinc.h"
 #include "client.h"
 #include "match.h"
+#include "ircd_defs.h"
 
 #define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
 
@@ -85,6 +86,101 @@ static void test_arrange_stars(void)
 	}
 }
 
+static const char *prog_masks[] = {
+	"", "*", "**", "?", "??", "*?", "?*", "a", "A", "abc", "ABC", "a*", "*a", "*a*",
+	"a*c", "a?c", "*b*", "a**c", "*ab*ab*", "*ab*ba*", "a*b*c*d", "*.example.com",
+	"*!*@*.example.com", "nick!*@*", "n?ck!us*@h*st", "[x]*", "{}|^*", "*~*",
+	"*aa", "*aaa*", "a*a*a*a", "?*?*?", "*\\*", "\\*", "*\\?*", "\\s*", "a\\sb",
+	"@*", "#", "*@#*", "\\@*", "\\#", "\\", "a\\",
+};
+
+static const char *prog_names[] = {
+	"", "a", "A", "b", "ab", "abc", "aBc", "abbc", "ac", "aac", "aaaa", "abab",
+	"abba", "abcd", "axbxcxd", "xabyabz", "host.example.com", "HOST.EXAMPLE.COM",
+	"nick!user@host.example.com", "NICK!us@hst", "nick!user@host", "[x]y", "{}|~x",
+	"*", "?", "a*", "\\", "a b", " x", "1", "a1", "x@1y", "@", "#", "aaa", "aa",
+};
+
+static void test_match_prog(void)
+{
+	int mismatches = 0, checked = 0;
+
+	for(size_t i = 0; i < ARRAY_SIZE(prog_masks); i++)
+	{
+		struct match_prog *prog = match_compile(prog_masks[i]);
+		struct match_prog *prog_esc = match_compile_esc(prog_masks[i]);
+
+		for(size_t j = 0; j < ARRAY_SIZE(prog_names); j++)
+		{
+			checked++;
+			if(match_prog(prog, prog_names[j]) != match(prog_masks[i], prog_names[j]))
+			{
+				diag("match %s %s", prog_masks[i], prog_names[j]);
+				mismatches++;
+			}
+			if(match_prog(prog_esc, prog_names[j]) != match_esc(prog_masks[i], prog_names[j]))
+			{
+				diag("match_esc %s %s", prog_masks[i], prog_names[j]);
+				mismatches++;
+			}
+		}
+
+		match_prog_free(prog);
+		match_prog_free(prog_esc);
+	}
+
+	ok(checked > 1000, MSG);
+	is_int(0, mismatches, MSG);
+}
+
+/* random masks over a small alphabet, so they match more often than not */
+static void test_match_prog_random(void)
+{
+	static const char mask_chars[] = "abAB*?\\@#s1";
+	static const char name_chars[] = "abAB*?\\1 ";
+	char mask[12], name[16];
+	int mismatches = 0;
+
+	srand(1);
+	for(int i = 0; i < 2000; i++)
+	{
+		size_t mlen = rand() % (sizeof(mask) - 1);
+		struct match_prog *prog, *prog_esc;
+
+		for(size_t k = 0; k < mlen; k++)
+			mask[k] = mask_chars[rand() % (sizeof(mask_chars) - 1)];
+		mask[mlen] = '\0';
+
+		prog = match_compile(mask);
+		prog_esc = match_compile_esc(mask);
+
+		for(int j = 0; j < 20; j++)
+		{
+			size_t nlen = rand() % (sizeof(name) - 1);
+
+			for(size_t k = 0; k < nlen; k++)
+				name[k] = name_chars[rand() % (sizeof(name_chars) - 1)];
+			name[nlen] = '\0';
+
+			if(match_prog(prog, name) != match(mask, name))
+			{
+				diag("match %s %s", mask, name);
+				mismatches++;
+			}
+			if(match_prog(prog_esc, name) != match_esc(mask, name))
+			{
+				diag("match_esc %s %s: %d", mask, name, match_esc(mask, name));
+				mismatches++;
+			}
+		}
+
+		match_prog_free(prog);
+		match_prog_free(prog_esc);
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -92,6 +188,8 @@ int main(int argc, char *argv[])
 	test_match();
 	test_mask_match();
 	test_arrange_stars();
+	test_match_prog();
+	test_match_prog_random();
 
 	return 0;
 }
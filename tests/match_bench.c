@@ -0,0 +1,124 @@
+/*
+ *  match_bench.c: match() and match_esc() against compiled masks
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "match.h"
+
+#define ROUNDS 200
+
+struct Client me;
+
+/* a K-line/ban style mask list, mostly misses as in real use */
+static const char *masks[] = {
+	"*.example.com", "*.example.net", "*.example.org", "host*.isp.example",
+	"*.dynamic.*.example.com", "*-*-*-*.pool.example", "irc.*.example.com",
+	"*bot*", "*spam*", "*.tor-exit.*", "192.0.2.*", "198.51.100.*",
+	"*.compute.amazonaws.com", "*.cloud.example", "??.example.com",
+	"*.*.*.*.*.*.*.*", "*a*b*c*d*e*f*", "unaffiliated/*", "gateway/web/*",
+	"user/*/bot/*",
+};
+
+static const char *names[] = {
+	"client-12-34-56-78.dsl.example.net", "host.example.com", "HOST123.ISP.EXAMPLE",
+	"a.b.c.d.example.com", "user/somebody", "gateway/web/irccloud.com/x-abcdef",
+	"unaffiliated/someone", "203.0.113.42", "ec2-203-0-113-42.compute.amazonaws.com",
+	"some.very.long.hostname.that.matches.nothing.in.particular.example",
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_interp(int (*fn)(const char *, const char *), int *hits)
+{
+	double start = now();
+
+	*hits = 0;
+	for (int r = 0; r < ROUNDS; r++)
+		for (size_t n = 0; n < ARRAY_SIZE(names); n++)
+			for (size_t m = 0; m < ARRAY_SIZE(masks); m++)
+				*hits += fn(masks[m], names[n]);
+	return now() - start;
+}
+
+static double bench_prog(struct match_prog **progs, int *hits)
+{
+	double start = now();
+
+	*hits = 0;
+	for (int r = 0; r < ROUNDS; r++)
+		for (size_t n = 0; n < ARRAY_SIZE(names); n++)
+			for (size_t m = 0; m < ARRAY_SIZE(masks); m++)
+				*hits += match_prog(progs[m], names[n]);
+	return now() - start;
+}
+
+static void report(const char *what, double t_interp, double t_prog, int h_interp, int h_prog)
+{
+	double calls = (double)ROUNDS * ARRAY_SIZE(names) * ARRAY_SIZE(masks);
+
+	printf("%s, %zu masks x %zu names\n", what, ARRAY_SIZE(masks), ARRAY_SIZE(names));
+	printf("  interpreted  %7.1f ns/match\n", t_interp * 1e9 / calls);
+	printf("  compiled     %7.1f ns/match  (%.2fx)\n", t_prog * 1e9 / calls, t_interp / t_prog);
+	if (h_interp != h_prog)
+		printf("  MISMATCH: %d vs %d hits\n", h_interp, h_prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct match_prog *progs[ARRAY_SIZE(masks)], *progs_esc[ARRAY_SIZE(masks)];
+	double t_interp, t_prog;
+	int h_interp, h_prog;
+
+	for (size_t m = 0; m < ARRAY_SIZE(masks); m++)
+	{
+		progs[m] = match_compile(masks[m]);
+		progs_esc[m] = match_compile_esc(masks[m]);
+	}
+
+	bench_interp(match, &h_interp);
+	t_interp = bench_interp(match, &h_interp);
+	t_prog = bench_prog(progs, &h_prog);
+	report("match()", t_interp, t_prog, h_interp, h_prog);
+	if (h_interp != h_prog)
+		return 1;
+
+	t_interp = bench_interp(match_esc, &h_interp);
+	t_prog = bench_prog(progs_esc, &h_prog);
+	report("match_esc()", t_interp, t_prog, h_interp, h_prog);
+	if (h_interp != h_prog)
+		return 1;
+
+	for (size_t m = 0; m < ARRAY_SIZE(masks); m++)
+	{
+		match_prog_free(progs[m]);
+		match_prog_free(progs_esc[m]);
+	}
+
+	return 0;
+}
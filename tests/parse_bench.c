@@ -0,0 +1,165 @@
+/*
+ *  parse_bench.c: msgbuf_parse() and command lookup throughput
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "msg.h"
+#include "msgbuf.h"
+#include "parse.h"
+
+#define ROUNDS 20000
+
+/* the commands registered by the stock modules and extensions */
+static const char *commands[] = {
+	"ACCEPT", "ADMIN", "ADMINWALL", "AUTHENTICATE", "AWAY", "BAN", "BMASK",
+	"CAP", "CAPAB", "CERTFP", "CHALLENGE", "CHANTRACE", "CHGHOST", "CLOSE",
+	"CONNECT", "DEHELPER", "DLINE", "ECHO", "ECHOTAGS", "ENCAP", "ERROR",
+	"ETB", "ETRACE", "EUID", "EXTENDCHANS", "FINDFORWARDS", "GCAP", "GET",
+	"GRANT", "HEAL", "HELP", "HURT", "IDENTIFY", "INFO", "INVITE", "INVITED",
+	"ISON", "JOIN", "KICK", "KILL", "KLINE", "KNOCK", "LINKS", "LIST",
+	"LOCOPS", "LOGIN", "LUSERS", "MAP", "MASKTRACE", "MECHLIST", "MKPASSWD",
+	"MLOCK", "MODE", "MODLIST", "MODLOAD", "MODRELOAD", "MODRESTART",
+	"MODUNLOAD", "MONITOR", "MOTD", "NAMES", "NICK", "NICKDELAY", "NOTICE",
+	"OJOIN", "OKICK", "OMODE", "OPER", "OPERSPY", "OPERWALL", "OPME", "PART",
+	"PASS", "PING", "PONG", "POST", "PRIVMSG", "PRIVS", "PUT", "QUIT",
+	"REALHOST", "REHASH", "REMOVE", "RESTART", "RESV", "RSFNC", "SASL",
+	"SAVE", "SCAN", "SENDBANS", "SERVER", "SET", "SETFILTER", "SID", "SIGNON",
+	"SJOIN", "SNOTE", "SQUIT", "STARTTLS", "STATS", "SU", "SVINFO",
+	"SVSLOGIN", "TB", "TEST", "TESTGECOS", "TESTKLINE", "TESTLINE",
+	"TESTMASK", "TGINFO", "TIME", "TMODE", "TOPIC", "TRACE", "UHELP", "UID",
+	"UNDLINE", "UNKLINE", "UNREJECT", "UNRESV", "UNXLINE", "USER",
+	"USERHOST", "USERS", "VERSION", "WALLOPS", "WEBIRC", "WHO", "WHOIS",
+	"WHOWAS", "XLINE",
+};
+
+/*
+ * lines from msgbuf_parse1.c, plus the commands that make up most of
+ * the rest of real client and server traffic
+ */
+static const char *lines[] = {
+	"@tag=value PRIVMSG #test :test",
+	"@tag0=value0;tag1=value1;tag2=value2 PRIVMSG #test :test",
+	"@tag=value :origin. PRIVMSG #test :test",
+	"@tag=value PRIVMSG #test test D E F G H I J K L M N :O P",
+	"@tag1=\\v\\a\\l\\u\\e\\1;tag2=\\va\\lu\\e2;tag3=v\\al\\ue\\3 PRIVMSG #test :test",
+	"@tag= PRIVMSG #test :test",
+	"PRIVMSG #test :test",
+	"privmsg #test :test",
+	"NOTICE someone :test",
+	"PING :irc.example.com",
+	"PONG irc.example.com :123456",
+	"JOIN #test,#other",
+	"PART #test :bye",
+	"MODE #test +o someone",
+	"WHO #test %tcuhnfar,42",
+	"AWAY :gone",
+	"AUTHENTICATE PLAIN",
+	"CAP REQ :message-tags",
+	":00AAAAAAB PRIVMSG #test :test",
+	":00AAAAAAB NOTICE #test :test",
+	":00A EUID nick 1 1 +i user host 192.0.2.1 00AAAAAAB * * :real name",
+	":00A SJOIN 1 #test + :@00AAAAAAB",
+	":00AAAAAAB TOPIC #test :topic",
+	":00A ENCAP * CERTFP :0123456789abcdef",
+	":00AAAAAAB QUIT :leaving",
+	"FINDFORWARDS #test",
+	"NOSUCHCOMMAND foo",
+	"X",
+};
+
+struct Client me;
+
+static struct Message msgtabs[ARRAY_SIZE(commands)];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench(struct Message *(*lookup)(const char *), uintptr_t *sum)
+{
+	char tmp[BUFSIZE];
+	struct MsgBuf msgbuf;
+	double start = now();
+
+	*sum = 0;
+	for (int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t n = 0; n < ARRAY_SIZE(lines); n++)
+		{
+			rb_strlcpy(tmp, lines[n], sizeof(tmp));
+			if (msgbuf_parse(&msgbuf, tmp))
+				continue;
+			*sum += (uintptr_t)lookup(msgbuf.cmd) * (n + 1);
+		}
+	}
+	return now() - start;
+}
+
+static struct Message *lookup_dict(const char *cmd)
+{
+	return rb_dictionary_retrieve(cmd_dict, cmd);
+}
+
+int main(int argc, char *argv[])
+{
+	double t_dict, t_hash;
+	uintptr_t s_dict, s_hash;
+	double calls = (double)ROUNDS * ARRAY_SIZE(lines);
+
+	clear_hash_parse();
+	for (size_t i = 0; i < ARRAY_SIZE(commands); i++)
+	{
+		msgtabs[i].cmd = commands[i];
+		mod_add_cmd(&msgtabs[i]);
+	}
+
+	bench(lookup_dict, &s_dict);
+	t_dict = bench(lookup_dict, &s_dict);
+	t_hash = bench(find_command, &s_hash);
+
+	printf("msgbuf_parse() and lookup, %zu commands x %zu lines\n",
+		ARRAY_SIZE(commands), ARRAY_SIZE(lines));
+	printf("  dictionary   %7.1f ns/line\n", t_dict * 1e9 / calls);
+	printf("  hash table   %7.1f ns/line  (%.2fx)\n", t_hash * 1e9 / calls, t_dict / t_hash);
+	if (s_dict != s_hash)
+	{
+		printf("  MISMATCH\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(commands); i++)
+	{
+		mod_del_cmd(&msgtabs[i]);
+		if (find_command(commands[i]) != NULL)
+		{
+			printf("  %s still found after mod_del_cmd()\n", commands[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
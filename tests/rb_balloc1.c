@@ -0,0 +1,158 @@
+/*
+ *  rb_balloc1.c: Test the block allocator
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define ELEMS 1000
+
+struct elem
+{
+	char data[100];
+};
+
+static void usage1(void)
+{
+	rb_bh *bh = rb_bh_create(sizeof(struct elem), 16, "usage1");
+	struct elem *elems[ELEMS];
+	size_t used, freem, memusage;
+	const char *desc;
+	int i;
+
+	rb_bh_usage(bh, &used, &freem, &memusage, &desc);
+	is_int(0, used, MSG);
+	is_int(0, freem, MSG);
+	is_int(0, memusage, MSG);
+	is_string("usage1", desc, MSG);
+
+	for (i = 0; i < ELEMS; i++)
+		elems[i] = rb_bh_alloc(bh);
+
+	rb_bh_usage(bh, &used, &freem, &memusage, NULL);
+	is_int(ELEMS, used, MSG);
+	is_int(ELEMS * sizeof(struct elem), memusage, MSG);
+
+	for (i = 0; i < ELEMS; i += 2)
+		rb_bh_free(bh, elems[i]);
+
+	rb_bh_usage(bh, &used, NULL, NULL, NULL);
+	is_int(ELEMS / 2, used, MSG);
+
+	rb_bh_destroy(bh);
+}
+
+static void zeroed1(void)
+{
+	rb_bh *bh = rb_bh_create(sizeof(struct elem), 16, "zeroed1");
+	struct elem *e1, *e2;
+	size_t i;
+	int zero = 1;
+
+	e1 = rb_bh_alloc(bh);
+	memset(e1->data, 'x', sizeof(e1->data));
+	rb_bh_free(bh, e1);
+
+	e2 = rb_bh_alloc(bh);
+	ok(e1 == e2, MSG);
+
+	for (i = 0; i < sizeof(e2->data); i++)
+		if (e2->data[i] != '\0')
+			zero = 0;
+	ok(zero, MSG);
+
+	rb_bh_destroy(bh);
+}
+
+static void distinct1(void)
+{
+	rb_bh *bh = rb_bh_create(sizeof(struct elem), 16, "distinct1");
+	struct elem *elems[ELEMS];
+	int i, overlap = 0;
+
+	for (i = 0; i < ELEMS; i++)
+	{
+		elems[i] = rb_bh_alloc(bh);
+		memset(elems[i]->data, i & 0xff, sizeof(elems[i]->data));
+	}
+
+	for (i = 0; i < ELEMS; i++)
+		if (elems[i]->data[0] != (char)(i & 0xff) ||
+				elems[i]->data[sizeof(elems[i]->data) - 1] != (char)(i & 0xff))
+			overlap = 1;
+	ok(!overlap, MSG);
+
+	rb_bh_destroy(bh);
+}
+
+static void cleanup1(void)
+{
+	rb_bh *bh = rb_bh_create(sizeof(struct elem), 16, "cleanup1");
+	struct elem *elems[ELEMS];
+	size_t used, freem;
+	int i;
+
+	for (i = 0; i < ELEMS; i++)
+		elems[i] = rb_bh_alloc(bh);
+	for (i = 0; i < ELEMS; i++)
+		rb_bh_free(bh, elems[i]);
+
+	rb_bh_usage(bh, &used, &freem, NULL, NULL);
+	is_int(0, used, MSG);
+
+#ifndef NOBALLOC
+	ok(freem >= ELEMS, MSG);
+	ok(rb_bh_cleanup(bh) > 0, MSG);
+
+	/* one empty block is kept back */
+	rb_bh_usage(bh, NULL, &freem, NULL, NULL);
+	ok(freem > 0 && freem < ELEMS, MSG);
+	is_int(0, rb_bh_cleanup(bh), MSG);
+#endif
+
+	/* the heap must still work after giving blocks back */
+	for (i = 0; i < ELEMS; i++)
+		elems[i] = rb_bh_alloc(bh);
+	rb_bh_usage(bh, &used, NULL, NULL, NULL);
+	is_int(ELEMS, used, MSG);
+
+	rb_bh_destroy(bh);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	usage1();
+	zeroed1();
+	distinct1();
+	cleanup1();
+
+	return 0;
+}
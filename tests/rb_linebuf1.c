@@ -0,0 +1,180 @@
+/*
+ *  rb_linebuf1.c: Test rb_linebuf
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static void put_num(buf_head_t *bufhead, int n)
+{
+	char buf[32];
+	rb_strf_t strings = { .format = buf, .format_args = NULL, .next = NULL };
+
+	snprintf(buf, sizeof(buf), "line %d", n);
+	rb_linebuf_put(bufhead, &strings);
+}
+
+static int get_num(buf_head_t *bufhead)
+{
+	char buf[BUFSIZE];
+	int n = -1;
+
+	if (rb_linebuf_get(bufhead, buf, sizeof(buf), 0, 0) <= 0)
+		return -1;
+	if (sscanf(buf, "line %d", &n) != 1)
+		return -1;
+	return n;
+}
+
+static void order1(void)
+{
+	buf_head_t bufhead;
+	int i, in = 0, out = 0, bad = 0;
+
+	rb_linebuf_newbuf(&bufhead);
+
+	/* keep the ring partly full while it wraps and grows */
+	for (i = 0; i < 50; i++)
+	{
+		put_num(&bufhead, in++);
+		put_num(&bufhead, in++);
+		put_num(&bufhead, in++);
+		if (get_num(&bufhead) != out++)
+			bad++;
+		if (get_num(&bufhead) != out++)
+			bad++;
+	}
+	is_int(in - out, rb_linebuf_numlines(&bufhead), MSG);
+
+	while (out < in)
+		if (get_num(&bufhead) != out++)
+			bad++;
+	is_int(0, bad, MSG);
+	is_int(0, rb_linebuf_numlines(&bufhead), MSG);
+	is_int(0, rb_linebuf_len(&bufhead), MSG);
+	is_int(-1, get_num(&bufhead), MSG);
+
+	rb_linebuf_donebuf(&bufhead);
+}
+
+static void attach1(void)
+{
+	buf_head_t linebuf, sendq[3];
+	int i, j, bad = 0;
+
+	for (i = 0; i < 3; i++)
+		rb_linebuf_newbuf(&sendq[i]);
+
+	for (j = 0; j < 40; j++)
+	{
+		rb_linebuf_newbuf(&linebuf);
+		put_num(&linebuf, j);
+		for (i = 0; i < 3; i++)
+			rb_linebuf_attach(&sendq[i], &linebuf);
+		rb_linebuf_donebuf(&linebuf);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		is_int(40, rb_linebuf_numlines(&sendq[i]), MSG);
+		is_int(40 * strlen("line 0\r\n") + 30, rb_linebuf_len(&sendq[i]), MSG);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 40; j++)
+			if (get_num(&sendq[i]) != j)
+				bad++;
+		rb_linebuf_donebuf(&sendq[i]);
+	}
+	is_int(0, bad, MSG);
+}
+
+static void partial1(void)
+{
+	buf_head_t bufhead;
+	char data[] = "first\r\nsec";
+	char more[] = "ond\r\n";
+	char buf[BUFSIZE];
+
+	rb_linebuf_newbuf(&bufhead);
+
+	rb_linebuf_parse(&bufhead, data, strlen(data), 0);
+	is_int(5, rb_linebuf_get(&bufhead, buf, sizeof(buf), 0, 0), MSG);
+	is_string("first", buf, MSG);
+	is_int(0, rb_linebuf_get(&bufhead, buf, sizeof(buf), 0, 0), MSG);
+
+	rb_linebuf_parse(&bufhead, more, strlen(more), 0);
+	is_int(6, rb_linebuf_get(&bufhead, buf, sizeof(buf), 0, 0), MSG);
+	is_string("second", buf, MSG);
+
+	rb_linebuf_donebuf(&bufhead);
+}
+
+static void grow1(void)
+{
+	buf_head_t bufhead;
+	char data[LINEBUF_SIZE + 100];
+	char buf[LINEBUF_SIZE + 100];
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = 'a' + i % 26;
+
+	rb_linebuf_newbuf(&bufhead);
+
+	/* a partial line that has to move up through the size classes */
+	rb_linebuf_parse(&bufhead, data, 100, 0);
+	rb_linebuf_parse(&bufhead, data + 100, 300, 0);
+	rb_linebuf_parse(&bufhead, data + 400, 300, 0);
+	is_int(1, rb_linebuf_numlines(&bufhead), MSG);
+	rb_linebuf_parse(&bufhead, "\r\n", 2, 0);
+	is_int(700, rb_linebuf_get(&bufhead, buf, sizeof(buf), 0, 0), MSG);
+	ok(memcmp(buf, data, 700) == 0, MSG);
+
+	/* too long lines are truncated to LINEBUF_SIZE */
+	rb_linebuf_parse(&bufhead, data, sizeof(data), 0);
+	rb_linebuf_parse(&bufhead, "\r\n", 2, 0);
+	is_int(LINEBUF_SIZE, rb_linebuf_get(&bufhead, buf, sizeof(buf), 0, 0), MSG);
+	ok(memcmp(buf, data, LINEBUF_SIZE) == 0, MSG);
+
+	rb_linebuf_donebuf(&bufhead);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	order1();
+	attach1();
+	partial1();
+	grow1();
+
+	return 0;
+}
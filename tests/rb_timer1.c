@@ -0,0 +1,189 @@
+/*
+ *  rb_timer1.c: Test fd timeouts and events on the librb timer wheel
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define PAIRS 100
+#define RUNTIME 2500	/* milliseconds */
+#define SLACK 400	/* how late a timer may fire on a loaded machine */
+
+static rb_fde_t *fds[PAIRS * 2];
+static int fired[PAIRS * 2];
+static long fired_at[PAIRS * 2];
+static int self_rearms;
+static int once_runs, periodic_runs, suicide_runs, deleted_runs;
+static long once_at;
+static struct ev_entry *suicide_ev;
+static int saw_timers_line;
+
+static struct timeval start;
+
+static long elapsed(void)
+{
+	struct timeval now;
+	rb_set_time();
+	now = *rb_current_time_tv();
+	return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+}
+
+static void timeout_cb(rb_fde_t *F, void *data)
+{
+	int i = (int)(intptr_t)data;
+
+	fired[i]++;
+	fired_at[i] = elapsed();
+}
+
+static void self_rearm_cb(rb_fde_t *F, void *data)
+{
+	if (++self_rearms < 3)
+		rb_settimeout(F, 0, self_rearm_cb, NULL);
+}
+
+static void once_cb(void *data)
+{
+	once_runs++;
+	once_at = elapsed();
+}
+
+static void periodic_cb(void *data)
+{
+	periodic_runs++;
+}
+
+static void suicide_cb(void *data)
+{
+	suicide_runs++;
+	rb_event_delete(suicide_ev);
+}
+
+static void deleted_cb(void *data)
+{
+	deleted_runs++;
+}
+
+static void dump_cb(char *line, void *data)
+{
+	if (!strncmp(line, "Timers: ", 8))
+		saw_timers_line = 1;
+}
+
+static void run_loop(void)
+{
+	while (elapsed() < RUNTIME)
+	{
+		rb_select(10);
+		rb_event_run();
+	}
+}
+
+static void timers1(void)
+{
+	struct ev_entry *deleted_ev;
+	rb_fde_t *self_F1, *self_F2;
+	int i, ok_first = 1, ok_second = 1, ok_cancelled = 1;
+
+	rb_set_time();
+	start = *rb_current_time_tv();
+
+	for (i = 0; i < PAIRS; i++)
+	{
+		if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2], &fds[i * 2 + 1], "timer1") == -1)
+			bail("rb_socketpair: %s", strerror(errno));
+	}
+
+	/* everything at 1s, then half moved to 2s and every tenth cancelled */
+	for (i = 0; i < PAIRS * 2; i++)
+		rb_settimeout(fds[i], 1, timeout_cb, (void *)(intptr_t)i);
+	for (i = 0; i < PAIRS * 2; i += 2)
+		rb_settimeout(fds[i], 2, timeout_cb, (void *)(intptr_t)i);
+	for (i = 0; i < PAIRS * 2; i += 10)
+		rb_settimeout(fds[i], 0, NULL, NULL);
+
+	if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &self_F1, &self_F2, "timer1 rearm") == -1)
+		bail("rb_socketpair: %s", strerror(errno));
+	rb_settimeout(self_F1, 0, self_rearm_cb, NULL);
+
+	rb_event_addonce("timer1 once", once_cb, NULL, 1);
+	rb_event_add("timer1 periodic", periodic_cb, NULL, 1);
+	suicide_ev = rb_event_add("timer1 suicide", suicide_cb, NULL, 1);
+	deleted_ev = rb_event_addonce("timer1 deleted", deleted_cb, NULL, 1);
+	rb_event_delete(deleted_ev);
+
+	rb_dump_events(dump_cb, NULL);
+	ok(saw_timers_line, MSG);
+
+	run_loop();
+
+	for (i = 0; i < PAIRS * 2; i++)
+	{
+		if (i % 10 == 0)
+		{
+			if (fired[i] != 0)
+				ok_cancelled = 0;
+		}
+		else if (i % 2 == 0)
+		{
+			if (fired[i] != 1 || fired_at[i] < 2000 || fired_at[i] > 2000 + SLACK)
+				ok_second = 0;
+		}
+		else
+		{
+			if (fired[i] != 1 || fired_at[i] < 1000 || fired_at[i] > 1000 + SLACK)
+				ok_first = 0;
+		}
+	}
+	ok(ok_first, MSG);
+	ok(ok_second, MSG);
+	ok(ok_cancelled, MSG);
+
+	is_int(3, self_rearms, MSG);
+
+	is_int(1, once_runs, MSG);
+	ok(once_at >= 1000 && once_at <= 1000 + SLACK, MSG);
+	is_int(2, periodic_runs, MSG);
+	is_int(1, suicide_runs, MSG);
+	is_int(0, deleted_runs, MSG);
+
+	for (i = 0; i < PAIRS * 2; i++)
+		rb_close(fds[i]);
+	rb_close(self_F1);
+	rb_close(self_F2);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	timers1();
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ *  send_deferred1.c: Test deferred flushing of client sendqs
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "send.h"
+#include "s_conf.h"
+#include "s_stats.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static rb_fde_t *peer;
+
+/* a local client whose sendq is written to a socket we can read */
+static struct Client *
+make_connected_person(void)
+{
+	struct Client *client = make_local_person();
+
+	if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &client->localClient->F, &peer, "test") == -1)
+		bail("rb_socketpair: %s", strerror(errno));
+
+	return client;
+}
+
+static int
+peer_lines_on(rb_fde_t *F, const char *want, bool *found)
+{
+	char buf[65536];
+	ssize_t len;
+	int lines = 0;
+
+	while ((len = recv(rb_get_fd(F), buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0)
+	{
+		ssize_t i;
+
+		buf[len] = '\0';
+		if (want != NULL && strstr(buf, want) != NULL)
+			*found = true;
+
+		for (i = 0; i < len; i++)
+			if (buf[i] == '\n')
+				lines++;
+	}
+
+	return lines;
+}
+
+static int
+peer_lines(void)
+{
+	return peer_lines_on(peer, NULL, NULL);
+}
+
+static void
+immediate1(void)
+{
+	struct Client *user = make_connected_person();
+
+	ConfigFileEntry.deferred_flush = false;
+
+	sendto_one(user, "TEST 1");
+	sendto_one(user, "TEST 2");
+	is_int(2, peer_lines(), MSG);
+	is_int(0, rb_linebuf_len(&user->localClient->buf_sendq), MSG);
+
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+static void
+deferred1(void)
+{
+	struct Client *user = make_connected_person();
+	unsigned long long saved = ServerStats.is_dfsaved;
+	unsigned long long flushed = ServerStats.is_dflush;
+
+	ConfigFileEntry.deferred_flush = true;
+
+	sendto_one(user, "TEST 1");
+	sendto_one(user, "TEST 2");
+	sendto_one(user, "TEST 3");
+	is_int(0, peer_lines(), MSG);
+	ok(IsDeferred(user), MSG);
+	is_int(2, ServerStats.is_dfsaved - saved, MSG);
+
+	send_deferred_flush();
+	is_int(3, peer_lines(), MSG);
+	ok(!IsDeferred(user), MSG);
+	is_int(0, rb_linebuf_len(&user->localClient->buf_sendq), MSG);
+	is_int(1, ServerStats.is_dflush - flushed, MSG);
+
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+static void
+threshold1(void)
+{
+	struct Client *user = make_connected_person();
+	unsigned long long early = ServerStats.is_dfearly;
+	int i, lines;
+
+	ConfigFileEntry.deferred_flush = true;
+
+	/* about 100 bytes a line */
+	for (i = 0; i < 200; i++)
+		sendto_one(user, "TEST %d %090d", i, 0);
+
+	lines = peer_lines();
+	ok(lines > 0 && lines < 200, MSG);
+	ok(ServerStats.is_dfearly > early, MSG);
+
+	send_deferred_flush();
+	is_int(200, lines + peer_lines(), MSG);
+
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+static void
+exit1(void)
+{
+	struct Client *user = make_connected_person();
+	rb_fde_t *user_peer = peer;
+	struct Client *user2 = make_connected_person();
+	bool found = false;
+
+	ConfigFileEntry.deferred_flush = true;
+
+	sendto_one(user, "TEST 1");
+	sendto_one(user2, "TEST 2");
+	ok(IsDeferred(user), MSG);
+	ok(IsDeferred(user2), MSG);
+
+	/* an exiting client leaves the list, and its sendq is written as
+	 * the connection is closed */
+	remove_local_person(user);
+	is_int(0, peer_lines(), MSG);
+	ok(peer_lines_on(user_peer, "TEST 1\r\n", &found) >= 1, MSG);
+	ok(found, MSG);
+
+	send_deferred_flush();
+	is_int(1, peer_lines(), MSG);
+
+	remove_local_person(user2);
+	rb_close(peer);
+	rb_close(user_peer);
+}
+
+/* the whole list is written once the oldest has waited deferred_flush_delay */
+static void
+delay1(void)
+{
+	struct Client *user = make_connected_person();
+	unsigned long long early = ServerStats.is_dfearly;
+	int i, lines;
+
+	ConfigFileEntry.deferred_flush = true;
+
+	/* well under DEFERRED_FLUSH_SENDQ, so only the delay can flush it */
+	ConfigFileEntry.deferred_flush_delay = 60000;
+	for (i = 0; i < 1000; i++)
+		sendto_one(user, "TEST %d", i);
+	is_int(0, peer_lines(), MSG);
+	is_int(0, ServerStats.is_dfearly - early, MSG);
+	send_deferred_flush();
+	is_int(1000, peer_lines(), MSG);
+
+	ConfigFileEntry.deferred_flush_delay = 0;
+	for (i = 0; i < 1000; i++)
+		sendto_one(user, "TEST %d", i);
+	lines = peer_lines();
+	ok(lines > 0, MSG);
+	ok(ServerStats.is_dfearly > early, MSG);
+	send_deferred_flush();
+	is_int(1000, lines + peer_lines(), MSG);
+
+	ConfigFileEntry.deferred_flush_delay = DEFERRED_FLUSH_DELAY_DEFAULT;
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	immediate1();
+	deferred1();
+	threshold1();
+	exit1();
+	delay1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ *  serv_burst1.c: Test lines sent to a server in the middle of its burst
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "s_serv.h"
+#include "s_conf.h"
+#include "s_newconf.h"
+#include "send.h"
+#include "hash.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+/* far more than one slice of burst, or a socket buffer, holds */
+#define USERS 20000
+
+static struct Client *users[USERS];
+static rb_fde_t *peer;
+
+static char *received;
+static size_t received_len, received_size;
+
+static void
+make_users(void)
+{
+	char nick[NICKLEN];
+
+	for (int i = 0; i < USERS; i++)
+	{
+		struct Client *client;
+
+		snprintf(nick, sizeof(nick), "burst%d", i);
+		client = make_local_person_nick(nick);
+		snprintf(client->id, sizeof(client->id), "%sA%05d", me.id, i);
+		add_to_id_hash(client->id, client);
+
+		/* as register_local_user() would */
+		rb_dlinkAddTail(client, &client->node, &global_client_list);
+		burst_client_introduced(client);
+		users[i] = client;
+	}
+}
+
+static struct Client *
+make_linking_server(void)
+{
+	struct Client *server = make_local_unknown();
+
+	if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &server->localClient->F, &peer, "test") == -1)
+		bail("rb_socketpair: %s", strerror(errno));
+
+	rb_strlcpy(server->name, TEST_SERVER_NAME, sizeof(server->name));
+	rb_strlcpy(server->id, TEST_SERVER_ID, sizeof(server->id));
+	attach_server_conf(server, find_server_conf(TEST_SERVER_NAME));
+	server->localClient->caps = CAP_EUID;
+
+	return server;
+}
+
+static void
+receive(void)
+{
+	ssize_t len;
+
+	do
+	{
+		if (received_size - received_len < 65536)
+		{
+			received_size += 1 << 20;
+			received = rb_realloc(received, received_size);
+		}
+
+		len = recv(rb_get_fd(peer), received + received_len,
+				received_size - received_len - 1, MSG_DONTWAIT);
+		if (len > 0)
+			received_len += len;
+	} while (len > 0);
+
+	received[received_len] = '\0';
+}
+
+/*
+ * read everything the server is sent, letting the burst run to the end,
+ * as send_queued_write() would each time the socket became writable
+ */
+static void
+finish_burst(struct Client *server)
+{
+	for (int i = 0; i < 100000; i++)
+	{
+		receive();
+
+		if (server->localClient->burst == NULL &&
+		    rb_linebuf_len(&server->localClient->buf_sendq) == 0)
+			break;
+
+		ClearFlush(server);
+		send_queued(server);
+		burst_resume(server);
+	}
+	receive();
+}
+
+static int
+count(const char *what)
+{
+	int n = 0;
+
+	for (const char *p = received; (p = strstr(p, what)) != NULL; p++)
+		n++;
+
+	return n;
+}
+
+static const char *
+euid_of(struct Client *client)
+{
+	static char buf[BUFSIZE];
+
+	snprintf(buf, sizeof(buf), ":%s EUID %s ", TEST_ME_ID, client->name);
+	return buf;
+}
+
+static void
+unsent_client1(void)
+{
+	struct Client *server, *early, *late, *later;
+	const char *euid, *privmsg;
+
+	make_users();
+	early = users[0];
+	late = users[USERS - 1];
+	later = users[USERS - 2];
+	server = make_linking_server();
+
+	is_int(0, server_estab(server), MSG);
+	if (!ok(server->localClient->burst != NULL, MSG))
+		return;
+
+	/* from clients the server has and has not been sent yet */
+	sendto_one(server, ":%s PRIVMSG %s :early", early->id, TEST_REMOTE_ID);
+	sendto_one(server, ":%s PRIVMSG %s :late", late->id, TEST_REMOTE_ID);
+	sendto_one(server, ":%s NOTICE %s :late again", late->id, TEST_REMOTE_ID);
+	sendto_one(server, ":%s AWAY :later", later->id);
+
+	finish_burst(server);
+	ok(server->localClient->burst == NULL, MSG);
+	ok(strstr(received, "PING :") != NULL, MSG);
+
+	/* each client is sent once, before anything from it */
+	is_int(1, count(euid_of(early)), MSG);
+	is_int(1, count(euid_of(late)), MSG);
+	is_int(1, count(euid_of(later)), MSG);
+	is_int(1, count(euid_of(users[USERS / 2])), MSG);
+	is_int(USERS, count(":" TEST_ME_ID " EUID "), MSG);
+
+	euid = strstr(received, euid_of(late));
+	privmsg = strstr(received, " PRIVMSG " TEST_REMOTE_ID " :late");
+	ok(euid != NULL && privmsg != NULL && euid < privmsg, MSG);
+	ok(strstr(received, " NOTICE " TEST_REMOTE_ID " :late again") != NULL, MSG);
+
+	euid = strstr(received, euid_of(later));
+	privmsg = strstr(received, " AWAY :later");
+	ok(euid != NULL && privmsg != NULL && euid < privmsg, MSG);
+
+	euid = strstr(received, euid_of(early));
+	privmsg = strstr(received, " PRIVMSG " TEST_REMOTE_ID " :early");
+	ok(euid != NULL && privmsg != NULL && euid < privmsg, MSG);
+
+	rb_free(received);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	unsent_client1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ *  tokenize_bench.c: rb_linebuf_parse() and msgbuf_parse() over a burst
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "msgbuf.h"
+
+#define ROUNDS 200
+#define READ_SIZE 16384		/* what a server link read hands us */
+
+/* lines from msgbuf_parse1.c, plus typical burst and channel traffic */
+static const char *lines[] = {
+	"@tag=value PRIVMSG #test :test",
+	"@tag0=value0;tag1=value1;tag2=value2 PRIVMSG #test :test",
+	"@tag0=val=ue0;tag1=val=ue1;tag2=val=ue2;tag3=val=ue3;tag4=val=ue4 PRIVMSG #test :test",
+	"@tag1=\\v\\a\\l\\u\\e\\1;tag2=\\va\\lu\\e2;tag3=v\\al\\ue\\3 PRIVMSG #test :test",
+	"@tag=value PRIVMSG #test test D E F G H I J K L M N :O P",
+	"@time=2024-01-01T00:00:00.000Z;account=someone :00AAAAAAB PRIVMSG #test :hello there, how is everyone doing today?",
+	":00A EUID somenick 1 1700000000 +iw user host.example.com 192.0.2.1 00AAAAAAB * * :Some Real Name",
+	":00A EUID othernick 2 1700000001 +i ident gateway/web/irccloud.com/x-abcdef 0 00AAAAAAC * account :Other Real Name",
+	":00A SJOIN 1700000000 #channel +nt :@00AAAAAAB +00AAAAAAC 00AAAAAAD 00AAAAAAE 00AAAAAAF",
+	":00A BMASK 1700000000 #channel b :*!*@192.0.2.* *!*@*.example.net $a:someone",
+	":00A TB #channel 1700000000 someone!user@host :The topic of the channel goes here",
+	":00AAAAAAB PRIVMSG #channel :a typical line of chat that is neither short nor long",
+	":00AAAAAAB NOTICE someone :\001VERSION some client 1.0\001",
+	":00AAAAAAB QUIT :Quit: leaving",
+	"PING :irc.example.com",
+};
+
+struct Client me;
+
+static char input[1 << 20];
+static size_t input_len;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* the byte at a time scan rb_linebuf_parse() used to do, for reference */
+static size_t scan_bytewise(const char *ch, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++)
+		if (ch[i] == '\r' || ch[i] == '\n')
+			n++;
+	return n;
+}
+
+static void report(const char *what, double t, unsigned long long c)
+{
+	double bytes = (double)ROUNDS * input_len;
+
+	if (c != 0)
+		printf("  %-24s %7.2f bytes/cycle  %7.1f MB/s\n", what, bytes / c, bytes / t / 1e6);
+	else
+		printf("  %-24s %7.1f MB/s\n", what, bytes / t / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	static char line[BUFSIZE];
+	buf_head_t bufhead;
+	struct MsgBuf msgbuf;
+	unsigned long long c;
+	double t;
+	size_t n, got = 0, want = 0, eols = 0;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+	rb_linebuf_newbuf(&bufhead);
+
+	for (n = 0; input_len + BUFSIZE < sizeof(input); n++)
+	{
+		input_len += snprintf(input + input_len, sizeof(input) - input_len,
+				"%s\r\n", lines[n % ARRAY_SIZE(lines)]);
+		want++;
+	}
+
+	printf("%zu lines, %zu bytes in %d byte reads\n", want, input_len, READ_SIZE);
+
+	/* split into lines */
+	t = now();
+	c = cycles();
+	for (int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t off = 0; off < input_len; off += READ_SIZE)
+		{
+			size_t len = input_len - off < READ_SIZE ? input_len - off : READ_SIZE;
+
+			rb_linebuf_parse(&bufhead, input + off, len, 0);
+		}
+		rb_linebuf_donebuf(&bufhead);
+	}
+	report("rb_linebuf_parse()", now() - t, cycles() - c);
+
+	/* and into tags and parameters */
+	t = now();
+	c = cycles();
+	for (int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t off = 0; off < input_len; off += READ_SIZE)
+		{
+			size_t len = input_len - off < READ_SIZE ? input_len - off : READ_SIZE;
+
+			rb_linebuf_parse(&bufhead, input + off, len, 0);
+			while (rb_linebuf_get(&bufhead, line, sizeof(line), LINEBUF_COMPLETE, LINEBUF_PARSED) > 0)
+				if (msgbuf_parse(&msgbuf, line) == 0)
+					got++;
+		}
+	}
+	report("... and msgbuf_parse()", now() - t, cycles() - c);
+
+	t = now();
+	c = cycles();
+	for (int r = 0; r < ROUNDS; r++)
+		eols += scan_bytewise(input, input_len);
+	report("bytewise CR/LF scan", now() - t, cycles() - c);
+
+	if (got != want * ROUNDS || eols != want * 2 * ROUNDS)
+	{
+		printf("  MISMATCH: %zu lines, %zu line ends\n", got, eols);
+		return 1;
+	}
+
+	return 0;
+}
@@ -22,6 +22,11 @@
 
 #include "stdinc.h"
 #include "sha1.h"
+#include "wsproc.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 #define MAXPASSFD 4
 #ifndef READBUF_SIZE
@@ -93,14 +98,47 @@ typedef struct _conn
 	uint8_t flags;
 
 	char client_key[37];		/* maximum 36 bytes + nul */
+
+	/* inbound frame parser state, see conn_mod_process() */
+	uint64_t frame_left;		/* payload bytes of the current data frame still to come */
+	uint8_t frame_mask[4];
+	uint8_t frame_phase;		/* mask offset of the next payload byte */
+	uint8_t frame_masked;
+	uint8_t frame_fin;
+	uint8_t in_message;		/* a fragmented message is in progress */
+	uint8_t line_open;		/* the message so far does not end in CR or LF */
+	uint8_t partial_len;
+	uint8_t partial[14 + 125];	/* incomplete frame header or control frame */
+
+	/* permessage-deflate, see ws_negotiate_deflate() */
+	uint8_t deflate_bits;		/* our window, 0 if we don't compress */
+	uint8_t inflate_bits;		/* the client's window, 0 if it doesn't */
+	uint8_t deflate_flags;
+	uint8_t frame_compressed;	/* the current inbound message is compressed */
+#ifdef HAVE_LIBZ
+	z_stream *deflate;		/* only kept with context takeover */
+	z_stream *inflate;
+	uint32_t inflated;		/* inflated size of the current message */
+#endif
 } conn_t;
 
+#define DEFLATE_SERVER_NO_CONTEXT	0x01
+#define DEFLATE_CLIENT_NO_CONTEXT	0x02
+
+#define WEBSOCKET_OPCODE_CONTINUATION_FRAME  0
 #define WEBSOCKET_OPCODE_TEXT_FRAME          1
+#define WEBSOCKET_OPCODE_BINARY_FRAME        2
+#define WEBSOCKET_OPCODE_CLOSE_FRAME         8
+#define WEBSOCKET_OPCODE_PING_FRAME          9
+#define WEBSOCKET_OPCODE_PONG_FRAME          10
 
 #define WEBSOCKET_MASK_LENGTH 4
 
 #define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 125
 
+/* iovecs gathered per read before they are written to the plain side */
+#define PLAIN_IOV 64
+
 typedef struct {
 	uint8_t opcode_rsv_fin; // opcode: 4, rsv1: 1, rsv2: 1, rsv3: 1, fin: 1
 	uint8_t payload_length_mask; // payload_length: 7, mask: 1
@@ -175,6 +213,17 @@ static const char *remote_closed = "Remote host closed the connection";
 static rb_dlink_list connid_hash_table[CONN_HASH_SIZE];
 static rb_dlink_list dead_list;
 
+/* set by the ircd with 'Z' */
+static struct
+{
+	bool enabled;
+	int window_bits;
+	bool no_context_takeover;
+} deflate_conf;
+
+/* reported to the ircd with 'S' */
+static struct wsockd_stats stats;
+
 static void conn_plain_read_shutdown_cb(rb_fde_t *fd, void *data);
 
 static void
@@ -234,6 +283,21 @@ conn_add_id_hash(conn_t * conn, uint32_t id)
 static void
 free_conn(conn_t * conn)
 {
+#ifdef HAVE_LIBZ
+	if(conn->deflate != NULL)
+	{
+		deflateEnd(conn->deflate);
+		rb_free(conn->deflate);
+	}
+	if(conn->inflate != NULL)
+	{
+		inflateEnd(conn->inflate);
+		rb_free(conn->inflate);
+	}
+#endif
+	if(conn->deflate_bits || conn->inflate_bits)
+		stats.deflate_conns--;
+
 	rb_linebuf_donebuf(&conn->plainbuf_in);
 	rb_linebuf_donebuf(&conn->plainbuf_out);
 
@@ -353,12 +417,167 @@ conn_mod_write_long_frame(conn_t * conn, void *data, int len)
 	conn_mod_write(conn, "\r\n", 2);
 }
 
+static void
+conn_mod_write_control_frame(conn_t *conn, int opcode, void *data, int len)
+{
+	ws_frame_hdr_t hdr = WEBSOCKET_FRAME_HDR_INIT;
+
+	ws_frame_set_opcode(&hdr, opcode);
+	ws_frame_set_fin(&hdr, 1);
+	hdr.payload_length_mask = len & 0x7f;
+
+	conn_mod_write(conn, &hdr, sizeof(hdr));
+	conn_mod_write(conn, data, len);
+}
+
+static void
+conn_mod_write_frame_header(conn_t *conn, uint8_t opcode_rsv_fin, uint64_t len)
+{
+	uint8_t hdr[10];
+	size_t hdrlen;
+	int i;
+
+	hdr[0] = opcode_rsv_fin;
+	if (len <= WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH)
+	{
+		hdr[1] = len;
+		hdrlen = 2;
+	}
+	else if (len <= 0xffff)
+	{
+		hdr[1] = 126;
+		hdr[2] = len >> 8;
+		hdr[3] = len;
+		hdrlen = 4;
+	}
+	else
+	{
+		hdr[1] = 127;
+		for (i = 0; i < 8; i++)
+			hdr[2 + i] = len >> (56 - 8 * i);
+		hdrlen = 10;
+	}
+
+	conn_mod_write(conn, hdr, hdrlen);
+}
+
+#ifdef HAVE_LIBZ
+static uint64_t
+cpu_usec(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Without context takeover nothing carries over from one message to the
+ * next, so every such connection shares one stream per window size.
+ */
+static z_stream *shared_deflate[WSOCK_DEFLATE_BITS_MAX + 1];
+
+static z_stream *
+ws_deflate_stream(conn_t *conn)
+{
+	z_stream **zs = &conn->deflate;
+
+	if (conn->deflate_flags & DEFLATE_SERVER_NO_CONTEXT)
+		zs = &shared_deflate[conn->deflate_bits];
+
+	if (*zs == NULL)
+	{
+		*zs = rb_malloc(sizeof(z_stream));
+		/* memLevel shrinks with the window, 8 (zlib's default) at 15 bits */
+		if (deflateInit2(*zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -conn->deflate_bits,
+				 conn->deflate_bits - 7, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			rb_free(*zs);
+			*zs = NULL;
+		}
+	}
+
+	return *zs;
+}
+
+/*
+ * Writes the line as a compressed message.  Returns false if it should
+ * go out uncompressed instead, which is always allowed.
+ */
+static bool
+conn_mod_write_deflated(conn_t *conn, void *data, int len)
+{
+	static uint8_t out[READBUF_SIZE * 2];
+	bool shared = conn->deflate_flags & DEFLATE_SERVER_NO_CONTEXT;
+	z_stream *zs = ws_deflate_stream(conn);
+	size_t outlen;
+	int ret;
+
+	if (zs == NULL)
+		return false;
+
+	zs->next_out = out;
+	zs->avail_out = sizeof(out);
+	zs->next_in = data;
+	zs->avail_in = len;
+	ret = deflate(zs, Z_NO_FLUSH);
+	if (ret == Z_OK)
+	{
+		zs->next_in = (Bytef *) "\r\n";
+		zs->avail_in = 2;
+		ret = deflate(zs, Z_SYNC_FLUSH);
+	}
+
+	if (ret != Z_OK || zs->avail_out == 0)
+	{
+		/* our history no longer matches the client's, stop compressing */
+		if (shared)
+			deflateReset(zs);
+		else
+		{
+			deflateEnd(zs);
+			rb_free(zs);
+			conn->deflate = NULL;
+			conn->deflate_bits = 0;
+			if (!conn->inflate_bits)
+				stats.deflate_conns--;
+		}
+		return false;
+	}
+
+	/* the sync flush ends in 00 00 ff ff, which the client puts back */
+	outlen = sizeof(out) - zs->avail_out - 4;
+	stats.deflate_in += len + 2;
+
+	if (shared)
+	{
+		deflateReset(zs);
+		if (outlen >= (size_t) len + 2)
+		{
+			stats.deflate_out += len + 2;
+			return false;
+		}
+	}
+
+	stats.deflate_out += outlen;
+	conn_mod_write_frame_header(conn, 0xc0 | WEBSOCKET_OPCODE_TEXT_FRAME, outlen);
+	conn_mod_write(conn, out, outlen);
+	return true;
+}
+#endif
+
 static void
 conn_mod_write_frame(conn_t *conn, void *data, int len)
 {
 	if(IsDead(conn))	/* no point in queueing to a dead man */
 		return;
 
+#ifdef HAVE_LIBZ
+	if (conn->deflate_bits && conn_mod_write_deflated(conn, data, len))
+		return;
+#endif
+
 	if (len < 123)
 	{
 		conn_mod_write_short_frame(conn, data, len);
@@ -482,130 +701,484 @@ cleanup_bad_message(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 		rb_close(ctlb->F[i]);
 }
 
+/*
+ * Unmasks in place.  phase is the offset into the mask of msg[0]; the
+ * bulk of the payload is XORed a 64-bit word at a time (which compilers
+ * will widen further), with single bytes only up to the first aligned
+ * word and after the last one.
+ */
 static void
-ws_frame_unmask(char *msg, int length, uint8_t maskval[WEBSOCKET_MASK_LENGTH])
+ws_frame_unmask(uint8_t *msg, size_t length, const uint8_t maskval[WEBSOCKET_MASK_LENGTH], unsigned int phase)
 {
-	int i;
+	uint8_t pattern[sizeof(uint64_t)];
+	uint64_t key, word;
+	size_t i;
+
+	for (; length > 0 && ((uintptr_t) msg & (sizeof(uint64_t) - 1)) != 0; length--)
+		*msg++ ^= maskval[phase++ & 3];
+
+	for (i = 0; i < sizeof(pattern); i++)
+		pattern[i] = maskval[(phase + i) & 3];
+	memcpy(&key, pattern, sizeof(key));
+
+	for (; length >= sizeof(uint64_t); length -= sizeof(uint64_t), msg += sizeof(uint64_t))
+	{
+		memcpy(&word, msg, sizeof(word));
+		word ^= key;
+		memcpy(msg, &word, sizeof(word));
+	}
 
-	for (i = 0; i < length; i++)
-		msg[i] = msg[i] ^ maskval[i % 4];
+	for (; length > 0; length--)
+		*msg++ ^= maskval[phase++ & 3];
 }
 
+/*
+ * Hands data to the plain side.  If nothing is queued ahead of it, it is
+ * written straight from the read buffer; only what the socket will not
+ * take is copied into plainbuf_out.
+ */
 static void
-conn_mod_process_frame(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+conn_plain_writev(conn_t *conn, struct rb_iovec *vec, int count)
 {
-	char msg[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
-	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
-	int dolen;
+	ssize_t written = 0;
+	int i;
+
+	if (count == 0 || IsDead(conn))
+		return;
 
-	/* if we're masked, we get to collect the masking key for this frame */
-	if (masked)
+	if (rb_linebuf_alloclen(&conn->plainbuf_out) == 0)
 	{
-		dolen = rb_rawbuf_get(conn->modbuf_in, maskval, sizeof(maskval));
-		if (!dolen)
+		/* errors are picked up by the next read or write on plain_fd */
+		written = rb_writev(conn->plain_fd, vec, count);
+		if (written < 0)
+			written = 0;
+		conn->plain_out += written;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if ((size_t) written >= vec[i].iov_len)
 		{
-			close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking unmask key");
-			return;
+			written -= vec[i].iov_len;
+			continue;
 		}
+
+		rb_linebuf_parse(&conn->plainbuf_out, (char *) vec[i].iov_base + written,
+				 vec[i].iov_len - written, 1);
+		written = 0;
 	}
+}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, msg, hdr->payload_length_mask);
-	if (!dolen)
+static void
+conn_plain_queue(conn_t *conn, struct rb_iovec *vec, int *count, void *data, size_t len)
+{
+	if (*count == PLAIN_IOV)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
+		conn_plain_writev(conn, vec, *count);
+		*count = 0;
 	}
 
-	if (masked)
-		ws_frame_unmask(msg, dolen, maskval);
-
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
+	vec[*count].iov_base = data;
+	vec[*count].iov_len = len;
+	(*count)++;
 }
 
+/*
+ * Each websocket message is one IRC line, and clients are not required
+ * to terminate it themselves.
+ */
 static void
-conn_mod_process_large(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+conn_mod_end_message(conn_t *conn, struct rb_iovec *vec, int *count)
 {
-	char msg[READBUF_SIZE];
-	uint16_t msglen;
-	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
-	int dolen;
+	static char crlf[] = "\r\n";
 
-	memset(msg, 0, sizeof msg);
+	if (conn->line_open)
+		conn_plain_queue(conn, vec, count, crlf, 2);
+	conn->line_open = 0;
+}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, &msglen, sizeof(msglen));
-	if (!dolen)
+#ifdef HAVE_LIBZ
+/*
+ * Inflates part of a compressed message straight to the plain side.
+ */
+static const char *
+conn_mod_inflate(conn_t *conn, struct rb_iovec *vec, int *count, uint8_t *data, size_t len)
+{
+	uint8_t out[READBUF_SIZE];
+	struct rb_iovec outvec;
+	uint64_t start = cpu_usec();
+	const char *err = NULL;
+	z_stream *zs;
+	size_t produced;
+	int ret;
+
+	if (conn->inflate == NULL)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message size");
-		return;
+		conn->inflate = rb_malloc(sizeof(z_stream));
+		if (inflateInit2(conn->inflate, -conn->inflate_bits) != Z_OK)
+		{
+			rb_free(conn->inflate);
+			conn->inflate = NULL;
+			return "websocket error: cannot inflate";
+		}
 	}
+	zs = conn->inflate;
 
-	msglen = ntohs(msglen);
+	/* anything gathered so far goes first */
+	conn_plain_writev(conn, vec, *count);
+	*count = 0;
 
-	if (masked)
+	stats.inflate_in += len;
+	zs->next_in = data;
+	zs->avail_in = len;
+	do
 	{
-		dolen = rb_rawbuf_get(conn->modbuf_in, maskval, sizeof(maskval));
-		if (!dolen)
+		zs->next_out = out;
+		zs->avail_out = sizeof(out);
+		ret = inflate(zs, Z_SYNC_FLUSH);
+		if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END)
 		{
-			close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking unmask key");
-			return;
+			err = "websocket error: bad compressed data";
+			break;
+		}
+
+		produced = sizeof(out) - zs->avail_out;
+		if (produced > 0)
+		{
+			conn->inflated += produced;
+			if (conn->inflated > READBUF_SIZE)
+			{
+				err = "websocket error: message too long";
+				break;
+			}
+			stats.inflate_out += produced;
+			conn->line_open = out[produced - 1] != '\r' && out[produced - 1] != '\n';
+
+			outvec.iov_base = out;
+			outvec.iov_len = produced;
+			conn_plain_writev(conn, &outvec, 1);
+		}
+
+		/* a final block ends the stream, the next message starts afresh */
+		if (ret == Z_STREAM_END)
+		{
+			inflateReset(zs);
+			break;
 		}
 	}
+	while (zs->avail_out == 0);
+
+	stats.cpu_usec += cpu_usec() - start;
+	return err;
+}
+#endif
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, msg, msglen);
-	if (!dolen)
+static const char *
+conn_mod_finish_message(conn_t *conn, struct rb_iovec *vec, int *count)
+{
+#ifdef HAVE_LIBZ
+	static uint8_t trailer[] = { 0x00, 0x00, 0xff, 0xff };
+	const char *err;
+
+	if (conn->frame_compressed)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
-	}
+		/* put back what the client left off after its sync flush */
+		err = conn_mod_inflate(conn, vec, count, trailer, sizeof(trailer));
+		if (err != NULL)
+			return err;
 
-	if (masked)
-		ws_frame_unmask(msg, dolen, maskval);
+		if (conn->deflate_flags & DEFLATE_CLIENT_NO_CONTEXT)
+		{
+			inflateEnd(conn->inflate);
+			rb_free(conn->inflate);
+			conn->inflate = NULL;
+		}
+	}
+#endif
 
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
+	conn_mod_end_message(conn, vec, count);
+	return NULL;
 }
 
 static void
-conn_mod_process_huge(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+conn_mod_process_control(conn_t *conn, int opcode, uint8_t *payload, int len)
 {
-	/* XXX implement me */
+	switch (opcode)
+	{
+	case WEBSOCKET_OPCODE_CLOSE_FRAME:
+		/* echo the status code back, close_conn() flushes it */
+		conn_mod_write_control_frame(conn, WEBSOCKET_OPCODE_CLOSE_FRAME, payload, len < 2 ? len : 2);
+		close_conn(conn, WAIT_PLAIN, "%s", remote_closed);
+		break;
+	case WEBSOCKET_OPCODE_PING_FRAME:
+		conn_mod_write_control_frame(conn, WEBSOCKET_OPCODE_PONG_FRAME, payload, len);
+		conn_mod_write_sendq(conn->mod_fd, conn);
+		break;
+	default:
+		/* pong, nothing to do */
+		break;
+	}
 }
 
+/*
+ * Streaming frame parser.  buf holds whatever was carried over from the
+ * last read followed by the new data.  Data frame payloads are unmasked
+ * where they lie and passed on as they arrive, so frames of any length
+ * are handled without being buffered whole; only an incomplete header or
+ * control frame is kept back for the next read.
+ */
 static void
-conn_mod_process(conn_t *conn)
+conn_mod_process(conn_t *conn, uint8_t *buf, size_t len)
 {
-	ws_frame_hdr_t hdr;
+	struct rb_iovec vec[PLAIN_IOV];
+	uint8_t *p = buf, *end = buf + len;
+	const char *err = NULL;
+	int count = 0;
 
-	while (1)
+	while (p < end)
 	{
-		int masked;
-		int dolen = rb_rawbuf_get(conn->modbuf_in, &hdr, sizeof(hdr));
-		if (dolen != sizeof(hdr))
+		uint64_t paylen;
+		size_t avail = end - p, hdrlen, n;
+		int opcode, fin, masked, compressed, i;
+
+		if (conn->frame_left > 0)
+		{
+			n = conn->frame_left < avail ? conn->frame_left : avail;
+
+			if (conn->frame_masked)
+			{
+				ws_frame_unmask(p, n, conn->frame_mask, conn->frame_phase);
+				conn->frame_phase = (conn->frame_phase + n) & 3;
+			}
+
+#ifdef HAVE_LIBZ
+			if (conn->frame_compressed)
+			{
+				if ((err = conn_mod_inflate(conn, vec, &count, p, n)) != NULL)
+					break;
+			}
+			else
+#endif
+			{
+				conn_plain_queue(conn, vec, &count, p, n);
+				conn->line_open = p[n - 1] != '\r' && p[n - 1] != '\n';
+			}
+			conn->frame_left -= n;
+			p += n;
+
+			if (conn->frame_left == 0 && conn->frame_fin &&
+			    (err = conn_mod_finish_message(conn, vec, &count)) != NULL)
+				break;
+			continue;
+		}
+
+		if (avail < 2)
 			break;
 
-		masked = (hdr.payload_length_mask >> 7) == 1;
+		opcode = p[0] & 0xf;
+		fin = p[0] >> 7;
+		masked = p[1] >> 7;
+		paylen = p[1] & 0x7f;
 
-		hdr.payload_length_mask &= 0x7f;
-		switch (hdr.payload_length_mask)
+		hdrlen = 2 + (paylen == 126 ? 2 : paylen == 127 ? 8 : 0) + (masked ? WEBSOCKET_MASK_LENGTH : 0);
+		if (avail < hdrlen)
+			break;
+
+		if (paylen == 126)
+			paylen = (p[2] << 8) | p[3];
+		else if (paylen == 127)
 		{
-		case 126:
-			conn_mod_process_large(conn, &hdr, masked);
+			for (paylen = 0, i = 2; i < 10; i++)
+				paylen = (paylen << 8) | p[i];
+			if (paylen >> 63)
+			{
+				err = "websocket error: bad payload length";
+				break;
+			}
+		}
+
+		/* RSV1 marks the first frame of a compressed message */
+		compressed = (p[0] & 0x70) == 0x40 && conn->inflate_bits &&
+			     opcode != WEBSOCKET_OPCODE_CONTINUATION_FRAME && !(opcode & 0x8);
+		if ((p[0] & 0x70) && !compressed)
+		{
+			err = "websocket error: reserved bits set";
 			break;
-		case 127:
-			conn_mod_process_huge(conn, &hdr, masked);
+		}
+
+		if (opcode & 0x8)
+		{
+			if (!fin || paylen > WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH)
+			{
+				err = "websocket error: bad control frame";
+				break;
+			}
+			if (avail < hdrlen + paylen)
+				break;
+
+			if (masked)
+				ws_frame_unmask(p + hdrlen, paylen, p + hdrlen - WEBSOCKET_MASK_LENGTH, 0);
+
+			p += hdrlen + paylen;
+			if (opcode == WEBSOCKET_OPCODE_CLOSE_FRAME)
+			{
+				/* everything before the close still goes through */
+				conn_plain_writev(conn, vec, count);
+				count = 0;
+			}
+			conn_mod_process_control(conn, opcode, p - paylen, paylen);
+			if (IsDead(conn))
+				return;
+			continue;
+		}
+
+		if (opcode != WEBSOCKET_OPCODE_CONTINUATION_FRAME &&
+		    opcode != WEBSOCKET_OPCODE_TEXT_FRAME &&
+		    opcode != WEBSOCKET_OPCODE_BINARY_FRAME)
+		{
+			err = "websocket error: unknown opcode";
 			break;
-		default:
-			conn_mod_process_frame(conn, &hdr, masked);
+		}
+
+		if ((opcode == WEBSOCKET_OPCODE_CONTINUATION_FRAME) != conn->in_message)
+		{
+			err = "websocket error: bad fragmentation";
 			break;
 		}
+
+		conn->frame_left = paylen;
+		conn->frame_fin = fin;
+		conn->frame_masked = masked;
+		conn->frame_phase = 0;
+		conn->in_message = !fin;
+		if (opcode != WEBSOCKET_OPCODE_CONTINUATION_FRAME)
+		{
+			conn->frame_compressed = compressed;
+#ifdef HAVE_LIBZ
+			conn->inflated = 0;
+#endif
+		}
+		if (masked)
+			memcpy(conn->frame_mask, p + hdrlen - WEBSOCKET_MASK_LENGTH, WEBSOCKET_MASK_LENGTH);
+		p += hdrlen;
+
+		if (paylen == 0 && fin && (err = conn_mod_finish_message(conn, vec, &count)) != NULL)
+			break;
 	}
 
+	conn_plain_writev(conn, vec, count);
+
+	if (err != NULL)
+	{
+		close_conn(conn, WAIT_PLAIN, "%s", err);
+		return;
+	}
+
+	/* a partial frame header or control frame always fits */
+	conn->partial_len = end - p;
+	memcpy(conn->partial, p, conn->partial_len);
+
 	conn_plain_write_sendq(conn->plain_fd, conn);
 }
 
+#ifdef HAVE_LIBZ
+static char *
+ws_trim(char *s)
+{
+	char *end;
+
+	while (*s == ' ' || *s == '\t' || *s == '"')
+		s++;
+	for (end = s + strlen(s); end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '"'); end--)
+		;
+	*end = '\0';
+	return s;
+}
+
+/*
+ * Accepts the first permessage-deflate offer in a Sec-WebSocket-Extensions
+ * header (RFC 7692) that we can, and writes the response header value to
+ * resp.  Our window is capped by the configuration and by the client's
+ * server_max_window_bits; the client's is capped by the configuration if
+ * it lets us, which bounds what inflating from it costs.
+ */
+static void
+ws_negotiate_deflate(conn_t *conn, char *offers, char *resp, size_t resplen)
+{
+	char *offer, *param, *value, *offer_save, *param_save;
+
+	for (offer = strtok_r(offers, ",", &offer_save); offer != NULL;
+	     offer = strtok_r(NULL, ",", &offer_save))
+	{
+		int server_bits = deflate_conf.window_bits, client_bits = 0, flags = 0, bits;
+		bool ok = true, server_bits_asked = false;
+
+		param = strtok_r(offer, ";", &param_save);
+		if (param == NULL || strcasecmp(ws_trim(param), "permessage-deflate"))
+			continue;
+
+		while (ok && (param = strtok_r(NULL, ";", &param_save)) != NULL)
+		{
+			if ((value = strchr(param, '=')) != NULL)
+				*value++ = '\0';
+			param = ws_trim(param);
+
+			if (!strcasecmp(param, "server_no_context_takeover"))
+				flags |= DEFLATE_SERVER_NO_CONTEXT;
+			else if (!strcasecmp(param, "client_no_context_takeover"))
+				flags |= DEFLATE_CLIENT_NO_CONTEXT;
+			else if (!strcasecmp(param, "server_max_window_bits") && value != NULL)
+			{
+				/* zlib can't do 8, so that one we decline */
+				bits = atoi(ws_trim(value));
+				if (bits < WSOCK_DEFLATE_BITS_MIN || bits > WSOCK_DEFLATE_BITS_MAX)
+					ok = false;
+				else if (bits < server_bits)
+					server_bits = bits;
+				server_bits_asked = true;
+			}
+			else if (!strcasecmp(param, "client_max_window_bits"))
+			{
+				bits = value != NULL ? atoi(ws_trim(value)) : WSOCK_DEFLATE_BITS_MAX;
+				if (bits < 8 || bits > WSOCK_DEFLATE_BITS_MAX)
+					ok = false;
+				else
+					client_bits = bits < deflate_conf.window_bits ? bits : deflate_conf.window_bits;
+			}
+			else
+				ok = false;
+		}
+
+		if (!ok)
+			continue;
+
+		if (deflate_conf.no_context_takeover)
+			flags |= DEFLATE_SERVER_NO_CONTEXT | DEFLATE_CLIENT_NO_CONTEXT;
+
+		conn->deflate_bits = server_bits;
+		conn->deflate_flags = flags;
+		/* a larger window inflates anything a smaller one produced */
+		conn->inflate_bits = client_bits < WSOCK_DEFLATE_BITS_MIN ?
+			(client_bits ? WSOCK_DEFLATE_BITS_MIN : WSOCK_DEFLATE_BITS_MAX) : client_bits;
+		stats.deflate_conns++;
+
+		snprintf(resp, resplen, "permessage-deflate%s%s",
+			 flags & DEFLATE_SERVER_NO_CONTEXT ? "; server_no_context_takeover" : "",
+			 flags & DEFLATE_CLIENT_NO_CONTEXT ? "; client_no_context_takeover" : "");
+		if (server_bits_asked || server_bits < WSOCK_DEFLATE_BITS_MAX)
+			snprintf(resp + strlen(resp), resplen - strlen(resp), "; server_max_window_bits=%d", server_bits);
+		if (client_bits && client_bits < WSOCK_DEFLATE_BITS_MAX)
+			snprintf(resp + strlen(resp), resplen - strlen(resp), "; client_max_window_bits=%d", client_bits);
+		return;
+	}
+}
+#endif
+
 static void
 conn_mod_handshake_process(conn_t *conn)
 {
 	char inbuf[READBUF_SIZE];
+	char extensions[256] = "";
 
 	memset(inbuf, 0, sizeof inbuf);
 
@@ -617,6 +1190,20 @@ conn_mod_handshake_process(conn_t *conn)
 		if (!dolen)
 			break;
 
+#ifdef HAVE_LIBZ
+		/* before the key is cut out below */
+		if (deflate_conf.enabled && !IsKeyed(conn) &&
+		    (p = rb_strcasestr(inbuf, "Sec-WebSocket-Extensions:")) != NULL)
+		{
+			char offers[512];
+
+			p += strlen("Sec-WebSocket-Extensions:");
+			rb_strlcpy(offers, p, sizeof(offers));
+			offers[strcspn(offers, "\r\n")] = '\0';
+			ws_negotiate_deflate(conn, offers, extensions, sizeof(extensions));
+		}
+#endif
+
 		if ((p = rb_strcasestr(inbuf, "Sec-WebSocket-Key:")) != NULL)
 		{
 			char *start, *end;
@@ -658,6 +1245,11 @@ conn_mod_handshake_process(conn_t *conn)
 
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_1, strlen(WEBSOCKET_ANSWER_STRING_1));
 		conn_mod_write(conn, resp, strlen(resp));
+		if (*extensions)
+		{
+			conn_mod_write(conn, "\r\nSec-WebSocket-Extensions: ", strlen("\r\nSec-WebSocket-Extensions: "));
+			conn_mod_write(conn, extensions, strlen(extensions));
+		}
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_2, strlen(WEBSOCKET_ANSWER_STRING_2));
 
 		rb_free(resp);
@@ -669,12 +1261,11 @@ conn_mod_handshake_process(conn_t *conn)
 static void
 conn_mod_read_cb(rb_fde_t *fd, void *data)
 {
-	char inbuf[READBUF_SIZE];
-
-	memset(inbuf, 0, sizeof inbuf);
-
+	uint8_t inbuf[sizeof(((conn_t *) NULL)->partial) + READBUF_SIZE];
 	conn_t *conn = data;
 	int length = 0;
+	size_t offset;
+
 	if (conn == NULL)
 		return;
 
@@ -686,7 +1277,15 @@ conn_mod_read_cb(rb_fde_t *fd, void *data)
 		if (IsDead(conn))
 			return;
 
-		length = rb_read(fd, inbuf, sizeof(inbuf));
+		/* whatever the last read left of a frame goes in front */
+		offset = 0;
+		if (IsKeyed(conn))
+		{
+			offset = conn->partial_len;
+			memcpy(inbuf, conn->partial, offset);
+		}
+
+		length = rb_read(fd, inbuf + offset, READBUF_SIZE);
 
 		if (length < 0)
 		{
@@ -706,13 +1305,17 @@ conn_mod_read_cb(rb_fde_t *fd, void *data)
 			return;
 		}
 
-		rb_rawbuf_append(conn->modbuf_in, inbuf, length);
+		conn->mod_in += length;
+
 		if (!IsKeyed(conn))
+		{
+			rb_rawbuf_append(conn->modbuf_in, inbuf, length);
 			conn_mod_handshake_process(conn);
+		}
 		else
-			conn_mod_process(conn);
+			conn_mod_process(conn, inbuf, offset + length);
 
-		if ((size_t) length < sizeof(inbuf))
+		if (length < READBUF_SIZE)
 		{
 			rb_setselect(fd, RB_SELECT_READ, conn_mod_read_cb, conn);
 			return;
@@ -742,6 +1345,9 @@ static void
 conn_plain_process_recvq(conn_t *conn)
 {
 	char inbuf[READBUF_SIZE];
+#ifdef HAVE_LIBZ
+	uint64_t start = conn->deflate_bits ? cpu_usec() : 0;
+#endif
 
 	memset(inbuf, 0, sizeof inbuf);
 
@@ -754,6 +1360,11 @@ conn_plain_process_recvq(conn_t *conn)
 		conn_mod_write_frame(conn, inbuf, dolen);
 	}
 
+#ifdef HAVE_LIBZ
+	if (start != 0)
+		stats.cpu_usec += cpu_usec() - start;
+#endif
+
 	if (IsKeyed(conn))
 		conn_mod_write_sendq(conn->mod_fd, conn);
 }
@@ -880,6 +1491,18 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 				wsock_process(ctl, ctl_buf);
 				break;
 			}
+		case 'Z':
+			{
+				if (ctl_buf->buflen != 4)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				deflate_conf.enabled = ctl_buf->buf[1];
+				deflate_conf.window_bits = ctl_buf->buf[2];
+				deflate_conf.no_context_takeover = ctl_buf->buf[3];
+				break;
+			}
 		default:
 			break;
 			/* Log unknown commands */
@@ -929,6 +1552,21 @@ mod_read_ctl(rb_fde_t *F, void *data)
 	rb_setselect(ctl->F, RB_SELECT_READ, mod_read_ctl, ctl);
 }
 
+static void
+send_stats(void *unused)
+{
+	static struct wsockd_stats sent;
+	uint8_t buf[1 + sizeof(stats)];
+
+	if (!memcmp(&sent, &stats, sizeof(stats)))
+		return;
+
+	sent = stats;
+	buf[0] = 'S';
+	memcpy(&buf[1], &stats, sizeof(stats));
+	mod_cmd_write_queue(mod_ctl, buf, sizeof(buf));
+}
+
 static void
 read_pipe_ctl(rb_fde_t *F, void *data)
 {
@@ -997,6 +1635,7 @@ main(int argc, char **argv)
 	rb_set_nb(mod_ctl->F);
 	rb_set_nb(mod_ctl->F_pipe);
 	rb_event_addish("clean_dead_conns", clean_dead_conns, NULL, 10);
+	rb_event_addish("send_stats", send_stats, NULL, 10);
 	read_pipe_ctl(mod_ctl->F_pipe, NULL);
 	mod_read_ctl(mod_ctl->F, mod_ctl);
 